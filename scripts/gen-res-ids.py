@@ -0,0 +1,111 @@
+#!/usr/bin/env python3
+
+import re
+
+from pathlib import Path
+
+from taiseilib.common import (
+    DirPathType,
+    TaiseiError,
+    add_common_args,
+    run_main,
+    write_depfile,
+    update_text_file,
+)
+
+
+# (macro, subdir, extensions); keep in sync with the resource handlers' find/check procs.
+RESOURCE_TYPES = (
+    ('SPRITE',  'gfx',    ('.spr', '.tex', '.basis', '.png', '.webp')),
+    ('TEXTURE', 'gfx',    ('.tex', '.basis', '.png', '.webp')),
+    ('SHPROG',  'shader', ('.prog',)),
+    ('SFX',     'sfx',    ('.opus',)),
+)
+
+
+def quote(s):
+    return '"{}"'.format(s.encode('unicode_escape').decode('latin-1').replace('"', '\\"'))
+
+
+def resource_name(relpath, exts):
+    s = relpath.as_posix()
+
+    for ext in exts:
+        if s.endswith(ext):
+            return s[:-len(ext)]
+
+    return None
+
+
+def gen(args):
+    deps = []
+    lines = [
+        '// Generated by gen-res-ids.py; do not edit.',
+        '',
+    ]
+
+    for macro, subdir, exts in RESOURCE_TYPES:
+        names = set()
+
+        for d in args.directories:
+            root = d / subdir
+
+            if not root.is_dir():
+                continue
+
+            # Directories are dependencies too, so that adding or removing files triggers regeneration.
+            deps.append(root)
+            deps += (p for p in root.glob('**/*') if p.is_dir())
+
+            for p in root.glob('**/*'):
+                if p.name[0] == '.' or not p.is_file():
+                    continue
+
+                name = resource_name(p.relative_to(root), exts)
+
+                if name is not None:
+                    names.add(name)
+
+        idents = {}
+
+        for name in sorted(names):
+            ident = re.sub(r'[^A-Za-z0-9_]', '_', name)
+
+            if ident in idents:
+                raise TaiseiError(f'{macro} resources {idents[ident]!r} and {name!r} map to the same identifier {ident!r}')
+
+            idents[ident] = name
+            lines.append(f'{macro}({ident}, {quote(name)})')
+
+        lines.append('')
+
+    update_text_file(args.output, '\n'.join(lines))
+
+    if args.depfile is not None:
+        write_depfile(args.depfile, args.output, deps)
+
+
+def main(args):
+    import argparse
+    parser = argparse.ArgumentParser(description='Generate compile-time resource IDs', prog=args[0])
+
+    parser.add_argument('output',
+        type=Path,
+        help='the output header path'
+    )
+
+    parser.add_argument('directories',
+        metavar='directory',
+        nargs='+',
+        type=DirPathType,
+        help='resource directory to scan'
+    )
+
+    add_common_args(parser, depfile=True)
+
+    args = parser.parse_args(args[1:])
+    gen(args)
+
+
+if __name__ == '__main__':
+    run_main(main)
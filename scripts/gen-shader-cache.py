@@ -0,0 +1,52 @@
+#!/usr/bin/env python3
+
+from taiseilib.common import (
+    run_main,
+)
+
+from pathlib import Path
+import os
+import subprocess
+import tempfile
+
+
+def main(args):
+    import argparse
+    parser = argparse.ArgumentParser(description='Generate a prebuilt shader cache pack by running the game with each renderer.', prog=args[0])
+
+    parser.add_argument('executable',
+        type=Path,
+        help='the Taisei executable'
+    )
+
+    parser.add_argument('output',
+        type=Path,
+        help='where to write the shader cache pack'
+    )
+
+    parser.add_argument('renderers',
+        metavar='renderer',
+        nargs='+',
+        help='renderer backend to generate shaders for'
+    )
+
+    args = parser.parse_args(args[1:])
+
+    with tempfile.TemporaryDirectory(prefix='taisei-shader-cache-') as tempdir:
+        env = dict(os.environ)
+        env['TAISEI_STORAGE_PATH'] = str(Path(tempdir) / 'storage')
+        env['TAISEI_CACHE_PATH'] = str(Path(tempdir) / 'cache')
+        env['TAISEI_PRELOAD_SHADERS'] = '1'
+        env['TAISEI_SHADER_CACHE_SIZE_LIMIT'] = '0'
+
+        for i, renderer in enumerate(args.renderers):
+            if i == len(args.renderers) - 1:
+                # The entries of the previous runs have accumulated in the temporary cache by now
+                env['TAISEI_SHADER_CACHE_EXPORT'] = str(args.output.resolve())
+
+            print(f'Populating shader cache for {renderer}')
+            subprocess.run([str(args.executable), '--renderer', renderer, '--populate-cache'], env=env, check=True)
+
+
+if __name__ == '__main__':
+    run_main(main)
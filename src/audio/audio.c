@@ -235,15 +235,13 @@ static SFXPlayID submit_play_sfx(
 	return register_sfx_playback(sfx, group, ch, loop);
 }
 
+static bool sfx_playback_enabled(void) {
+	return audio_output_works() && !is_skip_mode() && audio.sfx_enabled;
+}
+
 static SFXPlayID play_sfx_internal(
-	const char *name, bool is_ui, int cooldown, bool replace
+	SFX *sfx, bool is_ui, int cooldown, bool replace
 ) {
-	if(!audio_output_works() || is_skip_mode() || !audio.sfx_enabled) {
-		return 0;
-	}
-
-	SFX *sfx = res_sfx(name);
-
 	if(!sfx || (!is_ui && sfx->lastplayframe + 3 + cooldown >= global.frames)) {
 		return 0;
 	}
@@ -262,15 +260,33 @@ static SFXPlayID play_sfx_internal(
 }
 
 SFXPlayID play_sfx(const char *name) {
-	return play_sfx_internal(name, false, 0, false);
+	return play_sfx_ex(name, 0, false);
 }
 
 SFXPlayID play_sfx_ex(const char *name, int cooldown, bool replace) {
-	return play_sfx_internal(name, false, cooldown, replace);
+	if(!sfx_playback_enabled()) {
+		return 0;
+	}
+
+	return play_sfx_internal(res_sfx(name), false, cooldown, replace);
+}
+
+SFXPlayID play_sfx_by_id(SFXID id) {
+	return play_sfx_ex_by_id(id, 0, false);
+}
+
+SFXPlayID play_sfx_ex_by_id(SFXID id, int cooldown, bool replace) {
+	if(!sfx_playback_enabled()) {
+		return 0;
+	}
+
+	return play_sfx_internal(res_sfx_by_id(id), false, cooldown, replace);
 }
 
 void play_sfx_ui(const char *name) {
-	play_sfx_internal(name, true, 0, true);
+	if(sfx_playback_enabled()) {
+		play_sfx_internal(res_sfx(name), true, 0, true);
+	}
 }
 
 static void stop_sfx_fadeout(SFXPlayID sid, double fadeout) {
@@ -290,13 +306,7 @@ void replace_sfx(SFXPlayID sid, const char *name) {
 	play_sfx(name);
 }
 
-void play_sfx_loop(const char *name) {
-	if(!audio_output_works() || is_skip_mode() || !audio.sfx_enabled) {
-		return;
-	}
-
-	SFX *sfx = res_sfx(name);
-
+static void play_sfx_loop_internal(SFX *sfx) {
 	if(!sfx) {
 		return;
 	}
@@ -320,6 +330,18 @@ void play_sfx_loop(const char *name) {
 	}
 }
 
+void play_sfx_loop(const char *name) {
+	if(sfx_playback_enabled()) {
+		play_sfx_loop_internal(res_sfx(name));
+	}
+}
+
+void play_sfx_loop_by_id(SFXID id) {
+	if(sfx_playback_enabled()) {
+		play_sfx_loop_internal(res_sfx_by_id(id));
+	}
+}
+
 static void stop_sfx_loop(SFX *sfx, double fadeout) {
 	SFXPlayID sid = sfx->per_group[CHANGROUP_SFX_GAME].last_loop_id;
 	AudioBackendChannel ch = get_playid_chan(sid);
@@ -60,6 +60,9 @@ SFXPlayID play_sfx(const char *name) attr_nonnull(1);
 SFXPlayID play_sfx_ex(const char *name, int cooldown, bool replace) attr_nonnull(1);
 void play_sfx_loop(const char *name) attr_nonnull(1);
 void play_sfx_ui(const char *name) attr_nonnull(1);
+SFXPlayID play_sfx_by_id(SFXID id);
+SFXPlayID play_sfx_ex_by_id(SFXID id, int cooldown, bool replace);
+void play_sfx_loop_by_id(SFXID id);
 void stop_sfx(SFXPlayID sid);
 void replace_sfx(SFXPlayID sid, const char *name) attr_nonnull(2);
 void reset_all_sfx(void);
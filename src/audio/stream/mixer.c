@@ -9,8 +9,12 @@
 #include "mixer.h"
 
 #include "util.h"
+#include "util/env.h"
 #include "../backend.h"
 
+// Total size of the decoded PCM data of all loaded SFX, in bytes.
+static SDL_AtomicInt sfx_pcm_bytes;
+
 // BEGIN UTIL
 
 #define GPLR(mx, g) ({ \
@@ -407,16 +411,29 @@ MixerSFXImpl *mixersfx_load(const char *vfspath, const AudioStreamSpec *spec) {
 		return NULL;
 	}
 
-	log_debug("Loaded SFX from %s", vfspath);
-
 	isnd->pcm_size = pcm_size;
+
+	size_t total = SDL_AddAtomicInt(&sfx_pcm_bytes, pcm_size) + pcm_size;
+	size_t budget = env_get("TAISEI_SFX_MEMORY_BUDGET", 0) * 1024;
+
+	log_debug("Loaded SFX from %s (%zu KiB decoded, %zu KiB total)", vfspath, (size_t)pcm_size / 1024, total / 1024);
+
+	if(budget && total > budget && total - pcm_size <= budget) {
+		log_warn("Decoded SFX use %zu KiB, over the budget of %zu KiB", total / 1024, budget / 1024);
+	}
+
 	return isnd;
 }
 
 void mixersfx_unload(MixerSFXImpl *sfx) {
+	SDL_AddAtomicInt(&sfx_pcm_bytes, -(int)sfx->pcm_size);
 	mem_free(sfx);
 }
 
+size_t mixer_sfx_memory_usage(void) {
+	return SDL_GetAtomicInt(&sfx_pcm_bytes);
+}
+
 void mixer_notify_sfx_unload(Mixer *mx, MixerSFXImpl *sfx) {
 	for(int i = 0; i < ARRAY_SIZE(mx->sfx_streams); ++i) {
 		StaticPCMAudioStream *s = mx->sfx_streams + i;
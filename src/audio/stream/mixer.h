@@ -78,6 +78,9 @@ MixerSFXImpl *mixersfx_load(const char *vfspath, const AudioStreamSpec *spec);
 void mixersfx_unload(MixerSFXImpl *sfx) attr_nonnull(1);
 bool mixersfx_set_volume(MixerSFXImpl *sfx, double vol) attr_nonnull(1);
 
+// Returns the total size of decoded PCM data of all loaded SFX, in bytes.
+size_t mixer_sfx_memory_usage(void);
+
 void mixer_notify_bgm_unload(Mixer *mx, MixerBGMImpl *bgm) attr_nonnull_all;
 void mixer_notify_sfx_unload(Mixer *mx, MixerSFXImpl *sfx) attr_nonnull_all;
 
@@ -0,0 +1,227 @@
+/*
+ * This software is licensed under the terms of the MIT License.
+ * See COPYING for further information.
+ * ---
+ * Copyright (c) 2011-2024, Lukas Weber <laochailan@web.de>.
+ * Copyright (c) 2012-2024, Andrei Alexeyev <akari@taisei-project.org>.
+ */
+
+#include "mixops.h"
+
+#include "util/crap.h"
+
+#include <SDL3/SDL.h>
+
+#if defined(__SSE2__)
+	#define MIXOPS_HAVE_SSE2
+	#include <emmintrin.h>
+#endif
+
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+	// Built regardless of the target flags and only used if the CPU supports it
+	#define MIXOPS_HAVE_AVX
+	#include <immintrin.h>
+	#define attr_avx __attribute__((target("avx")))
+#endif
+
+#if defined(__ARM_NEON)
+	#define MIXOPS_HAVE_NEON
+	#include <arm_neon.h>
+#endif
+
+typedef struct MixOpsFuncs {
+	const char *name;
+	void (*ramp_stereo)(float *samples, uint num_frames, float gain, float step);
+	void (*mix_stereo)(float *restrict dst, const float *restrict src, uint num_frames, float gain);
+} MixOpsFuncs;
+
+// The gain is recomputed from the frame index rather than accumulated, so that long
+// fades don't drift away from the scalar result.
+
+static inline void ramp_stereo_tail(float *samples, uint i, uint num_frames, float gain, float step) {
+	for(; i < num_frames; ++i) {
+		float g = gain + step * i;
+		samples[2 * i + 0] *= g;
+		samples[2 * i + 1] *= g;
+	}
+}
+
+static inline void mix_stereo_tail(
+	float *restrict dst, const float *restrict src, uint i, uint num_samples, float gain
+) {
+	for(; i < num_samples; ++i) {
+		dst[i] += src[i] * gain;
+	}
+}
+
+static void ramp_stereo_scalar(float *samples, uint num_frames, float gain, float step) {
+	ramp_stereo_tail(samples, 0, num_frames, gain, step);
+}
+
+static void mix_stereo_scalar(float *restrict dst, const float *restrict src, uint num_frames, float gain) {
+	mix_stereo_tail(dst, src, 0, num_frames * 2, gain);
+}
+
+#ifdef MIXOPS_HAVE_SSE2
+
+static void ramp_stereo_sse2(float *samples, uint num_frames, float gain, float step) {
+	__m128 vidx = _mm_setr_ps(0, 0, 1, 1);
+	__m128 vinc = _mm_set1_ps(2);
+	__m128 vgain = _mm_set1_ps(gain);
+	__m128 vstep = _mm_set1_ps(step);
+	uint i = 0;
+
+	for(; i + 2 <= num_frames; i += 2) {
+		__m128 g = _mm_add_ps(vgain, _mm_mul_ps(vstep, vidx));
+		_mm_storeu_ps(samples + 2 * i, _mm_mul_ps(_mm_loadu_ps(samples + 2 * i), g));
+		vidx = _mm_add_ps(vidx, vinc);
+	}
+
+	ramp_stereo_tail(samples, i, num_frames, gain, step);
+}
+
+static void mix_stereo_sse2(float *restrict dst, const float *restrict src, uint num_frames, float gain) {
+	__m128 vgain = _mm_set1_ps(gain);
+	uint num_samples = num_frames * 2;
+	uint i = 0;
+
+	for(; i + 8 <= num_samples; i += 8) {
+		__m128 s0 = _mm_mul_ps(_mm_loadu_ps(src + i), vgain);
+		__m128 s1 = _mm_mul_ps(_mm_loadu_ps(src + i + 4), vgain);
+		_mm_storeu_ps(dst + i, _mm_add_ps(_mm_loadu_ps(dst + i), s0));
+		_mm_storeu_ps(dst + i + 4, _mm_add_ps(_mm_loadu_ps(dst + i + 4), s1));
+	}
+
+	mix_stereo_tail(dst, src, i, num_samples, gain);
+}
+
+#endif
+
+#ifdef MIXOPS_HAVE_AVX
+
+attr_avx
+static void ramp_stereo_avx(float *samples, uint num_frames, float gain, float step) {
+	__m256 vidx = _mm256_setr_ps(0, 0, 1, 1, 2, 2, 3, 3);
+	__m256 vinc = _mm256_set1_ps(4);
+	__m256 vgain = _mm256_set1_ps(gain);
+	__m256 vstep = _mm256_set1_ps(step);
+	uint i = 0;
+
+	for(; i + 4 <= num_frames; i += 4) {
+		__m256 g = _mm256_add_ps(vgain, _mm256_mul_ps(vstep, vidx));
+		_mm256_storeu_ps(samples + 2 * i, _mm256_mul_ps(_mm256_loadu_ps(samples + 2 * i), g));
+		vidx = _mm256_add_ps(vidx, vinc);
+	}
+
+	ramp_stereo_tail(samples, i, num_frames, gain, step);
+}
+
+attr_avx
+static void mix_stereo_avx(float *restrict dst, const float *restrict src, uint num_frames, float gain) {
+	__m256 vgain = _mm256_set1_ps(gain);
+	uint num_samples = num_frames * 2;
+	uint i = 0;
+
+	for(; i + 16 <= num_samples; i += 16) {
+		__m256 s0 = _mm256_mul_ps(_mm256_loadu_ps(src + i), vgain);
+		__m256 s1 = _mm256_mul_ps(_mm256_loadu_ps(src + i + 8), vgain);
+		_mm256_storeu_ps(dst + i, _mm256_add_ps(_mm256_loadu_ps(dst + i), s0));
+		_mm256_storeu_ps(dst + i + 8, _mm256_add_ps(_mm256_loadu_ps(dst + i + 8), s1));
+	}
+
+	mix_stereo_tail(dst, src, i, num_samples, gain);
+}
+
+#endif
+
+#ifdef MIXOPS_HAVE_NEON
+
+static void ramp_stereo_neon(float *samples, uint num_frames, float gain, float step) {
+	static const float idx_init[4] = { 0, 0, 1, 1 };
+	float32x4_t vidx = vld1q_f32(idx_init);
+	float32x4_t vinc = vdupq_n_f32(2);
+	float32x4_t vgain = vdupq_n_f32(gain);
+	float32x4_t vstep = vdupq_n_f32(step);
+	uint i = 0;
+
+	for(; i + 2 <= num_frames; i += 2) {
+		float32x4_t g = vaddq_f32(vgain, vmulq_f32(vstep, vidx));
+		vst1q_f32(samples + 2 * i, vmulq_f32(vld1q_f32(samples + 2 * i), g));
+		vidx = vaddq_f32(vidx, vinc);
+	}
+
+	ramp_stereo_tail(samples, i, num_frames, gain, step);
+}
+
+static void mix_stereo_neon(float *restrict dst, const float *restrict src, uint num_frames, float gain) {
+	float32x4_t vgain = vdupq_n_f32(gain);
+	uint num_samples = num_frames * 2;
+	uint i = 0;
+
+	for(; i + 8 <= num_samples; i += 8) {
+		float32x4_t s0 = vmulq_f32(vld1q_f32(src + i), vgain);
+		float32x4_t s1 = vmulq_f32(vld1q_f32(src + i + 4), vgain);
+		vst1q_f32(dst + i, vaddq_f32(vld1q_f32(dst + i), s0));
+		vst1q_f32(dst + i + 4, vaddq_f32(vld1q_f32(dst + i + 4), s1));
+	}
+
+	mix_stereo_tail(dst, src, i, num_samples, gain);
+}
+
+#endif
+
+static const MixOpsFuncs mixops_impls[NUM_MIXOPS_IMPLS] = {
+	[MIXOPS_SCALAR] = { "scalar", ramp_stereo_scalar, mix_stereo_scalar },
+	#ifdef MIXOPS_HAVE_SSE2
+	[MIXOPS_SSE2] = { "SSE2", ramp_stereo_sse2, mix_stereo_sse2 },
+	#endif
+	#ifdef MIXOPS_HAVE_AVX
+	[MIXOPS_AVX] = { "AVX", ramp_stereo_avx, mix_stereo_avx },
+	#endif
+	#ifdef MIXOPS_HAVE_NEON
+	[MIXOPS_NEON] = { "NEON", ramp_stereo_neon, mix_stereo_neon },
+	#endif
+};
+
+static const MixOpsFuncs *mixops = mixops_impls + MIXOPS_SCALAR;
+
+bool mixops_select(MixOpsImpl impl) {
+	if(impl < 0 || impl >= NUM_MIXOPS_IMPLS || !mixops_impls[impl].name) {
+		return false;
+	}
+
+	if(impl == MIXOPS_AVX && !SDL_HasAVX()) {
+		return false;
+	}
+
+	mixops = mixops_impls + impl;
+	return true;
+}
+
+void mixops_init(void) {
+	static const MixOpsImpl preference[] = {
+		MIXOPS_AVX,
+		MIXOPS_SSE2,
+		MIXOPS_NEON,
+	};
+
+	for(int i = 0; i < ARRAY_SIZE(preference); ++i) {
+		if(mixops_select(preference[i])) {
+			return;
+		}
+	}
+
+	mixops_select(MIXOPS_SCALAR);
+}
+
+const char *mixops_impl_name(void) {
+	return mixops->name;
+}
+
+void mixops_ramp_stereo(float *samples, uint num_frames, float gain, float step) {
+	mixops->ramp_stereo(samples, num_frames, gain, step);
+}
+
+void mixops_mix_stereo(float *restrict dst, const float *restrict src, uint num_frames, float gain) {
+	mixops->mix_stereo(dst, src, num_frames, gain);
+}
@@ -0,0 +1,45 @@
+/*
+ * This software is licensed under the terms of the MIT License.
+ * See COPYING for further information.
+ * ---
+ * Copyright (c) 2011-2024, Lukas Weber <laochailan@web.de>.
+ * Copyright (c) 2012-2024, Andrei Alexeyev <akari@taisei-project.org>.
+ */
+
+#pragma once
+#include "taisei.h"
+
+/*
+ * Mixing kernels for interleaved 32-bit float stereo buffers.
+ *
+ * On x86, the AVX version is picked at runtime if the CPU supports it, with SSE2 (or scalar
+ * code on targets without it) as the baseline. On ARM, NEON is used if the target has it.
+ * All variants produce the same results as the scalar code, up to floating point rounding.
+ */
+
+typedef enum MixOpsImpl {
+	MIXOPS_SCALAR,
+	MIXOPS_SSE2,
+	MIXOPS_AVX,
+	MIXOPS_NEON,
+
+	NUM_MIXOPS_IMPLS,
+} MixOpsImpl;
+
+// Selects the best implementation for this CPU. Must be called before mixing, and not
+// concurrently with it.
+void mixops_init(void);
+
+// Forces a specific implementation, for testing. Returns false if it's not available here.
+bool mixops_select(MixOpsImpl impl);
+
+// Returns a short name of the implementation in use, for logging.
+const char *mixops_impl_name(void);
+
+// Multiply frame i of [samples] by (gain + step * i).
+void mixops_ramp_stereo(float *samples, uint num_frames, float gain, float step)
+	attr_nonnull_all;
+
+// Add [src] multiplied by [gain] to [dst].
+void mixops_mix_stereo(float *restrict dst, const float *restrict src, uint num_frames, float gain)
+	attr_nonnull_all;
@@ -7,11 +7,17 @@
  */
 
 #include "player.h"
+
+#include "mixops.h"
 #include "util.h"
 
 // #define SPAM(...) log_debug(__VA_ARGS__)
 #define SPAM(...) ((void)0)
 
+// Larger requests are mixed in chunks of this many frames, so that the staging buffer
+// never has to be reallocated on the audio thread.
+#define SPLAYER_STAGING_FRAMES 4096
+
 typedef float sample_t;
 
 struct stereo_frame {
@@ -42,6 +48,8 @@ bool splayer_init(StreamPlayer *plr, int num_channels, const AudioStreamSpec *ds
 	plr->num_channels = num_channels,
 	plr->channels = ALLOC_ARRAY(num_channels, typeof(*plr->channels));
 	plr->dst_spec = *dst_spec;
+	// One half receives a channel's output, the other is used to decode streams that need conversion.
+	plr->staging_buffer = mem_alloc(2 * SPLAYER_STAGING_FRAMES * sizeof(struct stereo_frame));
 
 	for(int i = 0; i < num_channels; ++i) {
 		StreamPlayerChannel *chan = plr->channels + i;
@@ -50,10 +58,13 @@ bool splayer_init(StreamPlayer *plr, int num_channels, const AudioStreamSpec *ds
 		alist_append(&plr->channel_history, chan);
 	}
 
-	log_debug("Player spec: %iHz; %i chans; format=%i",
+	mixops_init();
+
+	log_debug("Player spec: %iHz; %i chans; format=%i; mixing=%s",
 		plr->dst_spec.sample_rate,
 		plr->dst_spec.channels,
-		plr->dst_spec.sample_format
+		plr->dst_spec.sample_format,
+		mixops_impl_name()
 	);
 
 	return true;
@@ -79,6 +90,7 @@ void splayer_shutdown(StreamPlayer *plr) {
 	}
 
 	mem_free(plr->channels);
+	mem_free(plr->staging_buffer);
 }
 
 static inline void splayer_stream_ended(StreamPlayer *plr, int chan) {
@@ -86,7 +98,7 @@ static inline void splayer_stream_ended(StreamPlayer *plr, int chan) {
 	splayer_halt(plr, chan);
 }
 
-static size_t splayer_process_channel(StreamPlayer *plr, int chan, size_t bufsize, void *buffer) {
+static size_t splayer_process_channel(StreamPlayer *plr, int chan, size_t bufsize, void *buffer, void *decode_buffer) {
 	AudioStreamReadFlags rflags = 0;
 	StreamPlayerChannel *pchan = plr->channels + chan;
 
@@ -107,7 +119,6 @@ static size_t splayer_process_channel(StreamPlayer *plr, int chan, size_t bufsiz
 		// convert/resample
 
 		do {
-			uint8_t staging_buffer[bufsize];
 			ssize_t read = SDL_GetAudioStreamData(pipe, buf, buf_end - buf);
 
 			if(UNLIKELY(read < 0)) {
@@ -121,7 +132,7 @@ static size_t splayer_process_channel(StreamPlayer *plr, int chan, size_t bufsiz
 				break;
 			}
 
-			read = astream_read_into_sdl_stream(astream, pipe, sizeof(staging_buffer), staging_buffer, rflags);
+			read = astream_read_into_sdl_stream(astream, pipe, bufsize, decode_buffer, rflags);
 
 			if(read <= 0) {
 				SDL_FlushAudioStream(pipe);
@@ -148,19 +159,60 @@ static size_t splayer_process_channel(StreamPlayer *plr, int chan, size_t bufsiz
 	return bufsize - (buf_end - buf);
 }
 
-void splayer_process(StreamPlayer *plr, size_t bufsize, void *vbuffer) {
-	if(plr->paused) {
-		return;
+static bool splayer_channel_can_mix_mapped(StreamPlayerChannel *pchan) {
+	// Streams already in the output format (e.g. pre-decoded SFX) can be mixed straight
+	// from their own memory, unless a fade needs to be applied to a copy of the data first.
+	return
+		!pchan->paused &&
+		pchan->stream &&
+		!pchan->pipe &&
+		pchan->fade.num_steps == 0 &&
+		astream_is_mappable(pchan->stream);
+}
+
+static void splayer_mix_channel_mapped(StreamPlayer *plr, int chan, uint num_frames, float *out, float gain) {
+	StreamPlayerChannel *pchan = plr->channels + chan;
+	AudioStreamReadFlags rflags = pchan->looping ? ASTREAM_READ_LOOP : 0;
+
+	while(num_frames > 0) {
+		const void *data;
+		ssize_t read = astream_read_mapped(pchan->stream, num_frames * sizeof(struct stereo_frame), &data, rflags);
+
+		if(read <= 0) {
+			if(read == 0) {
+				splayer_stream_ended(plr, chan);
+			}
+
+			break;
+		}
+
+		assert(read % sizeof(struct stereo_frame) == 0);
+		uint read_frames = read / sizeof(struct stereo_frame);
+		mixops_mix_stereo(out, data, read_frames, gain);
+		out += read_frames * 2;
+		num_frames -= read_frames;
 	}
+}
+
+static void splayer_process_chunk(StreamPlayer *plr, size_t bufsize, void *vbuffer) {
+	assert(bufsize <= SPLAYER_STAGING_FRAMES * sizeof(struct stereo_frame));
 
 	float gain = plr->gain;
 	int num_channels = plr->num_channels;
 	union audio_buffer out_buffer = { vbuffer };
+	union audio_buffer staging_buffer = { plr->staging_buffer };
+	uint8_t *decode_buffer = plr->staging_buffer + bufsize;
 
 	for(int i = 0; i < num_channels; ++i) {
-		uint8_t staging_buffer_bytes[bufsize];
-		union audio_buffer staging_buffer = { staging_buffer_bytes };
-		size_t chan_bytes = splayer_process_channel(plr, i, sizeof(staging_buffer_bytes), staging_buffer_bytes);
+		if(splayer_channel_can_mix_mapped(plr->channels + i)) {
+			StreamPlayerChannel *pchan = plr->channels + i;
+			float chan_gain = gain * pchan->gain * pchan->fade.gain;
+			uint num_frames = bufsize / sizeof(struct stereo_frame);
+			splayer_mix_channel_mapped(plr, i, num_frames, out_buffer.samples, chan_gain);
+			continue;
+		}
+
+		size_t chan_bytes = splayer_process_channel(plr, i, bufsize, staging_buffer.bytes, decode_buffer);
 
 		if(chan_bytes) {
 			assert(chan_bytes <= bufsize);
@@ -179,11 +231,7 @@ void splayer_process(StreamPlayer *plr, size_t bufsize, void *vbuffer) {
 					fade_steps = num_staging_frames;
 				}
 
-				for(uint i = 0; i < fade_steps; ++i) {
-					float g = fade_gain + fade_step * i;
-					staging_buffer.frames[i].l *= g;
-					staging_buffer.frames[i].r *= g;
-				}
+				mixops_ramp_stereo(staging_buffer.samples, fade_steps, fade_gain, fade_step);
 
 				if((pchan->fade.num_steps -= fade_steps) == 0) {
 					// fade finished
@@ -202,14 +250,28 @@ void splayer_process(StreamPlayer *plr, size_t bufsize, void *vbuffer) {
 				chan_gain *= pchan->fade.gain;
 			}
 
-			for(uint i = 0; i < num_staging_frames; ++i) {
-				out_buffer.frames[i].l += staging_buffer.frames[i].l * chan_gain;
-				out_buffer.frames[i].r += staging_buffer.frames[i].r * chan_gain;
-			}
+			mixops_mix_stereo(out_buffer.samples, staging_buffer.samples, num_staging_frames, chan_gain);
 		}
 	}
 }
 
+void splayer_process(StreamPlayer *plr, size_t bufsize, void *vbuffer) {
+	if(plr->paused) {
+		return;
+	}
+
+	const size_t chunk_size = SPLAYER_STAGING_FRAMES * sizeof(struct stereo_frame);
+	uint8_t *buffer = vbuffer;
+
+	while(bufsize > chunk_size) {
+		splayer_process_chunk(plr, chunk_size, buffer);
+		buffer += chunk_size;
+		bufsize -= chunk_size;
+	}
+
+	splayer_process_chunk(plr, bufsize, buffer);
+}
+
 static bool splayer_validate_channel(StreamPlayer *plr, int chan) {
 	if(chan < 0 || chan >= plr->num_channels) {
 		log_error("Bad channel %i", chan);
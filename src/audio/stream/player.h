@@ -35,6 +35,8 @@ struct StreamPlayer {
 	StreamPlayerChannel *channels;
 	LIST_ANCHOR(StreamPlayerChannel) channel_history;
 	AudioStreamSpec dst_spec;
+	// Scratch space for splayer_process(), allocated once in splayer_init().
+	uint8_t *staging_buffer;
 	float gain;
 	int num_channels;
 	bool paused;
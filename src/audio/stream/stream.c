@@ -98,6 +98,36 @@ ssize_t astream_read(AudioStream *stream, size_t bufsize, void *buffer, AudioStr
 	return PROC(stream, read)(stream, bufsize, buffer);
 }
 
+ssize_t astream_read_mapped(AudioStream *stream, size_t bufsize, const void **out_data, AudioStreamReadFlags flags) {
+	assert(!(flags & ASTREAM_READ_MAX_FILL));
+
+	if(UNLIKELY(!PROCS(stream).map)) {
+		log_error("Not implemented");
+		return -1;
+	}
+
+	ssize_t read = PROC(stream, map)(stream, bufsize, out_data);
+
+	if(UNLIKELY(read == 0) && (flags & ASTREAM_READ_LOOP)) {
+		ssize_t loop_start = stream->loop_start;
+		if(loop_start < 0) {
+			loop_start = 0;
+		}
+
+		if(UNLIKELY(astream_seek(stream, loop_start) < 0)) {
+			return -1;
+		}
+
+		return PROC(stream, map)(stream, bufsize, out_data);
+	}
+
+	return read;
+}
+
+bool astream_is_mappable(AudioStream *stream) {
+	return PROCS(stream).map != NULL;
+}
+
 ssize_t astream_read_into_sdl_stream(AudioStream *stream, SDL_AudioStream *sdlstream, size_t bufsize, void *buffer, AudioStreamReadFlags flags) {
 	char *buf = buffer;
 	ssize_t read_size = astream_read(stream, bufsize, buf, flags);
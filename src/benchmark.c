@@ -0,0 +1,231 @@
+/*
+ * This software is licensed under the terms of the MIT License.
+ * See COPYING for further information.
+ * ---
+ * Copyright (c) 2011-2024, Lukas Weber <laochailan@web.de>.
+ * Copyright (c) 2012-2024, Andrei Alexeyev <akari@taisei-project.org>.
+ */
+
+#include "benchmark.h"
+
+#include "boss.h"
+#include "dynarray.h"
+#include "global.h"
+#include "stageinfo.h"
+#include "util/strbuf.h"
+
+typedef struct BenchmarkSection {
+	StageInfo *stage;
+	char *spell;
+	DYNAMIC_ARRAY(uint32_t) frame_times;  // nanoseconds
+	hrtime_t zone_times[NUM_BENCH_ZONES];
+} BenchmarkSection;
+
+const char *const _benchmark_zone_names[NUM_BENCH_ZONES] = {
+	[BENCH_ZONE_TASKS] = "cosched_run_tasks",
+	[BENCH_ZONE_BOSS] = "process_boss",
+	[BENCH_ZONE_ENEMIES] = "process_enemies",
+	[BENCH_ZONE_PROJECTILES] = "process_projectiles",
+	[BENCH_ZONE_ITEMS] = "process_items",
+	[BENCH_ZONE_LASERS] = "process_lasers",
+};
+
+bool _benchmark_active;
+
+static struct {
+	DYNAMIC_ARRAY(BenchmarkSection*) sections;
+	BenchmarkSection *current;
+	hrtime_t frame_zone_times[NUM_BENCH_ZONES];
+} bench;
+
+void benchmark_init(void) {
+	assert(!_benchmark_active);
+	_benchmark_active = true;
+	log_info("Logic frame benchmark enabled");
+}
+
+void benchmark_shutdown(void) {
+	dynarray_foreach_elem(&bench.sections, BenchmarkSection **s, {
+		dynarray_free_data(&(*s)->frame_times);
+		mem_free((*s)->spell);
+		mem_free(*s);
+	});
+
+	dynarray_free_data(&bench.sections);
+	memset(&bench, 0, sizeof(bench));
+	_benchmark_active = false;
+}
+
+static const char *current_spell_name(void) {
+	Boss *boss = global.boss;
+
+	if(
+		boss &&
+		boss->current &&
+		ATTACK_IS_SPELL(boss->current->type) &&
+		attack_is_active(boss->current)
+	) {
+		return boss->current->name;
+	}
+
+	return NULL;
+}
+
+static bool section_matches(BenchmarkSection *s, StageInfo *stage, const char *spell) {
+	if(s->stage != stage) {
+		return false;
+	}
+
+	if(s->spell == NULL || spell == NULL) {
+		return s->spell == spell;
+	}
+
+	return !strcmp(s->spell, spell);
+}
+
+static BenchmarkSection *get_current_section(void) {
+	StageInfo *stage = global.stage;
+	const char *spell = current_spell_name();
+
+	if(bench.current && section_matches(bench.current, stage, spell)) {
+		return bench.current;
+	}
+
+	dynarray_foreach_elem(&bench.sections, BenchmarkSection **s, {
+		if(section_matches(*s, stage, spell)) {
+			return bench.current = *s;
+		}
+	});
+
+	auto s = ALLOC(BenchmarkSection, {
+		.stage = stage,
+		.spell = spell ? mem_strdup(spell) : NULL,
+	});
+
+	dynarray_append(&bench.sections, s);
+	return bench.current = s;
+}
+
+void _benchmark_zone_add(BenchmarkZone zone, hrtime_t duration) {
+	assert((uint)zone < NUM_BENCH_ZONES);
+	bench.frame_zone_times[zone] += duration;
+}
+
+void _benchmark_frame_end(hrtime_t start) {
+	hrtime_t frame_time = time_get() - start;
+	BenchmarkSection *s = get_current_section();
+
+	dynarray_append(&s->frame_times, (uint32_t)min(frame_time, UINT32_MAX));
+
+	for(int i = 0; i < NUM_BENCH_ZONES; ++i) {
+		s->zone_times[i] += bench.frame_zone_times[i];
+	}
+
+	memset(bench.frame_zone_times, 0, sizeof(bench.frame_zone_times));
+}
+
+static int compare_frame_times(const void *a, const void *b) {
+	uint32_t ta = *(const uint32_t*)a;
+	uint32_t tb = *(const uint32_t*)b;
+	return (ta > tb) - (ta < tb);
+}
+
+void benchmark_sort_frame_times(int num_frames, uint32_t frame_times[num_frames]) {
+	qsort(frame_times, num_frames, sizeof(*frame_times), compare_frame_times);
+}
+
+double benchmark_percentile_us(int num_frames, const uint32_t sorted_times[num_frames], int p) {
+	// nearest-rank
+	int rank = (num_frames * p + 99) / 100;
+	return sorted_times[clamp(rank - 1, 0, num_frames - 1)] * 1e-3;
+}
+
+static void report_section(
+	StringBuffer *sb,
+	const char *kind,
+	StageInfo *stage,
+	const char *spell,
+	int num_frames,
+	uint32_t frame_times[num_frames],
+	const hrtime_t zone_times[NUM_BENCH_ZONES]
+) {
+	if(num_frames == 0) {
+		return;
+	}
+
+	benchmark_sort_frame_times(num_frames, frame_times);
+
+	hrtime_t total = 0;
+
+	for(int i = 0; i < num_frames; ++i) {
+		total += frame_times[i];
+	}
+
+	strbuf_clear(sb);
+	strbuf_printf(sb, "{\"benchmark\":\"%s\",\"stage\":", kind);
+
+	if(stage) {
+		strbuf_cat_json_string(sb, stage->title);
+	} else {
+		strbuf_cat(sb, "null");
+	}
+
+	strbuf_cat(sb, ",\"spell\":");
+
+	if(spell) {
+		strbuf_cat_json_string(sb, spell);
+	} else {
+		strbuf_cat(sb, "null");
+	}
+
+	strbuf_printf(sb,
+		",\"frames\":%i,\"mean_us\":%.3f,\"p50_us\":%.3f,\"p90_us\":%.3f"
+		",\"p99_us\":%.3f,\"max_us\":%.3f,\"zones_mean_us\":{",
+		num_frames,
+		total * 1e-3 / num_frames,
+		benchmark_percentile_us(num_frames, frame_times, 50),
+		benchmark_percentile_us(num_frames, frame_times, 90),
+		benchmark_percentile_us(num_frames, frame_times, 99),
+		frame_times[num_frames - 1] * 1e-3
+	);
+
+	for(int i = 0; i < NUM_BENCH_ZONES; ++i) {
+		strbuf_printf(sb, "%s\"%s\":%.3f",
+			i ? "," : "", _benchmark_zone_names[i], zone_times[i] * 1e-3 / num_frames);
+	}
+
+	strbuf_cat(sb, "}}\n");
+	fputs(sb->start, stdout);
+}
+
+void benchmark_report(void) {
+	StringBuffer sb = {};
+	DYNAMIC_ARRAY(uint32_t) all_frames = {};
+	hrtime_t all_zones[NUM_BENCH_ZONES] = {};
+
+	dynarray_foreach_elem(&bench.sections, BenchmarkSection **ps, {
+		BenchmarkSection *s = *ps;
+
+		for(int i = 0; i < s->frame_times.num_elements; ++i) {
+			dynarray_append(&all_frames, s->frame_times.data[i]);
+		}
+
+		for(int i = 0; i < NUM_BENCH_ZONES; ++i) {
+			all_zones[i] += s->zone_times[i];
+		}
+
+		report_section(
+			&sb, s->spell ? "spell" : "stage", s->stage, s->spell,
+			s->frame_times.num_elements, s->frame_times.data, s->zone_times
+		);
+	});
+
+	report_section(
+		&sb, "total", NULL, NULL,
+		all_frames.num_elements, all_frames.data, all_zones
+	);
+
+	fflush(stdout);
+	dynarray_free_data(&all_frames);
+	strbuf_free(&sb);
+}
@@ -0,0 +1,80 @@
+/*
+ * This software is licensed under the terms of the MIT License.
+ * See COPYING for further information.
+ * ---
+ * Copyright (c) 2011-2024, Lukas Weber <laochailan@web.de>.
+ * Copyright (c) 2012-2024, Andrei Alexeyev <akari@taisei-project.org>.
+ */
+
+#pragma once
+#include "taisei.h"
+
+#include "hirestime.h"
+#include "profiler.h"
+
+/*
+ * Logic-frame benchmark, fed by headless replay playback (see --benchmark).
+ *
+ * Frame times are collected per stage and per spell, and broken down into the
+ * subsystem zones below. Zones nest: everything except BENCH_ZONE_TASKS runs
+ * inside the stage's main task, so it is also counted by BENCH_ZONE_TASKS.
+ *
+ * BENCHMARK_ZONE also feeds the profiler (see profiler.h), under the zone names listed in
+ * benchmark.c, so the same instrumentation serves both.
+ */
+
+typedef enum BenchmarkZone {
+	BENCH_ZONE_TASKS,
+	BENCH_ZONE_BOSS,
+	BENCH_ZONE_ENEMIES,
+	BENCH_ZONE_PROJECTILES,
+	BENCH_ZONE_ITEMS,
+	BENCH_ZONE_LASERS,
+
+	NUM_BENCH_ZONES,
+} BenchmarkZone;
+
+extern bool _benchmark_active;
+extern const char *const _benchmark_zone_names[NUM_BENCH_ZONES];
+
+void benchmark_init(void);
+void benchmark_shutdown(void);
+
+// Print the collected statistics to stdout as one JSON object per section.
+void benchmark_report(void);
+
+// Frame time statistics helpers, shared with the record renderer (times in nanoseconds).
+void benchmark_sort_frame_times(int num_frames, uint32_t frame_times[num_frames]);
+double benchmark_percentile_us(int num_frames, const uint32_t sorted_times[num_frames], int p);
+
+void _benchmark_frame_end(hrtime_t start);
+void _benchmark_zone_add(BenchmarkZone zone, hrtime_t duration);
+
+INLINE hrtime_t benchmark_begin(void) {
+	return UNLIKELY(_benchmark_active) ? time_get() : 0;
+}
+
+INLINE void benchmark_frame_end(hrtime_t start) {
+	if(UNLIKELY(_benchmark_active)) {
+		_benchmark_frame_end(start);
+	}
+}
+
+// Timestamp for zone boundaries; only taken if one of the sinks needs it.
+INLINE hrtime_t benchmark_zone_time(void) {
+	return (PROFILER_ENABLED || UNLIKELY(_benchmark_active)) ? time_get() : 0;
+}
+
+INLINE void benchmark_zone_record(BenchmarkZone zone, hrtime_t start, hrtime_t end) {
+	PROFILE_ZONE_RECORD(_benchmark_zone_names[zone], "stage", start, end);
+
+	if(UNLIKELY(_benchmark_active)) {
+		_benchmark_zone_add(zone, end - start);
+	}
+}
+
+#define BENCHMARK_ZONE(zone, ...) do { \
+	hrtime_t _benchmark_zone_start = benchmark_zone_time(); \
+	__VA_ARGS__ \
+	benchmark_zone_record(zone, _benchmark_zone_start, benchmark_zone_time()); \
+} while(0)
@@ -438,8 +438,8 @@ static void draw_spell_name(Boss *b, int time, bool healthbar_radial) {
 	float opacity = opacity_noplr * b->hud.plrproximity_opacity;
 
 	r_draw_sprite(&(SpriteParams) {
-		.sprite_ptr = res_sprite("spell"),
-		.shader_ptr = res_shader("sprite_default"),
+		.sprite_ptr = res_sprite_by_id(RID_SPRITE_spell),
+		.shader_ptr = res_shader_by_id(RID_SHPROG_sprite_default),
 		.pos = { (VIEWPORT_W - 128), y_offset * (1 - pow(1 - f2, 5)) + VIEWPORT_H * pow(1 - f2, 2) },
 		.color = color_mul_scalar(RGBA(1, 1, 1, f2 * 0.5), opacity * f2) ,
 		.scale.both = 3 - 2 * (1 - pow(1 - f2, 3)),
@@ -644,7 +644,7 @@ DEFINE_TASK(boss_particles) {
 		if(!(global.frames % 13) && !is_extra) {
 			ENT_ARRAY_COMPACT(&smoke_parts);
 			ENT_ARRAY_ADD(&smoke_parts, PARTICLE(
-				.sprite = "smoke",
+				.sprite_ptr = res_sprite_by_id(RID_SPRITE_part_smoke),
 				.pos = cdir(global.frames) + boss->pos,
 				.color = RGBA(shadowcolor->r, shadowcolor->g, shadowcolor->b, 0.0),
 				.timeout = 180,
@@ -680,8 +680,8 @@ void draw_boss_background(Boss *boss) {
 
 	r_mat_mv_scale(f, f, 1);
 	r_draw_sprite(&(SpriteParams) {
-		.sprite_ptr = res_sprite("boss_circle"),
-		.shader_ptr = res_shader("sprite_particle"),
+		.sprite_ptr = res_sprite_by_id(RID_SPRITE_boss_circle),
+		.shader_ptr = res_shader_by_id(RID_SHPROG_sprite_particle),
 		.shader_params = &(ShaderCustomParams) { 1.0f },
 		.color = RGBA(1, 1, 1, 0),
 	});
@@ -712,7 +712,7 @@ static void ent_draw_boss(EntityInterface *ent) {
 
 	r_draw_sprite(&(SpriteParams) {
 		.sprite_ptr = aniplayer_get_frame(&boss->ani),
-		.shader_ptr = res_shader("sprite_particle"),
+		.shader_ptr = res_shader_by_id(RID_SHPROG_sprite_particle),
 		.shader_params = &(ShaderCustomParams) { 1.0f },
 		.pos.as_cmplx = boss->pos + boss_get_sprite_offset(boss),
 		.color = c,
@@ -780,7 +780,7 @@ void draw_boss_overlay(Boss *boss) {
 
 		// remaining spells
 		Color *clr = RGBA(0.7 * o, 0.7 * o, 0.7 * o, 0.7 * o);
-		Sprite *star = res_sprite("star");
+		Sprite *star = res_sprite_by_id(RID_SPRITE_star);
 		float x = 10 + star->w * 0.5;
 		bool spell_found = false;
 
@@ -930,9 +930,9 @@ static DamageResult ent_damage_boss(EntityInterface *ent, const DamageInfo *dmg)
 	boss->damage_to_power_accum += damage;
 
 	if(boss->current->hp < boss->current->maxhp * 0.1) {
-		play_sfx_loop("hit1");
+		play_sfx_loop_by_id(RID_SFX_hit1);
 	} else {
-		play_sfx_loop("hit0");
+		play_sfx_loop_by_id(RID_SFX_hit0);
 	}
 
 	return DMG_RESULT_OK;
@@ -987,10 +987,10 @@ static void boss_give_spell_bonus(Boss *boss, Attack *a, Player *plr) {
 	stagetext_table_add_numeric(&tbl, "Total", bonus.total);
 	stagetext_end_table(&tbl);
 
-	play_sfx("spellend");
+	play_sfx_by_id(RID_SFX_spellend);
 
 	if(!bonus.failed) {
-		play_sfx("spellclear");
+		play_sfx_by_id(RID_SFX_spellclear);
 	}
 }
 
@@ -1194,7 +1194,7 @@ void process_boss(Boss **pboss) {
 		clr->a = 0;
 
 		PARTICLE(
-			.sprite = "petal",
+			.sprite_ptr = res_sprite_by_id(RID_SPRITE_part_petal),
 			.pos = boss->pos,
 			.draw_rule = pdraw_petal_random(),
 			.color = clr,
@@ -1218,7 +1218,7 @@ void process_boss(Boss **pboss) {
 			for(int i = 0; i < 256; i++) {
 				RNG_ARRAY(rng, 3);
 				PARTICLE(
-					.sprite = "flare",
+					.sprite_ptr = res_sprite_by_id(RID_SPRITE_part_flare),
 					.pos = boss->pos,
 					.timeout = vrng_range(rng[2], 60, 70),
 					.draw_rule = pdraw_timeout_fade(1, 0),
@@ -1241,7 +1241,7 @@ void process_boss(Boss **pboss) {
 			);
 		}
 
-		play_sfx_ex("bossdeath", BOSS_DEATH_DELAY * 2, false);
+		play_sfx_ex_by_id(RID_SFX_bossdeath, BOSS_DEATH_DELAY * 2, false);
 	}
 
 	if(boss_is_player_collision_active(boss) && cabs(boss->pos - global.plr.pos) < BOSS_HURT_RADIUS) {
@@ -1411,7 +1411,7 @@ void boss_start_next_attack(Boss *b, Attack *a) {
 			RNG_ARRAY(rng, 4);
 
 			PARTICLE(
-				.sprite = "stain",
+				.sprite_ptr = res_sprite_by_id(RID_SPRITE_part_stain),
 				.pos = CMPLX(VIEWPORT_W/2 + vrng_sreal(rng[0]) * VIEWPORT_W/4, VIEWPORT_H/2 + vrng_sreal(rng[1]) * 30),
 				.color = RGBA(0.2, 0.3, 0.4, 0.0),
 				.timeout = 50,
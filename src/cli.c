@@ -31,6 +31,10 @@ enum {
 	OPT_REREPLAY,
 	OPT_POPCACHE,
 	OPT_UNLOCKALL,
+	OPT_VERIFY_BATCH,
+	OPT_JOBS,
+	OPT_BATCH_SHARD,
+	OPT_BENCHMARK,
 };
 
 static void print_help(struct TsOption* opts) {
@@ -79,6 +83,10 @@ int cli_args(int argc, char **argv, CLIAction *a) {
 	struct TsOption taisei_opts[] = {
 		{{"replay",             required_argument,  0, 'r'},            "Play a replay from %s", "FILE"},
 		{{"verify-replay",      required_argument,  0, 'R'},            "Play a replay from %s in headless mode, crash as soon as it desyncs unless --rereplay is used", "FILE"},
+		{{"verify-replays",     required_argument,  0, OPT_VERIFY_BATCH}, "Verify all replays in a directory or list file %s in headless mode, print results as JSON lines", "PATH"},
+		{{"jobs",               required_argument,  0, 'j'},            "Number of worker processes for --verify-replays (default: CPU count)", "N"},
+		{{"batch-shard",        required_argument,  0, OPT_BATCH_SHARD}, "Only verify shard %s of the --verify-replays list (used by worker processes)", "I/N"},
+		{{"benchmark",          required_argument,  0, OPT_BENCHMARK},  "Play replays from a directory or list file %s headlessly and report logic frame times", "PATH"},
 		{{"rereplay",           required_argument,  0, OPT_REREPLAY},   "Re-record replay into %s; specify input with -r or -R", "OUTFILE"},
 #ifdef DEBUG
 		{{"play",               no_argument,        0, 'p'},            "Play a specific stage"},
@@ -160,6 +168,33 @@ int cli_args(int argc, char **argv, CLIAction *a) {
 		case 'R':
 			a->type = CLI_VerifyReplay;
 			stralloc(&a->filename, optarg);
+			break;
+		case OPT_VERIFY_BATCH:
+			a->type = CLI_VerifyReplayBatch;
+			stralloc(&a->filename, optarg);
+			break;
+		case OPT_BENCHMARK:
+			a->type = CLI_Benchmark;
+			stralloc(&a->filename, optarg);
+			break;
+		case 'j':
+			a->jobs = strtol(optarg, &endptr, 10);
+
+			if(!*optarg || *endptr || a->jobs < 1) {
+				log_fatal("Invalid number of jobs '%s'", optarg);
+			}
+
+			break;
+		case OPT_BATCH_SHARD:
+			if(
+				sscanf(optarg, "%d/%d", &a->batch_shard_index, &a->batch_shard_count) != 2 ||
+				a->batch_shard_count < 1 ||
+				a->batch_shard_index < 0 ||
+				a->batch_shard_index >= a->batch_shard_count
+			) {
+				log_fatal("Invalid batch shard '%s'", optarg);
+			}
+
 			break;
 		case OPT_REREPLAY:
 			stralloc(&a->out_replay, optarg);
@@ -305,6 +340,10 @@ int cli_args(int argc, char **argv, CLIAction *a) {
 		log_fatal("--rereplay requires --replay or --verify-replay");
 	}
 
+	if((a->jobs || a->batch_shard_count) && a->type != CLI_VerifyReplayBatch) {
+		log_fatal("--jobs and --batch-shard require --verify-replays");
+	}
+
 	return 0;
 }
 
@@ -15,6 +15,8 @@ typedef enum {
 	CLI_RunNormally = 0,
 	CLI_PlayReplay,
 	CLI_VerifyReplay,
+	CLI_VerifyReplayBatch,
+	CLI_Benchmark,
 	CLI_SelectStage,
 	CLI_DumpStages,
 	CLI_DumpVFSTree,
@@ -38,6 +40,9 @@ struct CLIAction {
 	bool unlock_all;
 	int width;
 	int height;
+	int jobs;
+	int batch_shard_index;
+	int batch_shard_count;
 };
 
 int cli_args(int argc, char **argv, CLIAction *a);
@@ -59,6 +59,8 @@
 	CONFIGDEF_KEYBINDING(KEY_RELOAD_RESOURCES,  "key_reload_resources", SDL_SCANCODE_F5) \
 	CONFIGDEF_KEYBINDING(KEY_QUICKSAVE,         "key_quicksave",        SDL_SCANCODE_F4) \
 	CONFIGDEF_KEYBINDING(KEY_QUICKLOAD,         "key_quickload",        SDL_SCANCODE_F3) \
+	CONFIGDEF_KEYBINDING(KEY_REPLAY_SEEK_BACK,  "key_replay_seek_back", SDL_SCANCODE_F7) \
+	CONFIGDEF_KEYBINDING(KEY_REPLAY_SEEK_FWD,   "key_replay_seek_fwd",  SDL_SCANCODE_F8) \
 
 
 #define GPKEYDEFS \
@@ -8,6 +8,7 @@
 
 #include "coroutine/coevent.h"
 #include "coroutine/coevent_internal.h"
+#include "coroutine/cosched_internal.h"
 #include "coroutine/cotask_internal.h"
 
 #include "util.h"
@@ -77,6 +78,17 @@ void coevent_add_subscriber(CoEvent *evt, CoTask *task) {
 }
 
 static void coevent_wake_subscribers(CoEvent *evt, uint num_subs, BoxedTask subs[num_subs]) {
+	// If a subscriber kills the task that is signalling us, the loop below is cut short, and the
+	// remaining subscribers are left to notice the event on their own when next visited.
+	// So make sure they do get visited.
+	for(int i = 0; i < num_subs; ++i) {
+		CoTask *task = cotask_unbox_notnull(subs[i]);
+
+		if(task && task->data && cotask_status(task) != CO_STATUS_DEAD) {
+			cosched_task_needs_visit(task->data->sched, task);
+		}
+	}
+
 	for(int i = 0; i < num_subs; ++i) {
 		CoTask *task = cotask_unbox_notnull(subs[i]);
 
@@ -17,6 +17,10 @@ void coroutines_shutdown(void) {
 	cotask_global_shutdown();
 }
 
+void coroutines_release_idle_stacks(void) {
+	cotask_release_idle_stacks();
+}
+
 #ifdef CO_TASK_STATS
 #include "video.h"
 #include "resource/font.h"
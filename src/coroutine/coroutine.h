@@ -11,4 +11,5 @@
 
 void coroutines_init(void);
 void coroutines_shutdown(void);
+void coroutines_release_idle_stacks(void);
 void coroutines_draw_stats(void);
@@ -7,9 +7,33 @@
  */
 
 #include "coroutine/cosched.h"
+#include "coroutine/cosched_internal.h"
 #include "coroutine/cotask.h"
 #include "coroutine/cotask_internal.h"
 #include "hashtable.h"
+#include "util.h"
+
+/*
+ * Conceptually, every frame the scheduler walks over all of its tasks in list order and resumes
+ * the ones that are ready. The order in which tasks run must be exactly that, otherwise replays
+ * desync. Most tasks are asleep at any given moment though, so instead of visiting them, we figure
+ * out in advance during which walk each task would be ready, and only visit those.
+ *
+ * Every task that made it into the main list has a sequence number, increasing in list order.
+ * A walk then is a merge of tasks sorted by that number:
+ *
+ *   - runnable: tasks that were visited in the previous walk and want to be visited again.
+ *     These are appended in visiting order, so they come out sorted for free;
+ *   - woken: tasks that became ready out of order, e.g. timers that fired or tasks whose bound
+ *     entity died. This is a heap.
+ *
+ * Tasks sleeping in WAIT(n) go into a two-level timer wheel keyed by walk number. Tasks waiting on
+ * events are only tracked by the event itself; signalling it resumes them directly, as before.
+ *
+ * A task "would have been visited" in the current walk if it's further down the list than the
+ * cursor. This is what cosched_visited_through() computes, and all the bookkeeping is relative
+ * to it, so that delay counters and CoWaitResult.frames come out identical to a full walk.
+ */
 
 void cosched_init(CoSched *sched) {
 	memset(sched, 0, sizeof(*sched));
@@ -17,7 +41,7 @@ void cosched_init(CoSched *sched) {
 
 CoTask *_cosched_new_task(CoSched *sched, CoTaskFunc func, void *arg, size_t arg_size, bool is_subtask, CoTaskDebugInfo debug) {
 	assume(sched != NULL);
-	CoTask *task = cotask_new_internal(cotask_entry);
+	CoTask *task = cotask_new_internal(cotask_entry, func);
 	task->name = debug.label;
 
 #ifdef CO_TASK_DEBUG
@@ -40,18 +64,321 @@ CoTask *_cosched_new_task(CoSched *sched, CoTaskFunc func, void *arg, size_t arg
 	cotask_resume_internal(task, &init_data);
 
 	assert(cotask_status(task) == CO_STATUS_SUSPENDED || cotask_status(task) == CO_STATUS_DEAD);
+	return task;
+}
+
+static inline bool task_seq_less(CoTask *a, CoTask *b) {
+	return a->sched_seq < b->sched_seq;
+}
+
+static void heap_sift_down(CoSchedTaskQueue *heap, uint i) {
+	uint n = heap->num_elements;
+	CoTask **h = heap->data;
+
+	for(;;) {
+		uint l = 2 * i + 1;
+		uint r = l + 1;
+		uint m = i;
+
+		if(l < n && task_seq_less(h[l], h[m])) {
+			m = l;
+		}
+
+		if(r < n && task_seq_less(h[r], h[m])) {
+			m = r;
+		}
+
+		if(m == i) {
+			break;
+		}
+
+		CoTask *t = h[i];
+		h[i] = h[m];
+		h[m] = t;
+		i = m;
+	}
+}
+
+static void heap_push(CoSchedTaskQueue *heap, CoTask *task) {
+	dynarray_append(heap, task);
+	CoTask **h = heap->data;
+
+	for(uint i = heap->num_elements - 1; i > 0;) {
+		uint p = (i - 1) / 2;
+
+		if(!task_seq_less(h[i], h[p])) {
+			break;
+		}
+
+		CoTask *t = h[i];
+		h[i] = h[p];
+		h[p] = t;
+		i = p;
+	}
+}
+
+static CoTask *heap_pop(CoSchedTaskQueue *heap) {
+	assert(heap->num_elements > 0);
+	CoTask *top = heap->data[0];
+	heap->data[0] = heap->data[--heap->num_elements];
+	heap_sift_down(heap, 0);
+	return top;
+}
+
+static void heap_build(CoSchedTaskQueue *heap) {
+	for(uint i = heap->num_elements / 2; i-- > 0;) {
+		heap_sift_down(heap, i);
+	}
+}
+
+// Last walk that has gone past the task's position in the list
+static uint32_t cosched_visited_through(CoSched *sched, CoTask *task) {
+	if(task->sched_seq == 0 || !sched->walking || task->sched_seq <= sched->cursor) {
+		// Pending tasks are appended at the start of the next walk, so they count as visited.
+		return sched->num_walks;
+	}
+
+	return sched->num_walks - 1;
+}
+
+static void cosched_enqueue(CoSched *sched, CoTask *task) {
+	if(task->sched_queued) {
+		return;
+	}
+
+	task->sched_queued = true;
+	++task->sched_park_id;  // invalidates timers
+
+	if(task->sched_seq == 0) {
+		// still pending; picked up when merged into the main list
+		return;
+	}
+
+	if(sched->walking) {
+		if(task->sched_seq == sched->cursor) {
+			dynarray_append(&sched->next_runnable, task);
+			return;
+		}
+
+		if(task->sched_seq > sched->cursor) {
+			heap_push(&sched->woken, task);
+			return;
+		}
+	}
+
+	dynarray_append(&sched->next_woken, task);
+}
+
+static void wheel_insert(CoSched *sched, CoSchedTimer timer) {
+	uint32_t now = sched->num_walks;
+	uint32_t wake = timer.wake_walk;
+	const uint near_bits = COSCHED_WHEEL_NEAR_BITS;
+	const uint far_bits = COSCHED_WHEEL_NEAR_BITS + COSCHED_WHEEL_FAR_BITS;
+
+	CoSchedTimerSlot *slot;
+
+	if((wake >> near_bits) == (now >> near_bits)) {
+		slot = &sched->wheel.near[wake & (COSCHED_WHEEL_NEAR_SLOTS - 1)];
+	} else if((wake >> far_bits) == (now >> far_bits)) {
+		slot = &sched->wheel.far[(wake >> near_bits) & (COSCHED_WHEEL_FAR_SLOTS - 1)];
+	} else {
+		slot = &sched->wheel.overflow;
+	}
+
+	dynarray_append(slot, timer);
+}
+
+static CoTask *timer_get_task(CoSchedTimer *timer) {
+	CoTask *task = cotask_unbox(timer->task);
+
+	if(!task || task->sched_queued || task->sched_park_id != timer->park_id) {
+		return NULL;
+	}
 
 	return task;
 }
 
+static void wheel_reinsert_slot(CoSched *sched, CoSchedTimerSlot *slot) {
+	if(slot->num_elements == 0) {
+		return;
+	}
+
+	// Entries may be re-added to the same slot, so detach its contents first.
+	CoSchedTimerSlot old = *slot;
+	memset(slot, 0, sizeof(*slot));
+
+	dynarray_foreach_elem(&old, CoSchedTimer *timer, {
+		if(timer_get_task(timer)) {
+			wheel_insert(sched, *timer);
+		}
+	});
+
+	dynarray_free_data(&old);
+}
+
+static void wheel_advance(CoSched *sched) {
+	uint32_t now = sched->num_walks;
+
+	if((now & (COSCHED_WHEEL_NEAR_SLOTS - 1)) == 0) {
+		if((now & ((COSCHED_WHEEL_NEAR_SLOTS * COSCHED_WHEEL_FAR_SLOTS) - 1)) == 0) {
+			wheel_reinsert_slot(sched, &sched->wheel.overflow);
+		}
+
+		uint far = (now >> COSCHED_WHEEL_NEAR_BITS) & (COSCHED_WHEEL_FAR_SLOTS - 1);
+		wheel_reinsert_slot(sched, &sched->wheel.far[far]);
+	}
+
+	CoSchedTimerSlot *slot = &sched->wheel.near[now & (COSCHED_WHEEL_NEAR_SLOTS - 1)];
+
+	dynarray_foreach_elem(slot, CoSchedTimer *timer, {
+		CoTask *task = timer_get_task(timer);
+
+		if(task) {
+			assert(timer->wake_walk == now);
+			cosched_enqueue(sched, task);
+		}
+	});
+
+	slot->num_elements = 0;
+}
+
+void cosched_task_needs_visit(CoSched *sched, CoTask *task) {
+	cosched_enqueue(sched, task);
+}
+
+void cosched_task_suspended(CoTask *task) {
+	if(task->sched_queued) {
+		// Already due for a visit, which will deal with whatever state the task is in.
+		return;
+	}
+
+	CoTaskData *task_data = cotask_get_data(task);
+	CoSched *sched = task_data->sched;
+
+	switch(task_data->wait.wait_type) {
+		case COTASK_WAIT_DELAY: {
+			// cotask_do_wait() decrements the counter once per visit and wakes the task when it
+			// goes negative. Do all of that in advance.
+			int remaining = task_data->wait.delay.remaining;
+			assert(remaining >= 0);
+
+			task_data->wait.delay.remaining = 0;
+			task_data->wait.result.frames += remaining;
+
+			if(remaining == 0) {
+				cosched_enqueue(sched, task);
+				return;
+			}
+
+			++task->sched_park_id;
+			wheel_insert(sched, (CoSchedTimer) {
+				.task = cotask_box(task),
+				.park_id = task->sched_park_id,
+				.wake_walk = cosched_visited_through(sched, task) + 1 + remaining,
+			});
+
+			return;
+		}
+
+		case COTASK_WAIT_EVENT: {
+			// Will be resumed by the event.
+			++task->sched_park_id;
+			task->sched_parked_on_event = true;
+			task->sched_parked_through = cosched_visited_through(sched, task);
+			return;
+		}
+
+		default: {
+			cosched_enqueue(sched, task);
+			return;
+		}
+	}
+}
+
+int cosched_task_missed_visits(CoTask *task) {
+	if(!task->sched_parked_on_event) {
+		return 0;
+	}
+
+	CoSched *sched = cotask_get_data(task)->sched;
+	uint32_t visited_through = cosched_visited_through(sched, task);
+	int missed = visited_through - task->sched_parked_through;
+
+	if(sched->walking && task->sched_seq == sched->cursor) {
+		// This is the visit itself; the caller accounts for it.
+		--missed;
+	}
+
+	task->sched_parked_on_event = false;
+	return missed;
+}
+
+static void cosched_merge_pending(CoSched *sched) {
+	for(CoTask *t; (t = alist_pop(&sched->pending_tasks));) {
+		t->sched_seq = ++sched->next_seq;
+		assert(sched->next_seq != 0);
+		alist_append(&sched->tasks, t);
+
+		if(t->sched_queued) {
+			dynarray_append(&sched->runnable, t);
+		}
+	}
+}
+
+static CoTask *cosched_next_task(CoSched *sched, uint *runnable_pos) {
+	CoTask *r = NULL;
+	CoTask *w = NULL;
+
+	if(*runnable_pos < sched->runnable.num_elements) {
+		r = dynarray_get(&sched->runnable, *runnable_pos);
+	}
+
+	if(sched->woken.num_elements > 0) {
+		w = dynarray_get(&sched->woken, 0);
+	}
+
+	if(r && (!w || task_seq_less(r, w))) {
+		++*runnable_pos;
+		return r;
+	}
+
+	if(w) {
+		return heap_pop(&sched->woken);
+	}
+
+	return NULL;
+}
+
 uint cosched_run_tasks(CoSched *sched) {
-	alist_merge_tail(&sched->tasks, &sched->pending_tasks);
+	++sched->num_walks;
+
+	assert(sched->runnable.num_elements == 0);
+	assert(sched->woken.num_elements == 0);
+
+	CoSchedTaskQueue q = sched->runnable;
+	sched->runnable = sched->next_runnable;
+	sched->next_runnable = q;
+
+	q = sched->woken;
+	sched->woken = sched->next_woken;
+	sched->next_woken = q;
+	heap_build(&sched->woken);
+
+	cosched_merge_pending(sched);
+
+	sched->walking = true;
+	sched->cursor = 0;
+
+	wheel_advance(sched);
 
 	uint ran = 0;
+	uint runnable_pos = 0;
 
 	TASK_DEBUG("---------------------------------------------------------------");
-	for(CoTask *t = sched->tasks.first, *next; t; t = next) {
-		next = t->next;
+	for(CoTask *t; (t = cosched_next_task(sched, &runnable_pos));) {
+		assert(t->sched_seq > sched->cursor);
+		sched->cursor = t->sched_seq;
+		t->sched_queued = false;
 
 		if(cotask_status(t) == CO_STATUS_DEAD) {
 			TASK_DEBUG("<!> %s", t->debug_label);
@@ -66,6 +393,9 @@ uint cosched_run_tasks(CoSched *sched) {
 	}
 	TASK_DEBUG("---------------------------------------------------------------");
 
+	sched->runnable.num_elements = 0;
+	sched->walking = false;
+
 	return ran;
 }
 
@@ -136,5 +466,20 @@ void cosched_finish(CoSched *sched) {
 	finish_task_list(&sched->pending_tasks);
 	assert(!sched->tasks.first);
 	assert(!sched->pending_tasks.first);
+
+	dynarray_free_data(&sched->runnable);
+	dynarray_free_data(&sched->next_runnable);
+	dynarray_free_data(&sched->woken);
+	dynarray_free_data(&sched->next_woken);
+
+	for(uint i = 0; i < ARRAY_SIZE(sched->wheel.near); ++i) {
+		dynarray_free_data(&sched->wheel.near[i]);
+	}
+
+	for(uint i = 0; i < ARRAY_SIZE(sched->wheel.far); ++i) {
+		dynarray_free_data(&sched->wheel.far[i]);
+	}
+
+	dynarray_free_data(&sched->wheel.overflow);
 	memset(sched, 0, sizeof(*sched));
 }
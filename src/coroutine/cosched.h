@@ -10,11 +10,48 @@
 #include "taisei.h"
 
 #include "cotask.h"
+#include "dynarray.h"
 
 typedef struct CoSched CoSched;
 
+enum {
+	COSCHED_WHEEL_NEAR_BITS = 8,
+	COSCHED_WHEEL_FAR_BITS = 6,
+	COSCHED_WHEEL_NEAR_SLOTS = 1 << COSCHED_WHEEL_NEAR_BITS,
+	COSCHED_WHEEL_FAR_SLOTS = 1 << COSCHED_WHEEL_FAR_BITS,
+};
+
+typedef struct CoSchedTimer {
+	BoxedTask task;
+	uint32_t park_id;
+	uint32_t wake_walk;
+} CoSchedTimer;
+
+typedef DYNAMIC_ARRAY(CoSchedTimer) CoSchedTimerSlot;
+typedef DYNAMIC_ARRAY(CoTask*) CoSchedTaskQueue;
+
 struct CoSched {
+	// All tasks in resume order. The order must be preserved for determinism.
 	CoTaskList tasks, pending_tasks;
+
+	// Tasks to visit in the current and next walk, sorted by sequence number
+	CoSchedTaskQueue runnable, next_runnable;
+
+	// Tasks woken out of order; min-heap by sequence number
+	CoSchedTaskQueue woken, next_woken;
+
+	// Hierarchical timer wheel for tasks sleeping in WAIT(n).
+	// near covers the current block of walks, far covers the blocks of the current superblock.
+	struct {
+		CoSchedTimerSlot near[COSCHED_WHEEL_NEAR_SLOTS];
+		CoSchedTimerSlot far[COSCHED_WHEEL_FAR_SLOTS];
+		CoSchedTimerSlot overflow;
+	} wheel;
+
+	uint32_t num_walks;
+	uint32_t next_seq;
+	uint32_t cursor;
+	bool walking;
 };
 
 void cosched_init(CoSched *sched);
@@ -0,0 +1,23 @@
+/*
+ * This software is licensed under the terms of the MIT License.
+ * See COPYING for further information.
+ * ---
+ * Copyright (c) 2011-2024, Lukas Weber <laochailan@web.de>.
+ * Copyright (c) 2012-2024, Andrei Alexeyev <akari@taisei-project.org>.
+ */
+
+#pragma once
+#include "taisei.h"
+
+#include "cosched.h"
+
+// Decides when a live task has to be visited next, based on what it's waiting for.
+// Must be called whenever a task yields, or is visited but not resumed.
+void cosched_task_suspended(CoTask *task) attr_nonnull_all;
+
+// Makes sure the task gets visited at the earliest point the old full walk would have reached it.
+void cosched_task_needs_visit(CoSched *sched, CoTask *task) attr_nonnull_all;
+
+// Number of walks that went past a task parked on an event since it was parked.
+// Resets the counter.
+int cosched_task_missed_visits(CoTask *task) attr_nonnull_all;
@@ -9,11 +9,25 @@
 #include "coroutine/cotask.h"
 #include "coroutine/cotask_internal.h"
 #include "coroutine/coevent_internal.h"
+#include "coroutine/cosched_internal.h"
+#include "hashtable.h"
 #include "log.h"
 #include "thread.h"
+#include "util.h"
 
-static CoTaskList task_pool;
+#ifdef TAISEI_BUILDCONF_HAVE_MADVISE
+	#include <errno.h>
+	#include <sys/mman.h>
+	#include <unistd.h>
+#endif
+
+// Released tasks, by stack size class
+static CoTaskList task_pool[CO_STACK_NUM_CLASSES];
 static koishi_coroutine_t *co_main;
+static uint32_t num_resumes;
+
+// spawn_id -> CoTaskBinding list of tasks bound to that entity
+static ht_int2ptr_t bindings;
 
 #ifdef CO_TASK_DEBUG
 size_t _cotask_debug_event_id;
@@ -23,7 +37,11 @@ size_t _cotask_debug_event_id;
 CoTaskStats cotask_stats;
 #endif
 
-#ifdef CO_TASK_STATS_STACK
+#if defined(CO_TASK_STATS_STACK) || defined(CO_TASK_STACK_CLASSES)
+	#define CO_TASK_STACK_PROBES
+#endif
+
+#ifdef CO_TASK_STACK_PROBES
 
 /*
  * Crude and simple method to estimate stack usage per task: at init time, fill
@@ -49,20 +67,38 @@ CoTaskStats cotask_stats;
 // for splitmix32
 #include "random.h"
 
+// Not all koishi backends support stack inspection; checked once in stack_probes_init()
+static bool stack_inspection_supported;
+
+static void *stack_probe_test_entry(void *arg) {
+	return arg;
+}
+
+static void stack_probes_init(void) {
+	koishi_coroutine_t co;
+	koishi_init(&co, CO_STACK_SIZE, stack_probe_test_entry);
+
+	size_t sz = 0;
+	stack_inspection_supported = koishi_get_stack(&co, &sz) && sz;
+	koishi_deinit(&co);
+
+	if(!stack_inspection_supported) {
+		log_debug("Coroutine stack inspection is not supported by this backend, stack probes disabled");
+	}
+}
+
 static inline uint32_t get_canary(CoTask *task) {
 	uint32_t temp = task->unique_id;
 	return splitmix32(&temp);
 }
 
 static void *get_stack(CoTask *task, size_t *sz) {
-	char *lower = koishi_get_stack(&task->ko, sz);
-
-	// Not all koishi backends support stack inspection. Give up in those cases.
-	if(!lower || !*sz) {
-		log_debug("koishi_get_stack() returned NULL");
+	if(!stack_inspection_supported) {
 		return NULL;
 	}
 
+	char *lower = NOT_NULL(koishi_get_stack(&task->ko, sz));
+
 	char *upper = lower + *sz;
 	assert(upper > lower);
 
@@ -76,11 +112,24 @@ static void *get_stack(CoTask *task, size_t *sz) {
 	return lower;
 }
 
+static inline bool should_probe_stack(CoTask *task) {
+#ifdef CO_TASK_STATS_STACK
+	return stack_inspection_supported;
+#else
+	return task->stack_probe != NULL;
+#endif
+}
+
 static void setup_stack(CoTask *task) {
+	if(!should_probe_stack(task)) {
+		return;
+	}
+
 	size_t stack_size;
 	void *stack = get_stack(task, &stack_size);
 
 	if(!stack) {
+		task->stack_probe = NULL;
 		return;
 	}
 
@@ -114,12 +163,17 @@ static uint32_t *find_first_canary(uint32_t *region, size_t offset, size_t sz, u
 	}
 }
 
-static void estimate_stack_usage(CoTask *task) {
+// Returns 0 if unknown
+static size_t estimate_stack_usage(CoTask *task) {
+	if(!should_probe_stack(task)) {
+		return 0;
+	}
+
 	size_t stack_size;
 	void *stack = get_stack(task, &stack_size);
 
 	if(!stack) {
-		return;
+		return 0;
 	}
 
 	uint32_t canary = get_canary(task);
@@ -129,8 +183,10 @@ static void estimate_stack_usage(CoTask *task) {
 	uint32_t *p_canary = find_first_canary(stack, 0, num_segments, canary);
 	assert(p_canary[1] != canary);
 
-	size_t real_stack_size = stack_size + STACK_BUFFER_LOWER + STACK_BUFFER_UPPER;
 	size_t usage = (uintptr_t)(first_segment + num_segments - p_canary) * sizeof(canary) + STACK_BUFFER_UPPER;
+
+#ifdef CO_TASK_STATS_STACK
+	size_t real_stack_size = stack_size + STACK_BUFFER_LOWER + STACK_BUFFER_UPPER;
 	double percentage = usage / (double)real_stack_size;
 
 	if(usage > STAT_VAL(peak_stack_usage)) {
@@ -143,25 +199,194 @@ static void estimate_stack_usage(CoTask *task) {
 		);
 		STAT_VAL_SET(peak_stack_usage, usage);
 	}
+#endif
+
+	return usage;
 }
 
-#else // CO_TASK_STATS_STACK
+#ifdef TAISEI_BUILDCONF_HAVE_MADVISE
 
+/*
+ * koishi reserves stacks with mmap on the platforms that have it, and the kernel only commits
+ * pages once they are touched. The canary fill above touches the whole stack though, and a
+ * recycled stack would keep all of it committed for as long as it sits in the pool. So after a
+ * probe, the pages below what the task actually used are handed back; they are committed again,
+ * zeroed, if a later task on the same stack goes that deep.
+ */
+static size_t stack_page_size;
+
+static void stack_decommit_init(void) {
+	long page_size = sysconf(_SC_PAGESIZE);
+	stack_page_size = page_size > 0 ? page_size : 0;
+}
+
+static void decommit_unused_stack(CoTask *task, size_t usage) {
+	size_t stack_size;
+	char *lower = get_stack(task, &stack_size);
+
+	if(!lower || !usage || !stack_page_size) {
+		return;
+	}
+
+	// Keep a page of slack below the deepest point the probe saw
+	uintptr_t begin = ((uintptr_t)lower + stack_page_size - 1) & ~(uintptr_t)(stack_page_size - 1);
+	uintptr_t end = (uintptr_t)lower + stack_size + STACK_BUFFER_UPPER - usage;
+	end = (end & ~(uintptr_t)(stack_page_size - 1)) - stack_page_size;
+
+	if(end > begin && madvise((void*)begin, end - begin, MADV_DONTNEED)) {
+		log_debug("madvise() failed: %s", strerror(errno));
+	}
+}
+
+#else // TAISEI_BUILDCONF_HAVE_MADVISE
+
+static void stack_decommit_init(void) { }
+static void decommit_unused_stack(CoTask *task, size_t usage) { }
+
+#endif // TAISEI_BUILDCONF_HAVE_MADVISE
+
+#else // CO_TASK_STACK_PROBES
+
+static void stack_probes_init(void) { }
+static void stack_decommit_init(void) { }
 static void setup_stack(CoTask *task) { }
-static void estimate_stack_usage(CoTask *task) { }
+static size_t estimate_stack_usage(CoTask *task) { return 0; }
+static void decommit_unused_stack(CoTask *task, size_t usage) { }
 
-#endif // CO_TASK_STATS_STACK
+#endif // CO_TASK_STACK_PROBES
+
+#ifdef CO_TASK_STACK_CLASSES
+
+/*
+ * Most tasks never get anywhere near CO_STACK_SIZE, yet every one of them used to get a stack that
+ * big. Instead, we keep a profile of stack usage per task function, and hand out the smallest size
+ * class that fits twice the recorded peak, rounded up to a power of two. The smallest class is
+ * still half of CO_STACK_SIZE (see cotask_internal.h), since the probes are only a sample.
+ *
+ * The profile is built from probes: the first few tasks of every function, and then every Nth one,
+ * run on a full-size stack filled with canaries, and are measured when released. A probe that
+ * needed more than expected promotes the function to a bigger class right away.
+ */
+
+enum {
+	STACK_PROBE_WARMUP = 8,
+	STACK_PROBE_INTERVAL = 64,
+};
+
+struct CoStackProfile {
+	size_t peak_usage;
+	uint num_spawned;
+	uint num_samples;
+	uint8_t stack_class;
+};
+
+static ht_ptr2ptr_t stack_profiles;
+
+static uint8_t stack_class_for_usage(size_t usage) {
+	size_t required = topow2_u64(usage) * 2;
+
+	for(uint8_t cls = 0; cls < CO_STACK_CLASS_MAX; ++cls) {
+		if(CO_STACK_CLASS_SIZE(cls) >= required) {
+			return cls;
+		}
+	}
+
+	return CO_STACK_CLASS_MAX;
+}
+
+static uint8_t select_stack_class(void *key, CoStackProfile **out_probe) {
+	if(!stack_inspection_supported) {
+		*out_probe = NULL;
+		return CO_STACK_CLASS_MAX;
+	}
 
+	CoStackProfile *prof = ht_get(&stack_profiles, key, NULL);
+
+	if(!prof) {
+		prof = ALLOC(CoStackProfile, { .stack_class = CO_STACK_CLASS_MAX });
+		ht_set(&stack_profiles, key, prof);
+	}
+
+	if(prof->num_samples < STACK_PROBE_WARMUP || prof->num_spawned++ % STACK_PROBE_INTERVAL == 0) {
+		*out_probe = prof;
+		return CO_STACK_CLASS_MAX;
+	}
+
+	*out_probe = NULL;
+	return prof->stack_class;
+}
+
+static void update_stack_profile(CoTask *task, size_t usage) {
+	CoStackProfile *prof = task->stack_probe;
+	task->stack_probe = NULL;
+
+	if(!prof || !usage) {
+		return;
+	}
+
+	++prof->num_samples;
+
+	if(usage > prof->peak_usage) {
+		prof->peak_usage = usage;
+		prof->stack_class = stack_class_for_usage(usage);
+	}
+}
+
+static void stack_profiles_init(void) {
+	ht_create(&stack_profiles);
+}
+
+static void stack_profiles_shutdown(void) {
+	ht_ptr2ptr_iter_t iter;
+	ht_iter_begin(&stack_profiles, &iter);
+
+	for(;iter.has_data; ht_iter_next(&iter)) {
+		mem_free(iter.value);
+	}
+
+	ht_iter_end(&iter);
+	ht_destroy(&stack_profiles);
+}
+
+#else // CO_TASK_STACK_CLASSES
+
+static uint8_t select_stack_class(void *key, CoStackProfile **out_probe) {
+	*out_probe = NULL;
+	return CO_STACK_CLASS_MAX;
+}
+
+static void update_stack_profile(CoTask *task, size_t usage) { }
+static void stack_profiles_init(void) { }
+static void stack_profiles_shutdown(void) { }
+
+#endif // CO_TASK_STACK_CLASSES
 
 void cotask_global_init(void) {
 	co_main = koishi_active();
+	ht_create(&bindings);
+	stack_probes_init();
+	stack_decommit_init();
+	stack_profiles_init();
 }
 
 void cotask_global_shutdown(void) {
-	for(CoTask *task; (task = alist_pop(&task_pool));) {
-		koishi_deinit(&task->ko);
-		mem_free(task);
+	cotask_release_idle_stacks();
+	ht_destroy(&bindings);
+	stack_profiles_shutdown();
+}
+
+void cotask_release_idle_stacks(void) {
+	attr_unused size_t num_released = 0;
+
+	for(uint cls = 0; cls < ARRAY_SIZE(task_pool); ++cls) {
+		for(CoTask *task; (task = alist_pop(&task_pool[cls]));) {
+			koishi_deinit(&task->ko);
+			mem_free(task);
+			++num_released;
+		}
 	}
+
+	STAT_VAL_ADD(num_tasks_allocated, -num_released);
 }
 
 attr_nonnull_all attr_returns_nonnull
@@ -196,11 +421,14 @@ CoTask *cotask_unbox_notnull(BoxedTask box) {
 	return NULL;
 }
 
-CoTask *cotask_new_internal(koishi_entrypoint_t entry_point) {
+CoTask *cotask_new_internal(koishi_entrypoint_t entry_point, CoTaskFunc func) {
 	CoTask *task;
 	STAT_VAL_ADD(num_tasks_in_use, 1);
 
-	if((task = alist_pop(&task_pool))) {
+	CoStackProfile *stack_probe;
+	uint8_t stack_class = select_stack_class(func ? *(void**)&func : *(void**)&entry_point, &stack_probe);
+
+	if((task = alist_pop(&task_pool[stack_class]))) {
 		koishi_recycle(&task->ko, entry_point);
 		TASK_DEBUG(
 			"Recycled task %p, entry=%p (%zu tasks allocated / %zu in use)",
@@ -209,7 +437,7 @@ CoTask *cotask_new_internal(koishi_entrypoint_t entry_point) {
 		);
 	} else {
 		task = ALLOC(typeof(*task));
-		koishi_init(&task->ko, CO_STACK_SIZE, entry_point);
+		koishi_init(&task->ko, CO_STACK_CLASS_SIZE(stack_class), entry_point);
 		STAT_VAL_ADD(num_tasks_allocated, 1);
 		TASK_DEBUG(
 			"Created new task %p, entry=%p (%zu tasks allocated / %zu in use)",
@@ -220,10 +448,15 @@ CoTask *cotask_new_internal(koishi_entrypoint_t entry_point) {
 
 	static uint32_t unique_counter = 0;
 	task->unique_id = ++unique_counter;
+	task->stack_class = stack_class;
+	task->stack_probe = stack_probe;
 	setup_stack(task);
 	assert(unique_counter != 0);
 
 	task->data = NULL;
+	task->sched_seq = 0;
+	task->sched_queued = false;
+	task->sched_parked_on_event = false;
 
 #ifdef CO_TASK_DEBUG
 	snprintf(task->debug_label, sizeof(task->debug_label), "<unknown at %p; entry=%p>", (void*)task, *(void**)&entry_point);
@@ -236,17 +469,67 @@ void *cotask_resume_internal(CoTask *task, void *arg) {
 	TASK_DEBUG_EVENT(ev);
 	TASK_DEBUG("[%zu] Resuming task %s", ev, task->debug_label);
 	STAT_VAL_ADD(num_switches_this_frame, 1);
+	++num_resumes;
 	arg = koishi_resume(&task->ko, arg);
 	TASK_DEBUG("[%zu] koishi_resume returned (%s)", ev, task->debug_label);
 	return arg;
 }
 
+static void cotask_track_binding(CoTaskData *task_data) {
+	uint32_t spawn_id = task_data->bound_ent.spawn_id;
+	CoTaskBinding *head = ht_get(&bindings, spawn_id, NULL);
+	CoTaskBinding *b = &task_data->binding;
+
+	b->task = task_data->task;
+	b->tracked = true;
+	list_push(&head, b);
+	ht_set(&bindings, spawn_id, head);
+}
+
+static void cotask_untrack_binding(CoTaskData *task_data) {
+	CoTaskBinding *b = &task_data->binding;
+
+	if(!b->tracked) {
+		return;
+	}
+
+	uint32_t spawn_id = task_data->bound_ent.spawn_id;
+	CoTaskBinding *head = NOT_NULL(ht_get(&bindings, spawn_id, NULL));
+	list_unlink(&head, b);
+	b->tracked = false;
+
+	if(head) {
+		ht_set(&bindings, spawn_id, head);
+	} else {
+		ht_unset(&bindings, spawn_id);
+	}
+}
+
+void cotask_entity_unregistered(uint32_t spawn_id) {
+	CoTaskBinding *head = ht_get(&bindings, spawn_id, NULL);
+
+	if(!head) {
+		return;
+	}
+
+	ht_unset(&bindings, spawn_id);
+
+	// cotask_resume() will cancel these tasks when it sees the entity is gone.
+	for(CoTaskBinding *b = head, *next; b; b = next) {
+		next = b->next;
+		b->tracked = false;
+		b->next = b->prev = NULL;
+		cosched_task_needs_visit(cotask_get_data(b->task)->sched, b->task);
+	}
+}
+
 static void cancel_task_events(CoTaskData *task_data) {
 	// HACK: This allows an entity-bound task to wait for its own "finished"
 	// event. Can be useful to do some cleanup without spawning a separate task
 	// just for that purpose.
 	// It's ok to unbind the entity like that, because when we get here, the
 	// task is about to die anyway.
+	cotask_untrack_binding(task_data);
 	task_data->bound_ent.ent = 0;
 
 	COEVENT_CANCEL_ARRAY(task_data->events);
@@ -267,6 +550,9 @@ static bool cotask_finalize(CoTask *task) {
 	TASK_DEBUG("[%zu] Finalizing task %s", ev, task->debug_label);
 	TASK_DEBUG("[%zu] data = %p", ev, (void*)task_data);
 
+	// Make sure the scheduler gets around to reaping it
+	cosched_task_needs_visit(task_data->sched, task);
+
 	cancel_task_events(task_data);
 
 	if(task_data->hosted.events) {
@@ -388,10 +674,12 @@ void cotask_free(CoTask *task) {
 
 	assert(task->data == NULL);
 
-	estimate_stack_usage(task);
+	size_t stack_usage = estimate_stack_usage(task);
+	decommit_unused_stack(task, stack_usage);
+	update_stack_profile(task, stack_usage);
 
 	task->unique_id = 0;
-	alist_push(&task_pool, task);
+	alist_push(&task_pool[task->stack_class], task);
 
 	STAT_VAL_ADD(num_tasks_in_use, -1);
 
@@ -476,7 +764,7 @@ static void cotask_force_cancel(CoTask *task) {
 	// CoTaskData, since we don't need any of the 'advanced' features for this.
 	// This also means we don't need to cotask_finalize it.
 
-	CoTask *cancel_task = cotask_new_internal(cotask_cancel_in_safe_context);
+	CoTask *cancel_task = cotask_new_internal(cotask_cancel_in_safe_context, NULL);
 
 	// This is basically just koishi_resume + some logging when built with CO_TASK_DEBUG.
 	// We can't use normal cotask_resume here, since we don't have CoTaskData.
@@ -524,6 +812,8 @@ static bool cotask_do_wait(CoTaskData *task_data) {
 		case COTASK_WAIT_EVENT: {
 			// TASK_DEBUG("COTASK_WAIT_EVENT in task %s", task_data->task->debug_label);
 
+			task_data->wait.result.frames += cosched_task_missed_visits(task_data->task);
+
 			CoEventStatus stat = coevent_poll(task_data->wait.event.pevent, &task_data->wait.event.snapshot);
 			if(stat != CO_EVENT_PENDING) {
 				task_data->wait.result.event_status = stat;
@@ -556,17 +846,24 @@ void *cotask_resume(CoTask *task, void *arg) {
 	}
 
 	if(!cotask_do_wait(task_data)) {
+		// The task tells the scheduler what it's waiting for itself, see cotask_yield()
 		return cotask_wake_and_resume(task, arg);
 	}
 
 	assert(task_data->wait.wait_type != COTASK_WAIT_NONE);
+	cosched_task_suspended(task);
 	return NULL;
 }
 
 void *cotask_yield(void *arg) {
-#ifdef CO_TASK_DEBUG
-	CoTask *task = cotask_active();
-#endif
+	CoTask *task = cotask_active_unsafe();
+
+	if(task->data) {
+		// NOTE: Must be done here rather than by whoever resumed us. If the resumer gets cancelled
+		// while we're running, koishi_yield() will skip right past it.
+		cosched_task_suspended(task);
+	}
+
 	TASK_DEBUG_EVENT(ev);
 	// TASK_DEBUG("[%zu] Yielding from task %s", ev, task->debug_label);
 	STAT_VAL_ADD(num_switches_this_frame, 1);
@@ -741,6 +1038,11 @@ EntityInterface *(cotask_bind_to_entity)(CoTask *task, EntityInterface *ent) {
 	}
 
 	task_data->bound_ent = ENT_BOX(ent);
+
+	if(task_data->bound_ent.spawn_id) {
+		cotask_track_binding(task_data);
+	}
+
 	return ent;
 }
 
@@ -765,3 +1067,7 @@ void cotask_force_finish(CoTask *task) {
 const char *cotask_get_name(CoTask *task) {
 	return task->name;
 }
+
+uint32_t cotask_num_resumes(void) {
+	return num_resumes;
+}
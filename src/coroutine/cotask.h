@@ -74,5 +74,11 @@ void cotask_host_events(CoTask *task, uint num_events, CoEvent events[num_events
 CoSched *cotask_get_sched(CoTask *task);
 const char *cotask_get_name(CoTask *task) attr_nonnull(1);
 
+// Monotonic (wrapping) counter of task resumes. If it hasn't changed, no task code could have run.
+uint32_t cotask_num_resumes(void);
+
+// Must be called when an entity is unregistered, so that tasks bound to it can be cancelled in time.
+void cotask_entity_unregistered(uint32_t spawn_id);
+
 BoxedTask cotask_box(CoTask *task);
 CoTask *cotask_unbox(BoxedTask box);
@@ -17,6 +17,21 @@
 	#define CO_STACK_SIZE (256 * 1024)
 #endif
 
+// Stacks come in a few size classes, each half the size of the next. CO_STACK_SIZE is the largest.
+// Stacks have no guaranteed guard page, so an overflow would go unnoticed; the smallest class must
+// leave plenty of room for paths the usage probes never saw (synchronous resource loads, logging,
+// rarely taken branches). Hence it's never below CO_STACK_SIZE / 2.
+// Where koishi reserves stacks with mmap, pages a task never touches cost no memory either way
+// (see decommit_unused_stack() in cotask.c), so the classes mostly matter on other backends.
+#define CO_STACK_NUM_CLASSES 2
+#define CO_STACK_CLASS_SIZE(cls) (CO_STACK_SIZE >> (CO_STACK_NUM_CLASSES - 1 - (cls)))
+#define CO_STACK_CLASS_MAX (CO_STACK_NUM_CLASSES - 1)
+
+// Pick stack size classes per task function based on sampled stack usage, see cotask.c
+#ifndef _WIN32
+	#define CO_TASK_STACK_CLASSES
+#endif
+
 #ifdef CO_TASK_DEBUG
 	#define TASK_DEBUG(...) log_debug(__VA_ARGS__)
 	extern size_t _cotask_debug_event_id;
@@ -48,6 +63,15 @@ enum {
 };
 
 typedef struct CoTaskData CoTaskData;
+typedef struct CoTaskBinding CoTaskBinding;
+typedef struct CoStackProfile CoStackProfile;
+
+// Node in the list of tasks bound to the same entity
+struct CoTaskBinding {
+	LIST_INTERFACE(CoTaskBinding);
+	CoTask *task;
+	bool tracked;
+};
 
 struct CoTask {
 	LIST_INTERFACE(CoTask);
@@ -59,6 +83,17 @@ struct CoTask {
 	uint32_t unique_id;
 	const char *name;
 
+	// Scheduler bookkeeping, see cosched.c
+	uint32_t sched_seq;             // position in the scheduler's list; 0 if pending
+	uint32_t sched_park_id;         // bumped whenever the task is parked or queued, invalidates timers
+	uint32_t sched_parked_through;  // last walk that went past the task when it parked on an event
+	bool sched_queued;              // will be visited in the current or next walk
+	bool sched_parked_on_event;
+
+	// If not NULL, the stack is filled with canaries, and its usage will be recorded here
+	CoStackProfile *stack_probe;
+	uint8_t stack_class;
+
 	char _end[0];
 
 	#ifdef CO_TASK_DEBUG
@@ -108,6 +143,7 @@ struct CoTaskData {
 	LIST_ANCHOR(CoTaskData) slaves;  // AKA subtasks
 
 	BoxedEntity bound_ent;
+	CoTaskBinding binding;
 	CoTaskEvents events;
 
 	bool finalizing;
@@ -154,7 +190,9 @@ typedef struct CoTaskInitData {
 void cotask_global_init(void);
 void cotask_global_shutdown(void);
 
-CoTask *cotask_new_internal(koishi_entrypoint_t entry_point);
+// func identifies the task for stack size selection; NULL to use entry_point for that
+CoTask *cotask_new_internal(koishi_entrypoint_t entry_point, CoTaskFunc func);
+void cotask_release_idle_stacks(void);
 void *cotask_resume_internal(CoTask *task, void *arg);
 CoTask *cotask_unbox_notnull(BoxedTask box);
 void cotask_force_finish(CoTask *task);
@@ -14,6 +14,7 @@
 #include "list.h"
 #include "projectile.h"
 #include "resource/resource.h"
+#include "spatialgrid.h"
 #include "stageobjects.h"
 #include "util/glm.h"
 
@@ -108,6 +109,7 @@ Enemy *create_enemy_p(EnemyList *enemies, cmplx pos, float hp, EnemyVisual visua
 	COEVENT_INIT_ARRAY(e->events);
 	fix_pos0_visual(e);
 	ent_register(&e->ent, ENT_TYPE_ID(Enemy));
+	spatialgrid_invalidate();
 
 	return e;
 }
@@ -116,7 +118,7 @@ static void enemy_death_effect(cmplx pos) {
 	for(int i = 0; i < 10; i++) {
 		RNG_ARRAY(rng, 2);
 		PARTICLE(
-			.sprite = "flare",
+			.sprite_ptr = res_sprite_by_id(RID_SPRITE_part_flare),
 			.pos = pos,
 			.timeout = 10,
 			.draw_rule = pdraw_timeout_fade(1, 0),
@@ -153,7 +155,7 @@ static void *_delete_enemy(ListAnchor *enemies, List* enemy, void *arg) {
 	Enemy *e = (Enemy*)enemy;
 
 	if(e->hp <= 0 && !(e->flags & EFLAG_NO_DEATH_EXPLOSION)) {
-		play_sfx("enemydeath");
+		play_sfx_by_id(RID_SFX_enemydeath);
 		enemy_death_effect(e->pos);
 
 		for(Projectile *p = global.projs.first; p; p = p->next) {
@@ -166,6 +168,7 @@ static void *_delete_enemy(ListAnchor *enemies, List* enemy, void *arg) {
 	COEVENT_CANCEL_ARRAY(e->events);
 	ent_unregister(&e->ent);
 	STAGE_RELEASE_OBJ(alist_unlink(enemies, e));
+	spatialgrid_invalidate();
 
 	return NULL;
 }
@@ -289,9 +292,9 @@ static DamageResult ent_damage_enemy(EntityInterface *ienemy, const DamageInfo *
 	}
 
 	if(enemy->hp < enemy->spawn_hp * 0.1) {
-		play_sfx_loop("hit1");
+		play_sfx_loop_by_id(RID_SFX_hit1);
 	} else {
-		play_sfx_loop("hit0");
+		play_sfx_loop_by_id(RID_SFX_hit0);
 	}
 
 	return DMG_RESULT_OK;
@@ -8,9 +8,11 @@
 
 #include "entity.h"
 
+#include "coroutine/cotask.h"
 #include "dynarray.h"
 #include "global.h"
 #include "renderer/api.h"
+#include "spatialgrid.h"
 #include "util.h"
 
 typedef struct EntityDrawHook EntityDrawHook;
@@ -22,16 +24,36 @@ struct EntityDrawHook {
 	void *arg;
 };
 
+typedef struct EntityDrawSlot {
+	EntityInterface *ent;
+	drawlayer_t layer;  // the entity's draw_layer when this slot was sorted
+	uint32_t spawn_id;
+} EntityDrawSlot;
+
 static struct {
 	DYNAMIC_ARRAY(EntityInterface*) registered;
 	uint32_t total_spawns;
 
+	struct {
+		// Sorted by (layer, spawn_id) up to num_sorted. Entities registered since the last
+		// update are appended past that, in spawn order. Unregistered entities leave holes.
+		DYNAMIC_ARRAY(EntityDrawSlot) slots;
+		DYNAMIC_ARRAY(EntityDrawSlot) pending;
+		uint num_sorted;
+		uint num_holes;
+	} draw_order;
+
 	struct {
 		EntityDrawHookList pre_draw;
 		EntityDrawHookList post_draw;
 	} hooks;
+
+	// Bit per DrawLayerID; see ent_set_layer_unordered()
+	uint32_t unordered_layers;
 } entities;
 
+static_assert(LAYER_ID_OVERLAY < 32, "unordered_layers mask is too small");
+
 static void add_hook(EntityDrawHookList *list, EntityDrawHookCallback cb, void *arg) {
 	auto hook = ALLOC(EntityDrawHook);
 	hook->callback = cb;
@@ -61,6 +83,7 @@ static void call_hooks(EntityDrawHookList *list, EntityInterface *ent) {
 void ent_init(void) {
 	memset(&entities, 0, sizeof(entities));
 	dynarray_ensure_capacity(&entities.registered, 1024);
+	dynarray_ensure_capacity(&entities.draw_order.slots, 1024);
 }
 
 void ent_shutdown(void) {
@@ -69,22 +92,72 @@ void ent_shutdown(void) {
 	}
 
 	dynarray_free_data(&entities.registered);
+	dynarray_free_data(&entities.draw_order.slots);
+	dynarray_free_data(&entities.draw_order.pending);
 
 	assert(entities.hooks.post_draw.first == NULL);
 	assert(entities.hooks.pre_draw.first == NULL);
 }
 
+static void draw_order_compact(void) {
+	auto d = &entities.draw_order;
+	uint num_sorted = 0;
+	uint w = 0;
+
+	dynarray_foreach(&d->slots, uint i, EntityDrawSlot *slot, {
+		if(i == d->num_sorted) {
+			num_sorted = w;
+		}
+
+		if(slot->ent) {
+			slot->ent->draw_index = w;
+			d->slots.data[w++] = *slot;
+		}
+	});
+
+	if(d->num_sorted == d->slots.num_elements) {
+		num_sorted = w;
+	}
+
+	d->slots.num_elements = w;
+	d->num_sorted = num_sorted;
+	d->num_holes = 0;
+}
+
 void ent_register(EntityInterface *ent, EntityType type) {
 	assert(type > _ENT_TYPE_ENUM_BEGIN && type < _ENT_TYPE_ENUM_END);
 	ent->type = type;
 	ent->spawn_id = ++entities.total_spawns;
 	ent->index = entities.registered.num_elements;
+	ent->draw_index = entities.draw_order.slots.num_elements;
 	assume(ent->spawn_id > 0);
 	dynarray_append(&entities.registered, ent);
+	dynarray_append(&entities.draw_order.slots, {
+		.ent = ent,
+		.layer = ent->draw_layer,
+		.spawn_id = ent->spawn_id,
+	});
+}
+
+void ent_reserve(uint num) {
+	dynarray_size_t need = entities.registered.num_elements + num;
+
+	if(need > entities.registered.capacity) {
+		dynarray_ensure_capacity(&entities.registered, max(need, entities.registered.capacity * 2));
+	}
+
+	auto slots = &entities.draw_order.slots;
+	need = slots->num_elements + num;
+
+	if(need > slots->capacity) {
+		dynarray_ensure_capacity(slots, max(need, slots->capacity * 2));
+	}
 }
 
 void ent_unregister(EntityInterface *ent) {
+	uint32_t spawn_id = ent->spawn_id;
 	ent->spawn_id = 0;
+	cotask_entity_unregistered(spawn_id);
 
 	// Fast non-order-preserving removal by moving the last element into the removed element's position.
 
@@ -92,36 +165,136 @@ void ent_unregister(EntityInterface *ent) {
 	assert(dynarray_get(&entities.registered, ent->index) == ent);
 	EntityInterface *sub = entities.registered.data[--entities.registered.num_elements];
 	entities.registered.data[sub->index = ent->index] = sub;
-}
 
-static int ent_cmp(const void *ptr1, const void *ptr2) {
-	const EntityInterface *ent1 = *(const EntityInterface**)ptr1;
-	const EntityInterface *ent2 = *(const EntityInterface**)ptr2;
+	// Draw order is preserved by leaving a hole, which the next draw order update removes.
+	// Compact here too in case nothing is being drawn (e.g. headless replay playback).
+
+	auto d = &entities.draw_order;
+	assert(dynarray_get(&d->slots, ent->draw_index).ent == ent);
+	d->slots.data[ent->draw_index].ent = NULL;
+
+	if(++d->num_holes > 1024 && d->num_holes > d->slots.num_elements / 2) {
+		draw_order_compact();
+	}
+}
 
-	int r = (int)ent1->draw_layer - (int)ent2->draw_layer;
+static int draw_slot_cmp(const EntityDrawSlot *s1, const EntityDrawSlot *s2) {
+	int r = (int)s1->layer - (int)s2->layer;
 
 	if(r == 0) {
 		// Same layer? Put whatever spawned later on top, then.
-		r = (int)ent1->spawn_id - (int)ent2->spawn_id;
+		r = (int)s1->spawn_id - (int)s2->spawn_id;
 	}
 
 	return r;
 }
 
+static int draw_slot_qsort_cmp(const void *ptr1, const void *ptr2) {
+	return draw_slot_cmp(ptr1, ptr2);
+}
+
+/*
+ * Restores the (draw_layer, spawn_id) order of all registered entities.
+ *
+ * Entities whose draw_layer has not changed since the last update keep their relative
+ * order, so only new entities and those that changed layers need sorting; these are then
+ * merged back into the rest. draw_layer is written directly all over the place, so
+ * changes are detected here rather than tracked at the call sites.
+ */
+static void draw_order_update(void) {
+	auto d = &entities.draw_order;
+	d->pending.num_elements = 0;
+	uint w = 0;
+
+	dynarray_foreach(&d->slots, uint i, EntityDrawSlot *slot, {
+		EntityInterface *ent = slot->ent;
+
+		if(!ent) {
+			continue;
+		}
+
+		if(i >= d->num_sorted || ent->draw_layer != slot->layer) {
+			dynarray_append(&d->pending, {
+				.ent = ent,
+				.layer = ent->draw_layer,
+				.spawn_id = slot->spawn_id,
+			});
+		} else {
+			ent->draw_index = w;
+			d->slots.data[w++] = *slot;
+		}
+	});
+
+	uint num_pending = d->pending.num_elements;
+	uint num_total = w + num_pending;
+	d->slots.num_elements = num_total;
+	d->num_sorted = num_total;
+	d->num_holes = 0;
+
+	if(num_pending == 0) {
+		return;
+	}
+
+	dynarray_qsort(&d->pending, draw_slot_qsort_cmp);
+
+	// Merge from the back, in place
+	EntityDrawSlot *sorted = d->slots.data;
+	EntityDrawSlot *pending = d->pending.data;
+	int i = w - 1;
+	int j = num_pending - 1;
+
+	for(int k = num_total - 1; j >= 0; --k) {
+		if(i >= 0 && draw_slot_cmp(sorted + i, pending + j) > 0) {
+			sorted[k] = sorted[i--];
+		} else {
+			sorted[k] = pending[j--];
+		}
+
+		sorted[k].ent->draw_index = k;
+	}
+}
+
 static inline bool ent_is_drawable(EntityInterface *ent) {
 	return (ent->draw_layer & ~LAYER_LOW_MASK) > LAYER_NODRAW && ent->draw_func;
 }
 
+static inline bool ent_layer_is_unordered(drawlayer_t layer) {
+	return entities.unordered_layers & (1u << (layer >> LAYER_LOW_BITS));
+}
+
+/*
+ * Opens a sprite batch unordered scope for each run of entities on the same unordered
+ * layer (including the sub-layer bits, so sub-layer ordering is still respected).
+ */
+static inline void ent_draw_update_unordered_scope(drawlayer_t layer, drawlayer_t *scope_layer) {
+	if(layer == *scope_layer) {
+		return;
+	}
+
+	if(*scope_layer != LAYER_ID_NONE) {
+		r_sprite_batch_end_unordered();
+	}
+
+	if(ent_layer_is_unordered(layer)) {
+		r_sprite_batch_begin_unordered();
+		*scope_layer = layer;
+	} else {
+		*scope_layer = LAYER_ID_NONE;
+	}
+}
+
 void ent_draw(EntityPredicate predicate) {
 	call_hooks(&entities.hooks.pre_draw, NULL);
-	dynarray_qsort(&entities.registered, ent_cmp);
+	draw_order_update();
+
+	drawlayer_t scope_layer = LAYER_ID_NONE;
 
 	if(predicate) {
-		dynarray_foreach(&entities.registered, int i, EntityInterface **pent, {
-			EntityInterface *ent = *pent;
-			ent->index = i;
+		dynarray_foreach_elem(&entities.draw_order.slots, EntityDrawSlot *slot, {
+			EntityInterface *ent = slot->ent;
 
-			if(ent_is_drawable(ent) && predicate(ent)) {
+			if(ent && ent_is_drawable(ent) && predicate(ent)) {
+				ent_draw_update_unordered_scope(slot->layer, &scope_layer);
 				call_hooks(&entities.hooks.pre_draw, ent);
 				r_state_push();
 				ent->draw_func(ent);
@@ -130,11 +303,11 @@ void ent_draw(EntityPredicate predicate) {
 			}
 		});
 	} else {
-		dynarray_foreach(&entities.registered, int i, EntityInterface **pent, {
-			EntityInterface *ent = *pent;
-			ent->index = i;
+		dynarray_foreach_elem(&entities.draw_order.slots, EntityDrawSlot *slot, {
+			EntityInterface *ent = slot->ent;
 
-			if(ent_is_drawable(ent)) {
+			if(ent && ent_is_drawable(ent)) {
+				ent_draw_update_unordered_scope(slot->layer, &scope_layer);
 				call_hooks(&entities.hooks.pre_draw, ent);
 				r_state_push();
 				ent->draw_func(ent);
@@ -144,9 +317,22 @@ void ent_draw(EntityPredicate predicate) {
 		});
 	}
 
+	ent_draw_update_unordered_scope(LAYER_ID_NONE, &scope_layer);
 	call_hooks(&entities.hooks.post_draw, NULL);
 }
 
+void ent_set_layer_unordered(DrawLayer layer, bool unordered) {
+	uint32_t bit = 1u << (layer >> LAYER_LOW_BITS);
+	assert((layer & LAYER_LOW_MASK) == 0);
+	assert(bit != 1u);
+
+	if(unordered) {
+		entities.unordered_layers |= bit;
+	} else {
+		entities.unordered_layers &= ~bit;
+	}
+}
+
 DamageResult ent_damage(EntityInterface *ent, const DamageInfo *damage) {
 	if(ent->damage_func == NULL) {
 		return DMG_RESULT_INAPPLICABLE;
@@ -169,48 +355,72 @@ DamageResult ent_damage(EntityInterface *ent, const DamageInfo *damage) {
 	return res;
 }
 
-void ent_area_damage(cmplx origin, float radius, const DamageInfo *damage, EntityAreaDamageCallback callback, void *callback_arg) {
-	for(Enemy *e = global.enemies.first; e; e = e->next) {
-		if(
-			cabs(origin - e->pos) < radius &&
-			ent_damage(&e->ent, damage) == DMG_RESULT_OK &&
-			callback != NULL
-		) {
-			callback(&e->entity_interface, e->pos, callback_arg);
-		}
+typedef struct AreaDamageArgs {
+	const DamageInfo *damage;
+	EntityAreaDamageCallback callback;
+	void *callback_arg;
+	union {
+		Circle circle;
+		Ellipse ellipse;
+	};
+} AreaDamageArgs;
+
+static cmplx area_damage_target_pos(EntityInterface *ent) {
+	switch(ent->type) {
+		case ENT_TYPE_ID(Enemy): return ENT_CAST(ent, Enemy)->pos;
+		case ENT_TYPE_ID(Boss):  return ENT_CAST(ent, Boss)->pos;
+		default: UNREACHABLE;
 	}
+}
 
-	if(
-		global.boss != NULL &&
-		cabs(origin - global.boss->pos) < radius &&
-		ent_damage(&global.boss->ent, damage) == DMG_RESULT_OK &&
-		callback != NULL
-	) {
-		callback(&global.boss->entity_interface, global.boss->pos, callback_arg);
+static void area_damage_apply(EntityInterface *ent, cmplx pos, AreaDamageArgs *args) {
+	if(ent_damage(ent, args->damage) == DMG_RESULT_OK && args->callback != NULL) {
+		args->callback(ent, pos, args->callback_arg);
 	}
 }
 
-void ent_area_damage_ellipse(Ellipse ellipse, const DamageInfo *damage, EntityAreaDamageCallback callback, void *callback_arg) {
-	for(Enemy *e = global.enemies.first; e; e = e->next) {
-		if(
-			point_in_ellipse(e->pos, ellipse) &&
-			ent_damage(&e->ent, damage) == DMG_RESULT_OK &&
-			callback != NULL
-		) {
-			callback(&e->entity_interface, e->pos, callback_arg);
-		}
+static void area_damage_circle(EntityInterface *ent, void *varg) {
+	AreaDamageArgs *args = varg;
+	cmplx pos = area_damage_target_pos(ent);
+
+	if(cabs(args->circle.origin - pos) < args->circle.radius) {
+		area_damage_apply(ent, pos, args);
 	}
+}
+
+static void area_damage_ellipse(EntityInterface *ent, void *varg) {
+	AreaDamageArgs *args = varg;
+	cmplx pos = area_damage_target_pos(ent);
 
-	if(
-		global.boss != NULL &&
-		point_in_ellipse(global.boss->pos, ellipse) &&
-		ent_damage(&global.boss->ent, damage) == DMG_RESULT_OK &&
-		callback != NULL
-	) {
-		callback(&global.boss->entity_interface, global.boss->pos, callback_arg);
+	if(point_in_ellipse(pos, args->ellipse)) {
+		area_damage_apply(ent, pos, args);
 	}
 }
 
+void ent_area_damage(cmplx origin, float radius, const DamageInfo *damage, EntityAreaDamageCallback callback, void *callback_arg) {
+	AreaDamageArgs args = {
+		.damage = damage,
+		.callback = callback,
+		.callback_arg = callback_arg,
+		.circle = { origin, radius },
+	};
+
+	cmplx r = CMPLX(radius, radius);
+	Rect bbox = { .top_left = origin - r, .bottom_right = origin + r };
+	spatialgrid_foreach_target_in_rect(bbox, area_damage_circle, &args);
+}
+
+void ent_area_damage_ellipse(Ellipse ellipse, const DamageInfo *damage, EntityAreaDamageCallback callback, void *callback_arg) {
+	AreaDamageArgs args = {
+		.damage = damage,
+		.callback = callback,
+		.callback_arg = callback_arg,
+		.ellipse = ellipse,
+	};
+
+	spatialgrid_foreach_target_in_rect(ellipse_bbox(ellipse), area_damage_ellipse, &args);
+}
+
 void ent_hook_pre_draw(EntityDrawHookCallback callback, void *arg) {
 	add_hook(&entities.hooks.pre_draw, callback, arg);
 }
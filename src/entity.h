@@ -90,6 +90,7 @@ typedef void (*EntityAreaDamageCallback)(EntityInterface *ent, cmplx ent_origin,
 	drawlayer_t draw_layer; \
 	uint32_t spawn_id; \
 	uint index; \
+	uint draw_index; \
 	EntityType type; \
 }
 
@@ -133,7 +134,14 @@ void ent_init(void);
 void ent_shutdown(void);
 void ent_register(EntityInterface *ent, EntityType type) attr_nonnull(1);
 void ent_unregister(EntityInterface *ent) attr_nonnull(1);
+
+// Preallocates registry space for `num` more entities, e.g. before spawning a batch.
+void ent_reserve(uint num);
 void ent_draw(EntityPredicate predicate);
+
+// Entities on an unordered layer may be drawn in any order relative to each other, which
+// allows sprites with the same texture/shader/blend state to be batched together.
+void ent_set_layer_unordered(DrawLayer layer, bool unordered);
 DamageResult ent_damage(EntityInterface *ent, const DamageInfo *damage) attr_nonnull(1, 2);
 void ent_area_damage(cmplx origin, float radius, const DamageInfo *damage, EntityAreaDamageCallback callback, void *callback_arg) attr_nonnull(3);
 void ent_area_damage_ellipse(Ellipse ellipse, const DamageInfo *damage, EntityAreaDamageCallback callback, void *callback_arg) attr_nonnull(2);
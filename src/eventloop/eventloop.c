@@ -10,6 +10,7 @@
 #include "eventloop_private.h"
 
 #include "global.h"
+#include "profiler.h"
 #include "thread.h"
 #include "util.h"
 #include "vfs/public.h"
@@ -67,6 +68,7 @@ LogicFrameAction run_logic_frame(LoopFrame *frame) {
 		return LFRAME_STOP;
 	}
 
+	PROFILE_ZONE("logic");
 	LogicFrameAction a = frame->logic(frame->context);
 
 	if(a != LFRAME_SKIP_ALWAYS) {
@@ -116,6 +118,7 @@ LogicFrameAction handle_logic(LoopFrame **pframe, const FrameTimes *ftimes) {
 }
 
 RenderFrameAction run_render_frame(LoopFrame *frame) {
+	PROFILE_ZONE("render");
 	attr_unused LoopFrame *stack_prev = evloop.stack_ptr;
 	r_begin_frame();
 	r_framebuffer_clear(NULL, BUFFER_ALL, RGBA(0, 0, 0, 1), 1);
@@ -123,6 +126,7 @@ RenderFrameAction run_render_frame(LoopFrame *frame) {
 	assert(evloop.stack_ptr == stack_prev);
 
 	if(a == RFRAME_SWAP) {
+		PROFILE_ZONE("swap");
 		video_swap_buffers();
 	}
 
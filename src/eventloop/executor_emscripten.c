@@ -9,6 +9,7 @@
 #include "eventloop_private.h"
 #include "events.h"
 #include "global.h"
+#include "profiler.h"
 
 #include <emscripten.h>
 
@@ -40,6 +41,7 @@ static void em_loop_callback(void) {
 	}
 
 	global.fps.busy.last_update_time = evloop.frame_times.start;
+	PROFILE_FRAME_BEGIN(frame_zone);
 
 	LogicFrameAction lframe_action = handle_logic(&frame, &evloop.frame_times);
 
@@ -52,6 +54,7 @@ static void em_loop_callback(void) {
 	}
 
 	fpscounter_update(&global.fps.busy);
+	PROFILE_FRAME_END(frame_zone);
 }
 
 static void update_vsync(void) {
@@ -9,6 +9,7 @@
 #include "eventloop_private.h"
 
 #include "global.h"
+#include "profiler.h"
 #include "util/env.h"
 
 void eventloop_run(void) {
@@ -49,6 +50,7 @@ void eventloop_run(void) {
 
 begin_frame:
 		global.fps.busy.last_update_time = time_get();
+		PROFILE_FRAME_BEGIN(frame_zone);
 		evloop.frame_times.target = frame->frametime;
 		++frame_num;
 
@@ -96,6 +98,7 @@ void eventloop_run(void) {
 		}
 
 		fpscounter_update(&global.fps.busy);
+		PROFILE_FRAME_END(frame_zone);
 
 		if(uncapped_rendering || global.frameskip > 0 || global.is_replay_verification) {
 			continue;
@@ -10,6 +10,7 @@
 
 #include "config.h"
 #include "global.h"
+#include "profiler.h"
 #include "transition.h"
 #include "video.h"
 
@@ -515,5 +516,12 @@ static bool events_handler_hotkeys(SDL_Event *event, void *arg) {
 		return true;
 	}
 
+#ifdef TAISEI_BUILDCONF_PROFILER
+	if(scan == SDL_SCANCODE_F9) {
+		profiler_dump_trace();
+		return true;
+	}
+#endif
+
 	return false;
 }
@@ -188,6 +188,14 @@
  * protecting them from data races when used by multiple threads. This has some
  * impact on performance and memory usage, however.
  *
+ * ht_XXX_get() and ht_XXX_lookup() don't take the lock. They read the table
+ * optimistically and retry if a write happened in the meantime (a seqlock), so
+ * they never block behind a writer unless it keeps the table busy for a long time.
+ * To keep those readers safe, memory released by writers (old bucket arrays after a
+ * resize, keys of removed entries) is reclaimed in epochs: it is only freed once every
+ * optimistic read that could have seen it has finished. Reads that start later don't
+ * hold it back, so the retired memory stays bounded even if the table is never idle.
+ *
  * Some additional APIs are provided in this mode, as well as unsafe versions of
  * some of the core APIs. They are documented below.
  *
@@ -319,6 +327,13 @@ typedef struct HT_TYPE(iter) HT_TYPE(iter);
  */
 typedef struct HT_TYPE(element) HT_TYPE(element);
 
+#ifdef HT_THREAD_SAFE
+/*
+ * Forward declaration of the private struct for memory awaiting reclamation.
+ */
+typedef struct HT_TYPE(retired) HT_TYPE(retired);
+#endif
+
 /*
  * Definition for ht_XXX_key_list_t.
  */
@@ -344,6 +359,17 @@ struct HT_BASETYPE {
 		SDL_Condition *cond;
 		uint readers;
 		bool writing;
+
+		// Incremented at the start and end of every write, so it is odd while one is in progress.
+		SDL_AtomicInt seq;
+
+		// Optimistic reads in progress, counted by the parity of the epoch they started in.
+		// See reclaim_retired().
+		SDL_AtomicU32 epoch;
+		SDL_AtomicInt epoch_readers[2];
+
+		// Newest first
+		HT_TYPE(retired) *retired;
 	} sync;
 #endif
 };
@@ -700,6 +726,143 @@ struct HT_TYPE(element) {
 	hash_t hash;
 };
 
+#ifdef HT_THREAD_SAFE
+struct HT_TYPE(retired) {
+	HT_TYPE(retired) *next;
+	HT_TYPE(element) *elements;  // if NULL, this is a retired key
+	HT_TYPE(key) key;
+	uint32_t epoch;
+};
+
+HT_DECLARE_PRIV_FUNC(void, retire_elements, (HT_BASETYPE *ht, HT_TYPE(element) *elements)) {
+	ht->sync.retired = ALLOC(HT_TYPE(retired), {
+		.next = ht->sync.retired,
+		.elements = elements,
+		.epoch = SDL_GetAtomicU32(&ht->sync.epoch),
+	});
+}
+
+HT_DECLARE_PRIV_FUNC(void, retire_key, (HT_BASETYPE *ht, HT_TYPE(key) key)) {
+	ht->sync.retired = ALLOC(HT_TYPE(retired), {
+		.next = ht->sync.retired,
+		.key = key,
+		.epoch = SDL_GetAtomicU32(&ht->sync.epoch),
+	});
+}
+
+/*
+ * Frees everything retired in [epoch] or earlier. The list is ordered newest first, so that's
+ * always a tail of it.
+ */
+HT_DECLARE_PRIV_FUNC(void, free_retired, (HT_BASETYPE *ht, uint32_t epoch)) {
+	HT_TYPE(retired) **link = &ht->sync.retired;
+
+	while(*link && (int32_t)(epoch - (*link)->epoch) < 0) {
+		link = &(*link)->next;
+	}
+
+	for(HT_TYPE(retired) *r = *link, *next; r; r = next) {
+		next = r->next;
+
+		if(r->elements) {
+			mem_free(r->elements);
+		} else {
+			HT_FUNC_FREE_KEY(r->key);
+		}
+
+		mem_free(r);
+	}
+
+	*link = NULL;
+}
+
+HT_DECLARE_PRIV_FUNC(void, free_all_retired, (HT_BASETYPE *ht)) {
+	assert(SDL_GetAtomicInt(&ht->sync.epoch_readers[0]) == 0);
+	assert(SDL_GetAtomicInt(&ht->sync.epoch_readers[1]) == 0);
+	HT_PRIV_FUNC(free_retired)(ht, SDL_GetAtomicU32(&ht->sync.epoch));
+}
+
+/*
+ * Optimistic readers register in the current epoch, and may only be in the current or the
+ * previous one: the epoch is advanced from E to E+1 only once no readers of E-1 are left, and
+ * E+1 reuses their counter. A reader that registered after that check sees the new epoch when
+ * it re-reads it, and registers again (all of these are full barriers).
+ *
+ * After advancing to E+1, the remaining readers started in E or later, when the table no longer
+ * referenced anything retired in E-1. So that can be freed. Writers call this when they're done,
+ * so every write gives reclamation a chance to make progress, no matter how many new readers
+ * keep arriving; each of them only holds back the memory retired while it was running.
+ */
+HT_DECLARE_PRIV_FUNC(void, reclaim_retired, (HT_BASETYPE *ht)) {
+	// Two advances free everything, if the readers let us
+	for(int i = 0; i < 2 && ht->sync.retired; ++i) {
+		uint32_t epoch = SDL_GetAtomicU32(&ht->sync.epoch);
+
+		if(SDL_GetAtomicInt(&ht->sync.epoch_readers[(epoch - 1) & 1]) != 0) {
+			break;
+		}
+
+		SDL_SetAtomicU32(&ht->sync.epoch, epoch + 1);
+		HT_PRIV_FUNC(free_retired)(ht, epoch - 1);
+	}
+}
+
+HT_DECLARE_PRIV_FUNC(uint32_t, enter_epoch, (HT_BASETYPE *ht)) {
+	for(;;) {
+		uint32_t epoch = SDL_GetAtomicU32(&ht->sync.epoch);
+		SDL_AddAtomicInt(&ht->sync.epoch_readers[epoch & 1], 1);
+
+		if(SDL_GetAtomicU32(&ht->sync.epoch) == epoch) {
+			return epoch;
+		}
+
+		SDL_AddAtomicInt(&ht->sync.epoch_readers[epoch & 1], -1);
+	}
+}
+
+HT_DECLARE_PRIV_FUNC(void, leave_epoch, (HT_BASETYPE *ht, uint32_t epoch)) {
+	SDL_AddAtomicInt(&ht->sync.epoch_readers[epoch & 1], -1);
+}
+
+#define HT_RETIRE_KEY(ht, k) HT_PRIV_FUNC(retire_key)(ht, k)
+#define HT_RETIRE_ELEMENTS(ht, e) HT_PRIV_FUNC(retire_elements)(ht, e)
+#else
+#define HT_RETIRE_KEY(ht, k) HT_FUNC_FREE_KEY(k)
+#define HT_RETIRE_ELEMENTS(ht, e) mem_free(e)
+#endif
+
+/*
+ * Accesses to fields that optimistic readers share with the writer. All of them are naturally
+ * aligned scalars, so a reader never sees half of a store.
+ *
+ * The hash of a bucket is stored last, with release semantics, and loaded first, with acquire
+ * semantics. So a reader that sees a live hash also sees the key that was stored along with it,
+ * or one stored even later, but never an older one. Keys are only stored along with live
+ * hashes; buckets that become empty keep their old key. This matters because the key may be a
+ * pointer: everything a reader can see this way was still in the table after it entered its
+ * epoch, and is kept alive until it leaves (see reclaim_retired()).
+ */
+#ifdef HT_THREAD_SAFE
+#define HT_LOAD(optimistic, lval) ((optimistic) ? __atomic_load_n(&(lval), __ATOMIC_RELAXED) : (lval))
+#define HT_LOAD_HASH(optimistic, lval) ((optimistic) ? __atomic_load_n(&(lval), __ATOMIC_ACQUIRE) : (lval))
+#define HT_STORE(lval, val) __atomic_store_n(&(lval), (val), __ATOMIC_RELAXED)
+#define HT_STORE_HASH(lval, val) __atomic_store_n(&(lval), (val), __ATOMIC_RELEASE)
+#else
+#define HT_LOAD(optimistic, lval) (lval)
+#define HT_LOAD_HASH(optimistic, lval) (lval)
+#define HT_STORE(lval, val) ((lval) = (val))
+#define HT_STORE_HASH(lval, val) ((lval) = (val))
+#endif
+
+HT_DECLARE_PRIV_FUNC(void, store_element, (HT_TYPE(element) *dst, const HT_TYPE(element) *src)) {
+	if(src->hash & HT_HASH_LIVE_BIT) {
+		dst->value = src->value;
+		HT_STORE(dst->key, src->key);
+	}
+
+	HT_STORE_HASH(dst->hash, src->hash);
+}
+
 inline
 HT_DECLARE_PRIV_FUNC(ht_size_t, get_psl, (ht_size_t zero_idx, ht_size_t actual_idx, ht_size_t num_allocated)) {
 	// returns the probe sequence length from zero_idx to actual_idx
@@ -745,11 +908,18 @@ HT_DECLARE_PRIV_FUNC(void, begin_write, (HT_BASETYPE *ht)) {
 
 	ht->sync.writing = true;
 	SDL_UnlockMutex(ht->sync.mutex);
+
+	SDL_AddAtomicInt(&ht->sync.seq, 1);
 	#endif
 }
 
 HT_DECLARE_PRIV_FUNC(void, end_write, (HT_BASETYPE *ht)) {
 	#ifdef HT_THREAD_SAFE
+	// This is a full barrier, so optimistic readers that see the epoch advanced below can only
+	// observe the new state of the table, not the memory retired during this write.
+	SDL_AddAtomicInt(&ht->sync.seq, 1);
+	HT_PRIV_FUNC(reclaim_retired)(ht);
+
 	SDL_LockMutex(ht->sync.mutex);
 	ht->sync.writing = false;
 	SDL_BroadcastCondition(ht->sync.cond);
@@ -813,38 +983,55 @@ HT_DECLARE_FUNC(void, create, (HT_BASETYPE *ht)) {
 	ht->sync.readers = 0;
 	ht->sync.mutex = SDL_CreateMutex();
 	ht->sync.cond = SDL_CreateCondition();
+	SDL_SetAtomicInt(&ht->sync.seq, 0);
+	SDL_SetAtomicU32(&ht->sync.epoch, 0);
+	SDL_SetAtomicInt(&ht->sync.epoch_readers[0], 0);
+	SDL_SetAtomicInt(&ht->sync.epoch_readers[1], 0);
+	ht->sync.retired = NULL;
 	#endif
 }
 
 HT_DECLARE_FUNC(void, destroy, (HT_BASETYPE *ht)) {
 	HT_FUNC(unset_all)(ht);
 	#ifdef HT_THREAD_SAFE
+	HT_PRIV_FUNC(free_all_retired)(ht);
 	SDL_DestroyCondition(ht->sync.cond);
 	SDL_DestroyMutex(ht->sync.mutex);
 	#endif
 	mem_free(ht->elements);
 }
 
-HT_DECLARE_PRIV_FUNC(HT_TYPE(element)*, find_element, (HT_BASETYPE *ht, HT_TYPE(const_key) key, hash_t hash)) {
-	hash_t hash_mask = ht->hash_mask;
+/*
+ * If [optimistic] is true, the table may be modified concurrently. The result is garbage in that
+ * case and must be validated by the caller, but the search never reads out of bounds: the mask is
+ * loaded before the bucket array, and resize() publishes them in the opposite order, so the mask
+ * never exceeds the size of the array it's used with. The caller must be registered in an epoch
+ * (see enter_epoch()), so that old arrays and removed keys stay allocated.
+ */
+HT_DECLARE_PRIV_FUNC(HT_TYPE(element)*, find_element_ex, (HT_BASETYPE *ht, HT_TYPE(const_key) key, hash_t hash, bool optimistic)) {
+	hash_t hash_mask = HT_LOAD(optimistic, ht->hash_mask);
 	ht_size_t i = hash & hash_mask;
 	ht_size_t attr_unused zero_idx = i;
 	ht_size_t probe_len = 0;
-	ht_size_t max_probe_len = ht->max_psl;
+	ht_size_t max_probe_len = HT_LOAD(optimistic, ht->max_psl);
 	hash |= HT_HASH_LIVE_BIT;
 
-	HT_TYPE(element) *elements = ht->elements;
+	#ifdef HT_THREAD_SAFE
+	SDL_MemoryBarrierAcquire();
+	#endif
+
+	HT_TYPE(element) *elements = HT_LOAD(optimistic, ht->elements);
 
 	// log_debug("%p %08x [%"HT_KEY_FMT"]", (void*)ht, hash, HT_KEY_PRINTABLE(key));
 
 	for(;;) {
 		HT_TYPE(element) *e = elements + i;
-		hash_t e_hash = e->hash;
+		hash_t e_hash = HT_LOAD_HASH(optimistic, e->hash);
 		// log_debug("i=%u :: %08x", i, e_hash);
 
-		if(e_hash == hash && HT_FUNC_KEYS_EQUAL(key, e->key)) {
+		if(e_hash == hash && HT_FUNC_KEYS_EQUAL(key, HT_LOAD(optimistic, e->key))) {
 			// log_debug("found at %u (probe_len = %u)", i, probe_len);
-			assert(probe_len == HT_PRIV_FUNC(get_element_psl)(ht, e));
+			assert(optimistic || probe_len == HT_PRIV_FUNC(get_element_psl)(ht, e));
 			return e;
 		}
 
@@ -853,8 +1040,8 @@ HT_DECLARE_PRIV_FUNC(HT_TYPE(element)*, find_element, (HT_BASETYPE *ht, HT_TYPE(
 			return NULL;
 		}
 
-		ht_size_t e_probe_len = HT_PRIV_FUNC(get_element_psl)(ht, e);
-		assert(probe_len == HT_PRIV_FUNC(get_psl)(zero_idx, i, ht->num_elements_allocated));
+		ht_size_t e_probe_len = HT_PRIV_FUNC(get_psl)(e_hash & hash_mask, i, hash_mask + 1);
+		assert(optimistic || probe_len == HT_PRIV_FUNC(get_psl)(zero_idx, i, ht->num_elements_allocated));
 
 		if(probe_len > e_probe_len) {
 			// log_debug("[%"HT_KEY_FMT"] probe len at %u lower than current (%u < %u), bailing", HT_KEY_PRINTABLE(key), i, e_probe_len, probe_len);
@@ -870,9 +1057,63 @@ HT_DECLARE_PRIV_FUNC(HT_TYPE(element)*, find_element, (HT_BASETYPE *ht, HT_TYPE(
 	}
 }
 
+HT_DECLARE_PRIV_FUNC(HT_TYPE(element)*, find_element, (HT_BASETYPE *ht, HT_TYPE(const_key) key, hash_t hash)) {
+	return HT_PRIV_FUNC(find_element_ex)(ht, key, hash, false);
+}
+
+/*
+ * Looks up [key] without taking the lock. Returns false if it could not get a consistent
+ * snapshot because writers kept the table busy; the caller should fall back to a locked read.
+ */
+HT_DECLARE_PRIV_FUNC(bool, lookup_optimistic, (HT_BASETYPE *ht, HT_TYPE(const_key) key, hash_t hash, bool *out_found, HT_TYPE(value) *out_value)) {
+	#ifdef HT_THREAD_SAFE
+	const int max_attempts = 64;
+	bool done = false;
+
+	uint32_t epoch = HT_PRIV_FUNC(enter_epoch)(ht);
+
+	for(int attempt = 0; attempt < max_attempts; ++attempt) {
+		int seq = SDL_GetAtomicInt(&ht->sync.seq);
+
+		if(seq & 1) {
+			SDL_CPUPauseInstruction();
+			continue;
+		}
+
+		HT_TYPE(element) *e = HT_PRIV_FUNC(find_element_ex)(ht, key, hash, true);
+		HT_TYPE(value) value;
+
+		if(e) {
+			value = e->value;
+		}
+
+		SDL_MemoryBarrierAcquire();
+
+		if(SDL_GetAtomicInt(&ht->sync.seq) == seq) {
+			if((*out_found = (e != NULL))) {
+				*out_value = value;
+			}
+
+			done = true;
+			break;
+		}
+	}
+
+	HT_PRIV_FUNC(leave_epoch)(ht, epoch);
+	return done;
+	#else
+	return false;
+	#endif
+}
+
 HT_DECLARE_FUNC(HT_TYPE(value), get_prehashed, (HT_BASETYPE *ht, HT_TYPE(const_key) key, hash_t hash, HT_TYPE(value) fallback)) {
 	assert(hash == HT_FUNC_HASH_KEY(key));
 	HT_TYPE(value) value;
+	bool found;
+
+	if(HT_PRIV_FUNC(lookup_optimistic)(ht, key, hash, &found, &value)) {
+		return found ? value : fallback;
+	}
 
 	HT_PRIV_FUNC(begin_read)(ht);
 	HT_TYPE(element) *e = HT_PRIV_FUNC(find_element)(ht, key, hash);
@@ -893,6 +1134,15 @@ HT_DECLARE_FUNC(HT_TYPE(value), get_unsafe_prehashed, (HT_BASETYPE *ht, HT_TYPE(
 HT_DECLARE_FUNC(bool, lookup_prehashed, (HT_BASETYPE *ht, HT_TYPE(const_key) key, hash_t hash, HT_TYPE(value) *out_value)) {
 	assert(hash == HT_FUNC_HASH_KEY(key));
 	bool found = false;
+	HT_TYPE(value) value;
+
+	if(HT_PRIV_FUNC(lookup_optimistic)(ht, key, hash, &found, &value)) {
+		if(found && out_value != NULL) {
+			*out_value = value;
+		}
+
+		return found;
+	}
 
 	HT_PRIV_FUNC(begin_read)(ht);
 	HT_TYPE(element) *e = HT_PRIV_FUNC(find_element)(ht, key, hash);
@@ -931,8 +1181,8 @@ HT_DECLARE_PRIV_FUNC(void, unset_all, (HT_BASETYPE *ht)) {
 	for(ht_size_t i = 0; i < ht->num_elements_allocated; ++i) {
 		HT_TYPE(element) *e = ht->elements + i;
 		if(e->hash & HT_HASH_LIVE_BIT) {
-			HT_FUNC_FREE_KEY(e->key);
-			e->hash = 0;
+			HT_RETIRE_KEY(ht, e->key);
+			HT_STORE_HASH(e->hash, 0);
 
 			if(--ht->num_elements_occupied == 0) {
 				break;
@@ -951,7 +1201,7 @@ HT_DECLARE_PRIV_FUNC(void, unset_with_backshift, (HT_BASETYPE *ht, HT_TYPE(eleme
 	HT_TYPE(element) *elements = ht->elements;
 	hash_t hash_mask = ht->hash_mask;
 
-	HT_FUNC_FREE_KEY(e->key);
+	HT_RETIRE_KEY(ht, e->key);
 	--ht->num_elements_occupied;
 
 	ht_size_t idx = e - elements;
@@ -960,11 +1210,11 @@ HT_DECLARE_PRIV_FUNC(void, unset_with_backshift, (HT_BASETYPE *ht, HT_TYPE(eleme
 		HT_TYPE(element) *next_e = elements + idx;
 
 		if(HT_PRIV_FUNC(get_element_psl)(ht, next_e) < 1) {
-			e->hash = 0;
+			HT_STORE_HASH(e->hash, 0);
 			return;
 		}
 
-		*e = *next_e;
+		HT_PRIV_FUNC(store_element)(e, next_e);
 		e = next_e;
 	}
 }
@@ -1029,7 +1279,7 @@ HT_DECLARE_PRIV_FUNC(HT_TYPE(element)*, insert, (
 		e = elements + idx;
 
 		if(!(e->hash & HT_HASH_LIVE_BIT)) {
-			*e = *insertion_elem;
+			HT_PRIV_FUNC(store_element)(e, insertion_elem);
 			if(target == NULL) {
 				target = e;
 			}
@@ -1048,7 +1298,7 @@ HT_DECLARE_PRIV_FUNC(HT_TYPE(element)*, insert, (
 		if(e_probe_len < i_probe_len) {
 			// log_debug("SWAP %u (%u < %u)", idx, e_probe_len, i_probe_len);
 			temp_elem = *e;
-			*e = *insertion_elem;
+			HT_PRIV_FUNC(store_element)(e, insertion_elem);
 			if(target == NULL) {
 				target = e;
 			}
@@ -1116,6 +1366,7 @@ HT_DECLARE_PRIV_FUNC(bool, set, (
 	insertion_elem.value = value;
 	HT_FUNC_COPY_KEY(&insertion_elem.key, key);
 	insertion_elem.hash = hash | HT_HASH_LIVE_BIT;
+
 	e = HT_PRIV_FUNC(insert)(&insertion_elem, ht->elements, ht->hash_mask, &ht->max_psl);
 	assume(e != NULL);
 
@@ -1155,15 +1406,24 @@ HT_DECLARE_PRIV_FUNC(void, resize, (HT_BASETYPE *ht, size_t new_size)) {
 	for(ht_size_t i = 0; i < old_size; ++i) {
 		HT_TYPE(element) *e = old_elements + i;
 		if(e->hash & HT_HASH_LIVE_BIT) {
-			HT_PRIV_FUNC(insert)(e, new_elements, new_size - 1, &ht->max_psl);
+			// insert() clobbers the element; don't let optimistic readers see that.
+			HT_TYPE(element) insertion_elem = *e;
+			HT_PRIV_FUNC(insert)(&insertion_elem, new_elements, new_size - 1, &ht->max_psl);
 		}
 	}
 
-	ht->elements = new_elements;
+	// See find_element_ex() for why the order matters here.
+	#ifdef HT_THREAD_SAFE
+	SDL_MemoryBarrierRelease();
+	#endif
+	HT_STORE(ht->elements, new_elements);
 	ht->num_elements_allocated = new_size;
-	ht->hash_mask = new_size - 1;
+	#ifdef HT_THREAD_SAFE
+	SDL_MemoryBarrierRelease();
+	#endif
+	HT_STORE(ht->hash_mask, new_size - 1);
 
-	mem_free(old_elements);
+	HT_RETIRE_ELEMENTS(ht, old_elements);
 
 	/*
 	log_debug(
@@ -1330,10 +1590,16 @@ HT_DECLARE_FUNC(void, iter_end, (HT_TYPE(iter) *iter)) {
 #undef HT_IMPL
 #undef HT_KEY_CONST
 #undef HT_KEY_TYPE
+#undef HT_LOAD
+#undef HT_LOAD_HASH
 #undef HT_MIN_SIZE
 #undef HT_NAME
 #undef HT_PRIV_FUNC
 #undef HT_PRIV_NAME
+#undef HT_RETIRE_ELEMENTS
+#undef HT_RETIRE_KEY
+#undef HT_STORE
+#undef HT_STORE_HASH
 #undef HT_SUFFIX
 #undef HT_THREAD_SAFE
 #undef HT_TYPE
@@ -19,18 +19,18 @@
 // distance to begin attracting the item towards the player.
 #define ITEM_GRAB_RADIUS 10
 
-static const char *item_sprite_name(ItemType type) {
-	static const char *const map[] = {
-		[ITEM_BOMB          - ITEM_FIRST] = "item/bomb",
-		[ITEM_BOMB_FRAGMENT - ITEM_FIRST] = "item/bombfrag",
-		[ITEM_LIFE          - ITEM_FIRST] = "item/life",
-		[ITEM_LIFE_FRAGMENT - ITEM_FIRST] = "item/lifefrag",
-		[ITEM_PIV           - ITEM_FIRST] = "item/bullet_point",
-		[ITEM_POINTS        - ITEM_FIRST] = "item/point",
-		[ITEM_POWER         - ITEM_FIRST] = "item/power",
-		[ITEM_POWER_MINI    - ITEM_FIRST] = "item/minipower",
-		[ITEM_SURGE         - ITEM_FIRST] = "item/surge",
-		[ITEM_VOLTAGE       - ITEM_FIRST] = "item/voltage",
+static SpriteID item_sprite_id(ItemType type) {
+	static const SpriteID map[] = {
+		[ITEM_BOMB          - ITEM_FIRST] = RID_SPRITE_item_bomb,
+		[ITEM_BOMB_FRAGMENT - ITEM_FIRST] = RID_SPRITE_item_bombfrag,
+		[ITEM_LIFE          - ITEM_FIRST] = RID_SPRITE_item_life,
+		[ITEM_LIFE_FRAGMENT - ITEM_FIRST] = RID_SPRITE_item_lifefrag,
+		[ITEM_PIV           - ITEM_FIRST] = RID_SPRITE_item_bullet_point,
+		[ITEM_POINTS        - ITEM_FIRST] = RID_SPRITE_item_point,
+		[ITEM_POWER         - ITEM_FIRST] = RID_SPRITE_item_power,
+		[ITEM_POWER_MINI    - ITEM_FIRST] = RID_SPRITE_item_minipower,
+		[ITEM_SURGE         - ITEM_FIRST] = RID_SPRITE_item_surge,
+		[ITEM_VOLTAGE       - ITEM_FIRST] = RID_SPRITE_item_voltage,
 	};
 
 	uint index = type - 1;
@@ -39,18 +39,19 @@ static const char *item_sprite_name(ItemType type) {
 	return map[index];
 }
 
-static const char *item_indicator_sprite_name(ItemType type) {
-	static const char *const map[] = {
-		[ITEM_BOMB          - ITEM_FIRST] = "item/bomb_indicator",
-		[ITEM_BOMB_FRAGMENT - ITEM_FIRST] = "item/bombfrag_indicator",
-		[ITEM_LIFE          - ITEM_FIRST] = "item/life_indicator",
-		[ITEM_LIFE_FRAGMENT - ITEM_FIRST] = "item/lifefrag_indicator",
-		[ITEM_PIV           - ITEM_FIRST] = NULL,
-		[ITEM_POINTS        - ITEM_FIRST] = "item/point_indicator",
-		[ITEM_POWER         - ITEM_FIRST] = "item/power_indicator",
-		[ITEM_POWER_MINI    - ITEM_FIRST] = NULL,
-		[ITEM_SURGE         - ITEM_FIRST] = NULL,
-		[ITEM_VOLTAGE       - ITEM_FIRST] = "item/voltage_indicator",
+// Returns NUM_SPRITE_IDS for items without an indicator
+static SpriteID item_indicator_sprite_id(ItemType type) {
+	static const SpriteID map[] = {
+		[ITEM_BOMB          - ITEM_FIRST] = RID_SPRITE_item_bomb_indicator,
+		[ITEM_BOMB_FRAGMENT - ITEM_FIRST] = RID_SPRITE_item_bombfrag_indicator,
+		[ITEM_LIFE          - ITEM_FIRST] = RID_SPRITE_item_life_indicator,
+		[ITEM_LIFE_FRAGMENT - ITEM_FIRST] = RID_SPRITE_item_lifefrag_indicator,
+		[ITEM_PIV           - ITEM_FIRST] = NUM_SPRITE_IDS,
+		[ITEM_POINTS        - ITEM_FIRST] = RID_SPRITE_item_point_indicator,
+		[ITEM_POWER         - ITEM_FIRST] = RID_SPRITE_item_power_indicator,
+		[ITEM_POWER_MINI    - ITEM_FIRST] = NUM_SPRITE_IDS,
+		[ITEM_SURGE         - ITEM_FIRST] = NUM_SPRITE_IDS,
+		[ITEM_VOLTAGE       - ITEM_FIRST] = RID_SPRITE_item_voltage_indicator,
 	};
 
 	uint index = type - 1;
@@ -60,15 +61,15 @@ static const char *item_indicator_sprite_name(ItemType type) {
 }
 
 static Sprite *item_sprite(ItemType type) {
-	return res_sprite(item_sprite_name(type));
+	return res_sprite_by_id(item_sprite_id(type));
 }
 
 static Sprite *item_indicator_sprite(ItemType type) {
-	const char *name = item_indicator_sprite_name(type);
-	if(name == NULL) {
+	SpriteID id = item_indicator_sprite_id(type);
+	if(id == NUM_SPRITE_IDS) {
 		return NULL;
 	}
-	return res_sprite(name);
+	return res_sprite_by_id(id);
 }
 
 void item_set_type(Item *item, ItemType type) {
@@ -93,7 +94,7 @@ static void ent_draw_item(EntityInterface *ent) {
 	float y = im(i->pos);
 
 	ShaderCustomParams shader_params = { 1.0f };
-	ShaderProgram *shader = res_shader("sprite_particle");
+	ShaderProgram *shader = res_shader_by_id(RID_SHPROG_sprite_particle);
 
 	if(y < 0) {
 		Sprite *s = i->sprites.indicator;
@@ -169,7 +170,7 @@ Item *create_clear_item(cmplx pos, uint clear_flags) {
 
 	if(i) {
 		PARTICLE(
-			.sprite = "flare",
+			.sprite_ptr = res_sprite_by_id(RID_SPRITE_part_flare),
 			.pos = pos,
 			.timeout = 30,
 			.draw_rule = pdraw_timeout_fade(1, 0),
@@ -327,30 +328,30 @@ void process_items(void) {
 				player_add_power(&global.plr, POWER_VALUE);
 				player_add_points(&global.plr, 25, item->pos);
 				player_extend_powersurge(&global.plr, PLR_POWERSURGE_POSITIVE_GAIN*3, PLR_POWERSURGE_NEGATIVE_GAIN*3);
-				play_sfx("item_generic");
+				play_sfx_by_id(RID_SFX_item_generic);
 				break;
 			case ITEM_POWER_MINI:
 				player_add_power(&global.plr, POWER_VALUE_MINI);
 				player_add_points(&global.plr, 5, item->pos);
-				play_sfx("item_generic");
+				play_sfx_by_id(RID_SFX_item_generic);
 				break;
 			case ITEM_SURGE:
 				player_extend_powersurge(&global.plr, PLR_POWERSURGE_POSITIVE_GAIN, PLR_POWERSURGE_NEGATIVE_GAIN);
 				player_add_points(&global.plr, 25, item->pos);
-				play_sfx("item_generic");
+				play_sfx_by_id(RID_SFX_item_generic);
 				break;
 			case ITEM_POINTS:
 				player_add_points(&global.plr, round(global.plr.point_item_value * item->pickup_value), item->pos);
-				play_sfx("item_generic");
+				play_sfx_by_id(RID_SFX_item_generic);
 				break;
 			case ITEM_PIV:
 				player_add_piv(&global.plr, 1, item->pos);
-				play_sfx("item_generic");
+				play_sfx_by_id(RID_SFX_item_generic);
 				break;
 			case ITEM_VOLTAGE:
 				player_add_voltage(&global.plr, 1);
 				player_add_piv(&global.plr, 10, item->pos);
-				play_sfx("item_generic");
+				play_sfx_by_id(RID_SFX_item_generic);
 				break;
 			case ITEM_LIFE:
 				player_add_lives(&global.plr, 1);
@@ -417,10 +418,10 @@ void spawn_and_collect_items(cmplx pos, float collect_value, SpawnItemsArgs grou
 
 void items_preload(ResourceGroup *rg) {
 	for(ItemType i = ITEM_FIRST; i <= ITEM_LAST; ++i) {
-		res_group_preload(rg, RES_SPRITE, 0, item_sprite_name(i), NULL);
-		const char *indicator = item_indicator_sprite_name(i);
-		if(indicator != NULL) {
-			res_group_preload(rg, RES_SPRITE, 0, indicator, NULL);
+		res_group_preload(rg, RES_SPRITE, 0, res_id_name(RES_SPRITE, item_sprite_id(i)), NULL);
+		SpriteID indicator = item_indicator_sprite_id(i);
+		if(indicator != NUM_SPRITE_IDS) {
+			res_group_preload(rg, RES_SPRITE, 0, res_id_name(RES_SPRITE, indicator), NULL);
 		}
 	}
 
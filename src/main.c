@@ -7,6 +7,7 @@
  */
 
 #include "audio/audio.h"
+#include "benchmark.h"
 #include "cli.h"
 #include "coroutine/coroutine.h"
 #include "credits.h"
@@ -19,12 +20,14 @@
 #include "log.h"
 #include "menu/mainmenu.h"
 #include "menu/savereplay.h"
+#include "profiler.h"
 #include "progress.h"
 #include "renderer/common/models.h"
 #include "renderer/common/sprite_batch.h"
 #include "replay/demoplayer.h"
 #include "replay/struct.h"
 #include "replay/tsrtool.h"
+#include "replay/verify.h"
 #include "rwops/rwops_stdiofp.h"
 #include "stage.h"
 #include "stageobjects.h"
@@ -72,6 +75,7 @@ static void taisei_shutdown(void) {
 	stage_objpools_shutdown();
 	gamemode_shutdown();
 	taskmgr_global_shutdown();
+	profiler_shutdown();
 	audio_shutdown();
 	r_models_shutdown();
 	r_sprite_batch_shutdown();
@@ -245,6 +249,7 @@ typedef struct MainContext {
 	Replay *replay_in;
 	Replay *replay_out;
 	SDL_IOStream *replay_out_stream;
+	ReplayVerifyBatch *replay_batch;
 	ResourceGroup rg;
 	int replay_idx;
 	uchar headless : 1;
@@ -255,6 +260,7 @@ static void main_post_vfsinit(CallChainResult ccr);
 static void main_mainmenu(CallChainResult ccr);
 static void main_singlestg(MainContext *mctx) attr_unused;
 static void main_replay(MainContext *mctx);
+static void main_replay_batch(MainContext *mctx);
 static noreturn void main_vfstree(CallChainResult ccr);
 
 static void cleanup_replay(Replay **rpy) {
@@ -274,6 +280,7 @@ static noreturn void main_quit(MainContext *ctx, int status) {
 	free_cli_action(&ctx->cli);
 
 	cleanup_replay(&ctx->replay_in);
+	replay_verify_batch_free(ctx->replay_batch);
 
 	if(ctx->replay_out_stream) {
 		if(ctx->replay_out) {
@@ -367,6 +374,29 @@ int main(int argc, char **argv) {
 
 			ctx->replay_out = alloc_replay();
 		}
+	} else if(ctx->cli.type == CLI_VerifyReplayBatch || ctx->cli.type == CLI_Benchmark) {
+		ctx->replay_batch = replay_verify_batch_new(
+			ctx->cli.filename, ctx->cli.batch_shard_index, ctx->cli.batch_shard_count);
+
+		if(!ctx->replay_batch) {
+			main_quit(ctx, 1);
+		}
+
+		if(ctx->cli.type == CLI_VerifyReplayBatch && ctx->cli.batch_shard_count == 0) {
+			int jobs = ctx->cli.jobs ? ctx->cli.jobs : SDL_GetNumLogicalCPUCores();
+
+			if(jobs > 1) {
+				int status = replay_verify_batch_spawn_workers(ctx->replay_batch, argc, argv, jobs);
+
+				if(status >= 0) {
+					main_quit(ctx, status);
+				}
+
+				log_warn("Couldn't spawn worker processes, verifying replays in this process");
+			}
+		}
+
+		ctx->headless = true;
 	} else if(ctx->cli.type == CLI_DumpVFSTree) {
 		vfs_setup(CALLCHAIN(main_vfstree, ctx));
 		return 0; // NO main_quit here! vfs_setup may be asynchronous.
@@ -379,6 +409,20 @@ int main(int argc, char **argv) {
 	return 0;
 }
 
+static void main_preload_shaders(MainContext *ctx) {
+	log_info("Loading all shaders now due to TAISEI_PRELOAD_SHADERS");
+
+	// Shader objects are preprocessed, compiled and transpiled on the task manager threads;
+	// only the final backend compile and link land back on this thread via the event loop.
+	res_group_preload_all(&ctx->rg, RES_SHADER_PROGRAM, RESF_DEFAULT);
+
+	hrtime_t start_time = time_get();
+	draw_loading_screen_until_loaded(&ctx->rg, "Compiling shaders");
+
+	log_info("All shader programs loaded in %.3f ms",
+		(time_get() - start_time) / (HRTIME_RESOLUTION / 1e3));
+}
+
 static void main_post_vfsinit(CallChainResult ccr) {
 	MainContext *ctx = ccr.ctx;
 
@@ -403,6 +447,7 @@ static void main_post_vfsinit(CallChainResult ccr) {
 	taskmgr_global_init();
 	gamemode_init();
 	time_init();
+	profiler_init();
 	init_global(&ctx->cli);
 	events_init();
 
@@ -432,7 +477,13 @@ static void main_post_vfsinit(CallChainResult ccr) {
 
 	audio_init();
 	res_post_init();
+
+	if(env_get("TAISEI_PRELOAD_SHADERS", 0)) {
+		main_preload_shaders(ctx);
+	}
+
 	menu_preload(&ctx->rg);
+	draw_loading_screen_until_loaded(&ctx->rg, "Loading");
 	gamepad_init();
 	progress_load();
 
@@ -464,6 +515,11 @@ static void main_post_vfsinit(CallChainResult ccr) {
 		return;
 	}
 
+	if(ctx->cli.type == CLI_VerifyReplayBatch || ctx->cli.type == CLI_Benchmark) {
+		main_replay_batch(ctx);
+		return;
+	}
+
 	if(ctx->cli.type == CLI_Credits) {
 		credits_enter(cc_cleanup);
 		eventloop_run();
@@ -594,6 +650,30 @@ static void main_replay(MainContext *mctx) {
 	eventloop_run();
 }
 
+static void main_replay_batch_done(CallChainResult ccr) {
+	MainContext *mctx = ccr.ctx;
+	int num_failed = (intptr_t)ccr.result;
+
+	if(mctx->cli.type == CLI_Benchmark) {
+		benchmark_report();
+		benchmark_shutdown();
+	}
+
+	main_quit(mctx, num_failed > 0);
+}
+
+static void main_replay_batch(MainContext *mctx) {
+	ReplayVerifyBatch *batch = mctx->replay_batch;
+	mctx->replay_batch = NULL;
+
+	if(mctx->cli.type == CLI_Benchmark) {
+		benchmark_init();
+	}
+
+	replay_verify_batch_run(batch, CALLCHAIN(main_replay_batch_done, mctx));
+	eventloop_run();
+}
+
 static void main_vfstree(CallChainResult ccr) {
 	MainContext *mctx = ccr.ctx;
 	SDL_IOStream *rwops = SDL_RWFromFP(stdout, false);
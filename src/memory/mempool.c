@@ -35,3 +35,24 @@ void mempool_generic_release(MemPool *pool, void *object) {
 	assert(pool->num_used + 1 > pool->num_used);
 	assert(pool->num_used <= pool->num_allocated);
 }
+
+void mempool_generic_reserve(MemPool *pool, MemArena *arena, size_t size, size_t align, uint num) {
+	uint num_free = pool->num_allocated - pool->num_used;
+
+	if(num_free >= num) {
+		return;
+	}
+
+	uint num_new = num - num_free;
+	size = (size + align - 1) & ~(align - 1);
+	char *block = marena_alloc_array_aligned(arena, num_new, size, align);
+
+	// Link in address order, so that the batch is handed out sequentially.
+	for(uint i = num_new; i--;) {
+		MemPoolObjectHeader *obj = (MemPoolObjectHeader*)(block + i * size);
+		obj->next = pool->free_objects.as_generic;
+		pool->free_objects.as_generic = obj;
+	}
+
+	pool->num_allocated += num_new;
+}
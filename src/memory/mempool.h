@@ -54,6 +54,11 @@ void *mempool_generic_acquire(MemPool *pool, MemArena *arena, size_t size, size_
 void mempool_generic_release(MemPool *pool, void *object)
 	attr_hot attr_nonnull(1, 2);
 
+// Makes sure at least `num` objects can be acquired without going to the arena,
+// allocating the missing ones as a single contiguous block.
+void mempool_generic_reserve(MemPool *pool, MemArena *arena, size_t size, size_t align, uint num)
+	attr_nonnull(1, 2);
+
 #define mempool_acquire(mpool, arena) ({ \
 	auto _mpool = mpool; \
 	MEMPOOL_OBJTYPE(_mpool) *_obj = mempool_generic_acquire(\
@@ -65,6 +70,16 @@ void mempool_generic_release(MemPool *pool, void *object)
 	_obj; \
 })
 
+#define mempool_reserve(mpool, arena, num) ({ \
+	auto _mpool = mpool; \
+	mempool_generic_reserve( \
+		MEMPOOL_CAST_TO_BASE(_mpool), \
+		(arena), \
+		sizeof(MEMPOOL_OBJTYPE(_mpool)), \
+		alignof(MEMPOOL_OBJTYPE(_mpool)), \
+		(num)); \
+})
+
 #define mempool_release(mpool, obj) ({ \
 	static_assert( \
 		__builtin_types_compatible_p(typeof(*(obj)), MEMPOOL_OBJTYPE(mpool))); \
@@ -16,6 +16,7 @@
 #include "audio/audio.h"
 #include "events.h"
 #include "global.h"
+#include "renderer/common/shaderlib/cache.h"
 #include "resource/font.h"
 #include "util/graphics.h"
 #include "version.h"
@@ -244,7 +245,7 @@ void draw_main_menu(MenuData *menu) {
 	r_state_pop();
 }
 
-void draw_loading_screen(void) {
+void draw_loading_screen_progress(const char *status) {
 	ResourceGroup rg;
 	res_group_init(&rg);
 	res_group_preload(&rg, RES_TEXTURE, RESF_DEFAULT, "loading", NULL);
@@ -260,10 +261,47 @@ void draw_loading_screen(void) {
 		.color = RGBA(0.35, 0.35, 0.35, 0.35),
 	});
 
+	if(status) {
+		text_draw(status, &(TextParams) {
+			.align = ALIGN_CENTER,
+			.pos = { SCREEN_W/2, SCREEN_H-40 },
+			.font = "small",
+			.shader_ptr = res_shader("text_default"),
+			.color = RGBA(0.35, 0.35, 0.35, 0.35),
+		});
+	}
+
 	video_swap_buffers();
 	res_group_release(&rg);
 }
 
+void draw_loading_screen(void) {
+	draw_loading_screen_progress(NULL);
+}
+
+void draw_loading_screen_until_loaded(ResourceGroup *rg, const char *what) {
+	if(global.is_headless) {
+		// Nothing to look at; whatever is still loading will be waited for on first use.
+		return;
+	}
+
+	uint num_done, num_total;
+	res_group_get_progress(rg, &num_done, &num_total);
+
+	while(num_done < num_total) {
+		events_poll(NULL, 0);
+
+		char status[64];
+		snprintf(status, sizeof(status), "%s: %u / %u", what, num_done, num_total);
+		draw_loading_screen_progress(status);
+
+		res_group_get_progress(rg, &num_done, &num_total);
+	}
+
+	// Persist whatever got compiled along the way, so that a crash later doesn't lose it.
+	shader_cache_flush();
+}
+
 void menu_preload(ResourceGroup *rg) {
 	difficulty_preload(rg);
 
@@ -17,4 +17,8 @@ void draw_main_menu_bg(MenuData *m, double center_x, double center_y, double R,
 void draw_main_menu(MenuData *m);
 void main_menu_update_practice_menus(void);
 void draw_loading_screen(void);
+void draw_loading_screen_progress(const char *status);
+
+// Keeps drawing the loading screen with a progress counter until everything in rg is loaded.
+void draw_loading_screen_until_loaded(ResourceGroup *rg, const char *what);
 void menu_preload(ResourceGroup *rg);
@@ -1096,6 +1096,16 @@ static MenuData* create_options_menu_controls(MenuData *parent) {
 		bind_keybinding(CONFIG_KEY_QUICKLOAD)
 	);
 
+	add_menu_separator(m);
+
+	add_menu_entry(m, "Replay: seek backward", do_nothing,
+		bind_keybinding(CONFIG_KEY_REPLAY_SEEK_BACK)
+	);
+
+	add_menu_entry(m, "Replay: seek forward", do_nothing,
+		bind_keybinding(CONFIG_KEY_REPLAY_SEEK_FWD)
+	);
+
 #ifdef DEBUG
 	add_menu_separator(m);
 
@@ -82,7 +82,7 @@ static void start_replay(MenuData *menu, void *arg) {
 
 	Replay *rpy = ictx->replay;
 
-	if(!replay_load(rpy, ictx->replayname, REPLAY_READ_EVENTS)) {
+	if(!replay_load(rpy, ictx->replayname, REPLAY_READ_EVENTS | REPLAY_READ_EVENTS_LAZY)) {
 		replayview_set_submenu(menu, replayview_sub_messagebox(menu, "Failed to load replay events"));
 		return;
 	}
@@ -130,7 +130,7 @@ bool player_set_power(Player *plr, short npow) {
 	plr->power_stored = new_stored;
 
 	if(old_stored / 100 < new_stored / 100) {
-		play_sfx("powerup");
+		play_sfx_by_id(RID_SFX_powerup);
 	}
 
 	bool change = old_stored != new_stored;
@@ -224,7 +224,7 @@ void player_draw_overlay(Player *plr) {
 	float spell_x = 128 * (1 - powf(1 - spell_in, 5)) + (VIEWPORT_W + 256) * powf(1 - spell_in, 3);
 	float spell_y = VIEWPORT_H - 128 * sqrtf(a);
 
-	Sprite *spell_spr = res_sprite("spell");
+	Sprite *spell_spr = res_sprite_by_id(RID_SPRITE_spell);
 
 	r_draw_sprite(&(SpriteParams) {
 		.sprite_ptr = spell_spr,
@@ -262,11 +262,11 @@ static void ent_draw_player(EntityInterface *ent) {
 	}
 
 	ShaderCustomParams shader_params = { 1.0f };
-	ShaderProgram *shader = res_shader("sprite_particle");
+	ShaderProgram *shader = res_shader_by_id(RID_SHPROG_sprite_particle);
 
 	if(plr->focus_circle_alpha) {
 		r_draw_sprite(&(SpriteParams) {
-			.sprite_ptr = res_sprite("fairy_circle"),
+			.sprite_ptr = res_sprite_by_id(RID_SPRITE_fairy_circle),
 			.shader_ptr = shader,
 			.shader_params = &shader_params,
 			.rotation.angle = DEG2RAD * global.frames * 10,
@@ -387,7 +387,7 @@ DEFINE_TASK(player_indicators) {
 	indicators->plr = TASK_BIND(ARGS.plr);
 	indicators->ent.draw_layer = LAYER_PLAYER_FOCUS;
 	indicators->ent.draw_func = player_draw_indicators;
-	indicators->sprites.focus = res_sprite("focus");
+	indicators->sprites.focus = res_sprite_by_id(RID_SPRITE_focus);
 
 	Player *plr = indicators->plr;
 
@@ -487,8 +487,8 @@ TASK(powersurge_player_particles, { BoxedPlayer plr; }) {
 	DECLARE_ENT_ARRAY(Projectile, trails, 32);
 	DECLARE_ENT_ARRAY(Projectile, fields, 4);
 
-	ShaderProgram *trail_shader = res_shader("sprite_silhouette");
-	Sprite *field_sprite = res_sprite("part/powersurge_field");
+	ShaderProgram *trail_shader = res_shader_by_id(RID_SHPROG_sprite_silhouette);
+	Sprite *field_sprite = res_sprite_by_id(RID_SPRITE_part_powersurge_field);
 
 	for(int t = 0; player_is_powersurge_active(plr); ++t, YIELD) {
 		ENT_ARRAY_COMPACT(&trails);
@@ -724,7 +724,7 @@ static bool player_powersurge(Player *plr) {
 	player_powersurge_calc_bonus(plr, &plr->powersurge.bonus);
 	player_add_power(plr, -PLR_POWERSURGE_POWERCOST);
 
-	play_sfx("powersurge_start");
+	play_sfx_by_id(RID_SFX_powersurge_start);
 
 	collect_all_items(1);
 	stagetext_add("Power Surge!", plr->pos - 64 * I, ALIGN_CENTER, res_font("standard"), RGBA(0.75, 0.75, 0.75, 0.75), 0, 45, 10, 20);
@@ -796,10 +796,10 @@ static void player_powersurge_expired(Player *plr) {
 	PowerSurgeBonus bonus;
 	player_powersurge_calc_bonus(plr, &bonus);
 
-	Sprite *blast = res_sprite("part/blast_huge_halo");
+	Sprite *blast = res_sprite_by_id(RID_SPRITE_part_blast_huge_halo);
 	float scale = 2 * bonus.discharge_range / blast->w;
 
-	play_sfx("powersurge_end");
+	play_sfx_by_id(RID_SFX_powersurge_end);
 
 	PARTICLE(
 		.size = 1+I,
@@ -965,12 +965,12 @@ void player_death(Player *plr) {
 		return;
 	}
 
-	play_sfx("death");
+	play_sfx_by_id(RID_SFX_death);
 
 	for(int i = 0; i < 60; i++) {
 		RNG_ARRAY(R, 2);
 		PARTICLE(
-			.sprite = "flare",
+			.sprite_ptr = res_sprite_by_id(RID_SPRITE_part_flare),
 			.pos = plr->pos,
 			.timeout = 40,
 			.draw_rule = pdraw_timeout_scale(2, 0.01),
@@ -982,7 +982,7 @@ void player_death(Player *plr) {
 	stage_clear_hazards(CLEAR_HAZARDS_ALL);
 
 	PARTICLE(
-		.sprite = "blast",
+		.sprite_ptr = res_sprite_by_id(RID_SPRITE_part_blast),
 		.pos = plr->pos,
 		.color = RGBA(0.5, 0.15, 0.15, 0),
 		.timeout = 35,
@@ -1398,7 +1398,7 @@ void player_graze(Player *plr, cmplx pos, int pts, int effect_intensity, const C
 	pos = (pos + plr->pos) * 0.5;
 
 	player_add_points(plr, pts, pos);
-	play_sfx("graze");
+	play_sfx_by_id(RID_SFX_graze);
 
 	Color *c = COLOR_COPY(color);
 	color_add(c, RGBA(1, 1, 1, 1));
@@ -1408,7 +1408,7 @@ void player_graze(Player *plr, cmplx pos, int pts, int effect_intensity, const C
 	for(int i = 0; i < effect_intensity; ++i) {
 		RNG_ARRAY(R, 4);
 		PARTICLE(
-			.sprite = "graze",
+			.sprite_ptr = res_sprite_by_id(RID_SPRITE_part_graze),
 			.color = c,
 			.pos = pos,
 			.draw_rule = pdraw_timeout_scalefade_exp(1, 0, 1, 0, 2),
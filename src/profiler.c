@@ -0,0 +1,234 @@
+/*
+ * This software is licensed under the terms of the MIT License.
+ * See COPYING for further information.
+ * ---
+ * Copyright (c) 2011-2024, Lukas Weber <laochailan@web.de>.
+ * Copyright (c) 2012-2024, Andrei Alexeyev <akari@taisei-project.org>.
+ */
+
+#include "profiler.h"
+
+#include "dynarray.h"
+#include "log.h"
+#include "thread.h"
+#include "util/env.h"
+#include "util/miscmath.h"
+#include "util/strbuf.h"
+#include "util/stringops.h"
+#include "util/systime.h"
+#include "vfs/public.h"
+
+// Number of zones kept per thread; must be a power of two.
+#define PROFILER_RING_SIZE (1 << 16)
+
+// Minimum time between automatic dumps triggered by frame spikes.
+#define PROFILER_SPIKE_DUMP_COOLDOWN (HRTIME_RESOLUTION * 5)
+
+typedef struct ProfileEvent {
+	const char *name;
+	const char *category;
+	hrtime_t start;
+	hrtime_t end;
+} ProfileEvent;
+
+typedef struct ProfileThread {
+	SDL_SpinLock lock;
+	uint id;
+	char name[32];
+	uint64_t num_written;
+	ProfileEvent events[PROFILER_RING_SIZE];
+} ProfileThread;
+
+static struct {
+	DYNAMIC_ARRAY(ProfileThread*) threads;
+	SDL_SpinLock threads_lock;
+	SDL_TLSID tls;
+	SDL_AtomicInt enabled;
+	hrtime_t base_time;
+	hrtime_t spike_threshold;
+	hrtime_t last_dump_time;
+} profiler;
+
+void profiler_init(void) {
+	profiler.base_time = time_get();
+	profiler.spike_threshold = env_get("TAISEI_PROFILER_SPIKE_MS", 0) * (HRTIME_RESOLUTION / 1000);
+	SDL_SetAtomicInt(&profiler.enabled, 1);
+
+	if(profiler.spike_threshold) {
+		log_info("Profiler enabled, dumping traces on frames longer than %"PRIuTIME" ms",
+			(hrtime_t)(profiler.spike_threshold / (HRTIME_RESOLUTION / 1000)));
+	} else {
+		log_info("Profiler enabled");
+	}
+}
+
+void profiler_shutdown(void) {
+	// Must be called after all other threads have stopped
+	SDL_SetAtomicInt(&profiler.enabled, 0);
+	SDL_SetTLS(&profiler.tls, NULL, NULL);
+
+	dynarray_foreach_elem(&profiler.threads, ProfileThread **t, {
+		mem_free(*t);
+	});
+
+	dynarray_free_data(&profiler.threads);
+}
+
+static ProfileThread *get_thread(void) {
+	ProfileThread *t = SDL_GetTLS(&profiler.tls);
+
+	if(LIKELY(t)) {
+		return t;
+	}
+
+	t = ALLOC(ProfileThread);
+
+	Thread *managed = thread_get_current();
+	const char *name = managed ? thread_get_name(managed) : (thread_current_is_main() ? "main" : "foreign");
+	strlcpy(t->name, name, sizeof(t->name));
+
+	SDL_LockSpinlock(&profiler.threads_lock);
+	t->id = profiler.threads.num_elements + 1;
+	dynarray_append(&profiler.threads, t);
+	SDL_UnlockSpinlock(&profiler.threads_lock);
+
+	if(!SDL_SetTLS(&profiler.tls, t, NULL)) {
+		log_sdl_error(LOG_WARN, "SDL_SetTLS");
+	}
+
+	return t;
+}
+
+static void record_event(const ProfileZone *zone, hrtime_t end) {
+	ProfileThread *t = get_thread();
+
+	SDL_LockSpinlock(&t->lock);
+	t->events[t->num_written++ & (PROFILER_RING_SIZE - 1)] = (ProfileEvent) {
+		.name = zone->name,
+		.category = zone->category,
+		.start = zone->start,
+		.end = end,
+	};
+	SDL_UnlockSpinlock(&t->lock);
+}
+
+void _profiler_zone_end(ProfileZone *zone) {
+	if(SDL_GetAtomicInt(&profiler.enabled)) {
+		record_event(zone, time_get());
+	}
+}
+
+void _profiler_zone_record(const ProfileZone *zone, hrtime_t end) {
+	if(SDL_GetAtomicInt(&profiler.enabled)) {
+		record_event(zone, end);
+	}
+}
+
+void _profiler_frame_end(ProfileZone *zone) {
+	if(!SDL_GetAtomicInt(&profiler.enabled)) {
+		return;
+	}
+
+	hrtime_t end = time_get();
+	record_event(zone, end);
+
+	if(
+		profiler.spike_threshold &&
+		end - zone->start > profiler.spike_threshold &&
+		end - profiler.last_dump_time > PROFILER_SPIKE_DUMP_COOLDOWN
+	) {
+		log_info("Frame took %.3f ms, dumping trace", (end - zone->start) / (HRTIME_RESOLUTION / 1e3));
+		profiler_dump_trace();
+	}
+}
+
+static void write_thread_events(StringBuffer *sb, ProfileThread *t, ProfileEvent *scratch, bool *first) {
+	SDL_LockSpinlock(&t->lock);
+	uint64_t num_written = t->num_written;
+	uint num_events = min(num_written, PROFILER_RING_SIZE);
+	uint ofs = num_written - num_events;
+
+	for(uint i = 0; i < num_events; ++i) {
+		scratch[i] = t->events[(ofs + i) & (PROFILER_RING_SIZE - 1)];
+	}
+
+	SDL_UnlockSpinlock(&t->lock);
+
+	strbuf_printf(sb, "%s\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,\"args\":{\"name\":",
+		*first ? "" : ",", t->id);
+	strbuf_cat_json_string(sb, t->name);
+	strbuf_cat(sb, "}}");
+	*first = false;
+
+	for(uint i = 0; i < num_events; ++i) {
+		ProfileEvent *e = scratch + i;
+
+		if(e->start < profiler.base_time) {
+			continue;
+		}
+
+		strbuf_cat(sb, ",\n{\"name\":");
+		strbuf_cat_json_string(sb, e->name);
+
+		if(e->category) {
+			strbuf_cat(sb, ",\"cat\":");
+			strbuf_cat_json_string(sb, e->category);
+		}
+
+		strbuf_printf(sb, ",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f}",
+			t->id,
+			(e->start - profiler.base_time) * 1e-3,
+			(e->end - e->start) * 1e-3
+		);
+	}
+}
+
+void profiler_dump_trace(void) {
+	SystemTime systime;
+	char timestamp[FILENAME_TIMESTAMP_MIN_BUF_SIZE];
+	get_system_time(&systime);
+	filename_timestamp(timestamp, sizeof(timestamp), systime);
+
+	vfs_mkdir("storage/traces");
+	char *path = strfmt("storage/traces/taisei_%s.json", timestamp);
+	SDL_IOStream *out = vfs_open(path, VFS_MODE_WRITE);
+
+	if(!out) {
+		log_error("VFS error: %s", vfs_get_error());
+		mem_free(path);
+		return;
+	}
+
+	StringBuffer sb = {};
+	auto scratch = ALLOC_ARRAY(PROFILER_RING_SIZE, ProfileEvent);
+	bool first = true;
+
+	strbuf_cat(&sb, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[");
+
+	SDL_LockSpinlock(&profiler.threads_lock);
+	uint num_threads = profiler.threads.num_elements;
+	auto threads = ALLOC_ARRAY(num_threads, ProfileThread*);
+	memcpy(threads, profiler.threads.data, num_threads * sizeof(*threads));
+	SDL_UnlockSpinlock(&profiler.threads_lock);
+
+	for(uint i = 0; i < num_threads; ++i) {
+		write_thread_events(&sb, threads[i], scratch, &first);
+		SDL_WriteIO(out, sb.start, sb.pos - sb.start);
+		strbuf_clear(&sb);
+	}
+
+	strbuf_cat(&sb, "\n]}\n");
+	SDL_WriteIO(out, sb.start, sb.pos - sb.start);
+	SDL_CloseIO(out);
+
+	strbuf_free(&sb);
+	mem_free(scratch);
+	mem_free(threads);
+
+	char *syspath = vfs_repr(path, true);
+	log_info("Trace written to %s", syspath ?: path);
+	mem_free(syspath);
+	mem_free(path);
+
+	profiler.last_dump_time = time_get();
+}
@@ -0,0 +1,103 @@
+/*
+ * This software is licensed under the terms of the MIT License.
+ * See COPYING for further information.
+ * ---
+ * Copyright (c) 2011-2024, Lukas Weber <laochailan@web.de>.
+ * Copyright (c) 2012-2024, Andrei Alexeyev <akari@taisei-project.org>.
+ */
+
+#pragma once
+#include "taisei.h"
+
+#include "hirestime.h"
+
+/*
+ * Scoped CPU zone instrumentation. Only built with -Dprofiler=true; otherwise all of this
+ * compiles to nothing.
+ *
+ * Each thread records its most recent zones into its own ring buffer. The buffers can be
+ * dumped as a Chrome/Perfetto trace (chrome://tracing, ui.perfetto.dev) with F9, or
+ * automatically when a frame takes longer than TAISEI_PROFILER_SPIKE_MS milliseconds.
+ *
+ * Zone names and categories must be string literals (or otherwise outlive the profiler).
+ *
+ *	void foo(void) {
+ *		PROFILE_ZONE("foo");
+ *		...  // zone ends when the enclosing scope is left
+ *	}
+ *
+ *	PROFILE_ZONE_BEGIN(z, "bar");
+ *	...
+ *	PROFILE_ZONE_END(z);
+ *
+ * The --benchmark zones (BENCHMARK_ZONE in benchmark.h) are recorded as profiler zones too, so
+ * code instrumented for the benchmark doesn't need separate profiler zones.
+ */
+
+#ifdef TAISEI_BUILDCONF_PROFILER
+
+#define PROFILER_ENABLED 1
+
+#include "util/macrohax.h"
+
+typedef struct ProfileZone {
+	const char *name;
+	const char *category;
+	hrtime_t start;
+} ProfileZone;
+
+void profiler_init(void);
+void profiler_shutdown(void);
+
+// Writes the contents of all ring buffers to a new file under storage/traces.
+void profiler_dump_trace(void);
+
+void _profiler_zone_end(ProfileZone *zone);
+void _profiler_zone_record(const ProfileZone *zone, hrtime_t end);
+void _profiler_frame_end(ProfileZone *zone);
+
+#define PROFILE_ZONE_BEGIN_CAT(_var, _name, _category) \
+	ProfileZone _var = { .name = (_name), .category = (_category), .start = time_get() }
+
+#define PROFILE_ZONE_BEGIN(_var, _name) \
+	PROFILE_ZONE_BEGIN_CAT(_var, _name, NULL)
+
+#define PROFILE_ZONE_END(_var) \
+	_profiler_zone_end(&(_var))
+
+#define PROFILE_ZONE_CAT(_name, _category) \
+	attr_unused __attribute__((cleanup(_profiler_zone_end))) \
+	PROFILE_ZONE_BEGIN_CAT(MACROHAX_ADDLINENUM(_profile_zone_), _name, _category)
+
+#define PROFILE_ZONE(_name) \
+	PROFILE_ZONE_CAT(_name, NULL)
+
+// Records a zone that has already ended, from timestamps taken by the caller.
+#define PROFILE_ZONE_RECORD(_name, _category, _start, _end) \
+	_profiler_zone_record(&(ProfileZone) { .name = (_name), .category = (_category), .start = (_start) }, (_end))
+
+// Like a zone, but also checked against the spike threshold when it ends.
+#define PROFILE_FRAME_BEGIN(_var) \
+	PROFILE_ZONE_BEGIN(_var, "frame")
+
+#define PROFILE_FRAME_END(_var) \
+	_profiler_frame_end(&(_var))
+
+#else
+
+#define PROFILER_ENABLED 0
+
+INLINE void profiler_init(void) { }
+INLINE void profiler_shutdown(void) { }
+INLINE void profiler_dump_trace(void) { }
+
+#define PROFILE_ZONE_BEGIN_CAT(_var, _name, _category) ((void)0)
+#define PROFILE_ZONE_BEGIN(_var, _name) ((void)0)
+#define PROFILE_ZONE_END(_var) ((void)0)
+#define PROFILE_ZONE_CAT(_name, _category) ((void)0)
+#define PROFILE_ZONE(_name) ((void)0)
+#define PROFILE_ZONE_RECORD(_name, _category, _start, _end) ((void)0)
+#define PROFILE_FRAME_BEGIN(_var) ((void)0)
+#define PROFILE_FRAME_END(_var) ((void)0)
+
+#endif
@@ -10,6 +10,8 @@
 
 #include "global.h"
 #include "list.h"
+#include "projectile_batch.h"
+#include "spatialgrid.h"
 #include "stageobjects.h"
 #include "util/glm.h"
 #include "stage.h"
@@ -127,6 +129,33 @@ static cmplx projectile_size(Projectile *p) {
 	return r;
 }
 
+static cmplx projectile_viewport_buffer(Projectile *p) {
+	real e = p->max_viewport_dist;
+	cmplx size = projectile_size(p);
+	return 0.5 * size + CMPLX(e, e);
+}
+
+static void proj_move(Projectile *p) {
+	IF_PROJ_DEBUG(
+		cmplx pos = p->pos;
+		MoveParams move = p->move;
+	)
+
+	if(projectile_batch_commit_move(p)) {
+		IF_PROJ_DEBUG(
+			move_update(&pos, &move);
+
+			if(memcmp(&pos, &p->pos, sizeof(pos)) || memcmp(&move.velocity, &p->move.velocity, sizeof(move.velocity))) {
+				log_fatal("Batched movement diverged from move_update()");
+			}
+		)
+
+		return;
+	}
+
+	move_update(&p->pos, &p->move);
+}
+
 static Projectile *spawn_bullet_spawning_effect(Projectile *p);
 
 // Returns true if projectile should be destroyed
@@ -137,7 +166,7 @@ static inline bool proj_update(Projectile *p, int t) {
 		destroy = true;
 	} else if(t >= 0) {
 		if(!(p->flags & PFLAG_NOMOVE)) {
-			move_update(&p->pos, &p->move);
+			proj_move(p);
 		}
 
 		if(p->flags & PFLAG_MANUALANGLE) {
@@ -240,13 +269,7 @@ void projectile_set_layer(Projectile *p, drawlayer_t layer) {
 
 static void ent_draw_projectile(EntityInterface *ent);
 
-static Projectile* _create_projectile(ProjArgs *args) {
-	if(IN_DRAW_CODE) {
-		log_fatal("Tried to spawn a projectile while in drawing code");
-	}
-
-	auto p = STAGE_ACQUIRE_OBJ(Projectile);
-
+static void init_projectile(Projectile *p, ProjArgs *args) {
 	p->birthtime = global.frames;
 	p->pos = p->pos0 = p->prevpos = args->pos;
 	p->angle = args->angle;
@@ -290,16 +313,84 @@ static Projectile* _create_projectile(ProjArgs *args) {
 
 	COEVENT_INIT_ARRAY(p->events);
 	ent_register(&p->ent, ENT_TYPE_ID(Projectile));
+}
+
+static Projectile* _create_projectile(ProjArgs *args) {
+	if(IN_DRAW_CODE) {
+		log_fatal("Tried to spawn a projectile while in drawing code");
+	}
+
+	auto p = STAGE_ACQUIRE_OBJ(Projectile);
+	init_projectile(p, args);
 	alist_append(args->dest, p);
 
+	if(args->dest == &global.projs) {
+		spatialgrid_hazard_spawned(p);
+	}
+
 	return p;
 }
 
+static void create_projectile_batch(
+	ProjArgs *args, ProjArgs *defaults, uint count,
+	const cmplx *pos, const MoveParams *move, Projectile **out
+) {
+	if(IN_DRAW_CODE) {
+		log_fatal("Tried to spawn a projectile while in drawing code");
+	}
+
+	process_projectile_args(args, defaults);
+
+	STAGE_RESERVE_OBJS(Projectile, count);
+	ent_reserve(count);
+
+	ProjectileList batch = {};
+
+	for(uint i = 0; i < count; ++i) {
+		if(pos) {
+			args->pos = pos[i];
+		}
+
+		if(move) {
+			args->move = move[i];
+		}
+
+		auto p = STAGE_ACQUIRE_OBJ(Projectile);
+		init_projectile(p, args);
+		alist_append(&batch, p);
+
+		IF_PROJ_DEBUG(
+			memcpy(&p->debug, get_debug_info(), sizeof(p->debug));
+		)
+
+		if(out) {
+			out[i] = p;
+		}
+	}
+
+	Projectile *first = batch.first;
+	alist_merge_tail(args->dest, &batch);
+
+	if(args->dest == &global.projs) {
+		for(Projectile *p = first; p; p = p->next) {
+			spatialgrid_hazard_spawned(p);
+		}
+	}
+}
+
 Projectile* create_projectile(ProjArgs *args) {
 	process_projectile_args(args, &defaults_proj);
 	return _create_projectile(args);
 }
 
+void create_projectiles(ProjArgs *args, uint count, const cmplx *pos, const MoveParams *move, Projectile **out) {
+	create_projectile_batch(args, &defaults_proj, count, pos, move, out);
+}
+
+void create_particles(ProjArgs *args, uint count, const cmplx *pos, const MoveParams *move, Projectile **out) {
+	create_projectile_batch(args, &defaults_part, count, pos, move, out);
+}
+
 Projectile* create_particle(ProjArgs *args) {
 	process_projectile_args(args, &defaults_part);
 	return _create_projectile(args);
@@ -327,6 +418,10 @@ static void delete_projectile(ProjectileList *projlist, Projectile *p, ProjColli
 	COEVENT_CANCEL_ARRAY(p->events);
 	ent_unregister(&p->ent);
 	STAGE_RELEASE_OBJ(alist_unlink(projlist, p));
+
+	if(projlist == &global.projs) {
+		spatialgrid_invalidate_hazards();
+	}
 }
 
 static void *foreach_delete_projectile(ListAnchor *projlist, List *proj, void *arg) {
@@ -338,6 +433,19 @@ void delete_projectiles(ProjectileList *projlist) {
 	alist_foreach(projlist, foreach_delete_projectile, NULL);
 }
 
+static void *player_shot_hit_test(Enemy *e, void *arg) {
+	Projectile *p = arg;
+
+	if(
+		!(e->flags & EFLAG_NO_HIT) &&
+		cabs2(e->pos - p->pos) < e->hit_radius * e->hit_radius
+	) {
+		return e;
+	}
+
+	return NULL;
+}
+
 void calc_projectile_collision(Projectile *p, ProjCollisionResult *out_col) {
 	out_col->type = PCOL_NONE;
 	out_col->entity = NULL;
@@ -394,17 +502,14 @@ void calc_projectile_collision(Projectile *p, ProjCollisionResult *out_col) {
 			}
 		}
 	} else if(p->type == PROJ_PLAYER) {
-		for(Enemy *e = global.enemies.first; e; e = e->next) {
-			if(
-				!(e->flags & EFLAG_NO_HIT) &&
-				cabs2(e->pos - p->pos) < e->hit_radius * e->hit_radius
-			) {
-				out_col->type = PCOL_ENTITY;
-				out_col->entity = &e->ent;
-				out_col->fatal = !(p->flags & PFLAG_INDESTRUCTIBLE);
-
-				return;
-			}
+		Enemy *e = spatialgrid_foreach_enemy_at_point(p->pos, player_shot_hit_test, p);
+
+		if(e) {
+			out_col->type = PCOL_ENTITY;
+			out_col->entity = &e->ent;
+			out_col->fatal = !(p->flags & PFLAG_INDESTRUCTIBLE);
+
+			return;
 		}
 
 		if(
@@ -483,10 +588,8 @@ static void ent_draw_projectile(EntityInterface *ent) {
 #endif
 }
 
-bool projectile_in_viewport(Projectile *proj) {
-	real e = proj->max_viewport_dist;
-	cmplx size = projectile_size(proj);
-	cmplx buffer = 0.5 * size + CMPLX(e, e);
+static bool projectile_in_viewport_scalar(Projectile *proj) {
+	cmplx buffer = projectile_viewport_buffer(proj);
 	cmplx pos = proj->pos;
 	cmplx br = pos + buffer;
 
@@ -503,6 +606,22 @@ bool projectile_in_viewport(Projectile *proj) {
 	return true;
 }
 
+bool projectile_in_viewport(Projectile *proj) {
+	bool in_viewport;
+
+	if(projectile_batch_in_viewport(proj, &in_viewport)) {
+		IF_PROJ_DEBUG(
+			if(in_viewport != projectile_in_viewport_scalar(proj)) {
+				log_fatal("Batched viewport test diverged from the scalar one");
+			}
+		)
+
+		return in_viewport;
+	}
+
+	return projectile_in_viewport_scalar(proj);
+}
+
 Projectile *spawn_projectile_collision_effect(Projectile *proj) {
 	if(proj->flags & PFLAG_NOCOLLISIONEFFECT) {
 		return NULL;
@@ -566,10 +685,22 @@ void kill_projectile(Projectile *proj) {
 	coevent_signal_once(&proj->events.killed);
 }
 
+static void gather_projectile_batch(Projectile *first) {
+	projectile_batch_reset();
+
+	for(Projectile *p = first; p && projectile_batch_add(p, projectile_viewport_buffer(p)); p = p->next);
+
+	projectile_batch_run();
+}
+
 void process_projectiles(ProjectileList *projlist, bool collision) {
 	ProjCollisionResult col = { 0 };
 	bool stage_cleared = stage_is_cleared();
 
+	if(projlist == &global.projs) {
+		spatialgrid_begin_hazard_update();
+	}
+
 	for(Projectile *proj = projlist->first, *next; proj; proj = next) {
 		next = proj->next;
 
@@ -582,6 +713,12 @@ void process_projectiles(ProjectileList *projlist, bool collision) {
 			clear_projectile(proj, CLEAR_HAZARDS_BULLETS | CLEAR_HAZARDS_FORCE);
 		}
 
+		// Clearing resumes tasks for every projectile, which would invalidate every run
+		if(!stage_cleared && !projectile_batch_enter(proj)) {
+			gather_projectile_batch(proj);
+			projectile_batch_enter(proj);
+		}
+
 		bool destroy = proj_update(proj, global.frames - proj->birthtime);
 
 		if(proj->graze_counter && proj->graze_counter_reset_timer - global.frames <= -90) {
@@ -614,6 +751,12 @@ void process_projectiles(ProjectileList *projlist, bool collision) {
 		apply_projectile_collision(projlist, proj, &col);
 	}
 
+	projectile_batch_end();
+
+	if(projlist == &global.projs) {
+		spatialgrid_end_hazard_update();
+	}
+
 	for(Projectile *proj = projlist->first, *next; proj; proj = next) {
 		next = proj->next;
 
@@ -724,7 +867,7 @@ static Projectile* spawn_projectile_highlight_effect_internal(Projectile *p, boo
 		RNG_ARRAY(R, 5);
 
 		PARTICLE(
-			.sprite = "stardust_green",
+			.sprite_ptr = res_sprite_by_id(RID_SPRITE_part_stardust_green),
 			.shader = "sprite_bullet",
 			.size = p->size * 4.5,
 			.layer = LAYER_PARTICLE_HIGH | 0x40,
@@ -744,7 +887,7 @@ static Projectile* spawn_projectile_highlight_effect_internal(Projectile *p, boo
 	RNG_ARRAY(R, 5);
 
 	return PARTICLE(
-		.sprite = "bullet_flare",
+		.sprite_ptr = res_sprite_by_id(RID_SPRITE_part_bullet_flare),
 		.size = p->size * 4.5,
 		.shader = "sprite_bullet",
 		.layer = LAYER_PARTICLE_HIGH | 0x80,
@@ -1037,7 +1180,7 @@ void petal_explosion(int n, cmplx pos) {
 		real t = rng_real();
 
 		PARTICLE(
-			.sprite = "petal",
+			.sprite_ptr = res_sprite_by_id(RID_SPRITE_part_petal),
 			.pos = pos,
 			.color = RGBA(sin(5*t) * t, cos(5*t) * t, 0.5 * t, 0),
 			.move = move_asymptotic_simple(v, 5),
@@ -219,6 +219,25 @@ Projectile *create_projectile(ProjArgs *args)
 Projectile *create_particle(ProjArgs *args)
 	attr_nonnull_all attr_returns_nonnull attr_returns_max_aligned;
 
+/*
+ * Spawns `count` projectiles (or particles) that share `args`. Sprite and shader names are
+ * resolved once, and pool, entity and store capacity is reserved up front for the whole batch.
+ * `pos[i]` and `move[i]` override args->pos and args->move for each projectile; either array may
+ * be NULL to use the value from `args` for all of them. If `out` is not NULL, it receives the
+ * spawned projectiles in order.
+ *
+ * Use the PROJECTILE_BATCH and PARTICLE_BATCH wrappers, e.g. for a ring:
+ *
+ *	cmplx pos[n];
+ *	MoveParams move[n];
+ *	...
+ *	PROJECTILE_BATCH(n, pos, move, NULL, .proto = pp_ball, .color = RGB(1, 0, 0));
+ */
+void create_projectiles(ProjArgs *args, uint count, const cmplx *pos, const MoveParams *move, Projectile **out)
+	attr_nonnull(1);
+void create_particles(ProjArgs *args, uint count, const cmplx *pos, const MoveParams *move, Projectile **out)
+	attr_nonnull(1);
+
 #ifdef PROJ_DEBUG
 	Projectile *_proj_attach_dbginfo(Projectile *p, DebugInfo *dbg, const char *callsite_str)
 		attr_nonnull_all;
@@ -232,6 +251,16 @@ Projectile *create_particle(ProjArgs *args)
 #define PROJECTILE(...) _PROJ_GENERIC_SPAWN(create_projectile, __VA_ARGS__)
 #define PARTICLE(...) _PROJ_GENERIC_SPAWN(create_particle, __VA_ARGS__)
 
+#define _PROJ_GENERIC_SPAWN_BATCH(constructor, _count, _pos, _move, _out, ...) ({ \
+	set_debug_info(_DEBUG_INFO_PTR_); \
+	(constructor)((&(ProjArgs) { __VA_ARGS__ }), (_count), (_pos), (_move), (_out)); \
+})
+
+#define PROJECTILE_BATCH(_count, _pos, _move, _out, ...) \
+	_PROJ_GENERIC_SPAWN_BATCH(create_projectiles, _count, _pos, _move, _out, __VA_ARGS__)
+#define PARTICLE_BATCH(_count, _pos, _move, _out, ...) \
+	_PROJ_GENERIC_SPAWN_BATCH(create_particles, _count, _pos, _move, _out, __VA_ARGS__)
+
 void delete_projectiles(ProjectileList *projlist) attr_nonnull_all;
 
 void calc_projectile_collision(Projectile *p, ProjCollisionResult *out_col) attr_nonnull_all;
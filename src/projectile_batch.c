@@ -0,0 +1,308 @@
+/*
+ * This software is licensed under the terms of the MIT License.
+ * See COPYING for further information.
+ * ---
+ * Copyright (c) 2011-2024, Lukas Weber <laochailan@web.de>.
+ * Copyright (c) 2012-2024, Andrei Alexeyev <akari@taisei-project.org>.
+ */
+
+#include "projectile_batch.h"
+
+#ifdef PROJ_BATCH_SIMD
+
+#include "coroutine/cotask.h"
+#include "global.h"
+#include "move.h"
+
+#include <emmintrin.h>
+
+enum {
+	// Must be even
+	PROJ_BATCH_CAPACITY = 64,
+	PROJ_BATCH_MIN_SIZE = 8,
+};
+
+typedef struct Lanes {
+	alignas(16) double re[PROJ_BATCH_CAPACITY];
+	alignas(16) double im[PROJ_BATCH_CAPACITY];
+} Lanes;
+
+static struct {
+	Lanes pos;
+	Lanes velocity;
+	Lanes acceleration;
+	Lanes retention;
+	Lanes attraction;
+	Lanes attraction_point;
+	Lanes viewport_buffer;
+
+	Lanes next_pos;
+	Lanes next_velocity;
+
+	double attraction_exponent[PROJ_BATCH_CAPACITY];
+	Projectile *items[PROJ_BATCH_CAPACITY];
+	bool in_viewport[PROJ_BATCH_CAPACITY];
+	bool committed[PROJ_BATCH_CAPACITY];
+
+	uint num;
+	uint cursor;
+	uint next;
+	// Runs are shortened while tasks keep interrupting them, see projectile_batch_enter
+	uint size;
+	uint32_t num_resumes;
+} batch = {
+	.size = PROJ_BATCH_CAPACITY,
+};
+
+#define BITS_EQUAL(a, b) ({ \
+	static_assert(sizeof(a) == sizeof(b), ""); \
+	!memcmp(&(a), &(b), sizeof(a)); \
+})
+
+static inline void lanes_set(Lanes *l, uint i, cmplx v) {
+	l->re[i] = re(v);
+	l->im[i] = im(v);
+}
+
+static inline cmplx lanes_get(Lanes *l, uint i) {
+	return CMPLX(l->re[i], l->im[i]);
+}
+
+void projectile_batch_reset(void) {
+	batch.num = 0;
+	batch.cursor = 0;
+	batch.next = 0;
+}
+
+bool projectile_batch_add(Projectile *p, cmplx viewport_buffer) {
+	if(batch.num == batch.size) {
+		return false;
+	}
+
+	uint i = batch.num++;
+	batch.items[i] = p;
+	batch.committed[i] = false;
+	batch.attraction_exponent[i] = p->move.attraction_exponent;
+	lanes_set(&batch.pos, i, p->pos);
+	lanes_set(&batch.velocity, i, p->move.velocity);
+	lanes_set(&batch.acceleration, i, p->move.acceleration);
+	lanes_set(&batch.retention, i, p->move.retention);
+	lanes_set(&batch.attraction, i, p->move.attraction);
+	lanes_set(&batch.attraction_point, i, p->move.attraction_point);
+	lanes_set(&batch.viewport_buffer, i, viewport_buffer);
+	return true;
+}
+
+#define LOAD(field, part, i) _mm_load_pd(batch.field.part + (i))
+#define STORE(field, part, i, v) _mm_store_pd(batch.field.part + (i), (v))
+
+// Same operation order as cmul_finite(), for two projectiles at once
+#define CMUL_RE(ar, ai, br, bi) _mm_sub_pd(_mm_mul_pd(ar, br), _mm_mul_pd(ai, bi))
+#define CMUL_IM(ar, ai, br, bi) _mm_add_pd(_mm_mul_pd(ar, bi), _mm_mul_pd(ai, br))
+
+static inline __m128d select_pd(__m128d mask, __m128d a, __m128d b) {
+	return _mm_or_pd(_mm_and_pd(mask, a), _mm_andnot_pd(mask, b));
+}
+
+// Mirrors move_update()
+static void batch_move(uint num) {
+	__m128d zero = _mm_setzero_pd();
+
+	for(uint i = 0; i < num; i += 2) {
+		__m128d pos_re = LOAD(pos, re, i);
+		__m128d pos_im = LOAD(pos, im, i);
+		__m128d vel_re = LOAD(velocity, re, i);
+		__m128d vel_im = LOAD(velocity, im, i);
+		__m128d ret_re = LOAD(retention, re, i);
+		__m128d ret_im = LOAD(retention, im, i);
+
+		pos_re = _mm_add_pd(pos_re, vel_re);
+		pos_im = _mm_add_pd(pos_im, vel_im);
+
+		__m128d nvel_re = _mm_add_pd(LOAD(acceleration, re, i), CMUL_RE(ret_re, ret_im, vel_re, vel_im));
+		__m128d nvel_im = _mm_add_pd(LOAD(acceleration, im, i), CMUL_IM(ret_re, ret_im, vel_re, vel_im));
+
+		__m128d attr_re = LOAD(attraction, re, i);
+		__m128d attr_im = LOAD(attraction, im, i);
+
+		// The complex number is "true" if either part compares unequal to zero (NaN included)
+		__m128d attracted = _mm_or_pd(_mm_cmpneq_pd(attr_re, zero), _mm_cmpneq_pd(attr_im, zero));
+
+		if(_mm_movemask_pd(attracted)) {
+			// Must not be added at all for unattracted lanes: even a zero product can flip the
+			// sign of a zero velocity, or be NaN.
+			__m128d av_re = _mm_sub_pd(LOAD(attraction_point, re, i), pos_re);
+			__m128d av_im = _mm_sub_pd(LOAD(attraction_point, im, i), pos_im);
+			__m128d avel_re = _mm_add_pd(nvel_re, CMUL_RE(attr_re, attr_im, av_re, av_im));
+			__m128d avel_im = _mm_add_pd(nvel_im, CMUL_IM(attr_re, attr_im, av_re, av_im));
+			nvel_re = select_pd(attracted, avel_re, nvel_re);
+			nvel_im = select_pd(attracted, avel_im, nvel_im);
+		}
+
+		STORE(next_pos, re, i, pos_re);
+		STORE(next_pos, im, i, pos_im);
+		STORE(next_velocity, re, i, nvel_re);
+		STORE(next_velocity, im, i, nvel_im);
+	}
+
+	for(uint i = 0; i < num; ++i) {
+		if(batch.attraction_exponent[i] != 1 && lanes_get(&batch.attraction, i)) {
+			// Needs pow()
+			cmplx pos = lanes_get(&batch.pos, i);
+			MoveParams m = {
+				.velocity = lanes_get(&batch.velocity, i),
+				.acceleration = lanes_get(&batch.acceleration, i),
+				.retention = lanes_get(&batch.retention, i),
+				.attraction = lanes_get(&batch.attraction, i),
+				.attraction_point = lanes_get(&batch.attraction_point, i),
+				.attraction_exponent = batch.attraction_exponent[i],
+			};
+
+			move_update(&pos, &m);
+			lanes_set(&batch.next_pos, i, pos);
+			lanes_set(&batch.next_velocity, i, m.velocity);
+		}
+	}
+}
+
+// Mirrors projectile_in_viewport() at the next position
+static void batch_cull(uint num) {
+	__m128d zero = _mm_setzero_pd();
+	__m128d vw = _mm_set1_pd(VIEWPORT_W);
+	__m128d vh = _mm_set1_pd(VIEWPORT_H);
+
+	for(uint i = 0; i < num; i += 2) {
+		__m128d pos_re = LOAD(next_pos, re, i);
+		__m128d pos_im = LOAD(next_pos, im, i);
+		__m128d buf_re = LOAD(viewport_buffer, re, i);
+		__m128d buf_im = LOAD(viewport_buffer, im, i);
+
+		__m128d out = _mm_or_pd(
+			_mm_or_pd(
+				_mm_cmplt_pd(_mm_add_pd(pos_re, buf_re), zero),
+				_mm_cmplt_pd(_mm_add_pd(pos_im, buf_im), zero)
+			),
+			_mm_or_pd(
+				_mm_cmpgt_pd(_mm_sub_pd(pos_re, buf_re), vw),
+				_mm_cmpgt_pd(_mm_sub_pd(pos_im, buf_im), vh)
+			)
+		);
+
+		int mask = _mm_movemask_pd(out);
+		batch.in_viewport[i] = !(mask & 1);
+		batch.in_viewport[i + 1] = !(mask & 2);
+	}
+}
+
+void projectile_batch_run(void) {
+	uint num = batch.num;
+
+	if(num & 1) {
+		// Pad to a whole register; the extra lane is never read back.
+		lanes_set(&batch.pos, num, 0);
+		lanes_set(&batch.velocity, num, 0);
+		lanes_set(&batch.acceleration, num, 0);
+		lanes_set(&batch.retention, num, 0);
+		lanes_set(&batch.attraction, num, 0);
+		lanes_set(&batch.attraction_point, num, 0);
+		lanes_set(&batch.viewport_buffer, num, 1);
+		batch.attraction_exponent[num] = 1;
+		++num;
+	}
+
+	batch_move(num);
+	batch_cull(num);
+	batch.cursor = 0;
+	batch.next = 0;
+	batch.num_resumes = cotask_num_resumes();
+}
+
+void projectile_batch_end(void) {
+	projectile_batch_reset();
+}
+
+bool projectile_batch_enter(Projectile *p) {
+	if(batch.num == 0) {
+		return false;
+	}
+
+	if(batch.num_resumes != cotask_num_resumes()) {
+		// A task ran and may have changed anything. Keep the next run short if it happened early
+		// in this one, so that a task resumed for every projectile (e.g. on a stage clear) doesn't
+		// make us gather a full run each time.
+		batch.size = clamp(2 * (batch.cursor + 1), PROJ_BATCH_MIN_SIZE, PROJ_BATCH_CAPACITY);
+		batch.num = 0;
+		return false;
+	}
+
+	// The run is a contiguous stretch of the list. Projectiles deleted during the pass are skipped,
+	// so scan forward. Never look back: a projectile spawned during the pass may have been
+	// allocated at the address of one that was already processed and deleted.
+	for(uint i = batch.next; i < batch.num; ++i) {
+		if(batch.items[i] == p) {
+			batch.cursor = i;
+			batch.next = i + 1;
+			return true;
+		}
+	}
+
+	batch.size = min(2 * batch.size, (uint)PROJ_BATCH_CAPACITY);
+	batch.num = 0;
+	return false;
+}
+
+static inline bool batch_current_valid(Projectile *p) {
+	return
+		batch.num > 0 &&
+		batch.items[batch.cursor] == p &&
+		batch.num_resumes == cotask_num_resumes();
+}
+
+bool projectile_batch_commit_move(Projectile *p) {
+	if(!batch_current_valid(p)) {
+		return false;
+	}
+
+	uint i = batch.cursor;
+
+	if(batch.committed[i]) {
+		// Already advanced once during this pass, e.g. through trace_projectile
+		return false;
+	}
+
+	// Movement parameters are only changed by tasks and by the code that spawns the projectile;
+	// the resume check covers those. The position and velocity are also compared, since they are
+	// the most likely to be poked at directly.
+	cmplx pos = lanes_get(&batch.pos, i);
+	cmplx velocity = lanes_get(&batch.velocity, i);
+
+	if(!BITS_EQUAL(p->pos, pos) || !BITS_EQUAL(p->move.velocity, velocity)) {
+		return false;
+	}
+
+	p->pos = lanes_get(&batch.next_pos, i);
+	p->move.velocity = lanes_get(&batch.next_velocity, i);
+	batch.committed[i] = true;
+
+	return true;
+}
+
+bool projectile_batch_in_viewport(Projectile *p, bool *out_in_viewport) {
+	if(!batch_current_valid(p)) {
+		return false;
+	}
+
+	uint i = batch.cursor;
+	cmplx pos = lanes_get(&batch.next_pos, i);
+
+	// Must be tested at the position the result was computed for. This also rejects projectiles
+	// that didn't move this frame.
+	if(!BITS_EQUAL(p->pos, pos)) {
+		return false;
+	}
+
+	*out_in_viewport = batch.in_viewport[i];
+	return true;
+}
+
+#endif
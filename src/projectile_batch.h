@@ -0,0 +1,65 @@
+/*
+ * This software is licensed under the terms of the MIT License.
+ * See COPYING for further information.
+ * ---
+ * Copyright (c) 2011-2024, Lukas Weber <laochailan@web.de>.
+ * Copyright (c) 2012-2024, Andrei Alexeyev <akari@taisei-project.org>.
+ */
+
+#pragma once
+#include "taisei.h"
+
+#include "projectile.h"
+
+/*
+ * Vectorized movement and viewport culling for process_projectiles.
+ *
+ * The projectile list is processed in short runs. For each run, the positions and movement
+ * parameters are copied into lane arrays, two projectiles per SSE2 register, and the next
+ * position, next velocity and the viewport test at the next position are computed for all of
+ * them at once. The results mirror the operation order of move_update() and
+ * projectile_in_viewport() exactly, so they are bit-for-bit identical to the scalar code.
+ *
+ * A staged result is only used while nothing could have changed its inputs: no task may have
+ * been resumed since the run was gathered, and each result is committed at most once. Otherwise
+ * the caller falls back to the scalar code and a new run is gathered at the next projectile.
+ *
+ * On targets without SSE2, or where the compiler may contract the scalar code into FMA
+ * instructions, this is compiled out and all functions are no-ops.
+ */
+
+#if defined(__SSE2__) && !defined(__FMA__)
+	#define PROJ_BATCH_SIMD
+#endif
+
+#ifdef PROJ_BATCH_SIMD
+
+// Returns false if p is not covered by the current run; gather a new one starting at p then.
+bool projectile_batch_enter(Projectile *p) attr_nonnull_all;
+
+// Start gathering a new run. Add projectiles in list order until projectile_batch_add returns
+// false, then call projectile_batch_run.
+void projectile_batch_reset(void);
+bool projectile_batch_add(Projectile *p, cmplx viewport_buffer) attr_nonnull_all;
+void projectile_batch_run(void);
+
+// Discard the current run
+void projectile_batch_end(void);
+
+// Apply the staged movement to p; returns false if the caller must call move_update instead.
+bool projectile_batch_commit_move(Projectile *p) attr_nonnull_all;
+
+// Returns false if the caller must do the viewport test itself.
+bool projectile_batch_in_viewport(Projectile *p, bool *out_in_viewport) attr_nonnull_all;
+
+#else
+
+INLINE bool projectile_batch_enter(Projectile *p) { return true; }
+INLINE void projectile_batch_reset(void) { }
+INLINE bool projectile_batch_add(Projectile *p, cmplx viewport_buffer) { return false; }
+INLINE void projectile_batch_run(void) { }
+INLINE void projectile_batch_end(void) { }
+INLINE bool projectile_batch_commit_move(Projectile *p) { return false; }
+INLINE bool projectile_batch_in_viewport(Projectile *p, bool *out_in_viewport) { return false; }
+
+#endif
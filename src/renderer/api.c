@@ -858,6 +858,18 @@ void r_begin_frame(void) {
 	}
 }
 
+void r_pipeline_cache_begin_scope(const char *name) {
+	if(B.pipeline_cache_begin_scope) {
+		B.pipeline_cache_begin_scope(name);
+	}
+}
+
+void r_pipeline_cache_end_scope(void) {
+	if(B.pipeline_cache_end_scope) {
+		B.pipeline_cache_end_scope();
+	}
+}
+
 void r_swap(SDL_Window *window) {
 	coroutines_draw_stats();
 	_r_sprite_batch_end_frame();
@@ -829,6 +829,15 @@ VsyncMode r_vsync_current(void);
 void r_begin_frame(void);
 void r_swap(SDL_Window *window);
 
+/*
+ * Backends that build pipeline state objects lazily (currently only sdlgpu) remember which
+ * pipelines were first needed while a named scope was active. The next time the same scope
+ * begins, those pipelines are created ahead of time, as the resources they depend on finish
+ * loading. Scope names are used as file names. Other backends ignore this.
+ */
+void r_pipeline_cache_begin_scope(const char *name) attr_nonnull(1);
+void r_pipeline_cache_end_scope(void);
+
 void r_mat_mv_push(void);
 void r_mat_mv_push_premade(mat4 mat);
 void r_mat_mv_push_identity(void);
@@ -889,6 +898,16 @@ void r_sprite_batch_add_instance(const SpriteInstanceAttribs *attribs);
 
 void r_flush_sprites(void);
 
+/*
+ * Sprites drawn with r_draw_sprite between these two calls may be reordered relative to
+ * each other, so that all sprites sharing the same state are drawn in one batch. Use this
+ * where draw order doesn't matter visually. Anything that flushes the sprite batch (e.g.
+ * non-sprite draws, r_sprite_batch_prepare_state, r_flush_sprites) still acts as a barrier.
+ * May be nested; the batches are drawn when the outermost scope ends.
+ */
+void r_sprite_batch_begin_unordered(void);
+void r_sprite_batch_end_unordered(void);
+
 BlendMode r_blend_compose(
 	BlendFactor src_color, BlendFactor dst_color, BlendOp color_op,
 	BlendFactor src_alpha, BlendFactor dst_alpha, BlendOp alpha_op
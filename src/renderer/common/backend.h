@@ -134,6 +134,9 @@ typedef struct RendererFuncs {
 
 	void (*begin_frame)(void);
 	void (*swap)(SDL_Window *window);
+
+	void (*pipeline_cache_begin_scope)(const char *name);
+	void (*pipeline_cache_end_scope)(void);
 } RendererFuncs;
 
 typedef struct RendererBackend {
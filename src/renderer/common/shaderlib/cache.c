@@ -10,7 +10,10 @@
 #include "cache.h"
 #include "reflect.h"
 
+#include "hirestime.h"
 #include "log.h"
+#include "taskmanager.h"
+#include "util/env.h"
 #include "util/sha256.h"
 #include "rwops/rwops_crc32.h"
 #include "rwops/rwops_autobuf.h"
@@ -267,58 +270,586 @@ static bool shader_cache_load_entry(SDL_IOStream *stream, ShaderSource *out_src,
 	return false;
 }
 
+/*
+ * All entries live in a single pack file rather than one file per entry. The pack is read
+ * into memory in one go when the cache is initialized. New entries are written back by a
+ * background task when a loading screen finishes (see shader_cache_flush()), and once more on
+ * shutdown if needed. A read-only pack may also be shipped with the game data; it is consulted
+ * after the user's own pack and never written to.
+ *
+ * The pack is always written to a temporary file first, which then replaces the old one, so
+ * that a crash mid-write can't leave a corrupted pack behind. Entries that another instance
+ * has saved in the meantime are merged in before writing. The file I/O is done without holding
+ * the mutex, so lookups are never blocked by a save.
+ *
+ * Pack layout (all integers little-endian):
+ *
+ *	u32 magic, u32 version, u32 generation, u32 num_entries
+ *	num_entries times:
+ *		u8 key_len, char key[key_len], u32 last_used, u32 data_size, u8 data[data_size]
+ *
+ * The data is a zstd-compressed entry as produced by shader_cache_construct_entry().
+ * The generation is bumped every time the pack is loaded; entries remember the generation they
+ * were last used in, and the least recently used ones are dropped when the pack grows past
+ * TAISEI_SHADER_CACHE_SIZE_LIMIT. Usage alone never causes a rewrite: the updated generations
+ * are only saved along with new entries, or when pruning.
+ */
+
+#define PACK_MAGIC 0x43535354  // "TSSC"
+#define PACK_VERSION 1
+#define PACK_HEADER_SIZE 16
+#define PACK_USER_PATH "cache/shaders.pack"
+#define PACK_BUNDLE_PATH "res/shader_cache.pack"
+
+typedef struct PackEntry {
+	const uint8_t *data;
+	uint32_t size;
+	uint32_t last_used;
+	bool owns_data;
+} PackEntry;
+
+typedef struct Pack {
+	ht_str2ptr_t entries;
+	uint8_t *blob;
+	size_t total_size;
+} Pack;
+
+static struct {
+	SDL_Mutex *mutex;
+	Pack user;
+	Pack bundle;
+	Task *flush_task;
+	uint32_t generation;
+	uint num_unsaved;
+	bool initialized;
+} shader_cache;
+
+// What gets written out; taken under the mutex, saved without it.
+typedef struct PackSnapshotEntry {
+	char *key;
+	const uint8_t *data;
+	uint32_t size;
+	uint32_t last_used;
+} PackSnapshotEntry;
+
+typedef struct PackSnapshot {
+	PackSnapshotEntry *entries;
+	uint num_entries;
+	uint32_t generation;
+} PackSnapshot;
+
+static uint32_t pack_read_u32(const uint8_t **p) {
+	uint32_t v;
+	memcpy(&v, *p, sizeof(v));
+	*p += sizeof(v);
+	return SDL_Swap32LE(v);
+}
+
+static void pack_free(Pack *pack) {
+	ht_str2ptr_iter_t iter;
+	ht_iter_begin(&pack->entries, &iter);
+
+	for(;iter.has_data; ht_iter_next(&iter)) {
+		PackEntry *e = iter.value;
+
+		if(e->owns_data) {
+			mem_free((void*)e->data);
+		}
+
+		mem_free(e);
+	}
+
+	ht_iter_end(&iter);
+	ht_destroy(&pack->entries);
+	mem_free(pack->blob);
+	memset(pack, 0, sizeof(*pack));
+}
+
+static uint32_t pack_load(Pack *pack, const char *path) {
+	ht_create(&pack->entries);
+
+	SDL_IOStream *in = vfs_open(path, VFS_MODE_READ);
+
+	if(!in) {
+		return 0;
+	}
+
+	size_t blob_size;
+	uint8_t *blob = SDL_LoadFile_IO(in, &blob_size, true);
+
+	if(!blob) {
+		log_sdl_error(LOG_ERROR, "SDL_LoadFile_IO");
+		return 0;
+	}
+
+	// Keep our own copy so that it can be released with mem_free()
+	pack->blob = memdup(blob, blob_size);
+	SDL_free(blob);
+
+	const uint8_t *p = pack->blob;
+	const uint8_t *end = pack->blob + blob_size;
+
+	if(
+		blob_size < PACK_HEADER_SIZE ||
+		pack_read_u32(&p) != PACK_MAGIC ||
+		pack_read_u32(&p) != PACK_VERSION
+	) {
+		log_warn("%s: not a shader cache pack or incompatible version, ignoring", path);
+		return 0;
+	}
+
+	uint32_t generation = pack_read_u32(&p);
+	uint32_t num_entries = pack_read_u32(&p);
+
+	for(uint32_t i = 0; i < num_entries; ++i) {
+		if(end - p < 1 || end - p < 1 + *p + 8) {
+			log_warn("%s: truncated after %u entries", path, i);
+			break;
+		}
+
+		char key[256];
+		uint key_len = *p++;
+		memcpy(key, p, key_len);
+		key[key_len] = 0;
+		p += key_len;
+
+		uint32_t last_used = pack_read_u32(&p);
+		uint32_t size = pack_read_u32(&p);
+
+		if((size_t)(end - p) < size) {
+			log_warn("%s: truncated after %u entries", path, i);
+			break;
+		}
+
+		ht_set(&pack->entries, key, ALLOC(PackEntry, {
+			.data = p,
+			.size = size,
+			.last_used = last_used,
+		}));
+
+		pack->total_size += size;
+		p += size;
+	}
+
+	log_debug("%s: %u entries, %zu bytes", path, pack->entries.num_elements_occupied, pack->total_size);
+	return generation;
+}
+
+typedef struct PackPruneItem {
+	char *key;
+	PackEntry *entry;
+} PackPruneItem;
+
+static int pack_prune_item_cmp(const void *a, const void *b) {
+	const PackEntry *ea = ((const PackPruneItem*)a)->entry;
+	const PackEntry *eb = ((const PackPruneItem*)b)->entry;
+	return (ea->last_used > eb->last_used) - (ea->last_used < eb->last_used);
+}
+
+static void pack_prune(Pack *pack, size_t budget) {
+	if(!budget || pack->total_size <= budget) {
+		return;
+	}
+
+	uint num_entries = pack->entries.num_elements_occupied;
+	auto items = ALLOC_ARRAY(num_entries, PackPruneItem);
+	uint i = 0;
+
+	ht_str2ptr_iter_t iter;
+	ht_iter_begin(&pack->entries, &iter);
+
+	for(;iter.has_data; ht_iter_next(&iter)) {
+		items[i++] = (PackPruneItem) { mem_strdup(iter.key), iter.value };
+	}
+
+	ht_iter_end(&iter);
+	assert(i == num_entries);
+
+	qsort(items, num_entries, sizeof(*items), pack_prune_item_cmp);
+
+	uint num_pruned = 0;
+
+	for(i = 0; i < num_entries; ++i) {
+		char *key = items[i].key;
+		PackEntry *e = items[i].entry;
+
+		if(pack->total_size > budget) {
+			pack->total_size -= e->size;
+			ht_unset(&pack->entries, key);
+
+			if(e->owns_data) {
+				mem_free((void*)e->data);
+			}
+
+			mem_free(e);
+			++num_pruned;
+		}
+
+		mem_free(key);
+	}
+
+	mem_free(items);
+	log_info("Pruned %u least recently used shader cache entries", num_pruned);
+}
+
+static size_t shader_cache_size_limit(void) {
+	return (uint64_t)env_get("TAISEI_SHADER_CACHE_SIZE_LIMIT", 64) << 20;
+}
+
+// Entry data is never freed or modified before shutdown, so the snapshot only copies the keys.
+static void pack_snapshot(Pack *pack, uint32_t generation, PackSnapshot *out) {
+	out->generation = generation;
+	out->num_entries = pack->entries.num_elements_occupied;
+	out->entries = ALLOC_ARRAY(out->num_entries, PackSnapshotEntry);
+	uint i = 0;
+
+	ht_str2ptr_iter_t iter;
+	ht_iter_begin(&pack->entries, &iter);
+
+	for(;iter.has_data; ht_iter_next(&iter)) {
+		PackEntry *e = iter.value;
+		out->entries[i++] = (PackSnapshotEntry) {
+			.key = mem_strdup(iter.key),
+			.data = e->data,
+			.size = e->size,
+			.last_used = e->last_used,
+		};
+	}
+
+	ht_iter_end(&iter);
+	assert(i == out->num_entries);
+}
+
+static void pack_snapshot_free(PackSnapshot *snap) {
+	for(uint i = 0; i < snap->num_entries; ++i) {
+		mem_free(snap->entries[i].key);
+	}
+
+	mem_free(snap->entries);
+	memset(snap, 0, sizeof(*snap));
+}
+
+static bool pack_save(const PackSnapshot *snap, SDL_IOStream *out) {
+	bool ok = true;
+
+	ok = ok && SDL_WriteU32LE(out, PACK_MAGIC);
+	ok = ok && SDL_WriteU32LE(out, PACK_VERSION);
+	ok = ok && SDL_WriteU32LE(out, snap->generation);
+	ok = ok && SDL_WriteU32LE(out, snap->num_entries);
+
+	for(uint i = 0; ok && i < snap->num_entries; ++i) {
+		const PackSnapshotEntry *e = snap->entries + i;
+		size_t key_len = strlen(e->key);
+		assert(key_len <= UINT8_MAX);
+
+		ok = ok && SDL_WriteU8(out, key_len);
+		ok = ok && SDL_WriteIO(out, e->key, key_len) == key_len;
+		ok = ok && SDL_WriteU32LE(out, e->last_used);
+		ok = ok && SDL_WriteU32LE(out, e->size);
+		ok = ok && SDL_WriteIO(out, e->data, e->size) == e->size;
+	}
+
+	if(!ok) {
+		log_sdl_error(LOG_ERROR, "SDL_WriteIO");
+	}
+
+	return ok;
+}
+
+// Adds entries that are in the on-disk pack but not in ours, e.g. saved by another instance.
+// Must be called with the mutex held.
+static void pack_merge(Pack *pack, Pack *disk, const char *path) {
+	uint num_merged = 0;
+
+	ht_str2ptr_iter_t iter;
+	ht_iter_begin(&disk->entries, &iter);
+
+	for(;iter.has_data; ht_iter_next(&iter)) {
+		if(!ht_get(&pack->entries, iter.key, NULL)) {
+			PackEntry *e = iter.value;
+			ht_set(&pack->entries, iter.key, ALLOC(PackEntry, {
+				.data = memdup(e->data, e->size),
+				.size = e->size,
+				.last_used = e->last_used,
+				.owns_data = true,
+			}));
+			pack->total_size += e->size;
+			++num_merged;
+		}
+	}
+
+	ht_iter_end(&iter);
+
+	if(num_merged) {
+		log_debug("%s: merged %u entries saved by another instance", path, num_merged);
+	}
+}
+
+static bool pack_save_atomic(const PackSnapshot *snap, const char *path) {
+	char *tmp_path = strfmt("%s.%llx-%llx.tmp", path,
+		(unsigned long long)SDL_GetCurrentThreadID(), (unsigned long long)time_get());
+	SDL_IOStream *out = vfs_open(tmp_path, VFS_MODE_WRITE);
+	bool ok = false;
+
+	if(out) {
+		ok = pack_save(snap, out);
+		ok = SDL_CloseIO(out) && ok;
+
+		if(ok && !(ok = vfs_rename(tmp_path, path))) {
+			log_error("Failed to replace %s: %s", path, vfs_get_error());
+		}
+
+		if(!ok && !vfs_remove(tmp_path)) {
+			log_warn("Failed to remove %s: %s", tmp_path, vfs_get_error());
+		}
+	} else {
+		log_error("VFS error: %s", vfs_get_error());
+	}
+
+	mem_free(tmp_path);
+	return ok;
+}
+
+// Must not be called with the mutex held, and only by one thread at a time: either the flush
+// task, or shutdown after it has finished. Pruning frees entries, so it's only allowed when
+// nothing else can be using them.
+static void shader_cache_save_user_pack(bool prune) {
+	Pack *user = &shader_cache.user;
+	Pack disk = {};
+	uint32_t disk_generation = pack_load(&disk, PACK_USER_PATH);
+
+	SDL_LockMutex(shader_cache.mutex);
+
+	shader_cache.generation = max(shader_cache.generation, disk_generation);
+	pack_merge(user, &disk, PACK_USER_PATH);
+
+	if(prune) {
+		pack_prune(user, shader_cache_size_limit());
+	}
+
+	uint num_saving = shader_cache.num_unsaved;
+	PackSnapshot snap;
+	pack_snapshot(user, shader_cache.generation, &snap);
+
+	SDL_UnlockMutex(shader_cache.mutex);
+
+	pack_free(&disk);
+
+	if(pack_save_atomic(&snap, PACK_USER_PATH)) {
+		log_debug("%s: saved %u entries (%u new)", PACK_USER_PATH, snap.num_entries, num_saving);
+
+		SDL_LockMutex(shader_cache.mutex);
+		shader_cache.num_unsaved -= num_saving;
+		SDL_UnlockMutex(shader_cache.mutex);
+	}
+
+	pack_snapshot_free(&snap);
+}
+
+void shader_cache_init(void) {
+	assert(!shader_cache.initialized);
+
+	if(!(shader_cache.mutex = SDL_CreateMutex())) {
+		log_sdl_error(LOG_ERROR, "SDL_CreateMutex");
+		return;
+	}
+
+	shader_cache.generation = pack_load(&shader_cache.user, PACK_USER_PATH) + 1;
+	pack_load(&shader_cache.bundle, PACK_BUNDLE_PATH);
+	shader_cache.initialized = true;
+}
+
+void shader_cache_shutdown(void) {
+	if(!shader_cache.initialized) {
+		return;
+	}
+
+	if(shader_cache.flush_task) {
+		task_finish(shader_cache.flush_task, NULL);
+		shader_cache.flush_task = NULL;
+	}
+
+	Pack *user = &shader_cache.user;
+
+	const char *export_path = env_get_string_nonempty("TAISEI_SHADER_CACHE_EXPORT", NULL);
+
+	if(export_path) {
+		// Everything that was used this session, including entries that came from the bundle
+		ht_str2ptr_iter_t iter;
+		ht_iter_begin(&shader_cache.bundle.entries, &iter);
+
+		for(;iter.has_data; ht_iter_next(&iter)) {
+			if(!ht_get(&user->entries, iter.key, NULL)) {
+				PackEntry *e = iter.value;
+				ht_set(&user->entries, iter.key, ALLOC(PackEntry, {
+					.data = memdup(e->data, e->size),
+					.size = e->size,
+					.owns_data = true,
+				}));
+			}
+		}
+
+		ht_iter_end(&iter);
+
+		SDL_IOStream *out = SDL_IOFromFile(export_path, "wb");
+
+		if(out) {
+			PackSnapshot snap;
+			pack_snapshot(user, 0, &snap);
+
+			if(pack_save(&snap, out)) {
+				log_info("Exported %u shader cache entries to %s", snap.num_entries, export_path);
+			}
+
+			pack_snapshot_free(&snap);
+			SDL_CloseIO(out);
+		} else {
+			log_sdl_error(LOG_ERROR, "SDL_IOFromFile");
+		}
+	} else {
+		size_t budget = shader_cache_size_limit();
+
+		if(shader_cache.num_unsaved || (budget && user->total_size > budget)) {
+			shader_cache_save_user_pack(true);
+		}
+	}
+
+	pack_free(user);
+	pack_free(&shader_cache.bundle);
+	SDL_DestroyMutex(shader_cache.mutex);
+	memset(&shader_cache, 0, sizeof(shader_cache));
+}
+
 bool shader_cache_get(const char *hash, const char *key, ShaderSource *entry, MemArena *arena) {
-	char path[256];
-	snprintf(path, sizeof(path), "cache/shaders/%s/%s", hash, key);
+	if(!shader_cache.initialized) {
+		return false;
+	}
+
+	char pack_key[256];
+	snprintf(pack_key, sizeof(pack_key), "%s/%s", hash, key);
+
+	SDL_LockMutex(shader_cache.mutex);
+
+	PackEntry *e = ht_get(&shader_cache.user.entries, pack_key, NULL);
 
-	SDL_IOStream *stream = vfs_open(path, VFS_MODE_READ);
+	if(e) {
+		e->last_used = shader_cache.generation;
+	} else {
+		e = ht_get(&shader_cache.bundle.entries, pack_key, NULL);
+	}
+
+	SDL_UnlockMutex(shader_cache.mutex);
 
-	if(stream == NULL) {
+	if(!e) {
 		return false;
 	}
 
+	// Entries are never removed or modified until shutdown (saving only adds entries),
+	// so it's safe to use outside of the lock.
+	SDL_IOStream *stream = NOT_NULL(SDL_IOFromConstMem(e->data, e->size));
 	stream = NOT_NULL(SDL_RWWrapZstdReader(stream, true));
 	bool result = shader_cache_load_entry(stream, entry, arena);
 	SDL_CloseIO(stream);
 
-	log_debug("%s %s/%s from cache", result ? "Retrieved " : "Failed to retrieve",  hash, key);
+	log_debug("%s %s from cache", result ? "Retrieved " : "Failed to retrieve", pack_key);
 	return result;
 }
 
-static bool shader_cache_set_raw(const char *hash, const char *key, uint8_t *entry, size_t entry_size) {
-	char path[256];
+static uint8_t *shader_cache_compress(const uint8_t *entry, size_t entry_size, size_t *out_size) {
+	void *buf;
+	SDL_IOStream *abuf = SDL_RWAutoBuffer(&buf, entry_size);
+	SDL_IOStream *zstd = NOT_NULL(SDL_RWWrapZstdWriter(abuf, RW_ZSTD_LEVEL_DEFAULT, false));
+	SDL_WriteIO(zstd, entry, entry_size);
+	SDL_CloseIO(zstd);
 
-	vfs_mkdir("cache/shaders");
-	snprintf(path, sizeof(path), "cache/shaders/%s", hash);
-	vfs_mkdir(path);
-	snprintf(path, sizeof(path), "cache/shaders/%s/%s", hash, key);
+	*out_size = SDL_TellIO(abuf);
+	uint8_t *result = memdup(buf, *out_size);
+	SDL_CloseIO(abuf);
 
-	SDL_IOStream *out = vfs_open(path, VFS_MODE_WRITE);
+	return result;
+}
 
-	if(out == NULL) {
-		log_error("VFS error: %s", vfs_get_error());
+bool shader_cache_set(const char *hash, const char *key, const ShaderSource *src) {
+	if(!shader_cache.initialized) {
+		return false;
+	}
+
+	size_t entry_size;
+	uint8_t *entry = shader_cache_construct_entry(src, NULL, &entry_size);
+
+	if(entry == NULL) {
 		return false;
 	}
 
-	out = NOT_NULL(SDL_RWWrapZstdWriter(out, RW_ZSTD_LEVEL_DEFAULT, true));
-	SDL_WriteIO(out, entry, entry_size);
-	SDL_CloseIO(out);
+	size_t data_size;
+	uint8_t *data = shader_cache_compress(entry, entry_size, &data_size);
+	mem_free(entry);
 
+	char pack_key[256];
+	snprintf(pack_key, sizeof(pack_key), "%s/%s", hash, key);
+
+	SDL_LockMutex(shader_cache.mutex);
+
+	// Content-addressed: an existing entry under the same key is identical, and may be in use.
+	if(!ht_get(&shader_cache.user.entries, pack_key, NULL)) {
+		ht_set(&shader_cache.user.entries, pack_key, ALLOC(PackEntry, {
+			.data = data,
+			.size = data_size,
+			.last_used = shader_cache.generation,
+			.owns_data = true,
+		}));
+		shader_cache.user.total_size += data_size;
+		++shader_cache.num_unsaved;
+		data = NULL;
+	}
+
+	SDL_UnlockMutex(shader_cache.mutex);
+
+	mem_free(data);
+	log_debug("Stored %s in cache", pack_key);
 	return true;
 }
 
-bool shader_cache_set(const char *hash, const char *key, const ShaderSource *src) {
-	size_t entry_size;
-	uint8_t *entry = shader_cache_construct_entry(src, NULL, &entry_size);
+static void *shader_cache_flush_task(void *arg) {
+	shader_cache_save_user_pack(false);
+	return NULL;
+}
 
-	if(entry != NULL) {
-		shader_cache_set_raw(hash, key, entry, entry_size);
-		mem_free(entry);
-		log_debug("Stored %s/%s in cache", hash, key);
-		return true;
+void shader_cache_flush(void) {
+	if(!shader_cache.initialized) {
+		return;
 	}
 
-	return false;
+	if(shader_cache.flush_task) {
+		switch(task_status(shader_cache.flush_task)) {
+			case TASK_PENDING:
+			case TASK_RUNNING:
+				// Still busy; anything it misses is picked up by the next flush or on shutdown.
+				return;
+
+			default:
+				task_detach(shader_cache.flush_task);
+				shader_cache.flush_task = NULL;
+				break;
+		}
+	}
+
+	SDL_LockMutex(shader_cache.mutex);
+	bool dirty = shader_cache.num_unsaved;
+	SDL_UnlockMutex(shader_cache.mutex);
+
+	if(!dirty) {
+		return;
+	}
+
+	shader_cache.flush_task = taskmgr_global_submit((TaskParams) {
+		.callback = shader_cache_flush_task,
+		.prio = 1,
+	});
+
+	if(!shader_cache.flush_task) {
+		shader_cache_save_user_pack(false);
+	}
 }
 
 bool shader_cache_hash(const ShaderSource *src, const ShaderMacro *macros, size_t buf_size, char out_buf[buf_size]) {
@@ -336,8 +867,6 @@ bool shader_cache_hash(const ShaderSource *src, const ShaderMacro *macros, size_
 	sha256_hexdigest(entry, entry_size, out_buf, buf_size);
 	snprintf(out_buf + sha_size, buf_size - sha_size, "-%zx", entry_size);
 
-	// shader_cache_set_raw(out_buf, "orig", entry, entry_size);
-
 	mem_free(entry);
 	return true;
 }
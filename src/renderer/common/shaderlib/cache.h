@@ -19,6 +19,9 @@
 // null terminator   : 1 byte
 #define SHADER_CACHE_HASH_BUFSIZE 74
 
+void shader_cache_init(void);
+void shader_cache_shutdown(void);
+
 bool shader_cache_hash(const ShaderSource *src, const ShaderMacro *macros, size_t buf_size, char out_buf[buf_size])
 	attr_nonnull(1, 4) attr_nodiscard;
 
@@ -27,3 +30,7 @@ bool shader_cache_get(const char *hash, const char *key, ShaderSource *entry, Me
 
 bool shader_cache_set(const char *hash, const char *key, const ShaderSource *src)
 	attr_nonnull(1, 2, 3);
+
+// Starts writing out entries added since the last save in the background, if there are any and
+// no save is in progress already. Main thread only.
+void shader_cache_flush(void);
@@ -9,6 +9,8 @@
 #include "sprite_batch_internal.h"
 
 #include "../api.h"
+#include "dynarray.h"
+#include "taskmanager.h"
 #include "util.h"
 #include "util/glm.h"
 #include "resource/sprite.h"
@@ -25,6 +27,56 @@
 
 #define SIZEOF_SPRITE_ATTRIBS (offsetof(SpriteInstanceAttribs, end_of_fields))
 
+// Initial size of the vertex buffer, in instances. It grows as needed.
+#define SPRITE_BATCH_CAPACITY (1 << 12)
+
+/*
+ * Deferred instances are finished on worker threads if there are at least this many in a flush.
+ * Finishing and packing one instance takes about 35 ns on a desktop CPU, and handing a flush to
+ * the task manager costs roughly 10 µs, so below a few hundred instances it isn't worth it.
+ */
+#define SPRITE_BATCH_PARALLEL_THRESHOLD 1024
+#define SPRITE_BATCH_JOB_SIZE 256u
+
+static_assert(SPRITE_BATCH_PARALLEL_THRESHOLD < SPRITE_BATCH_CAPACITY);
+
+// Everything that forces a flush when it changes between two sprites
+typedef struct SpriteBatchKey {
+	mat4 projection;
+	Texture *primary_texture;
+	Texture *aux_textures[R_NUM_SPRITE_AUX_TEXTURES];
+	ShaderProgram *shader;
+	Framebuffer *framebuffer;
+	BlendMode blend;
+	CullFaceMode cull_mode;
+	DepthTestFunc depth_func;
+	r_capability_bits_t capbits;
+} SpriteBatchKey;
+
+// What _r_sprite_batch_finish_attribs() needs besides the attributes themselves, copied so that
+// it can be deferred. The sprite's texture area and size go straight into the attributes.
+typedef struct SpriteBatchInput {
+	FloatRect padding;
+	FloatOffset pos;
+	SpriteScaleParams scale;
+	SpriteRotationParams rotation;
+	SpriteFlipParams flip;
+} SpriteBatchInput;
+
+typedef struct SpriteBatchBucket {
+	SpriteBatchKey key;
+	// partially initialized until flushed, see _r_sprite_batch_finish_unordered_attribs()
+	DYNAMIC_ARRAY(SpriteInstanceAttribs) instances;
+	DYNAMIC_ARRAY(SpriteBatchInput) inputs;
+} SpriteBatchBucket;
+
+typedef struct SpriteBatchJob {
+	SpriteInstanceAttribs *attribs;
+	const SpriteBatchInput *inputs;
+	char *packed;
+	uint count;
+} SpriteBatchJob;
+
 static struct SpriteBatchState {
 	// constants (set once on init and not expected to change)
 	VertexArray *varr;
@@ -42,9 +94,37 @@ static struct SpriteBatchState {
 	BlendMode blend;
 	CullFaceMode cull_mode;
 	DepthTestFunc depth_func;
-	uint num_pending;
+	uint num_pending;  // includes the deferred run below
 	r_capability_bits_t capbits;
 
+	// pending sprites drawn through r_draw_sprite() whose attributes are not finished yet;
+	// they always come after any instances already written into vbuf
+	struct {
+		DYNAMIC_ARRAY(SpriteInstanceAttribs) instances;
+		DYNAMIC_ARRAY(SpriteBatchInput) inputs;
+	} deferred;
+
+	// work split for _r_sprite_batch_run_jobs()
+	DYNAMIC_ARRAY(SpriteBatchJob) jobs;
+	DYNAMIC_ARRAY(Task*) tasks;
+	bool parallel;
+
+	// finished attributes packed with the vertex buffer's stride, so that a whole run can be
+	// written into it at once
+	char *staging;
+	size_t staging_size;
+
+	// deferred instances, see r_sprite_batch_begin_unordered()
+	struct {
+		// buckets past num_active are kept around to reuse their allocations
+		DYNAMIC_ARRAY(SpriteBatchBucket) buckets;
+		uint num_active;
+		uint num_instances;
+		uint last_used;
+		uint nesting;
+		bool flushing;
+	} unordered;
+
 #if SPRITE_BATCH_STATS
 	struct {
 		uint flushes;
@@ -91,9 +171,7 @@ void r_sprite_batch_init(void) {
 	#undef VERTEX_OFS
 	#undef INSTANCE_OFS
 
-	uint capacity = 1 << 11;
-
-	_r_sprite_batch.vbuf = r_vertex_buffer_create(sz_attr * capacity, NULL);
+	_r_sprite_batch.vbuf = r_vertex_buffer_create(sz_attr * SPRITE_BATCH_CAPACITY, NULL);
 	r_vertex_buffer_set_debug_label(_r_sprite_batch.vbuf, "Sprite batch vertex buffer");
 	r_vertex_buffer_invalidate(_r_sprite_batch.vbuf);
 
@@ -110,18 +188,35 @@ void r_sprite_batch_init(void) {
 	_r_sprite_batch.quad.vertex_array = _r_sprite_batch.varr;
 
 	_r_sprite_batch.renderer_features = r_features();
+	_r_sprite_batch.parallel = SDL_GetNumLogicalCPUCores() > 1;
 }
 
 void r_sprite_batch_shutdown(void) {
+	assert(_r_sprite_batch.unordered.nesting == 0);
+
+	dynarray_foreach_elem(&_r_sprite_batch.unordered.buckets, SpriteBatchBucket *b, {
+		dynarray_free_data(&b->instances);
+		dynarray_free_data(&b->inputs);
+	});
+
+	dynarray_free_data(&_r_sprite_batch.unordered.buckets);
+	dynarray_free_data(&_r_sprite_batch.deferred.instances);
+	dynarray_free_data(&_r_sprite_batch.deferred.inputs);
+	dynarray_free_data(&_r_sprite_batch.jobs);
+	dynarray_free_data(&_r_sprite_batch.tasks);
+	mem_free(_r_sprite_batch.staging);
 	r_vertex_array_destroy(_r_sprite_batch.varr);
 	r_vertex_buffer_destroy(_r_sprite_batch.vbuf);
 }
 
-void r_flush_sprites(void) {
+static void _r_sprite_batch_write_deferred(void);
+
+static void _r_sprite_batch_flush_pending(void) {
 	if(_r_sprite_batch.num_pending == 0) {
 		return;
 	}
 
+	_r_sprite_batch_write_deferred();
 	uint pending = _r_sprite_batch.num_pending;
 
 	// needs to be done early to thwart recursive calls
@@ -182,84 +277,292 @@ void r_flush_sprites(void) {
 	r_state_pop();
 }
 
-static void _r_sprite_batch_compute_attribs(
+// Sets up the parts of the attributes that depend on the current renderer state.
+static void _r_sprite_batch_begin_attribs(
+	const SpriteParams *restrict params,
+	SpriteInstanceAttribs *restrict attribs
+) {
+	r_mat_mv_current(attribs->mv_transform);
+	r_mat_tex_current(attribs->tex_transform);
+
+	if(params->color == NULL) {
+		// XXX: should we use r_color_current here?
+		attribs->rgba = *RGBA(1, 1, 1, 1);
+	} else {
+		attribs->rgba = *params->color;
+	}
+
+	if(params->shader_params != NULL) {
+		attribs->custom = *params->shader_params;
+	} else {
+		attribs->custom = (ShaderCustomParams) { };
+	}
+}
+
+INLINE void _r_sprite_batch_make_input(
 	const Sprite *restrict spr,
 	const SpriteParams *restrict params,
-	SpriteInstanceAttribs *restrict out_attribs
+	SpriteInstanceAttribs *restrict attribs,
+	SpriteBatchInput *restrict input
 ) {
-	SpriteInstanceAttribs attribs = { };
-	r_mat_mv_current(attribs.mv_transform);
-	r_mat_tex_current(attribs.tex_transform);
+	attribs->texrect = spr->tex_area;
+	attribs->sprite_size = spr->extent;
+	input->padding = spr->padding;
+	input->pos = params->pos;
+	input->scale = params->scale;
+	input->rotation = params->rotation;
+	input->flip = params->flip;
+}
 
-	float scale_x = params->scale.x ? params->scale.x : 1;
-	float scale_y = params->scale.y ? params->scale.y : scale_x;
+// Does the rest of the work. Doesn't touch any global state, so this may run on any thread.
+static void _r_sprite_batch_finish_attribs(
+	const SpriteBatchInput *restrict in,
+	SpriteInstanceAttribs *restrict attribs
+) {
+	float scale_x = in->scale.x ? in->scale.x : 1;
+	float scale_y = in->scale.y ? in->scale.y : scale_x;
 
-	FloatOffset ofs = spr->padding.offset;
-	FloatExtent imgdims = spr->extent;
-	imgdims.as_cmplx -= spr->padding.extent.as_cmplx;
+	FloatOffset ofs = in->padding.offset;
+	FloatExtent imgdims = attribs->sprite_size;
+	imgdims.as_cmplx -= in->padding.extent.as_cmplx;
 
-	glm_translate_x(attribs.mv_transform, params->pos.x);
-	glm_translate_y(attribs.mv_transform, params->pos.y);
+	glm_translate_x(attribs->mv_transform, in->pos.x);
+	glm_translate_y(attribs->mv_transform, in->pos.y);
 
-	if(params->rotation.angle)
+	if(in->rotation.angle)
 	{
-		float *rvec = (float*)params->rotation.vector;
+		float *rvec = (float*)in->rotation.vector;
 
 		if(LIKELY(rvec[0] == 0 && rvec[1] == 0 && (rvec[2] == 0 || rvec[2] == 1))) {
-			glm_rotate_z(attribs.mv_transform, params->rotation.angle, attribs.mv_transform);
+			glm_rotate_z(attribs->mv_transform, in->rotation.angle, attribs->mv_transform);
 		} else {
-			glm_rotate(attribs.mv_transform, params->rotation.angle, rvec);
+			glm_rotate(attribs->mv_transform, in->rotation.angle, rvec);
 		}
 	}
 
 	if(ofs.x || ofs.y) {
-		glm_vec4_scale(attribs.mv_transform[0], scale_x, attribs.mv_transform[0]);
-		glm_vec4_scale(attribs.mv_transform[1], scale_y, attribs.mv_transform[1]);
+		glm_vec4_scale(attribs->mv_transform[0], scale_x, attribs->mv_transform[0]);
+		glm_vec4_scale(attribs->mv_transform[1], scale_y, attribs->mv_transform[1]);
 
-		if(UNLIKELY(params->flip.x)) {
+		if(UNLIKELY(in->flip.x)) {
 			ofs.x = -ofs.x;
 		}
 
-		if(UNLIKELY(params->flip.y)) {
+		if(UNLIKELY(in->flip.y)) {
 			ofs.y = -ofs.y;
 		}
 
-		glm_translate_x(attribs.mv_transform, ofs.x);
-		glm_translate_y(attribs.mv_transform, ofs.y);
+		glm_translate_x(attribs->mv_transform, ofs.x);
+		glm_translate_y(attribs->mv_transform, ofs.y);
 
-		glm_vec4_scale(attribs.mv_transform[0], imgdims.w, attribs.mv_transform[0]);
-		glm_vec4_scale(attribs.mv_transform[1], imgdims.h, attribs.mv_transform[1]);
+		glm_vec4_scale(attribs->mv_transform[0], imgdims.w, attribs->mv_transform[0]);
+		glm_vec4_scale(attribs->mv_transform[1], imgdims.h, attribs->mv_transform[1]);
 	} else {
-		glm_vec4_scale(attribs.mv_transform[0], scale_x * imgdims.w, attribs.mv_transform[0]);
-		glm_vec4_scale(attribs.mv_transform[1], scale_y * imgdims.h, attribs.mv_transform[1]);
+		glm_vec4_scale(attribs->mv_transform[0], scale_x * imgdims.w, attribs->mv_transform[0]);
+		glm_vec4_scale(attribs->mv_transform[1], scale_y * imgdims.h, attribs->mv_transform[1]);
 	}
 
-	if(params->color == NULL) {
-		// XXX: should we use r_color_current here?
-		attribs.rgba = *RGBA(1, 1, 1, 1);
+	if(UNLIKELY(in->flip.x)) {
+		attribs->texrect.x += attribs->texrect.w;
+		attribs->texrect.w = -attribs->texrect.w;
+	}
+
+	if(UNLIKELY(in->flip.y)) {
+		attribs->texrect.y += attribs->texrect.h;
+		attribs->texrect.h = -attribs->texrect.h;
+	}
+}
+
+static void _r_sprite_batch_apply_key(const SpriteBatchKey *key) {
+	glm_mat4_copy((vec4*)key->projection, _r_sprite_batch.projection);
+	_r_sprite_batch.primary_texture = key->primary_texture;
+	_r_sprite_batch.shader = key->shader;
+	_r_sprite_batch.framebuffer = key->framebuffer;
+	_r_sprite_batch.blend = key->blend;
+	_r_sprite_batch.cull_mode = key->cull_mode;
+	_r_sprite_batch.depth_func = key->depth_func;
+	_r_sprite_batch.capbits = key->capbits;
+
+	for(uint i = 0; i < R_NUM_SPRITE_AUX_TEXTURES; ++i) {
+		if(key->aux_textures[i]) {
+			_r_sprite_batch.aux_textures[i] = key->aux_textures[i];
+		}
+	}
+}
+
+static void *_r_sprite_batch_job(void *arg) {
+	SpriteBatchJob *job = arg;
+
+	for(uint i = 0; i < job->count; ++i) {
+		_r_sprite_batch_finish_attribs(job->inputs + i, job->attribs + i);
+		memcpy(job->packed + i * SIZEOF_SPRITE_ATTRIBS, job->attribs + i, SIZEOF_SPRITE_ATTRIBS);
+	}
+
+	return NULL;
+}
+
+// Returns a buffer for at least count packed instances; only valid until the next call.
+static char *_r_sprite_batch_get_staging(uint count) {
+	size_t size = count * SIZEOF_SPRITE_ATTRIBS;
+
+	if(size > _r_sprite_batch.staging_size) {
+		_r_sprite_batch.staging_size = topow2(size);
+		mem_free(_r_sprite_batch.staging);
+		_r_sprite_batch.staging = mem_alloc(_r_sprite_batch.staging_size);
+	}
+
+	return _r_sprite_batch.staging;
+}
+
+static void _r_sprite_batch_add_jobs(
+	SpriteInstanceAttribs *attribs,
+	const SpriteBatchInput *inputs,
+	char *packed,
+	uint count
+) {
+	for(uint ofs = 0; ofs < count; ofs += SPRITE_BATCH_JOB_SIZE) {
+		dynarray_append(&_r_sprite_batch.jobs, {
+			.attribs = attribs + ofs,
+			.inputs = inputs + ofs,
+			.packed = packed + ofs * SIZEOF_SPRITE_ATTRIBS,
+			.count = min(SPRITE_BATCH_JOB_SIZE, count - ofs),
+		});
+	}
+}
+
+/*
+ * Runs the jobs queued with _r_sprite_batch_add_jobs(). Large batches are handed to the global
+ * task manager; the main thread works on the first job itself, then waits for the rest
+ * (task_finish() runs them in place if no worker has picked them up yet). The jobs only write
+ * to their own slices of the attribute arrays, so the order of the instances is preserved.
+ */
+static void _r_sprite_batch_run_jobs(uint num_instances) {
+	auto jobs = &_r_sprite_batch.jobs;
+	auto tasks = &_r_sprite_batch.tasks;
+
+	if(num_instances < SPRITE_BATCH_PARALLEL_THRESHOLD || !_r_sprite_batch.parallel) {
+		dynarray_foreach_elem(jobs, SpriteBatchJob *job, {
+			_r_sprite_batch_job(job);
+		});
 	} else {
-		attribs.rgba = *params->color;
+		tasks->num_elements = 0;
+
+		for(uint i = 1; i < jobs->num_elements; ++i) {
+			dynarray_append(tasks, taskmgr_global_submit((TaskParams) {
+				.callback = _r_sprite_batch_job,
+				.userdata = dynarray_get_ptr(jobs, i),
+				.topmost = true,
+			}));
+		}
+
+		_r_sprite_batch_job(dynarray_get_ptr(jobs, 0));
+
+		dynarray_foreach(tasks, int i, Task **task, {
+			if(*task) {
+				task_finish(*task, NULL);
+			} else {
+				_r_sprite_batch_job(dynarray_get_ptr(jobs, i + 1));
+			}
+		});
 	}
 
-	attribs.texrect = spr->tex_area;
+	jobs->num_elements = 0;
+}
+
+// Finishes the deferred run of ordered sprites and streams it into vbuf, in submission order.
+static void _r_sprite_batch_write_deferred(void) {
+	auto d = &_r_sprite_batch.deferred;
+	uint count = d->instances.num_elements;
 
-	if(UNLIKELY(params->flip.x)) {
-		attribs.texrect.x += attribs.texrect.w;
-		attribs.texrect.w = -attribs.texrect.w;
+	if(count == 0) {
+		return;
 	}
 
-	if(UNLIKELY(params->flip.y)) {
-		attribs.texrect.y += attribs.texrect.h;
-		attribs.texrect.h = -attribs.texrect.h;
+	assert(d->inputs.num_elements == count);
+	char *packed = _r_sprite_batch_get_staging(count);
+	_r_sprite_batch_add_jobs(d->instances.data, d->inputs.data, packed, count);
+	_r_sprite_batch_run_jobs(count);
+
+	SDL_IOStream *stream = r_vertex_buffer_get_stream(_r_sprite_batch.vbuf);
+	SDL_WriteIO(stream, packed, count * SIZEOF_SPRITE_ATTRIBS);
+
+	d->instances.num_elements = 0;
+	d->inputs.num_elements = 0;
+}
+
+// Completes the attributes of all instances in the unordered buckets, and packs them bucket
+// after bucket into the returned buffer.
+static char *_r_sprite_batch_finish_unordered_attribs(void) {
+	auto u = &_r_sprite_batch.unordered;
+	char *packed = _r_sprite_batch_get_staging(u->num_instances);
+	char *p = packed;
+
+	for(uint i = 0; i < u->num_active; ++i) {
+		SpriteBatchBucket *b = dynarray_get_ptr(&u->buckets, i);
+		uint count = b->instances.num_elements;
+		assert(count == b->inputs.num_elements);
+		_r_sprite_batch_add_jobs(b->instances.data, b->inputs.data, p, count);
+		p += count * SIZEOF_SPRITE_ATTRIBS;
 	}
 
-	attribs.sprite_size = spr->extent;
+	_r_sprite_batch_run_jobs(u->num_instances);
+	return packed;
+}
 
-	if(params->shader_params != NULL) {
-		attribs.custom = *params->shader_params;
+static void _r_sprite_batch_flush_unordered(void) {
+	auto u = &_r_sprite_batch.unordered;
+
+	if(u->num_active == 0 || u->flushing) {
+		return;
 	}
 
-	*out_attribs = attribs;
+	// drawing the buckets calls back into r_flush_sprites()
+	u->flushing = true;
+	_r_sprite_batch_flush_pending();
+	const char *packed = _r_sprite_batch_finish_unordered_attribs();
+
+	SDL_IOStream *stream = r_vertex_buffer_get_stream(_r_sprite_batch.vbuf);
+
+	for(uint i = 0; i < u->num_active; ++i) {
+		SpriteBatchBucket *b = dynarray_get_ptr(&u->buckets, i);
+		uint count = b->instances.num_elements;
+
+		if(count == 0) {
+			continue;
+		}
+
+		_r_sprite_batch_apply_key(&b->key);
+
+		SDL_WriteIO(stream, packed, count * SIZEOF_SPRITE_ATTRIBS);
+		packed += count * SIZEOF_SPRITE_ATTRIBS;
+
+		_r_sprite_batch.num_pending = count;
+		b->instances.num_elements = 0;
+		b->inputs.num_elements = 0;
+		_r_sprite_batch_flush_pending();
+	}
+
+	u->num_active = 0;
+	u->num_instances = 0;
+	u->last_used = 0;
+	u->flushing = false;
+}
+
+void r_flush_sprites(void) {
+	_r_sprite_batch_flush_pending();
+	_r_sprite_batch_flush_unordered();
+}
+
+void r_sprite_batch_begin_unordered(void) {
+	_r_sprite_batch.unordered.nesting++;
+}
+
+void r_sprite_batch_end_unordered(void) {
+	assert(_r_sprite_batch.unordered.nesting > 0);
+
+	if(--_r_sprite_batch.unordered.nesting == 0) {
+		_r_sprite_batch_flush_unordered();
+	}
 }
 
 INLINE void _r_sprite_batch_process_params(
@@ -283,7 +586,82 @@ INLINE void _r_sprite_batch_process_params(
 	}
 }
 
+static void _r_sprite_batch_make_key(const SpriteStateParams *stp, SpriteBatchKey *key) {
+	// zeroed, so that padding and unused fields compare equal
+	memset(key, 0, sizeof(*key));
+
+	glm_mat4_copy(*r_mat_proj_current_ptr(), key->projection);
+	key->primary_texture = stp->primary_texture;
+	memcpy(key->aux_textures, stp->aux_textures, sizeof(key->aux_textures));
+	key->shader = NOT_NULL(stp->shader);
+	key->framebuffer = r_framebuffer_current();
+	key->blend = stp->blend;
+	key->capbits = r_capabilities_current();
+
+	if(key->capbits & r_capability_bit(RCAP_DEPTH_TEST)) {
+		key->depth_func = r_depth_func_current();
+	}
+
+	if(key->capbits & r_capability_bit(RCAP_CULL_FACE)) {
+		key->cull_mode = r_cull_current();
+	}
+}
+
+static void _r_sprite_batch_add_unordered(
+	const SpriteStateParams *restrict stp,
+	const Sprite *restrict spr,
+	const SpriteParams *restrict params
+) {
+	auto u = &_r_sprite_batch.unordered;
+	SpriteBatchKey key;
+	_r_sprite_batch_make_key(stp, &key);
+
+	// Consecutive sprites usually share state, so check the last used bucket first.
+	// Otherwise just scan; there are rarely more than a few dozen distinct states.
+	SpriteBatchBucket *bucket = NULL;
+
+	if(
+		u->last_used < u->num_active &&
+		!memcmp(&key, &dynarray_get_ptr(&u->buckets, u->last_used)->key, sizeof(key))
+	) {
+		bucket = dynarray_get_ptr(&u->buckets, u->last_used);
+	} else {
+		for(uint i = 0; i < u->num_active; ++i) {
+			SpriteBatchBucket *b = dynarray_get_ptr(&u->buckets, i);
+
+			if(!memcmp(&key, &b->key, sizeof(key))) {
+				bucket = b;
+				u->last_used = i;
+				break;
+			}
+		}
+	}
+
+	if(!bucket) {
+		if(u->num_active == u->buckets.num_elements) {
+			dynarray_append(&u->buckets, {});
+		}
+
+		u->last_used = u->num_active++;
+		bucket = dynarray_get_ptr(&u->buckets, u->last_used);
+		bucket->key = key;
+		assert(bucket->instances.num_elements == 0);
+	}
+
+	SpriteInstanceAttribs *attribs = dynarray_append(&bucket->instances);
+	_r_sprite_batch_begin_attribs(params, attribs);
+	_r_sprite_batch_make_input(spr, params, attribs, dynarray_append(&bucket->inputs));
+	u->num_instances++;
+
+#if SPRITE_BATCH_STATS
+	_r_sprite_batch.frame_stats.sprites++;
+#endif
+}
+
 void r_sprite_batch_prepare_state(const SpriteStateParams *stp) {
+	// Instances added directly can't be deferred, so they act as a barrier
+	_r_sprite_batch_flush_unordered();
+
 	if(stp->primary_texture != _r_sprite_batch.primary_texture) {
 		r_flush_sprites();
 		_r_sprite_batch.primary_texture = stp->primary_texture;
@@ -347,6 +725,9 @@ void r_sprite_batch_prepare_state(const SpriteStateParams *stp) {
 }
 
 void r_sprite_batch_add_instance(const SpriteInstanceAttribs *attribs) {
+	// keep the order of submission
+	_r_sprite_batch_write_deferred();
+
 	SDL_IOStream *stream = r_vertex_buffer_get_stream(_r_sprite_batch.vbuf);
 	SDL_WriteIO(stream, attribs, SIZEOF_SPRITE_ATTRIBS);
 
@@ -359,13 +740,27 @@ void r_sprite_batch_add_instance(const SpriteInstanceAttribs *attribs) {
 
 void r_draw_sprite(const SpriteParams *params) {
 	SpriteStateParams state_params;
-	SpriteInstanceAttribs attribs;
 	Sprite *spr;
 
 	_r_sprite_batch_process_params(params, &state_params, &spr);
+
+	if(_r_sprite_batch.unordered.nesting) {
+		_r_sprite_batch_add_unordered(&state_params, spr, params);
+		return;
+	}
+
+	// Any state change flushes the deferred run, so it only ever holds same-state sprites.
+	// Their attributes are finished when the run is flushed; long runs in parallel.
 	r_sprite_batch_prepare_state(&state_params);
-	_r_sprite_batch_compute_attribs(spr, params, &attribs);
-	r_sprite_batch_add_instance(&attribs);
+	auto d = &_r_sprite_batch.deferred;
+	SpriteInstanceAttribs *attribs = dynarray_append(&d->instances);
+	_r_sprite_batch_begin_attribs(params, attribs);
+	_r_sprite_batch_make_input(spr, params, attribs, dynarray_append(&d->inputs));
+	_r_sprite_batch.num_pending++;
+
+#if SPRITE_BATCH_STATS
+	_r_sprite_batch.frame_stats.sprites++;
+#endif
 }
 
 #if SPRITE_BATCH_STATS
@@ -413,4 +808,22 @@ void _r_sprite_batch_texture_deleted(Texture *tex) {
 			_r_sprite_batch.aux_textures[i] = NULL;
 		}
 	}
+
+	// Deferred sprites using it can't be drawn anymore
+	auto u = &_r_sprite_batch.unordered;
+
+	for(uint i = 0; i < u->num_active; ++i) {
+		SpriteBatchBucket *b = dynarray_get_ptr(&u->buckets, i);
+		bool uses_tex = b->key.primary_texture == tex;
+
+		for(uint j = 0; j < R_NUM_SPRITE_AUX_TEXTURES; ++j) {
+			uses_tex |= b->key.aux_textures[j] == tex;
+		}
+
+		if(uses_tex) {
+			u->num_instances -= b->instances.num_elements;
+			b->instances.num_elements = 0;
+			b->inputs.num_elements = 0;
+		}
+	}
 }
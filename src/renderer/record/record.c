@@ -0,0 +1,1131 @@
+/*
+ * This software is licensed under the terms of the MIT License.
+ * See COPYING for further information.
+ * ---
+ * Copyright (c) 2011-2024, Lukas Weber <laochailan@web.de>.
+ * Copyright (c) 2012-2024, Andrei Alexeyev <akari@taisei-project.org>.
+ */
+
+/*
+ * A renderer that doesn't render anything, but keeps track of everything the frontend asks
+ * of it: draw calls, state changes, uploads. Meant for measuring the CPU side of the draw path
+ * on machines without a GPU. Objects are real (so queries return what was set), but no pixel
+ * data is retained. Uniforms are taken from the uniform declarations in GLSL sources, so that
+ * uniform uploads can be counted too.
+ *
+ * A JSON summary is printed to stdout on shutdown. Set TAISEI_RENDERER_RECORD_LOG to a file
+ * path to also get a textual log of every recorded command.
+ */
+
+#include "../api.h"
+#include "../common/backend.h"
+
+#include "benchmark.h"
+#include "dynarray.h"
+#include "hashtable.h"
+#include "hirestime.h"
+#include "util/crap.h"
+#include "util/env.h"
+#include "util/io.h"
+#include "util/miscmath.h"
+#include "util/strbuf.h"
+
+#define RECORD_MAX_VERTEX_ATTACHMENTS 8
+
+#define RECORD_COUNTERS(X) \
+	X(draws) \
+	X(draws_indexed) \
+	X(instances) \
+	X(vertices) \
+	X(shader_changes) \
+	X(framebuffer_changes) \
+	X(blend_changes) \
+	X(cull_changes) \
+	X(depth_func_changes) \
+	X(capability_changes) \
+	X(color_changes) \
+	X(scissor_changes) \
+	X(viewport_changes) \
+	X(clears) \
+	X(copies) \
+	X(vertex_bytes) \
+	X(index_bytes) \
+	X(texture_bytes) \
+	X(uniform_uploads) \
+	X(uniform_bytes) \
+
+typedef struct RecordCounters {
+	#define X(name) uint64_t name;
+	RECORD_COUNTERS(X)
+	#undef X
+} RecordCounters;
+
+struct Texture {
+	TextureParams params;
+	char debug_label[R_DEBUG_LABEL_SIZE];
+};
+
+struct Framebuffer {
+	FramebufferAttachmentQueryResult attachments[FRAMEBUFFER_MAX_ATTACHMENTS];
+	FramebufferAttachment outputs[FRAMEBUFFER_MAX_OUTPUTS];
+	FloatRect viewport;
+	char debug_label[R_DEBUG_LABEL_SIZE];
+};
+
+struct VertexBuffer {
+	SDL_IOStream *stream;
+	size_t size;
+	size_t offset;
+	char debug_label[R_DEBUG_LABEL_SIZE];
+};
+
+struct IndexBuffer {
+	uint index_size;
+	size_t capacity;
+	size_t offset;
+	char debug_label[R_DEBUG_LABEL_SIZE];
+};
+
+struct VertexArray {
+	VertexBuffer *attachments[RECORD_MAX_VERTEX_ATTACHMENTS];
+	IndexBuffer *index_attachment;
+	char debug_label[R_DEBUG_LABEL_SIZE];
+};
+
+typedef struct RecordUniformDecl {
+	char *name;
+	UniformType type;
+	uint array_size;
+} RecordUniformDecl;
+
+struct ShaderObject {
+	DYNAMIC_ARRAY(RecordUniformDecl) uniforms;
+	char debug_label[R_DEBUG_LABEL_SIZE];
+};
+
+struct Uniform {
+	char *name;
+	UniformType type;
+	uint array_size;
+};
+
+struct ShaderProgram {
+	ht_str2ptr_t uniforms;
+	char debug_label[R_DEBUG_LABEL_SIZE];
+};
+
+static struct {
+	SDL_Window *window;
+	SDL_IOStream *log;
+
+	struct {
+		r_capability_bits_t capabilities;
+		Color color;
+		BlendMode blend;
+		CullFaceMode cull;
+		DepthTestFunc depth_func;
+		ShaderProgram *shader;
+		Framebuffer *framebuffer;
+		IntRect scissor;
+		FloatRect default_viewport;
+		VsyncMode vsync;
+	} state;
+
+	RecordCounters totals;
+	RecordCounters frame;
+	RecordCounters frame_max;
+
+	DYNAMIC_ARRAY(uint32_t) frame_times;  // nanoseconds
+	hrtime_t frame_start;
+	uint64_t frames;
+} R;
+
+#define COUNT(name) (++R.frame.name)
+#define COUNT_N(name, n) (R.frame.name += (n))
+
+#define LOG(...) do { \
+	if(UNLIKELY(R.log)) { \
+		SDL_RWprintf(R.log, __VA_ARGS__); \
+	} \
+} while(0)
+
+static const char *fb_label(Framebuffer *fb) {
+	return fb ? fb->debug_label : "<default>";
+}
+
+static void record_accumulate_frame(void) {
+	#define X(name) \
+		R.totals.name += R.frame.name; \
+		R.frame_max.name = max(R.frame_max.name, R.frame.name);
+	RECORD_COUNTERS(X)
+	#undef X
+
+	memset(&R.frame, 0, sizeof(R.frame));
+}
+
+static void record_init(void) {
+	R.state.capabilities = r_capability_bit(RCAP_DEPTH_WRITE);
+	R.state.color = *RGBA(1, 1, 1, 1);
+	R.state.blend = BLEND_NONE;
+	R.state.cull = CULL_BACK;
+	R.state.depth_func = DEPTH_LESS;
+
+	const char *log_path = env_get("TAISEI_RENDERER_RECORD_LOG", NULL);
+
+	if(log_path && *log_path) {
+		if(!(R.log = SDL_IOFromFile(log_path, "w"))) {
+			log_sdl_error(LOG_ERROR, "SDL_IOFromFile");
+		} else {
+			log_info("Recording renderer commands to %s", log_path);
+		}
+	}
+}
+
+static void record_post_init(void) { }
+
+static void record_report(void) {
+	uint32_t *times = R.frame_times.data;
+	int n = R.frame_times.num_elements;
+
+	if(n == 0) {
+		return;
+	}
+
+	benchmark_sort_frame_times(n, times);
+
+	hrtime_t total_time = 0;
+
+	for(int i = 0; i < n; ++i) {
+		total_time += times[i];
+	}
+
+	StringBuffer sb = {};
+
+	strbuf_printf(&sb,
+		"{\"benchmark\":\"render\",\"frames\":%i,\"mean_us\":%.3f,\"p50_us\":%.3f"
+		",\"p90_us\":%.3f,\"p99_us\":%.3f,\"max_us\":%.3f",
+		n,
+		total_time * 1e-3 / n,
+		benchmark_percentile_us(n, times, 50),
+		benchmark_percentile_us(n, times, 90),
+		benchmark_percentile_us(n, times, 99),
+		times[n - 1] * 1e-3
+	);
+
+	strbuf_cat(&sb, ",\"total\":{");
+	#define X(name) strbuf_printf(&sb, "\"" #name "\":%"PRIu64",", R.totals.name);
+	RECORD_COUNTERS(X)
+	#undef X
+	sb.pos[-1] = '}';
+
+	strbuf_cat(&sb, ",\"frame_mean\":{");
+	#define X(name) strbuf_printf(&sb, "\"" #name "\":%.3f,", (double)R.totals.name / R.frames);
+	RECORD_COUNTERS(X)
+	#undef X
+	sb.pos[-1] = '}';
+
+	strbuf_cat(&sb, ",\"frame_max\":{");
+	#define X(name) strbuf_printf(&sb, "\"" #name "\":%"PRIu64",", R.frame_max.name);
+	RECORD_COUNTERS(X)
+	#undef X
+	sb.pos[-1] = '}';
+
+	strbuf_cat(&sb, "}\n");
+	fputs(sb.start, stdout);
+	fflush(stdout);
+	strbuf_free(&sb);
+}
+
+static void record_shutdown(void) {
+	record_report();
+	dynarray_free_data(&R.frame_times);
+
+	if(R.log) {
+		SDL_CloseIO(R.log);
+	}
+
+	memset(&R, 0, sizeof(R));
+}
+
+static bool record_window_size(int *w, int *h) {
+	return R.window && SDL_GetWindowSizeInPixels(R.window, w, h);
+}
+
+static SDL_Window *record_create_window(const char *title, int x, int y, int w, int h, uint32_t flags) {
+	R.window = SDL_CreateWindow(title, w, h, flags);
+
+	if(record_window_size(&w, &h)) {
+		R.state.default_viewport = (FloatRect) { 0, 0, w, h };
+	}
+
+	return R.window;
+}
+
+static r_feature_bits_t record_features(void) { return ~0; }
+
+static void record_capabilities(r_capability_bits_t capbits) {
+	if(R.state.capabilities != capbits) {
+		R.state.capabilities = capbits;
+		COUNT(capability_changes);
+		LOG("capabilities 0x%x\n", (uint)capbits);
+	}
+}
+
+static r_capability_bits_t record_capabilities_current(void) {
+	return R.state.capabilities;
+}
+
+static void record_color4(float r, float g, float b, float a) {
+	Color c = { r, g, b, a };
+
+	if(memcmp(&R.state.color, &c, sizeof(c))) {
+		R.state.color = c;
+		COUNT(color_changes);
+	}
+}
+
+static const Color *record_color_current(void) {
+	return &R.state.color;
+}
+
+static void record_blend(BlendMode mode) {
+	if(R.state.blend != mode) {
+		R.state.blend = mode;
+		COUNT(blend_changes);
+		LOG("blend 0x%x\n", (uint)mode);
+	}
+}
+
+static BlendMode record_blend_current(void) {
+	return R.state.blend;
+}
+
+static void record_cull(CullFaceMode mode) {
+	if(R.state.cull != mode) {
+		R.state.cull = mode;
+		COUNT(cull_changes);
+		LOG("cull %i\n", mode);
+	}
+}
+
+static CullFaceMode record_cull_current(void) {
+	return R.state.cull;
+}
+
+static void record_depth_func(DepthTestFunc func) {
+	if(R.state.depth_func != func) {
+		R.state.depth_func = func;
+		COUNT(depth_func_changes);
+		LOG("depth_func %i\n", func);
+	}
+}
+
+static DepthTestFunc record_depth_func_current(void) {
+	return R.state.depth_func;
+}
+
+static void record_draw_common(
+	const char *cmd, VertexArray *varr, Primitive prim, uint first, uint count, uint instances
+) {
+	COUNT_N(instances, max(instances, 1u));
+	COUNT_N(vertices, (uint64_t)count * max(instances, 1u));
+	LOG("%s [%s] shader=[%s] fb=[%s] prim=%i first=%u count=%u instances=%u\n",
+		cmd, varr->debug_label,
+		R.state.shader ? R.state.shader->debug_label : "<none>",
+		fb_label(R.state.framebuffer),
+		prim, first, count, instances
+	);
+}
+
+static void record_draw(VertexArray *varr, Primitive prim, uint first, uint count, uint instances, uint base_instance) {
+	COUNT(draws);
+	record_draw_common("draw", varr, prim, first, count, instances);
+}
+
+static void record_draw_indexed(VertexArray *varr, Primitive prim, uint first, uint count, uint instances, uint base_instance) {
+	COUNT(draws_indexed);
+	record_draw_common("draw_indexed", varr, prim, first, count, instances);
+}
+
+static bool record_shader_language_supported(const ShaderLangInfo *lang, SPIRVTranspileOptions *transpile_opts) {
+	return true;
+}
+
+static bool glsl_is_ident_char(char c) {
+	return c == '_' || (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9');
+}
+
+static const char *glsl_skip_space(const char *p, const char *end) {
+	while(p < end && strchr(" \t\r\n", *p)) {
+		++p;
+	}
+
+	return p;
+}
+
+// Returns the length of the identifier at p, 0 if there is none.
+static size_t glsl_ident_len(const char *p, const char *end) {
+	const char *start = p;
+
+	if(p < end && !(*p >= '0' && *p <= '9')) {
+		while(p < end && glsl_is_ident_char(*p)) {
+			++p;
+		}
+	}
+
+	return p - start;
+}
+
+static UniformType glsl_uniform_type(const char *name, size_t len) {
+	static const struct {
+		const char *name;
+		UniformType type;
+	} types[] = {
+		{ "float",       UNIFORM_FLOAT },
+		{ "vec2",        UNIFORM_VEC2 },
+		{ "vec3",        UNIFORM_VEC3 },
+		{ "vec4",        UNIFORM_VEC4 },
+		{ "int",         UNIFORM_INT },
+		{ "ivec2",       UNIFORM_IVEC2 },
+		{ "ivec3",       UNIFORM_IVEC3 },
+		{ "ivec4",       UNIFORM_IVEC4 },
+		{ "sampler2D",   UNIFORM_SAMPLER_2D },
+		{ "samplerCube", UNIFORM_SAMPLER_CUBE },
+		{ "mat3",        UNIFORM_MAT3 },
+		{ "mat4",        UNIFORM_MAT4 },
+	};
+
+	for(int i = 0; i < ARRAY_SIZE(types); ++i) {
+		if(strlen(types[i].name) == len && !memcmp(types[i].name, name, len)) {
+			return types[i].type;
+		}
+	}
+
+	return UNIFORM_UNKNOWN;
+}
+
+/*
+ * Picks up declarations of the form `uniform [precision] type name[N];`, where `uniform` may
+ * also be spelled as the shader library's UNIFORM(location) macro. This isn't a real parser:
+ * macros aren't expanded, uniform blocks and types the API doesn't support are skipped, and a
+ * declaration inside a comment or an inactive #if branch is picked up anyway. That's harmless
+ * here; the worst case is a stub uniform that the frontend would otherwise have treated as
+ * optimized out.
+ */
+static void record_shader_object_scan_uniforms(ShaderObject *shobj, const ShaderSource *source) {
+	const char *p = source->content;
+	const char *end = p + source->content_size;
+
+	while(p < end) {
+		size_t len = glsl_ident_len(p, end);
+
+		if(len == 0) {
+			++p;
+			continue;
+		}
+
+		const char *word = p;
+		p += len;
+
+		if(len != 7) {
+			continue;
+		}
+
+		if(!memcmp(word, "UNIFORM", 7)) {
+			// The shader library's UNIFORM(location) macro; source isn't preprocessed.
+			const char *args = glsl_skip_space(p, end);
+			const char *args_end;
+
+			if(args == end || *args != '(' || !(args_end = memchr(args, ')', end - args))) {
+				continue;
+			}
+
+			p = args_end + 1;
+		} else if(memcmp(word, "uniform", 7)) {
+			continue;
+		}
+
+		const char *type_name = glsl_skip_space(p, end);
+		size_t type_len = glsl_ident_len(type_name, end);
+
+		if(
+			(type_len == 4 && !memcmp(type_name, "lowp", 4)) ||
+			(type_len == 7 && !memcmp(type_name, "mediump", 7)) ||
+			(type_len == 5 && !memcmp(type_name, "highp", 5))
+		) {
+			type_name = glsl_skip_space(type_name + type_len, end);
+			type_len = glsl_ident_len(type_name, end);
+		}
+
+		UniformType type = glsl_uniform_type(type_name, type_len);
+
+		if(type == UNIFORM_UNKNOWN) {
+			continue;
+		}
+
+		const char *name = glsl_skip_space(type_name + type_len, end);
+		size_t name_len = glsl_ident_len(name, end);
+
+		if(name_len == 0) {
+			continue;
+		}
+
+		p = glsl_skip_space(name + name_len, end);
+		uint array_size = 1;
+
+		if(p < end && *p == '[') {
+			// The size is often a macro; don't clamp uploads to arrays of unknown size.
+			char *size_end;
+			array_size = strtoul(p + 1, &size_end, 10);
+
+			if(size_end == p + 1 || array_size == 0) {
+				array_size = UINT_MAX;
+			}
+		}
+
+		dynarray_append(&shobj->uniforms, {
+			.name = memcpy(mem_alloc(name_len + 1), name, name_len),
+			.type = type,
+			.array_size = array_size,
+		});
+	}
+}
+
+static ShaderObject *record_shader_object_compile(ShaderSource *source) {
+	auto shobj = ALLOC(ShaderObject);
+	strlcpy(shobj->debug_label, "shader object", sizeof(shobj->debug_label));
+
+	if(source->lang.lang == SHLANG_GLSL) {
+		record_shader_object_scan_uniforms(shobj, source);
+	}
+
+	return shobj;
+}
+
+static void record_shader_object_destroy(ShaderObject *shobj) {
+	dynarray_foreach_elem(&shobj->uniforms, RecordUniformDecl *decl, {
+		mem_free(decl->name);
+	});
+
+	dynarray_free_data(&shobj->uniforms);
+	mem_free(shobj);
+}
+
+static void record_shader_object_set_debug_label(ShaderObject *shobj, const char *label) {
+	strlcpy(shobj->debug_label, label, sizeof(shobj->debug_label));
+}
+
+static const char *record_shader_object_get_debug_label(ShaderObject *shobj) {
+	return shobj->debug_label;
+}
+
+static bool record_shader_object_transfer(ShaderObject *dst, ShaderObject *src) {
+	*dst = *src;
+	mem_free(src);
+	return true;
+}
+
+static ShaderProgram *record_shader_program_link(uint num_objects, ShaderObject *shobjs[num_objects]) {
+	auto prog = ALLOC(ShaderProgram);
+	strlcpy(prog->debug_label, "shader program", sizeof(prog->debug_label));
+	ht_create(&prog->uniforms);
+
+	for(uint i = 0; i < num_objects; ++i) {
+		dynarray_foreach_elem(&shobjs[i]->uniforms, RecordUniformDecl *decl, {
+			if(!ht_get(&prog->uniforms, decl->name, NULL)) {
+				ht_set(&prog->uniforms, decl->name, ALLOC(Uniform, {
+					.name = mem_strdup(decl->name),
+					.type = decl->type,
+					.array_size = decl->array_size,
+				}));
+			}
+		});
+	}
+
+	return prog;
+}
+
+static void *free_uniform(const char *key, void *data, void *arg) {
+	Uniform *uniform = data;
+	mem_free(uniform->name);
+	mem_free(uniform);
+	return NULL;
+}
+
+static void record_shader_program_destroy(ShaderProgram *prog) {
+	if(R.state.shader == prog) {
+		R.state.shader = NULL;
+	}
+
+	ht_foreach(&prog->uniforms, free_uniform, NULL);
+	ht_destroy(&prog->uniforms);
+	mem_free(prog);
+}
+
+static void record_shader_program_set_debug_label(ShaderProgram *prog, const char *label) {
+	strlcpy(prog->debug_label, label, sizeof(prog->debug_label));
+}
+
+static const char *record_shader_program_get_debug_label(ShaderProgram *prog) {
+	return prog->debug_label;
+}
+
+static bool record_shader_program_transfer(ShaderProgram *dst, ShaderProgram *src) {
+	// Uniforms of dst may be cached by the frontend, so they are updated in place. Ones that no
+	// longer exist are kept around until dst is destroyed.
+	ht_str2ptr_iter_t iter;
+	ht_iter_begin(&src->uniforms, &iter);
+
+	for(; iter.has_data; ht_iter_next(&iter)) {
+		Uniform *unew = NOT_NULL(iter.value);
+		Uniform *uold = ht_get(&dst->uniforms, iter.key, NULL);
+
+		if(uold) {
+			uold->type = unew->type;
+			uold->array_size = unew->array_size;
+			free_uniform(iter.key, unew, NULL);
+		} else {
+			ht_set(&dst->uniforms, iter.key, unew);
+		}
+	}
+
+	ht_iter_end(&iter);
+	ht_destroy(&src->uniforms);
+	strlcpy(dst->debug_label, src->debug_label, sizeof(dst->debug_label));
+
+	if(R.state.shader == src) {
+		R.state.shader = dst;
+	}
+
+	mem_free(src);
+	return true;
+}
+
+static void record_shader(ShaderProgram *prog) {
+	if(R.state.shader != prog) {
+		R.state.shader = prog;
+		COUNT(shader_changes);
+		LOG("shader [%s]\n", prog ? prog->debug_label : "<none>");
+	}
+}
+
+static ShaderProgram *record_shader_current(void) {
+	return R.state.shader;
+}
+
+static Uniform *record_shader_uniform(ShaderProgram *prog, const char *uniform_name, hash_t uniform_name_hash) {
+	// Returns NULL for names that weren't declared; the frontend treats those as optimized out.
+	Uniform *uniform = NULL;
+	ht_lookup_prehashed(&prog->uniforms, uniform_name, uniform_name_hash, (void**)&uniform);
+	return uniform;
+}
+
+static void record_uniform(Uniform *uniform, uint offset, uint count, const void *data) {
+	if(offset >= uniform->array_size) {
+		return;
+	}
+
+	count = min(count, uniform->array_size - offset);
+	auto type_info = r_uniform_type_info(uniform->type);
+
+	COUNT(uniform_uploads);
+	COUNT_N(uniform_bytes, count * type_info->elements * type_info->element_size);
+	LOG("uniform [%s] offset=%u count=%u\n", uniform->name, offset, count);
+}
+
+static UniformType record_uniform_type(Uniform *uniform) {
+	return uniform->type;
+}
+
+static Texture *record_texture_create(const TextureParams *params) {
+	auto tex = ALLOC(Texture, {
+		.params = *params,
+	});
+
+	if(tex->params.mipmaps == 0) {
+		tex->params.mipmaps = 1;
+	}
+
+	strlcpy(tex->debug_label, "texture", sizeof(tex->debug_label));
+	return tex;
+}
+
+static void record_texture_get_params(Texture *tex, TextureParams *params) {
+	*params = tex->params;
+}
+
+static void record_texture_get_size(Texture *tex, uint mipmap, uint *width, uint *height) {
+	if(width) *width = max(1u, tex->params.width >> mipmap);
+	if(height) *height = max(1u, tex->params.height >> mipmap);
+}
+
+static const char *record_texture_get_debug_label(Texture *tex) {
+	return tex->debug_label;
+}
+
+static void record_texture_set_debug_label(Texture *tex, const char *label) {
+	strlcpy(tex->debug_label, label, sizeof(tex->debug_label));
+}
+
+static void record_texture_set_filter(Texture *tex, TextureFilterMode fmin, TextureFilterMode fmag) {
+	tex->params.filter.min = fmin;
+	tex->params.filter.mag = fmag;
+}
+
+static void record_texture_set_wrap(Texture *tex, TextureWrapMode ws, TextureWrapMode wt) {
+	tex->params.wrap.s = ws;
+	tex->params.wrap.t = wt;
+}
+
+static void record_texture_destroy(Texture *tex) {
+	mem_free(tex);
+}
+
+static void record_texture_invalidate(Texture *tex) { }
+
+static void record_texture_fill(Texture *tex, uint mipmap, uint layer, const Pixmap *image_data) {
+	COUNT_N(texture_bytes, image_data->data_size);
+	LOG("texture_fill [%s] mip=%u layer=%u bytes=%u\n", tex->debug_label, mipmap, layer, image_data->data_size);
+}
+
+static void record_texture_fill_region(Texture *tex, uint mipmap, uint layer, uint x, uint y, const Pixmap *image_data) {
+	COUNT_N(texture_bytes, image_data->data_size);
+	LOG("texture_fill_region [%s] mip=%u layer=%u x=%u y=%u bytes=%u\n",
+		tex->debug_label, mipmap, layer, x, y, image_data->data_size);
+}
+
+static bool record_texture_dump(Texture *tex, uint mipmap, uint layer, Pixmap *dst) {
+	return false;
+}
+
+static void record_texture_clear(Texture *tex, const Color *clr) {
+	COUNT(clears);
+	LOG("texture_clear [%s]\n", tex->debug_label);
+}
+
+static bool record_texture_type_query(TextureType type, TextureFlags flags, PixmapFormat pxfmt, PixmapOrigin pxorigin, TextureTypeQueryResult *result) {
+	if(result) {
+		result->optimal_pixmap_format = pxfmt;
+		result->optimal_pixmap_origin = pxorigin;
+		result->supplied_pixmap_format_supported = true;
+		result->supplied_pixmap_origin_supported = true;
+	}
+
+	return true;
+}
+
+static bool record_texture_transfer(Texture *dst, Texture *src) {
+	*dst = *src;
+	mem_free(src);
+	return true;
+}
+
+static Framebuffer *record_framebuffer_create(void) {
+	auto fb = ALLOC(Framebuffer);
+	strlcpy(fb->debug_label, "framebuffer", sizeof(fb->debug_label));
+
+	for(int i = 0; i < FRAMEBUFFER_MAX_OUTPUTS; ++i) {
+		fb->outputs[i] = FRAMEBUFFER_ATTACH_COLOR0 + i;
+	}
+
+	return fb;
+}
+
+static const char *record_framebuffer_get_debug_label(Framebuffer *fb) {
+	return fb_label(fb);
+}
+
+static void record_framebuffer_set_debug_label(Framebuffer *fb, const char *label) {
+	strlcpy(fb->debug_label, label, sizeof(fb->debug_label));
+}
+
+static void record_framebuffer_destroy(Framebuffer *fb) {
+	if(R.state.framebuffer == fb) {
+		R.state.framebuffer = NULL;
+	}
+
+	mem_free(fb);
+}
+
+static void record_framebuffer_attach(Framebuffer *fb, Texture *tex, uint mipmap, FramebufferAttachment attachment) {
+	assert((uint)attachment < FRAMEBUFFER_MAX_ATTACHMENTS);
+	fb->attachments[attachment] = (FramebufferAttachmentQueryResult) {
+		.texture = tex,
+		.miplevel = mipmap,
+	};
+}
+
+static FramebufferAttachmentQueryResult record_framebuffer_query_attachment(Framebuffer *fb, FramebufferAttachment attachment) {
+	assert((uint)attachment < FRAMEBUFFER_MAX_ATTACHMENTS);
+	return fb->attachments[attachment];
+}
+
+static void record_framebuffer_outputs(Framebuffer *fb, FramebufferAttachment config[FRAMEBUFFER_MAX_OUTPUTS], uint8_t write_mask) {
+	for(int i = 0; i < FRAMEBUFFER_MAX_OUTPUTS; ++i) {
+		if(write_mask & (1 << i)) {
+			fb->outputs[i] = config[i];
+		} else {
+			config[i] = fb->outputs[i];
+		}
+	}
+}
+
+static FloatRect *record_framebuffer_viewport_ptr(Framebuffer *fb) {
+	return fb ? &fb->viewport : &R.state.default_viewport;
+}
+
+static void record_framebuffer_viewport(Framebuffer *fb, FloatRect vp) {
+	FloatRect *cur = record_framebuffer_viewport_ptr(fb);
+
+	if(memcmp(cur, &vp, sizeof(vp))) {
+		*cur = vp;
+		COUNT(viewport_changes);
+		LOG("viewport [%s] %g %g %g %g\n", fb_label(fb), vp.x, vp.y, vp.w, vp.h);
+	}
+}
+
+static void record_framebuffer_viewport_current(Framebuffer *fb, FloatRect *vp) {
+	*vp = *record_framebuffer_viewport_ptr(fb);
+}
+
+static void record_framebuffer(Framebuffer *fb) {
+	if(R.state.framebuffer != fb) {
+		R.state.framebuffer = fb;
+		COUNT(framebuffer_changes);
+		LOG("framebuffer [%s]\n", fb_label(fb));
+	}
+}
+
+static Framebuffer *record_framebuffer_current(void) {
+	return R.state.framebuffer;
+}
+
+static void record_framebuffer_clear(Framebuffer *fb, BufferKindFlags flags, const Color *colorval, float depthval) {
+	COUNT(clears);
+	LOG("clear [%s] flags=0x%x\n", fb_label(fb), (uint)flags);
+}
+
+static void record_framebuffer_copy(Framebuffer *dst, Framebuffer *src, BufferKindFlags flags) {
+	COUNT(copies);
+	LOG("copy [%s] -> [%s] flags=0x%x\n", fb_label(src), fb_label(dst), (uint)flags);
+}
+
+static IntExtent record_framebuffer_get_size(Framebuffer *fb) {
+	if(fb) {
+		for(int i = 0; i < FRAMEBUFFER_MAX_ATTACHMENTS; ++i) {
+			Texture *tex = fb->attachments[i].texture;
+
+			if(tex) {
+				uint w, h;
+				record_texture_get_size(tex, fb->attachments[i].miplevel, &w, &h);
+				return (IntExtent) { w, h };
+			}
+		}
+	} else {
+		int w, h;
+
+		if(record_window_size(&w, &h)) {
+			return (IntExtent) { w, h };
+		}
+	}
+
+	return (IntExtent) { 64, 64 };
+}
+
+static void record_framebuffer_read_async(Framebuffer *fb, FramebufferAttachment attachment, IntRect region, void *userdata, FramebufferReadAsyncCallback callback) {
+	callback(NULL, userdata);
+}
+
+static int64_t record_vertex_buffer_stream_seek(void *ctx, int64_t offset, SDL_IOWhence whence) {
+	VertexBuffer *vbuf = ctx;
+
+	switch(whence) {
+		case SDL_IO_SEEK_CUR: vbuf->offset += offset; break;
+		case SDL_IO_SEEK_END: vbuf->offset = vbuf->size + offset; break;
+		case SDL_IO_SEEK_SET: vbuf->offset = offset; break;
+	}
+
+	return vbuf->offset;
+}
+
+static int64_t record_vertex_buffer_stream_size(void *ctx) {
+	VertexBuffer *vbuf = ctx;
+	return vbuf->size;
+}
+
+static size_t record_vertex_buffer_stream_write(void *ctx, const void *data, size_t size, SDL_IOStatus *status) {
+	VertexBuffer *vbuf = ctx;
+	vbuf->offset += size;
+	vbuf->size = max(vbuf->size, vbuf->offset);
+	COUNT_N(vertex_bytes, size);
+	return size;
+}
+
+static VertexBuffer *record_vertex_buffer_create(size_t capacity, void *data) {
+	auto vbuf = ALLOC(VertexBuffer, {
+		.size = capacity,
+	});
+
+	vbuf->stream = NOT_NULL(SDL_OpenIO(&(SDL_IOStreamInterface) {
+		.version = sizeof(SDL_IOStreamInterface),
+		.seek = record_vertex_buffer_stream_seek,
+		.size = record_vertex_buffer_stream_size,
+		.write = record_vertex_buffer_stream_write,
+	}, vbuf));
+
+	if(data) {
+		COUNT_N(vertex_bytes, capacity);
+	}
+
+	strlcpy(vbuf->debug_label, "vertex buffer", sizeof(vbuf->debug_label));
+	return vbuf;
+}
+
+static const char *record_vertex_buffer_get_debug_label(VertexBuffer *vbuf) {
+	return vbuf->debug_label;
+}
+
+static void record_vertex_buffer_set_debug_label(VertexBuffer *vbuf, const char *label) {
+	strlcpy(vbuf->debug_label, label, sizeof(vbuf->debug_label));
+}
+
+static void record_vertex_buffer_destroy(VertexBuffer *vbuf) {
+	SDL_CloseIO(vbuf->stream);
+	mem_free(vbuf);
+}
+
+static void record_vertex_buffer_invalidate(VertexBuffer *vbuf) {
+	vbuf->offset = 0;
+}
+
+static SDL_IOStream *record_vertex_buffer_get_stream(VertexBuffer *vbuf) {
+	return vbuf->stream;
+}
+
+static IndexBuffer *record_index_buffer_create(uint index_size, size_t max_elements) {
+	auto ibuf = ALLOC(IndexBuffer, {
+		.index_size = index_size,
+		.capacity = max_elements,
+	});
+
+	strlcpy(ibuf->debug_label, "index buffer", sizeof(ibuf->debug_label));
+	return ibuf;
+}
+
+static size_t record_index_buffer_get_capacity(IndexBuffer *ibuf) {
+	return ibuf->capacity;
+}
+
+static uint record_index_buffer_get_index_size(IndexBuffer *ibuf) {
+	return ibuf->index_size;
+}
+
+static const char *record_index_buffer_get_debug_label(IndexBuffer *ibuf) {
+	return ibuf->debug_label;
+}
+
+static void record_index_buffer_set_debug_label(IndexBuffer *ibuf, const char *label) {
+	strlcpy(ibuf->debug_label, label, sizeof(ibuf->debug_label));
+}
+
+static void record_index_buffer_set_offset(IndexBuffer *ibuf, size_t offset) {
+	ibuf->offset = offset;
+}
+
+static size_t record_index_buffer_get_offset(IndexBuffer *ibuf) {
+	return ibuf->offset;
+}
+
+static void record_index_buffer_add_indices(IndexBuffer *ibuf, size_t data_size, void *data) {
+	ibuf->offset += data_size / ibuf->index_size;
+	ibuf->capacity = max(ibuf->capacity, ibuf->offset);
+	COUNT_N(index_bytes, data_size);
+}
+
+static void record_index_buffer_invalidate(IndexBuffer *ibuf) {
+	ibuf->offset = 0;
+}
+
+static void record_index_buffer_destroy(IndexBuffer *ibuf) {
+	mem_free(ibuf);
+}
+
+static VertexArray *record_vertex_array_create(void) {
+	auto varr = ALLOC(VertexArray);
+	strlcpy(varr->debug_label, "vertex array", sizeof(varr->debug_label));
+	return varr;
+}
+
+static const char *record_vertex_array_get_debug_label(VertexArray *varr) {
+	return varr->debug_label;
+}
+
+static void record_vertex_array_set_debug_label(VertexArray *varr, const char *label) {
+	strlcpy(varr->debug_label, label, sizeof(varr->debug_label));
+}
+
+static void record_vertex_array_destroy(VertexArray *varr) {
+	mem_free(varr);
+}
+
+static void record_vertex_array_layout(VertexArray *varr, uint nattribs, VertexAttribFormat attribs[nattribs]) { }
+
+static void record_vertex_array_attach_vertex_buffer(VertexArray *varr, VertexBuffer *vbuf, uint attachment) {
+	assert(attachment < RECORD_MAX_VERTEX_ATTACHMENTS);
+	varr->attachments[attachment] = vbuf;
+}
+
+static VertexBuffer *record_vertex_array_get_vertex_attachment(VertexArray *varr, uint attachment) {
+	if(attachment >= RECORD_MAX_VERTEX_ATTACHMENTS) {
+		return NULL;
+	}
+
+	return varr->attachments[attachment];
+}
+
+static void record_vertex_array_attach_index_buffer(VertexArray *varr, IndexBuffer *ibuf) {
+	varr->index_attachment = ibuf;
+}
+
+static IndexBuffer *record_vertex_array_get_index_attachment(VertexArray *varr) {
+	return varr->index_attachment;
+}
+
+static void record_scissor(IntRect scissor) {
+	if(memcmp(&R.state.scissor, &scissor, sizeof(scissor))) {
+		R.state.scissor = scissor;
+		COUNT(scissor_changes);
+		LOG("scissor %i %i %i %i\n", scissor.x, scissor.y, scissor.w, scissor.h);
+	}
+}
+
+static void record_scissor_current(IntRect *scissor) {
+	*scissor = R.state.scissor;
+}
+
+static void record_vsync(VsyncMode mode) {
+	R.state.vsync = mode;
+}
+
+static VsyncMode record_vsync_current(void) {
+	return R.state.vsync;
+}
+
+static void record_begin_frame(void) {
+	R.frame_start = time_get();
+	LOG("begin_frame %"PRIu64"\n", R.frames);
+}
+
+static void record_swap(SDL_Window *window) {
+	if(R.frame_start) {
+		hrtime_t frame_time = time_get() - R.frame_start;
+		dynarray_append(&R.frame_times, (uint32_t)min(frame_time, UINT32_MAX));
+		R.frame_start = 0;
+	}
+
+	LOG("swap %"PRIu64" draws=%"PRIu64" indexed=%"PRIu64" shader_changes=%"PRIu64"\n",
+		R.frames, R.frame.draws, R.frame.draws_indexed, R.frame.shader_changes);
+
+	record_accumulate_frame();
+	++R.frames;
+}
+
+RendererBackend _r_backend_record = {
+	.name = "record",
+	.funcs = {
+		.init = record_init,
+		.post_init = record_post_init,
+		.shutdown = record_shutdown,
+		.create_window = record_create_window,
+		.features = record_features,
+		.capabilities = record_capabilities,
+		.capabilities_current = record_capabilities_current,
+		.draw = record_draw,
+		.draw_indexed = record_draw_indexed,
+		.color4 = record_color4,
+		.color_current = record_color_current,
+		.blend = record_blend,
+		.blend_current = record_blend_current,
+		.cull = record_cull,
+		.cull_current = record_cull_current,
+		.depth_func = record_depth_func,
+		.depth_func_current = record_depth_func_current,
+		.shader_language_supported = record_shader_language_supported,
+		.shader_object_compile = record_shader_object_compile,
+		.shader_object_destroy = record_shader_object_destroy,
+		.shader_object_set_debug_label = record_shader_object_set_debug_label,
+		.shader_object_get_debug_label = record_shader_object_get_debug_label,
+		.shader_object_transfer = record_shader_object_transfer,
+		.shader_program_link = record_shader_program_link,
+		.shader_program_destroy = record_shader_program_destroy,
+		.shader_program_set_debug_label = record_shader_program_set_debug_label,
+		.shader_program_get_debug_label = record_shader_program_get_debug_label,
+		.shader_program_transfer = record_shader_program_transfer,
+		.shader = record_shader,
+		.shader_current = record_shader_current,
+		.shader_uniform = record_shader_uniform,
+		.uniform = record_uniform,
+		.uniform_type = record_uniform_type,
+		.texture_create = record_texture_create,
+		.texture_get_params = record_texture_get_params,
+		.texture_get_size = record_texture_get_size,
+		.texture_get_debug_label = record_texture_get_debug_label,
+		.texture_set_debug_label = record_texture_set_debug_label,
+		.texture_set_filter = record_texture_set_filter,
+		.texture_set_wrap = record_texture_set_wrap,
+		.texture_destroy = record_texture_destroy,
+		.texture_invalidate = record_texture_invalidate,
+		.texture_fill = record_texture_fill,
+		.texture_fill_region = record_texture_fill_region,
+		.texture_dump = record_texture_dump,
+		.texture_clear = record_texture_clear,
+		.texture_type_query = record_texture_type_query,
+		.texture_transfer = record_texture_transfer,
+		.framebuffer_create = record_framebuffer_create,
+		.framebuffer_get_debug_label = record_framebuffer_get_debug_label,
+		.framebuffer_set_debug_label = record_framebuffer_set_debug_label,
+		.framebuffer_destroy = record_framebuffer_destroy,
+		.framebuffer_attach = record_framebuffer_attach,
+		.framebuffer_query_attachment = record_framebuffer_query_attachment,
+		.framebuffer_outputs = record_framebuffer_outputs,
+		.framebuffer_viewport = record_framebuffer_viewport,
+		.framebuffer_viewport_current = record_framebuffer_viewport_current,
+		.framebuffer = record_framebuffer,
+		.framebuffer_current = record_framebuffer_current,
+		.framebuffer_clear = record_framebuffer_clear,
+		.framebuffer_copy = record_framebuffer_copy,
+		.framebuffer_get_size = record_framebuffer_get_size,
+		.framebuffer_read_async = record_framebuffer_read_async,
+		.vertex_buffer_create = record_vertex_buffer_create,
+		.vertex_buffer_get_debug_label = record_vertex_buffer_get_debug_label,
+		.vertex_buffer_set_debug_label = record_vertex_buffer_set_debug_label,
+		.vertex_buffer_destroy = record_vertex_buffer_destroy,
+		.vertex_buffer_invalidate = record_vertex_buffer_invalidate,
+		.vertex_buffer_get_stream = record_vertex_buffer_get_stream,
+		.index_buffer_create = record_index_buffer_create,
+		.index_buffer_get_capacity = record_index_buffer_get_capacity,
+		.index_buffer_get_index_size = record_index_buffer_get_index_size,
+		.index_buffer_get_debug_label = record_index_buffer_get_debug_label,
+		.index_buffer_set_debug_label = record_index_buffer_set_debug_label,
+		.index_buffer_set_offset = record_index_buffer_set_offset,
+		.index_buffer_get_offset = record_index_buffer_get_offset,
+		.index_buffer_add_indices = record_index_buffer_add_indices,
+		.index_buffer_invalidate = record_index_buffer_invalidate,
+		.index_buffer_destroy = record_index_buffer_destroy,
+		.vertex_array_create = record_vertex_array_create,
+		.vertex_array_get_debug_label = record_vertex_array_get_debug_label,
+		.vertex_array_set_debug_label = record_vertex_array_set_debug_label,
+		.vertex_array_destroy = record_vertex_array_destroy,
+		.vertex_array_layout = record_vertex_array_layout,
+		.vertex_array_attach_vertex_buffer = record_vertex_array_attach_vertex_buffer,
+		.vertex_array_get_vertex_attachment = record_vertex_array_get_vertex_attachment,
+		.vertex_array_attach_index_buffer = record_vertex_array_attach_index_buffer,
+		.vertex_array_get_index_attachment = record_vertex_array_get_index_attachment,
+		.scissor = record_scissor,
+		.scissor_current = record_scissor_current,
+		.vsync = record_vsync,
+		.vsync_current = record_vsync_current,
+		.begin_frame = record_begin_frame,
+		.swap = record_swap,
+	},
+};
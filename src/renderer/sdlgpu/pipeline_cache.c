@@ -12,6 +12,37 @@
 #include "shader_object.h"
 #include "vertex_array.h"
 
+#include "hirestime.h"
+#include "vfs/public.h"
+
+#define PIPECACHE_SCOPE_DIR "cache/sdlgpu_pipelines"
+#define PIPECACHE_SCOPE_MAGIC 0x43505354  // "TSPC"
+#define PIPECACHE_SCOPE_VERSION 1
+
+// How much of a frame prewarming is allowed to take up.
+#define PIPECACHE_PREWARM_FRAME_BUDGET (HRTIME_RESOLUTION / 250)
+
+/*
+ * Persistent description of a pipeline. Runtime ids are not stable across launches, so the
+ * shader program and vertex array are identified by their debug labels; the vertex layout
+ * hash catches vertex arrays that kept their label but changed their layout.
+ */
+typedef struct PipelineScopeRecord {
+	char shader_program[R_DEBUG_LABEL_SIZE];
+	char vertex_array[R_DEBUG_LABEL_SIZE];
+	uint32_t vertex_layout_hash;
+	uint32_t blend_mode;
+	uint32_t output_formats[FRAMEBUFFER_MAX_OUTPUTS];
+	uint32_t depth_format;
+	uint8_t num_outputs;
+	uint8_t cull_mode;
+	uint8_t depth_func;
+	uint8_t primitive;
+	uint8_t cap_bits;
+	uint8_t front_face;
+	uint8_t padding[2];
+} PipelineScopeRecord;
+
 static hash_t pkey_hash(const PipelineCacheKey *k) {
 	union {
 		PipelineCacheKey k;
@@ -46,10 +77,27 @@ static bool pkeys_eq(const PipelineCacheKey *restrict a, const PipelineCacheKey
 
 static struct {
 	ht_pcache_t cache;
+
+	struct {
+		ht_str2ptr_t shader_programs;
+		ht_str2ptr_t vertex_arrays;
+		uint generation;
+	} registry;
+
+	struct {
+		char *path;
+		DYNAMIC_ARRAY(PipelineScopeRecord) records;
+		DYNAMIC_ARRAY(PipelineScopeRecord) pending;
+		uint pending_generation;
+		uint num_prewarmed;
+		bool dirty;
+	} scope;
 } pcache;
 
 void sdlgpu_pipecache_init(void) {
 	ht_pcache_create(&pcache.cache);
+	ht_create(&pcache.registry.shader_programs);
+	ht_create(&pcache.registry.vertex_arrays);
 }
 
 void sdlgpu_pipecache_wipe(void) {
@@ -195,18 +243,95 @@ static SDL_GPUGraphicsPipeline *sdlgpu_pipecache_create_pipeline_callback(ht_pca
 	return sdlgpu_pipecache_create_pipeline((PipelineDescription*)v);
 }
 
-SDL_GPUGraphicsPipeline *sdlgpu_pipecache_get(PipelineDescription *pd) {
+static uint32_t sdlgpu_pipecache_vertex_layout_hash(const VertexArray *varr) {
+	const SDL_GPUVertexInputState *vis = &varr->vertex_input_state;
+	uint32_t h = htutil_hashfunc_uint32(vis->num_vertex_attributes);
+
+	#define HASH_FIELD(x) (h = h * 31 + htutil_hashfunc_uint32(x))
+
+	for(uint i = 0; i < vis->num_vertex_attributes; ++i) {
+		const SDL_GPUVertexAttribute *a = &vis->vertex_attributes[i];
+		HASH_FIELD(a->location);
+		HASH_FIELD(a->buffer_slot);
+		HASH_FIELD(a->format);
+		HASH_FIELD(a->offset);
+	}
+
+	HASH_FIELD(vis->num_vertex_buffers);
+
+	for(uint i = 0; i < vis->num_vertex_buffers; ++i) {
+		const SDL_GPUVertexBufferDescription *b = &vis->vertex_buffer_descriptions[i];
+		HASH_FIELD(b->slot);
+		HASH_FIELD(b->pitch);
+		HASH_FIELD(b->input_rate);
+		HASH_FIELD(b->instance_step_rate);
+	}
+
+	#undef HASH_FIELD
+
+	return h;
+}
+
+static void sdlgpu_pipecache_record(const PipelineDescription *pd) {
+	if(!pcache.scope.path) {
+		return;
+	}
+
+	ShaderProgram *prog = pd->shader_program;
+	VertexArray *varr = pd->vertex_array;
+
+	if(
+		ht_get(&pcache.registry.shader_programs, prog->debug_label, NULL) != prog ||
+		ht_get(&pcache.registry.vertex_arrays, varr->debug_label, NULL) != varr
+	) {
+		// Unlabeled or ambiguous; there would be no way to find these again.
+		return;
+	}
+
+	PipelineScopeRecord rec = {
+		.vertex_layout_hash = sdlgpu_pipecache_vertex_layout_hash(varr),
+		.blend_mode = pd->blend_mode,
+		.depth_format = pd->depth_format,
+		.num_outputs = pd->num_outputs,
+		.cull_mode = pd->cull_mode,
+		.depth_func = pd->depth_func,
+		.primitive = pd->primitive,
+		.cap_bits = pd->cap_bits,
+		.front_face = pd->front_face,
+	};
+
+	strlcpy(rec.shader_program, prog->debug_label, sizeof(rec.shader_program));
+	strlcpy(rec.vertex_array, varr->debug_label, sizeof(rec.vertex_array));
+
+	for(uint i = 0; i < pd->num_outputs; ++i) {
+		rec.output_formats[i] = pd->outputs[i].format;
+	}
+
+	dynarray_foreach_elem(&pcache.scope.records, PipelineScopeRecord *r, {
+		if(!memcmp(r, &rec, sizeof(rec))) {
+			return;
+		}
+	});
+
+	*dynarray_append(&pcache.scope.records) = rec;
+	pcache.scope.dirty = true;
+}
+
+static SDL_GPUGraphicsPipeline *sdlgpu_pipecache_lookup(PipelineDescription *pd) {
 	auto key = sdlgpu_pipecache_construct_key(pd);
 	SDL_GPUGraphicsPipeline *result = NULL;
 
-	bool attr_unused created = ht_pcache_try_set(
+	bool created = ht_pcache_try_set(
 		&pcache.cache, key, (ht_pcache_value_t)pd, sdlgpu_pipecache_create_pipeline_callback, &result);
 
 	if(created) {
 		if(!result) {
 			ht_pcache_unset(&pcache.cache, key);
+			return NULL;
 		}
 
+		sdlgpu_pipecache_record(pd);
+
 #ifdef DEBUG
 		char pipe_repr[PIPECACHE_KEY_REPR_SIZE] = {};
 		sdlgpu_pipecache_key_repr(key, sizeof(pipe_repr), pipe_repr);
@@ -214,12 +339,19 @@ SDL_GPUGraphicsPipeline *sdlgpu_pipecache_get(PipelineDescription *pd) {
 #endif
 	}
 
-	return NOT_NULL(result);
+	return result;
+}
+
+SDL_GPUGraphicsPipeline *sdlgpu_pipecache_get(PipelineDescription *pd) {
+	return NOT_NULL(sdlgpu_pipecache_lookup(pd));
 }
 
 void sdlgpu_pipecache_deinit(void) {
+	sdlgpu_pipecache_end_scope();
 	sdlgpu_pipecache_wipe();
 	ht_pcache_destroy(&pcache.cache);
+	ht_destroy(&pcache.registry.shader_programs);
+	ht_destroy(&pcache.registry.vertex_arrays);
 }
 
 static void sdlgpu_pipecache_remove_matching(bool (*filter)(PipelineCacheKey, sdlgpu_id_t), sdlgpu_id_t id) {
@@ -267,3 +399,283 @@ void sdlgpu_pipecache_unref_shader_program(sdlgpu_id_t shader_id) {
 void sdlgpu_pipecache_unref_vertex_array(sdlgpu_id_t va_id) {
 	sdlgpu_pipecache_remove_matching(match_vertex_array, va_id);
 }
+
+static void registry_set(ht_str2ptr_t *reg, const char *label, void *obj) {
+	ht_set(reg, label, obj);
+	++pcache.registry.generation;
+}
+
+static void registry_unset(ht_str2ptr_t *reg, const char *label, void *obj) {
+	if(ht_get(reg, label, NULL) == obj) {
+		ht_unset(reg, label);
+	}
+}
+
+void sdlgpu_pipecache_register_shader_program(ShaderProgram *prog) {
+	registry_set(&pcache.registry.shader_programs, prog->debug_label, prog);
+}
+
+void sdlgpu_pipecache_unregister_shader_program(ShaderProgram *prog) {
+	registry_unset(&pcache.registry.shader_programs, prog->debug_label, prog);
+}
+
+void sdlgpu_pipecache_register_vertex_array(VertexArray *varr) {
+	registry_set(&pcache.registry.vertex_arrays, varr->debug_label, varr);
+}
+
+void sdlgpu_pipecache_unregister_vertex_array(VertexArray *varr) {
+	registry_unset(&pcache.registry.vertex_arrays, varr->debug_label, varr);
+}
+
+static bool blend_op_is_valid(uint32_t op) {
+	return op >= BLENDOP_ADD && op <= BLENDOP_MAX;
+}
+
+static bool blend_factor_is_valid(uint32_t factor) {
+	return factor >= BLENDFACTOR_ZERO && factor <= BLENDFACTOR_INV_DST_ALPHA;
+}
+
+static bool blend_mode_is_valid(uint32_t mode) {
+	const uint32_t component_bits = BLENDMODE_COMPOSE(0xF, 0xF, 0xF, 0xF, 0xF, 0xF);
+
+	return
+		!(mode & ~component_bits) &&
+		blend_op_is_valid(BLENDMODE_COMPONENT(mode, BLENDCOMP_COLOR_OP)) &&
+		blend_op_is_valid(BLENDMODE_COMPONENT(mode, BLENDCOMP_ALPHA_OP)) &&
+		blend_factor_is_valid(BLENDMODE_COMPONENT(mode, BLENDCOMP_SRC_COLOR)) &&
+		blend_factor_is_valid(BLENDMODE_COMPONENT(mode, BLENDCOMP_DST_COLOR)) &&
+		blend_factor_is_valid(BLENDMODE_COMPONENT(mode, BLENDCOMP_SRC_ALPHA)) &&
+		blend_factor_is_valid(BLENDMODE_COMPONENT(mode, BLENDCOMP_DST_ALPHA));
+}
+
+static bool texture_format_is_valid(uint32_t fmt, SDL_GPUTextureUsageFlags usage) {
+	return
+		fmt != SDL_GPU_TEXTUREFORMAT_INVALID &&
+		fmt == (fmt & PIPECACHE_FMT_MASK) &&
+		SDL_GPUTextureSupportsFormat(sdlgpu.device, fmt, SDL_GPU_TEXTURETYPE_2D, usage);
+}
+
+/*
+ * Records come from disk and may be corrupted or written by a different build. Anything that
+ * doesn't fit the enums (and the PipelineCacheKey bitfields) must be rejected here; it would
+ * otherwise trip the asserts in sdlgpu_pipecache_construct_key, or end up in
+ * SDL_CreateGPUGraphicsPipeline.
+ */
+static bool sdlgpu_pipecache_record_is_valid(const PipelineScopeRecord *rec) {
+	if(rec->num_outputs > FRAMEBUFFER_MAX_OUTPUTS) {
+		return false;
+	}
+
+	for(uint i = 0; i < FRAMEBUFFER_MAX_OUTPUTS; ++i) {
+		uint32_t fmt = rec->output_formats[i];
+
+		if(i >= rec->num_outputs) {
+			if(fmt != SDL_GPU_TEXTUREFORMAT_INVALID) {
+				return false;
+			}
+		} else if(!texture_format_is_valid(fmt, SDL_GPU_TEXTUREUSAGE_COLOR_TARGET)) {
+			return false;
+		}
+	}
+
+	if(
+		rec->depth_format != SDL_GPU_TEXTUREFORMAT_INVALID &&
+		!texture_format_is_valid(rec->depth_format, SDL_GPU_TEXTUREUSAGE_DEPTH_STENCIL_TARGET)
+	) {
+		return false;
+	}
+
+	if(rec->cap_bits & ~((1u << NUM_RCAPS) - 1)) {
+		return false;
+	}
+
+	if(rec->cull_mode > CULL_BOTH) {
+		return false;
+	}
+
+	if(!rec->cull_mode && (rec->cap_bits & r_capability_bit(RCAP_CULL_FACE))) {
+		return false;
+	}
+
+	return
+		blend_mode_is_valid(rec->blend_mode) &&
+		rec->primitive <= PRIM_TRIANGLES &&
+		rec->depth_func <= DEPTH_GEQUAL &&
+		rec->front_face <= SDL_GPU_FRONTFACE_CLOCKWISE;
+}
+
+static void sdlgpu_pipecache_load_scope(const char *path) {
+	SDL_IOStream *in = vfs_open(path, VFS_MODE_READ);
+
+	if(!in) {
+		// Not an error; this scope just hasn't been seen before.
+		return;
+	}
+
+	uint32_t magic, version, record_size, num_records;
+
+	if(
+		!SDL_ReadU32LE(in, &magic) || magic != PIPECACHE_SCOPE_MAGIC ||
+		!SDL_ReadU32LE(in, &version) || version != PIPECACHE_SCOPE_VERSION ||
+		!SDL_ReadU32LE(in, &record_size) || record_size != sizeof(PipelineScopeRecord) ||
+		!SDL_ReadU32LE(in, &num_records)
+	) {
+		log_warn("%s: incompatible or corrupted pipeline cache, ignoring", path);
+		SDL_CloseIO(in);
+		return;
+	}
+
+	uint num_invalid = 0;
+
+	for(uint i = 0; i < num_records; ++i) {
+		PipelineScopeRecord rec;
+
+		if(SDL_ReadIO(in, &rec, sizeof(rec)) != sizeof(rec)) {
+			log_warn("%s: truncated pipeline cache", path);
+			break;
+		}
+
+		if(!sdlgpu_pipecache_record_is_valid(&rec)) {
+			++num_invalid;
+			continue;
+		}
+
+		rec.shader_program[sizeof(rec.shader_program) - 1] = 0;
+		rec.vertex_array[sizeof(rec.vertex_array) - 1] = 0;
+
+		*dynarray_append(&pcache.scope.records) = rec;
+		*dynarray_append(&pcache.scope.pending) = rec;
+	}
+
+	SDL_CloseIO(in);
+
+	if(num_invalid) {
+		log_warn("%s: dropped %u invalid pipeline records", path, num_invalid);
+		pcache.scope.dirty = true;
+	}
+
+	log_debug("%s: %u pipelines to prewarm", path, pcache.scope.pending.num_elements);
+}
+
+static void sdlgpu_pipecache_save_scope(const char *path) {
+	vfs_mkdir(PIPECACHE_SCOPE_DIR);
+	SDL_IOStream *out = vfs_open(path, VFS_MODE_WRITE);
+
+	if(!out) {
+		log_error("VFS error: %s", vfs_get_error());
+		return;
+	}
+
+	SDL_WriteU32LE(out, PIPECACHE_SCOPE_MAGIC);
+	SDL_WriteU32LE(out, PIPECACHE_SCOPE_VERSION);
+	SDL_WriteU32LE(out, sizeof(PipelineScopeRecord));
+	SDL_WriteU32LE(out, pcache.scope.records.num_elements);
+	SDL_WriteIO(out, pcache.scope.records.data, pcache.scope.records.num_elements * sizeof(PipelineScopeRecord));
+	SDL_CloseIO(out);
+
+	log_debug("%s: saved %u pipelines", path, pcache.scope.records.num_elements);
+}
+
+void sdlgpu_pipecache_begin_scope(const char *name) {
+	sdlgpu_pipecache_end_scope();
+
+	pcache.scope.path = strfmt(PIPECACHE_SCOPE_DIR "/%s", name);
+	pcache.scope.pending_generation = pcache.registry.generation - 1;
+	sdlgpu_pipecache_load_scope(pcache.scope.path);
+}
+
+void sdlgpu_pipecache_end_scope(void) {
+	if(!pcache.scope.path) {
+		return;
+	}
+
+	if(pcache.scope.num_prewarmed || pcache.scope.pending.num_elements) {
+		log_debug("%s: %u pipelines prewarmed, %u never resolved",
+			pcache.scope.path, pcache.scope.num_prewarmed, pcache.scope.pending.num_elements);
+	}
+
+	if(pcache.scope.dirty) {
+		sdlgpu_pipecache_save_scope(pcache.scope.path);
+	}
+
+	dynarray_free_data(&pcache.scope.records);
+	dynarray_free_data(&pcache.scope.pending);
+	mem_free(pcache.scope.path);
+	memset(&pcache.scope, 0, sizeof(pcache.scope));
+}
+
+// Returns false if the record can't be resolved yet and should be retried later.
+static bool sdlgpu_pipecache_prewarm(const PipelineScopeRecord *rec) {
+	ShaderProgram *prog = ht_get(&pcache.registry.shader_programs, rec->shader_program, NULL);
+	VertexArray *varr = ht_get(&pcache.registry.vertex_arrays, rec->vertex_array, NULL);
+
+	if(!prog || !varr || !varr->layout_id) {
+		return false;
+	}
+
+	if(sdlgpu_pipecache_vertex_layout_hash(varr) != rec->vertex_layout_hash) {
+		log_debug("Vertex layout of %s changed, dropping stale pipeline", varr->debug_label);
+		return true;
+	}
+
+	PipelineDescription pd = {
+		.shader_program = prog,
+		.vertex_array = varr,
+		.cull_mode = rec->cull_mode,
+		.depth_func = rec->depth_func,
+		.blend_mode = rec->blend_mode,
+		.primitive = rec->primitive,
+		.cap_bits = rec->cap_bits,
+		.front_face = rec->front_face,
+		.num_outputs = rec->num_outputs,
+		.depth_format = rec->depth_format,
+	};
+
+	for(uint i = 0; i < rec->num_outputs; ++i) {
+		pd.outputs[i].format = rec->output_formats[i];
+	}
+
+	if(sdlgpu_pipecache_lookup(&pd)) {
+		++pcache.scope.num_prewarmed;
+	}
+
+	return true;
+}
+
+void sdlgpu_pipecache_prewarm_step(void) {
+	if(
+		pcache.scope.pending.num_elements == 0 ||
+		pcache.scope.pending_generation == pcache.registry.generation
+	) {
+		// Nothing new got registered since the last pass; nothing else could've been resolved.
+		return;
+	}
+
+	hrtime_t deadline = time_get() + PIPECACHE_PREWARM_FRAME_BUDGET;
+	uint num_pending = pcache.scope.pending.num_elements;
+	uint num_kept = 0;
+	bool out_of_time = false;
+
+	for(uint i = 0; i < num_pending; ++i) {
+		PipelineScopeRecord *rec = dynarray_get_ptr(&pcache.scope.pending, i);
+
+		if(!out_of_time) {
+			if(sdlgpu_pipecache_prewarm(rec)) {
+				out_of_time = time_get() >= deadline;
+				continue;
+			}
+		}
+
+		if(num_kept != i) {
+			*dynarray_get_ptr(&pcache.scope.pending, num_kept) = *rec;
+		}
+
+		++num_kept;
+	}
+
+	pcache.scope.pending.num_elements = num_kept;
+
+	if(!out_of_time) {
+		pcache.scope.pending_generation = pcache.registry.generation;
+	}
+}
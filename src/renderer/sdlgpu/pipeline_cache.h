@@ -53,3 +53,22 @@ SDL_GPUGraphicsPipeline *sdlgpu_pipecache_get(PipelineDescription *pd);
 void sdlgpu_pipecache_deinit(void);
 void sdlgpu_pipecache_unref_shader_program(sdlgpu_id_t shader_id);
 void sdlgpu_pipecache_unref_vertex_array(sdlgpu_id_t va_id);
+
+/*
+ * Persistent pipeline scopes.
+ *
+ * While a scope is active, every newly created pipeline whose shader program and vertex array
+ * carry an explicit debug label is recorded. The records are saved to cache/sdlgpu_pipelines
+ * when the scope ends. Beginning the same scope later loads them back, and
+ * sdlgpu_pipecache_prewarm_step() creates the pipelines a few at a time as their shader
+ * programs and vertex arrays become available, before anything gets to draw with them.
+ */
+void sdlgpu_pipecache_begin_scope(const char *name);
+void sdlgpu_pipecache_end_scope(void);
+void sdlgpu_pipecache_prewarm_step(void);
+
+// Objects are looked up by their debug labels when resolving saved records.
+void sdlgpu_pipecache_register_shader_program(ShaderProgram *prog);
+void sdlgpu_pipecache_unregister_shader_program(ShaderProgram *prog);
+void sdlgpu_pipecache_register_vertex_array(VertexArray *varr);
+void sdlgpu_pipecache_unregister_vertex_array(VertexArray *varr);
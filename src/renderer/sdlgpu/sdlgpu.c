@@ -286,6 +286,8 @@ static void sdlgpu_begin_frame(void) {
 	if(!sdlgpu.frame.swapchain.tex) {
 		sdlgpu_renew_swapchain_texture();
 	}
+
+	sdlgpu_pipecache_prewarm_step();
 }
 
 static void sdlgpu_submit_frame(void) {
@@ -870,6 +872,8 @@ RendererBackend _r_backend_sdlgpu = {
 		.index_buffer_set_debug_label = sdlgpu_index_buffer_set_debug_label,
 		.index_buffer_set_offset = sdlgpu_index_buffer_set_offset,
 		.init = sdlgpu_init,
+		.pipeline_cache_begin_scope = sdlgpu_pipecache_begin_scope,
+		.pipeline_cache_end_scope = sdlgpu_pipecache_end_scope,
 		.post_init = sdlgpu_post_init,
 		.shader = sdlgpu_shader,
 		.shader_current = sdlgpu_shader_current,
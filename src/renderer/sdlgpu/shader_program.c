@@ -54,6 +54,7 @@ ShaderProgram *sdlgpu_shader_program_link(uint num_objects, ShaderObject *shobjs
 }
 
 void sdlgpu_shader_program_destroy(ShaderProgram *prog) {
+	sdlgpu_pipecache_unregister_shader_program(prog);
 	sdlgpu_pipecache_unref_shader_program(prog->id);
 	sdlgpu_shader_object_destroy(prog->stages.fragment);
 	sdlgpu_shader_object_destroy(prog->stages.vertex);
@@ -63,7 +64,9 @@ void sdlgpu_shader_program_destroy(ShaderProgram *prog) {
 }
 
 void sdlgpu_shader_program_set_debug_label(ShaderProgram *prog, const char *label) {
+	sdlgpu_pipecache_unregister_shader_program(prog);
 	strlcpy(prog->debug_label, label, sizeof(prog->debug_label));
+	sdlgpu_pipecache_register_shader_program(prog);
 }
 
 const char* sdlgpu_shader_program_get_debug_label(ShaderProgram *prog) {
@@ -87,10 +87,13 @@ const char *sdlgpu_vertex_array_get_debug_label(VertexArray *varr) {
 }
 
 void sdlgpu_vertex_array_set_debug_label(VertexArray *varr, const char *label) {
+	sdlgpu_pipecache_unregister_vertex_array(varr);
 	strlcpy(varr->debug_label, label, sizeof(varr->debug_label));
+	sdlgpu_pipecache_register_vertex_array(varr);
 }
 
 void sdlgpu_vertex_array_destroy(VertexArray *varr) {
+	sdlgpu_pipecache_unregister_vertex_array(varr);
 	sdlgpu_pipecache_unref_vertex_array(varr->layout_id);
 	dynarray_free_data(&varr->attachments);
 	mem_free((void*)varr->vertex_input_state.vertex_attributes);
@@ -62,6 +62,11 @@ static void replay_do_play(CallChainResult ccr) {
 		break;
 	};
 
+	if(stginfo != NULL && !replay_read_stage_events(rpy, ctx->stage_idx - 1)) {
+		log_error("Failed to read the events of stage %X in replay, aborting", rstg->stage);
+		stginfo = NULL;
+	}
+
 	if(stginfo == NULL) {
 		replay_do_cleanup(ccr);
 	} else {
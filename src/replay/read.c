@@ -8,10 +8,22 @@
 
 #include "replay.h"
 #include "rw_common.h"
+#include "stage.h"
 
 #include "player.h"
 #include "rwops/rwops_segment.h"
 
+struct ReplayEventReader {
+	SDL_IOStream *file;
+	// Decompresses from file, or is file itself for uncompressed replays. NULL if not positioned
+	// at any stage's events.
+	SDL_IOStream *stream;
+	char *source;
+	ReplayReadMode mode;
+	// Index of the stage whose events come next in the stream
+	int next_stage;
+};
+
 typedef struct ReplayReadContext {
 	Replay *replay;
 	SDL_IOStream *stream;
@@ -117,6 +129,7 @@ static bool replay_read_header(
 		case REPLAY_STRUCT_VERSION_TS103000_REV3:
 		case REPLAY_STRUCT_VERSION_TS104000_REV0:
 		case REPLAY_STRUCT_VERSION_TS104000_REV1:
+		case REPLAY_STRUCT_VERSION_TS104000_REV2:
 		{
 			if(taisei_version_read(file, &rpy->game_version) != TAISEI_VERSION_SIZE) {
 				log_error("%s: Failed to read game version", source);
@@ -312,21 +325,157 @@ static bool replay_read_meta(ReplayReadContext *ctx) {
 	return true;
 }
 
-static bool _replay_read_events(ReplayReadContext *ctx) {
-	dynarray_foreach_elem(&ctx->replay->stages, ReplayStage *stg, {
-		if(!stg->num_events) {
-			log_error("%s: No events in stage", ctx->filename);
+// frame (uint32_t), type (uint8_t), value (uint16_t)
+#define REPLAY_EVENT_STORED_SIZE 7
+
+static bool replay_read_stage_events_flat(ReplayReadContext *ctx, ReplayStage *stg) {
+	// Events are decoded from a buffer rather than field by field: going through the
+	// (usually decompressing) stream for every field is what dominated loading time.
+	uint8_t buf[REPLAY_EVENT_STORED_SIZE * (REPLAY_COMPRESSION_CHUNK_SIZE / REPLAY_EVENT_STORED_SIZE)];
+	const int buf_events = sizeof(buf) / REPLAY_EVENT_STORED_SIZE;
+
+	for(int j = 0; j < stg->num_events;) {
+		int n = min(stg->num_events - j, buf_events);
+		size_t size = n * REPLAY_EVENT_STORED_SIZE;
+		size_t nread = SDL_ReadIO(ctx->stream, buf, size);
+
+		if(nread < size) {
+			log_error("%s: Error reading events: %s", ctx->filename, SDL_GetError());
 			RETURN_ERROR;
+			memset(buf + nread, 0, size - nread);
+		}
+
+		for(int k = 0; k < n; ++k) {
+			const uint8_t *e = buf + k * REPLAY_EVENT_STORED_SIZE;
+
+			dynarray_append(&stg->events, {
+				.frame = e[0] | e[1] << 8 | e[2] << 16 | (uint32_t)e[3] << 24,
+				.type = e[4],
+				.value = e[5] | e[6] << 8,
+			});
+		}
+
+		j += n;
+	}
+
+	return true;
+}
+
+static bool replay_read_stage_events_columnar(ReplayReadContext *ctx, ReplayStage *stg) {
+	int num_events = stg->num_events;
+	uint32_t frames_size = 0;
+	CHECKPROP(frames_size, SDL_ReadU32LE, ctx->stream, u);
+
+	// Every frame delta takes 1 to 5 bytes
+	if(frames_size < num_events || frames_size > num_events * 5) {
+		log_error("%s: Event frames column has invalid size %u", ctx->filename, frames_size);
+		return false;
+	}
+
+	size_t size = frames_size + num_events * 3;
+	uint8_t *buf = mem_alloc(size);
+	size_t nread = SDL_ReadIO(ctx->stream, buf, size);
+
+	if(nread < size) {
+		log_error("%s: Error reading events: %s", ctx->filename, SDL_GetError());
+
+		if(!(ctx->mode & REPLAY_READ_IGNORE_ERRORS)) {
+			mem_free(buf);
+			return false;
+		}
+
+		memset(buf + nread, 0, size - nread);
+	}
+
+	const uint8_t *frames = buf;
+	const uint8_t *frames_end = frames + frames_size;
+	const uint8_t *types = frames_end;
+	const uint8_t *values_lo = types + num_events;
+	const uint8_t *values_hi = values_lo + num_events;
+	uint32_t frame = 0;
+
+	for(int i = 0; i < num_events; ++i) {
+		uint32_t zigzag = 0;
+		uint8_t byte;
+		uint shift = 0;
+
+		do {
+			if(frames == frames_end || shift > 28) {
+				log_error("%s: Event frames column is corrupt", ctx->filename);
+				mem_free(buf);
+				return false;
+			}
+
+			byte = *frames++;
+			zigzag |= (uint32_t)(byte & 0x7f) << shift;
+			shift += 7;
+		} while(byte & 0x80);
+
+		frame += (zigzag >> 1) ^ -(zigzag & 1);
+
+		dynarray_append(&stg->events, {
+			.frame = frame,
+			.type = types[i],
+			.value = values_lo[i] | values_hi[i] << 8,
+		});
+	}
+
+	mem_free(buf);
+
+	if(frames != frames_end) {
+		log_error("%s: Event frames column has trailing data", ctx->filename);
+		RETURN_ERROR;
+	}
+
+	return true;
+}
+
+static bool replay_read_stage_events_any(ReplayReadContext *ctx, ReplayStage *stg) {
+	if(!stg->num_events) {
+		log_error("%s: No events in stage", ctx->filename);
+		RETURN_ERROR;
+	}
+
+	dynarray_ensure_capacity(&stg->events, stg->num_events);
+
+	if(ctx->version >= REPLAY_STRUCT_VERSION_TS104000_REV2) {
+		return replay_read_stage_events_columnar(ctx, stg);
+	}
+
+	return replay_read_stage_events_flat(ctx, stg);
+}
+
+static bool replay_skip_stage_events(ReplayReadContext *ctx, ReplayStage *stg) {
+	// The stream is usually decompressing, so it can't seek
+	uint8_t buf[REPLAY_COMPRESSION_CHUNK_SIZE];
+	size_t size;
+
+	if(ctx->version >= REPLAY_STRUCT_VERSION_TS104000_REV2) {
+		uint32_t frames_size = 0;
+		CHECKPROP(frames_size, SDL_ReadU32LE, ctx->stream, u);
+		size = frames_size + stg->num_events * 3;
+	} else {
+		size = stg->num_events * REPLAY_EVENT_STORED_SIZE;
+	}
+
+	while(size > 0) {
+		size_t n = min(size, sizeof(buf));
+
+		if(SDL_ReadIO(ctx->stream, buf, n) < n) {
+			log_error("%s: Error reading events: %s", ctx->filename, SDL_GetError());
+			return false;
 		}
 
-		dynarray_ensure_capacity(&stg->events, stg->num_events);
+		size -= n;
+	}
 
-		for(int j = 0; j < stg->num_events; ++j) {
-			ReplayEvent *evt = dynarray_append(&stg->events, {});
+	return true;
+}
 
-			CHECKPROP(evt->frame, SDL_ReadU32LE, ctx->stream, u);
-			CHECKPROP(evt->type, SDL_ReadU8, ctx->stream, u);
-			CHECKPROP(evt->value, SDL_ReadU16LE, ctx->stream, u);
+static bool _replay_read_events(ReplayReadContext *ctx) {
+	dynarray_foreach_elem(&ctx->replay->stages, ReplayStage *stg, {
+		if(!replay_read_stage_events_any(ctx, stg)) {
+			return false;
 		}
 	});
 
@@ -342,6 +491,98 @@ static bool replay_read_events(ReplayReadContext *ctx) {
 	return true;
 }
 
+void replay_close_event_reader(Replay *rpy) {
+	auto rd = rpy->event_reader;
+
+	if(!rd) {
+		return;
+	}
+
+	if(rd->stream && rd->stream != rd->file) {
+		SDL_CloseIO(rd->stream);
+	}
+
+	SDL_CloseIO(rd->file);
+	mem_free(rd->source);
+	mem_free(rd);
+	rpy->event_reader = NULL;
+}
+
+static bool replay_event_reader_rewind(Replay *rpy) {
+	auto rd = rpy->event_reader;
+
+	if(rd->stream && rd->stream != rd->file) {
+		SDL_CloseIO(rd->stream);
+	}
+
+	rd->stream = NULL;
+
+	if(SDL_SeekIO(rd->file, rpy->fileoffset, SDL_IO_SEEK_SET) < 0) {
+		log_error("%s: SDL_SeekIO() failed: %s", rd->source, SDL_GetError());
+		return false;
+	}
+
+	if(rpy->version & REPLAY_VERSION_COMPRESSION_BIT) {
+		rd->stream = replay_wrap_stream_decompress(rpy->version, rd->file, false);
+	} else {
+		rd->stream = rd->file;
+	}
+
+	rd->next_stage = 0;
+	return true;
+}
+
+bool replay_read_stage_events(Replay *rpy, int stage_idx) {
+	auto rd = rpy->event_reader;
+	ReplayStage *stg = dynarray_get_ptr(&rpy->stages, stage_idx);
+
+	if(!rd || stg->events.data) {
+		return true;
+	}
+
+	dynarray_foreach_elem(&rpy->stages, ReplayStage *s, {
+		replay_stage_destroy_events(s);
+	});
+
+	// Stages are stored in order, so going back to an earlier one means starting over
+	if((!rd->stream || stage_idx < rd->next_stage) && !replay_event_reader_rewind(rpy)) {
+		return false;
+	}
+
+	ReplayReadContext ctx = {
+		.replay = rpy,
+		.stream = rd->stream,
+		.filename = rd->source,
+		.filesize = -1,
+		.version = rpy->version & ~REPLAY_VERSION_COMPRESSION_BIT,
+		.mode = rd->mode,
+	};
+
+	bool ok = true;
+
+	while(ok && rd->next_stage < stage_idx) {
+		ok = replay_skip_stage_events(&ctx, dynarray_get_ptr(&rpy->stages, rd->next_stage++));
+	}
+
+	if(ok) {
+		ok = replay_read_stage_events_any(&ctx, stg);
+		++rd->next_stage;
+	}
+
+	if(!ok) {
+		replay_stage_destroy_events(stg);
+
+		// Where the stream is at is unknown now
+		if(rd->stream != rd->file) {
+			SDL_CloseIO(rd->stream);
+		}
+
+		rd->stream = NULL;
+	}
+
+	return ok;
+}
+
 bool replay_read(Replay *rpy, SDL_IOStream *file, ReplayReadMode mode, const char *source) {
 	int64_t filesize; // must be signed
 
@@ -350,6 +591,7 @@ bool replay_read(Replay *rpy, SDL_IOStream *file, ReplayReadMode mode, const cha
 	}
 
 	assert((mode & REPLAY_READ_ALL) != 0);
+	assert(!(mode & REPLAY_READ_EVENTS_LAZY) || (mode & REPLAY_READ_EVENTS));
 	filesize = SDL_GetIOSize(file);
 
 	if(filesize < 0) {
@@ -437,6 +679,17 @@ bool replay_read(Replay *rpy, SDL_IOStream *file, ReplayReadMode mode, const cha
 			}
 		}
 
+		if(mode & REPLAY_READ_EVENTS_LAZY) {
+			replay_close_event_reader(rpy);
+			rpy->event_reader = ALLOC(struct ReplayEventReader, {
+				.file = file,
+				.source = mem_strdup(source),
+				.mode = mode,
+			});
+
+			return true;
+		}
+
 		bool compression = false;
 
 		if(rpy->version & REPLAY_VERSION_COMPRESSION_BIT) {
@@ -7,7 +7,7 @@
  */
 
 #include "replay.h"
-#include "struct.h"
+#include "rw_common.h"
 #include "stage.h"
 
 #include "rwops/rwops_stdiofp.h"
@@ -16,6 +16,8 @@ void replay_destroy_events(Replay *rpy) {
 	dynarray_foreach_elem(&rpy->stages, ReplayStage *stg, {
 		replay_stage_destroy_events(stg);
 	});
+
+	replay_close_event_reader(rpy);
 }
 
 void replay_reset(Replay *rpy) {
@@ -82,7 +84,11 @@ bool replay_load_vfspath(Replay *rpy, const char *path, ReplayReadMode mode) {
 	bool result = replay_read(rpy, file, mode, sp);
 
 	mem_free(sp);
-	SDL_CloseIO(file);
+
+	if(!result || !(mode & REPLAY_READ_EVENTS_LAZY)) {
+		SDL_CloseIO(file);
+	}
+
 	return result;
 }
 
@@ -114,7 +120,10 @@ bool replay_load_syspath(Replay *rpy, const char *path, ReplayReadMode mode) {
 
 	bool result = replay_read(rpy, file, mode, path);
 
-	SDL_CloseIO(file);
+	if(!result || !(mode & REPLAY_READ_EVENTS_LAZY)) {
+		SDL_CloseIO(file);
+	}
+
 	return result;
 }
 
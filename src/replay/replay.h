@@ -29,6 +29,11 @@ typedef enum ReplayReadMode {
 	REPLAY_READ_EVENTS = (1 << 1),
 	REPLAY_READ_IGNORE_ERRORS = (1 << 2),
 
+	// With REPLAY_READ_EVENTS: don't read any events yet, keep the file open and read them one
+	// stage at a time, when that stage is about to be played (see replay_read_stage_events()).
+	// On success, the replay takes ownership of the file; replay_destroy_events() closes it.
+	REPLAY_READ_EVENTS_LAZY = (1 << 3),
+
 	REPLAY_READ_ALL = REPLAY_READ_META | REPLAY_READ_EVENTS,
 } ReplayReadMode;
 
@@ -38,6 +43,11 @@ void replay_destroy_events(Replay *rpy) attr_nonnull_all;
 bool replay_write(Replay *rpy, SDL_IOStream *file, uint16_t version) attr_nonnull_all;
 bool replay_read(Replay *rpy, SDL_IOStream *file, ReplayReadMode mode, const char *source) attr_nonnull(1, 2);
 
+// Makes sure the events of a stage are loaded. If the replay was read with
+// REPLAY_READ_EVENTS_LAZY, they are read from the file now, and the events of every other stage
+// are released. Otherwise this does nothing.
+bool replay_read_stage_events(Replay *rpy, int stage_idx) attr_nonnull_all;
+
 bool replay_save(Replay *rpy, const char *name) attr_nonnull_all;
 bool replay_save_syspath(Replay *rpy, const char *path, uint16_t version) attr_nonnull_all;
 bool replay_load(Replay *rpy, const char *name, ReplayReadMode mode) attr_nonnull_all;
@@ -18,4 +18,6 @@ SDL_IOStream *replay_wrap_stream_compress(uint16_t version, SDL_IOStream *rw,
 SDL_IOStream *replay_wrap_stream_decompress(uint16_t version,
 					    SDL_IOStream *rw, bool autoclose);
 
+void replay_close_event_reader(Replay *rpy);
+
 extern uint8_t replay_magic_header[REPLAY_MAGIC_HEADER_SIZE];
@@ -55,6 +55,9 @@
 
 	// Taisei v1.4 revision 1: switch to zstd compression, remove plr_focus, add skip_frames (for demos), rework/fix player resource usage stats
 	#define REPLAY_STRUCT_VERSION_TS104000_REV1 14
+
+	// Taisei v1.4 revision 2: store events in columns, with frames delta-encoded as varints
+	#define REPLAY_STRUCT_VERSION_TS104000_REV2 15
 /* END supported struct versions */
 
 #define REPLAY_VERSION_COMPRESSION_BIT 0x8000
@@ -62,7 +65,7 @@
 
 // What struct version to use when saving recorded replays
 #define REPLAY_STRUCT_VERSION_WRITE \
-	(REPLAY_STRUCT_VERSION_TS104000_REV1 | REPLAY_VERSION_COMPRESSION_BIT)
+	(REPLAY_STRUCT_VERSION_TS104000_REV2 | REPLAY_VERSION_COMPRESSION_BIT)
 
 #define REPLAY_ALLOC_INITIAL 256
 
@@ -72,6 +75,18 @@
 
 #define REPLAY_MAGIC_HEADER_SIZE (sizeof((uint8_t[])REPLAY_MAGIC_HEADER))
 
+/*
+ *  REPLAY_STRUCT_VERSION_TS104000_REV1 and below store events as a flat sequence of records.
+ *
+ *  REPLAY_STRUCT_VERSION_TS104000_REV2 and above store the events of each stage in columns instead:
+ *
+ *      uint32_t frames_size;
+ *      uint8_t frames[frames_size];    // zigzag-encoded deltas from the previous event's frame, as LEB128 varints
+ *      uint8_t types[num_events];
+ *      uint8_t values_lo[num_events];  // low bytes of values
+ *      uint8_t values_hi[num_events];  // high bytes of values
+ */
+
 typedef struct ReplayEvent {
 	/* BEGIN stored fields */
 
@@ -224,6 +239,9 @@ typedef struct Replay {
 	/* END stored fields */
 
 	DYNAMIC_ARRAY(ReplayStage) stages;
+
+	// Only set while the events are read lazily, see REPLAY_READ_EVENTS_LAZY
+	struct ReplayEventReader *event_reader;
 } Replay;
 
 #define REPLAY_GFLAGS \
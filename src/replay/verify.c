@@ -0,0 +1,370 @@
+/*
+ * This software is licensed under the terms of the MIT License.
+ * See COPYING for further information.
+ * ---
+ * Copyright (c) 2011-2024, Lukas Weber <laochailan@web.de>.
+ * Copyright (c) 2012-2024, Andrei Alexeyev <akari@taisei-project.org>.
+ */
+
+#include "verify.h"
+#include "replay.h"
+#include "state.h"
+#include "struct.h"
+
+#include "dynarray.h"
+#include "global.h"
+#include "hirestime.h"
+#include "log.h"
+#include "util/io.h"
+#include "util/strbuf.h"
+
+struct ReplayVerifyBatch {
+	char *path;
+	DYNAMIC_ARRAY(char*) replays;
+	CallChain next;
+	Replay rpy;
+	StringBuffer record;
+	int current;
+	int num_failed;
+
+	// stats of the replay currently being verified
+	hrtime_t start_time;
+	int64_t frames;
+	int desync_frame;
+	int desync_stage;
+};
+
+static ReplayVerifyBatch *active_batch;
+
+static SDL_EnumerationResult SDLCALL collect_dir_entry(void *userdata, const char *dirname, const char *fname) {
+	ReplayVerifyBatch *batch = userdata;
+
+	if(strendswith(fname, "." REPLAY_EXTENSION)) {
+		dynarray_append(&batch->replays, strjoin(dirname, fname, NULL));
+	}
+
+	return SDL_ENUM_CONTINUE;
+}
+
+static bool collect_list_file(ReplayVerifyBatch *batch, const char *path) {
+	SDL_IOStream *io = SDL_IOFromFile(path, "r");
+
+	if(!io) {
+		log_sdl_error(LOG_ERROR, "SDL_IOFromFile");
+		return false;
+	}
+
+	size_t bufsize = 256;
+	char *buf = mem_alloc(bufsize);
+
+	while(SDL_RWgets_realloc(io, &buf, &bufsize)) {
+		char *p = buf;
+
+		while(isspace(*p)) {
+			++p;
+		}
+
+		char *end = p + strlen(p);
+
+		while(end > p && isspace(end[-1])) {
+			*--end = 0;
+		}
+
+		if(*p && *p != '#') {
+			dynarray_append(&batch->replays, mem_strdup(p));
+		}
+	}
+
+	mem_free(buf);
+	SDL_CloseIO(io);
+	return true;
+}
+
+static int compare_paths(const void *a, const void *b) {
+	return strcmp(*(char *const*)a, *(char *const*)b);
+}
+
+ReplayVerifyBatch *replay_verify_batch_new(const char *path, int shard_index, int shard_count) {
+	auto batch = ALLOC(ReplayVerifyBatch, {
+		.path = mem_strdup(path),
+	});
+
+	SDL_PathInfo info;
+	bool ok;
+
+	if(!SDL_GetPathInfo(path, &info)) {
+		log_sdl_error(LOG_ERROR, "SDL_GetPathInfo");
+		ok = false;
+	} else if(info.type == SDL_PATHTYPE_DIRECTORY) {
+		ok = SDL_EnumerateDirectory(path, collect_dir_entry, batch);
+
+		if(!ok) {
+			log_sdl_error(LOG_ERROR, "SDL_EnumerateDirectory");
+		}
+	} else if(strendswith(path, "." REPLAY_EXTENSION)) {
+		dynarray_append(&batch->replays, mem_strdup(path));
+		ok = true;
+	} else {
+		ok = collect_list_file(batch, path);
+	}
+
+	if(!ok) {
+		replay_verify_batch_free(batch);
+		return NULL;
+	}
+
+	dynarray_qsort(&batch->replays, compare_paths);
+
+	if(shard_count > 1) {
+		assert(shard_index >= 0 && shard_index < shard_count);
+		int n = 0;
+
+		dynarray_foreach(&batch->replays, int i, char **p, {
+			if(i % shard_count == shard_index) {
+				dynarray_set(&batch->replays, n, *p);
+				++n;
+			} else {
+				mem_free(*p);
+			}
+		});
+
+		batch->replays.num_elements = n;
+	}
+
+	if(batch->replays.num_elements == 0) {
+		log_warn("No replays to verify in %s", path);
+	}
+
+	return batch;
+}
+
+void replay_verify_batch_free(ReplayVerifyBatch *batch) {
+	if(!batch) {
+		return;
+	}
+
+	assert(batch != active_batch);
+
+	dynarray_foreach_elem(&batch->replays, char **p, {
+		mem_free(*p);
+	});
+
+	dynarray_free_data(&batch->replays);
+	replay_reset(&batch->rpy);
+	strbuf_free(&batch->record);
+	mem_free(batch->path);
+	mem_free(batch);
+}
+
+/*
+ * Returns how many arguments starting at argv[i] make up an option that must not be forwarded
+ * to workers (0 if it should be forwarded). Only the exact option names are recognized, not
+ * the abbreviations getopt_long() would also accept.
+ */
+static int worker_skip_arg(int argc, char **argv, int i) {
+	static const char *const long_opts[] = { "--verify-replays", "--jobs", "--batch-shard" };
+	const char *arg = argv[i];
+
+	for(int j = 0; j < ARRAY_SIZE(long_opts); ++j) {
+		size_t len = strlen(long_opts[j]);
+
+		if(!strncmp(arg, long_opts[j], len)) {
+			if(arg[len] == '=') {
+				return 1;
+			}
+
+			if(arg[len] == 0) {
+				return min(2, argc - i);
+			}
+		}
+	}
+
+	if(!strncmp(arg, "-j", 2)) {
+		return arg[2] ? 1 : min(2, argc - i);
+	}
+
+	return 0;
+}
+
+int replay_verify_batch_spawn_workers(ReplayVerifyBatch *batch, int argc, char **argv, int num_workers) {
+	num_workers = min(num_workers, (int)batch->replays.num_elements);
+
+	if(num_workers < 1) {
+		return 0;
+	}
+
+	// argv[0], forwarded options, 4 batch arguments, and the terminator
+	const char *args[argc + 5];
+	int num_args = 0;
+	args[num_args++] = argv[0];
+
+	for(int i = 1; i < argc;) {
+		int skip = worker_skip_arg(argc, argv, i);
+
+		if(skip) {
+			i += skip;
+		} else {
+			args[num_args++] = argv[i++];
+		}
+	}
+
+	char shard[32];
+	args[num_args++] = "--verify-replays";
+	args[num_args++] = batch->path;
+	args[num_args++] = "--batch-shard";
+	args[num_args++] = shard;
+	args[num_args] = NULL;
+
+	SDL_Process **workers = ALLOC_ARRAY(num_workers, typeof(*workers));
+	int num_spawned = 0;
+	int status = 0;
+
+	for(int i = 0; i < num_workers; ++i) {
+		snprintf(shard, sizeof(shard), "%i/%i", i, num_workers);
+
+		if((workers[i] = SDL_CreateProcess(args, false))) {
+			++num_spawned;
+		} else {
+			log_sdl_error(LOG_ERROR, "SDL_CreateProcess");
+		}
+	}
+
+	if(num_spawned == 0) {
+		mem_free(workers);
+		return -1;
+	}
+
+	log_info("Verifying %i replays with %i worker processes",
+		batch->replays.num_elements, num_spawned);
+
+	for(int i = 0; i < num_workers; ++i) {
+		if(!workers[i]) {
+			log_error("Shard %i/%i was not verified", i, num_workers);
+			status = 1;
+			continue;
+		}
+
+		int exitcode = 1;
+
+		if(!SDL_WaitProcess(workers[i], true, &exitcode)) {
+			log_sdl_error(LOG_ERROR, "SDL_WaitProcess");
+		}
+
+		if(exitcode != 0) {
+			status = 1;
+		}
+
+		SDL_DestroyProcess(workers[i]);
+	}
+
+	mem_free(workers);
+	return status;
+}
+
+static void emit_record(ReplayVerifyBatch *batch, const char *path, const char *result) {
+	StringBuffer *sb = &batch->record;
+	double seconds = (double)(time_get() - batch->start_time) / HRTIME_RESOLUTION;
+
+	strbuf_clear(sb);
+	strbuf_cat(sb, "{\"replay\":");
+	strbuf_cat_json_string(sb, path);
+	strbuf_printf(sb, ",\"result\":\"%s\"", result);
+
+	if(batch->desync_frame >= 0) {
+		strbuf_printf(sb, ",\"desync_frame\":%i,\"desync_stage\":%i",
+			batch->desync_frame, batch->desync_stage);
+	} else {
+		strbuf_cat(sb, ",\"desync_frame\":null,\"desync_stage\":null");
+	}
+
+	strbuf_printf(sb, ",\"frames\":%"PRIi64",\"time\":%.6f,\"fps\":%.1f}\n",
+		batch->frames, seconds, seconds > 0 ? batch->frames / seconds : 0.0);
+
+	// one write per line, so that concurrent workers don't interleave records
+	fputs(sb->start, stdout);
+	fflush(stdout);
+}
+
+static void verify_batch_next(ReplayVerifyBatch *batch);
+
+static void verify_batch_replay_done(CallChainResult ccr) {
+	ReplayVerifyBatch *batch = ccr.ctx;
+	const char *path = dynarray_get(&batch->replays, batch->current - 1);
+	const char *result;
+
+	if(batch->desync_frame >= 0) {
+		result = "desync";
+	} else if(batch->frames == 0) {
+		result = "error";
+	} else {
+		result = "ok";
+	}
+
+	if(strcmp(result, "ok")) {
+		++batch->num_failed;
+	}
+
+	emit_record(batch, path, result);
+	replay_reset(&batch->rpy);
+	verify_batch_next(batch);
+}
+
+static void verify_batch_next(ReplayVerifyBatch *batch) {
+	while(batch->current < batch->replays.num_elements) {
+		const char *path = dynarray_get(&batch->replays, batch->current++);
+
+		batch->start_time = time_get();
+		batch->frames = 0;
+		batch->desync_frame = -1;
+		batch->desync_stage = -1;
+
+		if(!replay_load_syspath(&batch->rpy, path, REPLAY_READ_ALL | REPLAY_READ_EVENTS_LAZY)) {
+			replay_reset(&batch->rpy);
+			++batch->num_failed;
+			emit_record(batch, path, "error");
+			continue;
+		}
+
+		replay_play(&batch->rpy, 0, false, CALLCHAIN(verify_batch_replay_done, batch));
+		return;
+	}
+
+	log_info("Verified %i replays, %i failed", batch->replays.num_elements, batch->num_failed);
+
+	CallChain next = batch->next;
+	int num_failed = batch->num_failed;
+	active_batch = NULL;
+	replay_verify_batch_free(batch);
+	run_call_chain(&next, (void*)(intptr_t)num_failed);
+}
+
+void replay_verify_batch_run(ReplayVerifyBatch *batch, CallChain next) {
+	assert(active_batch == NULL);
+	assert(global.is_replay_verification);
+
+	active_batch = batch;
+	batch->next = next;
+	batch->current = 0;
+	batch->num_failed = 0;
+	verify_batch_next(batch);
+}
+
+bool replay_verify_batch_active(void) {
+	return active_batch != NULL;
+}
+
+void replay_verify_batch_stage_end(void) {
+	ReplayVerifyBatch *batch = active_batch;
+
+	if(!batch) {
+		return;
+	}
+
+	ReplayState *rst = &global.replay.input;
+	batch->frames += global.frames;
+
+	if(rst->replay == &batch->rpy && rst->play.desync_frame >= 0 && batch->desync_frame < 0) {
+		batch->desync_frame = rst->play.desync_frame;
+		batch->desync_stage = rst->stage->stage;
+	}
+}
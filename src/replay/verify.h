@@ -0,0 +1,48 @@
+/*
+ * This software is licensed under the terms of the MIT License.
+ * See COPYING for further information.
+ * ---
+ * Copyright (c) 2011-2024, Lukas Weber <laochailan@web.de>.
+ * Copyright (c) 2012-2024, Andrei Alexeyev <akari@taisei-project.org>.
+ */
+
+#pragma once
+#include "taisei.h"
+
+#include "util/callchain.h"
+
+typedef struct ReplayVerifyBatch ReplayVerifyBatch;
+
+/*
+ * Collects the replays to verify. `path` may be a directory (all *.tsr files in it are
+ * verified), a single .tsr file, or a text file listing one replay path per line.
+ * The list is sorted; if shard_count > 1, only every shard_count-th replay starting at
+ * shard_index is kept. Returns NULL on error.
+ */
+ReplayVerifyBatch *replay_verify_batch_new(const char *path, int shard_index, int shard_count)
+	attr_nonnull(1);
+
+void replay_verify_batch_free(ReplayVerifyBatch *batch);
+
+/*
+ * Re-executes argv[0] as num_workers headless worker processes, each verifying one shard
+ * of the batch, and waits for all of them. The rest of the command line is forwarded to
+ * the workers, minus the batch and job control options. Workers write their results
+ * directly to the inherited stdout. Returns the process exit status to use (0 if every
+ * replay passed), or -1 if no worker could be started.
+ */
+int replay_verify_batch_spawn_workers(ReplayVerifyBatch *batch, int argc, char **argv, int num_workers)
+	attr_nonnull_all;
+
+/*
+ * Plays every replay in the batch in this process, one after another, printing one JSON
+ * object per replay to stdout. Takes ownership of the batch. `next` is invoked with the
+ * number of failed replays cast to a pointer.
+ */
+void replay_verify_batch_run(ReplayVerifyBatch *batch, CallChain next)
+	attr_nonnull(1);
+
+bool replay_verify_batch_active(void);
+
+// Called by the stage code when a stage ends, to account frames and desyncs.
+void replay_verify_batch_stage_end(void);
@@ -102,7 +102,7 @@ static bool replay_write_stage(ReplayStage *stg, SDL_IOStream *file,
 	return true;
 }
 
-static void replay_write_stage_events(ReplayStage *stg, SDL_IOStream *file) {
+static void replay_write_stage_events_flat(ReplayStage *stg, SDL_IOStream *file) {
 	dynarray_foreach_elem(&stg->events, ReplayEvent *evt, {
 		SDL_WriteU32LE(file, evt->frame);
 		SDL_WriteU8(file, evt->type);
@@ -110,9 +110,51 @@ static void replay_write_stage_events(ReplayStage *stg, SDL_IOStream *file) {
 	});
 }
 
-static bool replay_write_events(Replay *rpy, SDL_IOStream *file) {
+static void replay_write_stage_events_columnar(ReplayStage *stg, SDL_IOStream *file) {
+	int num_events = stg->events.num_elements;
+
+	if(num_events == 0) {
+		SDL_WriteU32LE(file, 0);
+		return;
+	}
+
+	// Up to 5 bytes per frame delta, then one byte each for type, value low and value high
+	uint8_t *buf = mem_alloc(num_events * 8);
+	uint8_t *types = buf + num_events * 5;
+	uint8_t *values_lo = types + num_events;
+	uint8_t *values_hi = values_lo + num_events;
+	uint8_t *frames_end = buf;
+	uint32_t prev_frame = 0;
+
+	dynarray_foreach(&stg->events, int i, ReplayEvent *evt, {
+		int32_t delta = evt->frame - prev_frame;
+		uint32_t zigzag = ((uint32_t)delta << 1) ^ (uint32_t)(delta >> 31);
+		prev_frame = evt->frame;
+
+		while(zigzag >= 0x80) {
+			*frames_end++ = (zigzag & 0x7f) | 0x80;
+			zigzag >>= 7;
+		}
+
+		*frames_end++ = zigzag;
+		types[i] = evt->type;
+		values_lo[i] = evt->value & 0xff;
+		values_hi[i] = evt->value >> 8;
+	});
+
+	SDL_WriteU32LE(file, frames_end - buf);
+	SDL_WriteIO(file, buf, frames_end - buf);
+	SDL_WriteIO(file, types, num_events * 3);
+	mem_free(buf);
+}
+
+static bool replay_write_events(Replay *rpy, SDL_IOStream *file, uint16_t version) {
 	dynarray_foreach_elem(&rpy->stages, ReplayStage *stg, {
-		replay_write_stage_events(stg, file);
+		if(version >= REPLAY_STRUCT_VERSION_TS104000_REV2) {
+			replay_write_stage_events_columnar(stg, file);
+		} else {
+			replay_write_stage_events_flat(stg, file);
+		}
 	});
 
 	return true;
@@ -170,7 +212,7 @@ bool replay_write(Replay *rpy, SDL_IOStream *file, uint16_t version) {
 		vfile = replay_wrap_stream_compress(version, file, false);
 	}
 
-	bool events_ok = replay_write_events(rpy, vfile);
+	bool events_ok = replay_write_events(rpy, vfile, base_version);
 
 	if(compression) {
 		SDL_CloseIO(vfile);
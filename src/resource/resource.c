@@ -23,6 +23,7 @@
 #include "eventloop/eventloop.h"
 #include "events.h"
 #include "filewatch/filewatch.h"
+#include "profiler.h"
 #include "taskmanager.h"
 #include "util.h"
 #include "util/env.h"
@@ -137,6 +138,10 @@ struct InternalResource {
 	// For simplicity of implementation, this is a counted set (a multiset)
 	ht_ires_counted_set_t dependents;
 
+	// Slot in a ResourceIDTable that caches this resource, if it has been looked up by ID.
+	// Cleared when the resource is unloaded.
+	void **id_slot;
+
 #if DEBUG_LOCKS
 	SDL_AtomicInt num_locks;
 #endif
@@ -151,6 +156,72 @@ struct InternalResLoadState {
 	bool ready_to_finalize;
 };
 
+typedef struct ResourceIDTable {
+	const char *const *names;
+	void **slots;
+	uint num_ids;
+} ResourceIDTable;
+
+static const char *const sprite_id_names[] = {
+	#define SPRITE(_ident, _name) [RID_SPRITE_##_ident] = _name,
+	#define TEXTURE RES_IDS_NOOP
+	#define SHPROG RES_IDS_NOOP
+	#define SFX RES_IDS_NOOP
+	#include "res-ids.inc.h"
+	#undef SPRITE
+	#undef TEXTURE
+	#undef SHPROG
+	#undef SFX
+};
+
+static const char *const texture_id_names[] = {
+	#define SPRITE RES_IDS_NOOP
+	#define TEXTURE(_ident, _name) [RID_TEXTURE_##_ident] = _name,
+	#define SHPROG RES_IDS_NOOP
+	#define SFX RES_IDS_NOOP
+	#include "res-ids.inc.h"
+	#undef SPRITE
+	#undef TEXTURE
+	#undef SHPROG
+	#undef SFX
+};
+
+static const char *const shader_program_id_names[] = {
+	#define SPRITE RES_IDS_NOOP
+	#define TEXTURE RES_IDS_NOOP
+	#define SHPROG(_ident, _name) [RID_SHPROG_##_ident] = _name,
+	#define SFX RES_IDS_NOOP
+	#include "res-ids.inc.h"
+	#undef SPRITE
+	#undef TEXTURE
+	#undef SHPROG
+	#undef SFX
+};
+
+static const char *const sfx_id_names[] = {
+	#define SPRITE RES_IDS_NOOP
+	#define TEXTURE RES_IDS_NOOP
+	#define SHPROG RES_IDS_NOOP
+	#define SFX(_ident, _name) [RID_SFX_##_ident] = _name,
+	#include "res-ids.inc.h"
+	#undef SPRITE
+	#undef TEXTURE
+	#undef SHPROG
+	#undef SFX
+};
+
+static void *sprite_id_slots[NUM_SPRITE_IDS];
+static void *texture_id_slots[NUM_TEXTURE_IDS];
+static void *shader_program_id_slots[NUM_SHADER_PROGRAM_IDS];
+static void *sfx_id_slots[NUM_SFX_IDS];
+
+static const ResourceIDTable id_tables[RES_NUMTYPES] = {
+	[RES_SPRITE] = { sprite_id_names, sprite_id_slots, NUM_SPRITE_IDS },
+	[RES_TEXTURE] = { texture_id_names, texture_id_slots, NUM_TEXTURE_IDS },
+	[RES_SHADER_PROGRAM] = { shader_program_id_names, shader_program_id_slots, NUM_SHADER_PROGRAM_IDS },
+	[RES_SFX] = { sfx_id_names, sfx_id_slots, NUM_SFX_IDS },
+};
+
 typedef struct FileWatchHandlerData {
 	IResPtrArray temp_ires_array;
 } FileWatchHandlerData;
@@ -767,6 +838,20 @@ void res_group_release(ResourceGroup *rg) {
 	dynarray_free_data(&rg->refs);
 }
 
+void res_group_get_progress(ResourceGroup *rg, uint *out_num_done, uint *out_num_total) {
+	uint num_done = 0;
+
+	dynarray_foreach_elem(&rg->refs, void **ref, {
+		InternalResource *ires = *ref;
+		ires_lock(ires);
+		num_done += (ires->status != RES_STATUS_LOADING);
+		ires_unlock(ires);
+	});
+
+	*out_num_done = num_done;
+	*out_num_total = rg->refs.num_elements;
+}
+
 static void res_group_add_ires(ResourceGroup *rg, InternalResource *ires, bool incref) {
 	if(rg == NULL) {
 		rg = &res_gstate.default_group;
@@ -1016,6 +1101,7 @@ static void *load_resource_async_task(void *vdata) {
 	LOAD_DBG("BEGIN:\t\tires = %p\t\tst = %p", ires, st);
 
 	ResourceHandler *h = get_ires_handler(ires);
+	PROFILE_ZONE_CAT("res_load_async", type_name(h->type));
 
 	lstate_set_status(st, LOAD_NONE);
 	PROTECT_FLAGS(st, h->procs.load(&st->st));
@@ -1110,6 +1196,11 @@ static bool unload_resource(InternalResource *ires) {
 
 	ht_unset(&handler->private.mapping, ires->name);
 
+	if(ires->id_slot) {
+		SDL_SetAtomicPointer(ires->id_slot, NULL);
+		ires->id_slot = NULL;
+	}
+
 	ires_unmake_dependent(ires, &ires->dependencies);
 	ires_remove_watched_paths(ires);
 
@@ -1250,6 +1341,8 @@ static void load_resource(
 	const char *typename = type_name(handler->type);
 	char *path = NULL;
 
+	PROFILE_ZONE_CAT("res_load", typename);
+
 	if(handler->type == RES_SFX || handler->type == RES_BGM) {
 		// audio stuff is always optional.
 		// loading may fail if the backend failed to initialize properly, even though the resource exists.
@@ -1373,6 +1466,7 @@ static bool reload_resource(InternalResource *ires, ResourceFlags flags, bool as
 static void load_resource_finish(InternalResLoadState *st) {
 	void *raw = NULL;
 	InternalResource *ires = st->ires;
+	PROFILE_ZONE_CAT("res_finish", type_name(ires->res.type));
 
 	assert(ires->status == RES_STATUS_LOADING || ires->status == RES_STATUS_FAILED);
 	assert(st->ready_to_finalize);
@@ -1542,6 +1636,46 @@ Resource *_res_get_prehashed(ResourceType type, const char *name, hash_t hash, R
 	}
 }
 
+Resource *_res_get_by_id(ResourceType type, uint id, ResourceFlags flags) {
+	const ResourceIDTable *t = id_tables + type;
+	assert(t->slots != NULL);
+	assert(id < t->num_ids);
+
+	if(!(flags & RESF_RELOAD)) {
+		InternalResource *ires = SDL_GetAtomicPointer(t->slots + id);
+
+		if(LIKELY(ires)) {
+			assert(ires->status == RES_STATUS_LOADED);
+			return &ires->res;
+		}
+	}
+
+	Resource *res = res_get(type, res_id_name(type, id), flags);
+
+	if(res) {
+		InternalResource *ires = CASTPTR_ASSUME_ALIGNED(
+			(char*)res - offsetof(InternalResource, res), InternalResource);
+
+		ires_lock(ires);
+
+		if(ires->status == RES_STATUS_LOADED && !ires->id_slot) {
+			ires->id_slot = t->slots + id;
+			SDL_SetAtomicPointer(ires->id_slot, ires);
+		}
+
+		ires_unlock(ires);
+	}
+
+	return res;
+}
+
+const char *res_id_name(ResourceType type, uint id) {
+	const ResourceIDTable *t = id_tables + type;
+	assert(t->names != NULL);
+	assert(id < t->num_ids);
+	return NOT_NULL(t->names[id]);
+}
+
 static InternalResource *preload_resource_internal(
 	ResourceType type, const char *name, ResourceFlags flags
 ) {
@@ -1708,24 +1842,36 @@ char *res_util_basename(const char *prefix, const char *path) {
 	return out;
 }
 
-static void preload_path(const char *path, ResourceType type, ResourceFlags flags) {
+static void preload_path(ResourceGroup *rg, const char *path, ResourceType type, ResourceFlags flags) {
 	if(_handlers[type]->procs.check(path)) {
 		char *name = get_name_from_path(_handlers[type], path);
 		if(name) {
-			res_group_preload_one(NULL, type, flags, name);
+			res_group_preload_one(rg, type, flags, name);
 			mem_free(name);
 		}
 	}
 }
 
-static void *preload_shaders(const char *path, void *arg) {
-	preload_path(path, RES_SHADER_PROGRAM, RESF_DEFAULT);
+struct preload_all_of_type_arg {
+	ResourceGroup *rg;
+	ResourceType type;
+	ResourceFlags flags;
+};
+
+static void *preload_all_of_type(const char *path, void *varg) {
+	struct preload_all_of_type_arg *arg = varg;
+	preload_path(arg->rg, path, arg->type, arg->flags);
 	return NULL;
 }
 
+void res_group_preload_all(ResourceGroup *rg, ResourceType type, ResourceFlags flags) {
+	struct preload_all_of_type_arg arg = { rg, type, flags };
+	vfs_dir_walk(get_handler(type)->subdir, preload_all_of_type, &arg);
+}
+
 static void *preload_all(const char *path, void *arg) {
 	for(ResourceType t = 0; t < RES_NUMTYPES; ++t) {
-		preload_path(path, t, RESF_OPTIONAL);
+		preload_path(NULL, path, t, RESF_OPTIONAL);
 	}
 
 	return NULL;
@@ -1765,11 +1911,6 @@ void res_post_init(void) {
 		}
 	}
 
-	if(env_get("TAISEI_PRELOAD_SHADERS", 0)) {
-		log_info("Loading all shaders now due to TAISEI_PRELOAD_SHADERS");
-		vfs_dir_walk(SHPROG_PATH_PREFIX, preload_shaders, NULL);
-	}
-
 	if(env_get("TAISEI_AGGRESSIVE_PRELOAD", 0)) {
 		log_info("Attempting to load all resources now due to TAISEI_AGGRESSIVE_PRELOAD");
 		vfs_dir_walk("res/", preload_all, NULL);
@@ -1849,6 +1990,14 @@ void res_shutdown(void) {
 	ht_watch2iresset_destroy(&res_gstate.watch_to_iresset);
 	res_gstate.ires_freelist = NULL;
 
+	for(ResourceType type = 0; type < RES_NUMTYPES; ++type) {
+		const ResourceIDTable *t = id_tables + type;
+
+		if(t->slots) {
+			memset(t->slots, 0, t->num_ids * sizeof(*t->slots));
+		}
+	}
+
 	if(!res_gstate.env.no_async_load) {
 		events_unregister_handler(resource_asyncload_handler);
 	}
@@ -11,6 +11,7 @@
 
 #include "dynarray.h"
 #include "hashtable.h"
+#include "resource_ids.h"
 #include "vfs/public.h"
 
 typedef enum ResourceType {
@@ -157,10 +158,27 @@ INLINE void *res_get_data(ResourceType type, const char *name, ResourceFlags fla
 	return _res_get_data_prehashed(type, name, ht_str2ptr_hash(name), flags);
 }
 
+// Looks up a resource by its compile-time ID (see resource_ids.h).
+// Once loaded, the resource is cached in a flat per-type table, bypassing the name lookup.
+Resource *_res_get_by_id(ResourceType type, uint id, ResourceFlags flags);
+
+// Returns the resource name corresponding to a compile-time ID.
+const char *res_id_name(ResourceType type, uint id) attr_returns_nonnull;
+
+INLINE void *_res_get_data_by_id(ResourceType type, uint id, ResourceFlags flags) {
+	Resource *res = _res_get_by_id(type, id, flags);
+	return res ? res->data : NULL;
+}
+
 void *res_for_each(ResourceType type, void *(*callback)(const char *name, Resource *res, void *arg), void *arg);
 
 void res_group_init(ResourceGroup *rg) attr_nonnull_all;
 void res_group_release(ResourceGroup *rg) attr_nonnull_all;
+void res_group_preload_all(ResourceGroup *rg, ResourceType type, ResourceFlags flags) attr_nonnull_all;
+
+// Non-blocking; counts resources that finished loading, successfully or not.
+void res_group_get_progress(ResourceGroup *rg, uint *out_num_done, uint *out_num_total) attr_nonnull_all;
+
 void res_group_preload(ResourceGroup *rg, ResourceType type, ResourceFlags flags, ...)
 	attr_sentinel;
 
@@ -178,3 +196,14 @@ char *res_util_basename(const char *prefix, const char *path);
 	INLINE _type *_name(const char *resname) { \
 		return res_get_data(_enum, resname, RESF_OPTIONAL); \
 	}
+
+#define DEFINE_RESOURCE_ID_GETTER(_type, _name, _enum, _idtype) \
+	attr_returns_nonnull \
+	INLINE _type *_name(_idtype id) { \
+		return NOT_NULL(_res_get_data_by_id(_enum, id, RESF_DEFAULT)); \
+	}
+
+#define DEFINE_OPTIONAL_RESOURCE_ID_GETTER(_type, _name, _enum, _idtype) \
+	INLINE _type *_name(_idtype id) { \
+		return _res_get_data_by_id(_enum, id, RESF_OPTIONAL); \
+	}
@@ -0,0 +1,74 @@
+/*
+ * This software is licensed under the terms of the MIT License.
+ * See COPYING for further information.
+ * ---
+ * Copyright (c) 2011-2024, Lukas Weber <laochailan@web.de>.
+ * Copyright (c) 2012-2024, Andrei Alexeyev <akari@taisei-project.org>.
+ */
+
+#pragma once
+#include "taisei.h"
+
+/*
+ * Compile-time IDs for resources that ship with the game, generated from the resource
+ * directories at build time (scripts/gen-res-ids.py). Identifiers are resource names with
+ * every non-alphanumeric character replaced by an underscore, e.g. "part/flare" becomes
+ * RID_SPRITE_part_flare. Referencing a resource that does not exist is a compile error.
+ *
+ * Look these up with the res_*_by_id getters. Those skip hashing the name and locking the
+ * resource table once the resource has been loaded.
+ */
+
+#define RES_IDS_NOOP(_ident, _name)
+
+typedef enum SpriteID {
+	#define SPRITE(_ident, _name) RID_SPRITE_##_ident,
+	#define TEXTURE RES_IDS_NOOP
+	#define SHPROG RES_IDS_NOOP
+	#define SFX RES_IDS_NOOP
+	#include "res-ids.inc.h"
+	#undef SPRITE
+	#undef TEXTURE
+	#undef SHPROG
+	#undef SFX
+	NUM_SPRITE_IDS,
+} SpriteID;
+
+typedef enum TextureID {
+	#define SPRITE RES_IDS_NOOP
+	#define TEXTURE(_ident, _name) RID_TEXTURE_##_ident,
+	#define SHPROG RES_IDS_NOOP
+	#define SFX RES_IDS_NOOP
+	#include "res-ids.inc.h"
+	#undef SPRITE
+	#undef TEXTURE
+	#undef SHPROG
+	#undef SFX
+	NUM_TEXTURE_IDS,
+} TextureID;
+
+typedef enum ShaderProgramID {
+	#define SPRITE RES_IDS_NOOP
+	#define TEXTURE RES_IDS_NOOP
+	#define SHPROG(_ident, _name) RID_SHPROG_##_ident,
+	#define SFX RES_IDS_NOOP
+	#include "res-ids.inc.h"
+	#undef SPRITE
+	#undef TEXTURE
+	#undef SHPROG
+	#undef SFX
+	NUM_SHADER_PROGRAM_IDS,
+} ShaderProgramID;
+
+typedef enum SFXID {
+	#define SPRITE RES_IDS_NOOP
+	#define TEXTURE RES_IDS_NOOP
+	#define SHPROG RES_IDS_NOOP
+	#define SFX(_ident, _name) RID_SFX_##_ident,
+	#include "res-ids.inc.h"
+	#undef SPRITE
+	#undef TEXTURE
+	#undef SHPROG
+	#undef SFX
+	NUM_SFX_IDS,
+} SFXID;
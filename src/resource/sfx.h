@@ -18,3 +18,4 @@ extern ResourceHandler sfx_res_handler;
 typedef struct SFX SFX;
 
 DEFINE_OPTIONAL_RESOURCE_GETTER(SFX, res_sfx, RES_SFX)
+DEFINE_OPTIONAL_RESOURCE_ID_GETTER(SFX, res_sfx_by_id, RES_SFX, SFXID)
@@ -20,3 +20,4 @@ extern ResourceHandler shader_program_res_handler;
 
 DEFINE_RESOURCE_GETTER(ShaderProgram, res_shader, RES_SHADER_PROGRAM)
 DEFINE_OPTIONAL_RESOURCE_GETTER(ShaderProgram, res_shader_optional, RES_SHADER_PROGRAM)
+DEFINE_RESOURCE_ID_GETTER(ShaderProgram, res_shader_by_id, RES_SHADER_PROGRAM, ShaderProgramID)
@@ -36,6 +36,7 @@ void draw_sprite_p(float x, float y, Sprite *spr);
 
 DEFINE_RESOURCE_GETTER(Sprite, res_sprite, RES_SPRITE)
 DEFINE_OPTIONAL_RESOURCE_GETTER(Sprite, res_sprite_optional, RES_SPRITE)
+DEFINE_RESOURCE_ID_GETTER(Sprite, res_sprite_by_id, RES_SPRITE, SpriteID)
 
 Sprite *prefix_get_sprite(const char *name, const char *prefix);
 
@@ -33,3 +33,4 @@ extern ResourceHandler texture_res_handler;
 
 DEFINE_RESOURCE_GETTER(Texture, res_texture, RES_TEXTURE)
 DEFINE_OPTIONAL_RESOURCE_GETTER(Texture, res_texture_optional, RES_TEXTURE)
+DEFINE_RESOURCE_ID_GETTER(Texture, res_texture_by_id, RES_TEXTURE, TextureID)
@@ -0,0 +1,599 @@
+/*
+ * This software is licensed under the terms of the MIT License.
+ * See COPYING for further information.
+ * ---
+ * Copyright (c) 2011-2024, Lukas Weber <laochailan@web.de>.
+ * Copyright (c) 2012-2024, Andrei Alexeyev <akari@taisei-project.org>.
+ */
+
+#include "spatialgrid.h"
+
+#include "coroutine/cotask.h"
+#include "dynarray.h"
+#include "global.h"
+
+enum {
+	SGRID_CELL_SIZE = 32,
+	SGRID_COLS = (VIEWPORT_W + SGRID_CELL_SIZE - 1) / SGRID_CELL_SIZE,
+	SGRID_ROWS = (VIEWPORT_H + SGRID_CELL_SIZE - 1) / SGRID_CELL_SIZE,
+	SGRID_NUM_CELLS = SGRID_COLS * SGRID_ROWS,
+
+	// Rebuild a set once this many of its entities had to be re-binned
+	SGRID_MIN_OVERFLOW = 32,
+};
+
+// Inclusive range of cells covered by an entity
+typedef struct CellSpan {
+	uint8_t x0, y0, x1, y1;
+} CellSpan;
+
+static_assert(SGRID_COLS <= UINT8_MAX && SGRID_ROWS <= UINT8_MAX, "Grid too large for CellSpan");
+
+typedef struct SpatialSet {
+	// Indexed by sequence number, which is the entity's position in its list at build time
+	DYNAMIC_ARRAY(EntityInterface*) ents;
+	DYNAMIC_ARRAY(CellSpan) spans;
+	// Circles the entities were last seen at, used to tell whether they moved
+	DYNAMIC_ARRAY(Circle) circles;
+	// Per sequence number: set once the entity's cell entries are out of date
+	DYNAMIC_ARRAY(bool) relocated;
+	// Per sequence number: the last query that collected it
+	DYNAMIC_ARRAY(uint32_t) visited;
+	// Sequence numbers of relocated entities, tested by every query
+	DYNAMIC_ARRAY(uint32_t) overflow;
+	// Result of the last query
+	DYNAMIC_ARRAY(uint32_t) candidates;
+
+	// Sequence numbers grouped by cell, ascending within each cell
+	DYNAMIC_ARRAY(uint32_t) entries;
+	uint32_t cell_start[SGRID_NUM_CELLS + 1];
+
+	Boss *boss;
+	uint32_t num_resumes;
+	uint32_t generation;
+	uint32_t query;
+	// Bumped whenever the candidates of a running query may be out of date
+	uint32_t version;
+	bool built;
+	bool locked;
+} SpatialSet;
+
+static struct {
+	SpatialSet targets;
+	SpatialSet hazards;
+
+	CoTask *owner;
+	bool active;
+} grid;
+
+static void spatialset_free(SpatialSet *s) {
+	dynarray_free_data(&s->ents);
+	dynarray_free_data(&s->spans);
+	dynarray_free_data(&s->circles);
+	dynarray_free_data(&s->relocated);
+	dynarray_free_data(&s->visited);
+	dynarray_free_data(&s->overflow);
+	dynarray_free_data(&s->candidates);
+	dynarray_free_data(&s->entries);
+}
+
+void spatialgrid_init(void) {
+	memset(&grid, 0, sizeof(grid));
+	dynarray_ensure_capacity(&grid.targets.ents, 64);
+	dynarray_ensure_capacity(&grid.targets.entries, 256);
+	dynarray_ensure_capacity(&grid.hazards.ents, 1024);
+	dynarray_ensure_capacity(&grid.hazards.entries, 1024);
+}
+
+void spatialgrid_shutdown(void) {
+	spatialgrid_end();
+	spatialset_free(&grid.targets);
+	spatialset_free(&grid.hazards);
+}
+
+void spatialgrid_begin(void) {
+	// NOTE: not asserting !grid.active here; the task that opened the previous window may have
+	// been cancelled before it got to close it.
+	grid.active = true;
+	grid.targets.built = false;
+	grid.hazards.built = false;
+	grid.owner = cotask_active();
+}
+
+void spatialgrid_end(void) {
+	grid.active = false;
+	grid.targets.built = false;
+	grid.hazards.built = false;
+	grid.owner = NULL;
+}
+
+void spatialgrid_invalidate(void) {
+	grid.targets.built = false;
+}
+
+void spatialgrid_invalidate_hazards(void) {
+	grid.hazards.built = false;
+}
+
+void spatialgrid_begin_hazard_update(void) {
+	grid.hazards.locked = true;
+	grid.hazards.built = false;
+}
+
+void spatialgrid_end_hazard_update(void) {
+	grid.hazards.locked = false;
+	grid.hazards.built = false;
+}
+
+static inline uint cell_coord(double v, uint num_cells) {
+	v /= SGRID_CELL_SIZE;
+
+	if(!(v > 0)) {  // also catches NaN
+		return 0;
+	}
+
+	if(v >= num_cells) {
+		return num_cells - 1;
+	}
+
+	return (uint)v;
+}
+
+static inline uint cell_index(uint x, uint y) {
+	return y * SGRID_COLS + x;
+}
+
+static inline CellSpan cell_span(cmplx top_left, cmplx bottom_right) {
+	return (CellSpan) {
+		.x0 = cell_coord(re(top_left), SGRID_COLS),
+		.y0 = cell_coord(im(top_left), SGRID_ROWS),
+		.x1 = cell_coord(re(bottom_right), SGRID_COLS),
+		.y1 = cell_coord(im(bottom_right), SGRID_ROWS),
+	};
+}
+
+static inline CellSpan circle_span(Circle c) {
+	cmplx r = CMPLX(c.radius, c.radius);
+	return cell_span(c.origin - r, c.origin + r);
+}
+
+static inline bool spans_overlap(CellSpan a, CellSpan b) {
+	return a.x0 <= b.x1 && b.x0 <= a.x1 && a.y0 <= b.y1 && b.y0 <= a.y1;
+}
+
+static Circle ent_circle(EntityInterface *ent) {
+	switch(ent->type) {
+		case ENT_TYPE_ID(Enemy): {
+			Enemy *e = ENT_CAST(ent, Enemy);
+			double r = fabs(e->hit_radius);
+			return (Circle) { e->pos, isfinite(r) ? r : 0 };
+		}
+
+		case ENT_TYPE_ID(Boss):
+			return (Circle) { ENT_CAST(ent, Boss)->pos, 0 };
+
+		case ENT_TYPE_ID(Projectile):
+			return (Circle) { ENT_CAST(ent, Projectile)->pos, 0 };
+
+		default: UNREACHABLE;
+	}
+}
+
+static void spatialset_add(SpatialSet *s, EntityInterface *ent) {
+	Circle c = ent_circle(ent);
+	dynarray_append(&s->ents, ent);
+	dynarray_append(&s->spans, circle_span(c));
+	dynarray_append(&s->circles, c);
+	dynarray_append(&s->relocated, false);
+	dynarray_append(&s->visited, 0);
+	++s->version;
+}
+
+static void spatialset_build(SpatialSet *s) {
+	s->ents.num_elements = 0;
+	s->spans.num_elements = 0;
+	s->circles.num_elements = 0;
+	s->relocated.num_elements = 0;
+	s->visited.num_elements = 0;
+	s->overflow.num_elements = 0;
+	s->query = 0;
+	memset(s->cell_start, 0, sizeof(s->cell_start));
+
+	if(s == &grid.targets) {
+		for(Enemy *e = global.enemies.first; e; e = e->next) {
+			spatialset_add(s, &e->ent);
+		}
+
+		s->boss = global.boss;
+
+		// Always last, matching the order of the linear scans
+		if(s->boss) {
+			spatialset_add(s, &s->boss->ent);
+		}
+	} else {
+		for(Projectile *p = global.projs.first; p; p = p->next) {
+			spatialset_add(s, &p->ent);
+		}
+	}
+
+	// Count entries per cell (shifted by one for the prefix sum)
+	dynarray_foreach_elem(&s->spans, CellSpan *span, {
+		for(uint y = span->y0; y <= span->y1; ++y) {
+			for(uint x = span->x0; x <= span->x1; ++x) {
+				++s->cell_start[cell_index(x, y) + 1];
+			}
+		}
+	});
+
+	for(uint i = 1; i <= SGRID_NUM_CELLS; ++i) {
+		s->cell_start[i] += s->cell_start[i - 1];
+	}
+
+	uint32_t num_entries = s->cell_start[SGRID_NUM_CELLS];
+	dynarray_ensure_capacity(&s->entries, num_entries);
+	s->entries.num_elements = num_entries;
+
+	// Scatter sequence numbers into their cells.
+	// Iterating in sequence order keeps every cell sorted.
+	uint32_t cursor[SGRID_NUM_CELLS];
+	memcpy(cursor, s->cell_start, sizeof(cursor));
+
+	dynarray_foreach(&s->spans, int seq, CellSpan *span, {
+		for(uint y = span->y0; y <= span->y1; ++y) {
+			for(uint x = span->x0; x <= span->x1; ++x) {
+				s->entries.data[cursor[cell_index(x, y)]++] = seq;
+			}
+		}
+	});
+
+	s->num_resumes = cotask_num_resumes();
+	++s->generation;
+	s->built = true;
+}
+
+static void spatialset_relocate(SpatialSet *s, uint32_t seq) {
+	bool *relocated = dynarray_get_ptr(&s->relocated, seq);
+
+	if(!*relocated) {
+		*relocated = true;
+		dynarray_append(&s->overflow, seq);
+	}
+}
+
+static inline int spatialset_max_overflow(SpatialSet *s) {
+	return max(SGRID_MIN_OVERFLOW, s->ents.num_elements / 4);
+}
+
+/*
+ * Catch up with entities that were moved by a task since the last check. Spawns and deaths are
+ * reported explicitly, so only movement needs to be detected. Without a write barrier on entity
+ * positions, an entity that moved *into* a queried cell from anywhere else can only be noticed
+ * by looking at every position, but only the entities that actually moved get re-binned; the
+ * cells of everything else are left alone.
+ */
+static bool spatialset_revalidate(SpatialSet *s) {
+	if(s == &grid.targets && s->boss != global.boss) {
+		return false;
+	}
+
+	dynarray_foreach(&s->ents, int seq, EntityInterface **pent, {
+		Circle c = ent_circle(*pent);
+		Circle *old = dynarray_get_ptr(&s->circles, seq);
+
+		if(c.origin != old->origin || c.radius != old->radius) {
+			*old = c;
+			spatialset_relocate(s, seq);
+		}
+	});
+
+	if(s->overflow.num_elements > spatialset_max_overflow(s)) {
+		return false;
+	}
+
+	s->num_resumes = cotask_num_resumes();
+	return true;
+}
+
+static bool spatialset_usable(SpatialSet *s) {
+	if(!grid.active || s->locked) {
+		return false;
+	}
+
+	if(!s->built) {
+		spatialset_build(s);
+		return true;
+	}
+
+	// The task that opened the window only moves things at well-defined points, and invalidates
+	// the grid there. Anyone else may have done so just before calling us.
+	bool trusted =
+		cotask_active() == grid.owner &&
+		s->num_resumes == cotask_num_resumes();
+
+	if(!trusted && !spatialset_revalidate(s)) {
+		spatialset_build(s);
+	}
+
+	return true;
+}
+
+static inline bool spatialset_still_valid(SpatialSet *s, uint32_t generation, uint32_t version) {
+	return
+		s->built &&
+		s->generation == generation &&
+		s->version == version &&
+		s->num_resumes == cotask_num_resumes() &&
+		(s != &grid.targets || s->boss == global.boss);
+}
+
+/*
+ * Called when a query callback gave some tasks a chance to run, spawned something, or started
+ * another query. If the set was not rebuilt in
+ * the meantime, sequence numbers are still meaningful, so the query can carry on from where it
+ * stopped.
+ */
+static bool spatialset_resume_query(SpatialSet *s, uint32_t generation) {
+	return
+		s->built &&
+		s->generation == generation &&
+		spatialset_revalidate(s);
+}
+
+static int compare_seq(const void *a, const void *b) {
+	uint32_t sa = *(const uint32_t*)a;
+	uint32_t sb = *(const uint32_t*)b;
+	return (sa > sb) - (sa < sb);
+}
+
+// Collects the sequence numbers of entities that may be inside the span, skipping those below
+// min_seq. The result is in ascending order.
+static uint32_t spatialset_gather(SpatialSet *s, CellSpan q, uint32_t min_seq) {
+	s->candidates.num_elements = 0;
+
+	if(UNLIKELY(++s->query == 0)) {
+		memset(s->visited.data, 0, s->visited.num_elements * sizeof(*s->visited.data));
+		s->query = 1;
+	}
+
+	for(uint y = q.y0; y <= q.y1; ++y) {
+		for(uint x = q.x0; x <= q.x1; ++x) {
+			uint c = cell_index(x, y);
+
+			for(uint32_t i = s->cell_start[c]; i < s->cell_start[c + 1]; ++i) {
+				uint32_t seq = s->entries.data[i];
+
+				if(seq < min_seq || s->relocated.data[seq] || s->visited.data[seq] == s->query) {
+					continue;
+				}
+
+				s->visited.data[seq] = s->query;
+				dynarray_append(&s->candidates, seq);
+			}
+		}
+	}
+
+	dynarray_foreach_elem(&s->overflow, uint32_t *pseq, {
+		uint32_t seq = *pseq;
+
+		if(seq >= min_seq && spans_overlap(circle_span(dynarray_get(&s->circles, seq)), q)) {
+			dynarray_append(&s->candidates, seq);
+		}
+	});
+
+	if(s->candidates.num_elements > 1) {
+		qsort(
+			s->candidates.data, s->candidates.num_elements,
+			sizeof(*s->candidates.data), compare_seq
+		);
+	}
+
+	return ++s->version;
+}
+
+static void *foreach_enemy_linear(Enemy *first, SpatialGridEnemyCallback callback, void *arg) {
+	for(Enemy *e = first; e; e = e->next) {
+		void *r = callback(e, arg);
+
+		if(r) {
+			return r;
+		}
+	}
+
+	return NULL;
+}
+
+static void *foreach_enemy_candidate(
+	CellSpan q, uint32_t min_seq, uint32_t generation, SpatialGridEnemyCallback callback, void *arg
+) {
+	SpatialSet *s = &grid.targets;
+
+restart:;
+	uint32_t version = spatialset_gather(s, q, min_seq);
+
+	for(uint i = 0; i < s->candidates.num_elements; ++i) {
+		uint32_t seq = s->candidates.data[i];
+		EntityInterface *ent = dynarray_get(&s->ents, seq);
+
+		if(ent->type != ENT_TYPE_ID(Enemy)) {
+			continue;
+		}
+
+		Enemy *e = ENT_CAST(ent, Enemy);
+		void *r = callback(e, arg);
+
+		if(r) {
+			return r;
+		}
+
+		if(!spatialset_still_valid(s, generation, version)) {
+			if(spatialset_resume_query(s, generation)) {
+				min_seq = seq + 1;
+				goto restart;
+			}
+
+			// The callback may have mutated the enemy list; whatever comes after this enemy
+			// has not been visited yet, so continue the old-fashioned way.
+			return foreach_enemy_linear(e->next, callback, arg);
+		}
+	}
+
+	return NULL;
+}
+
+void *spatialgrid_foreach_enemy_at_point(cmplx point, SpatialGridEnemyCallback callback, void *arg) {
+	SpatialSet *s = &grid.targets;
+
+	if(!spatialset_usable(s)) {
+		return foreach_enemy_linear(global.enemies.first, callback, arg);
+	}
+
+	uint x = cell_coord(re(point), SGRID_COLS);
+	uint y = cell_coord(im(point), SGRID_ROWS);
+	uint32_t generation = s->generation;
+	uint32_t version = s->version;
+
+	if(s->overflow.num_elements) {
+		CellSpan q = { x, y, x, y };
+		return foreach_enemy_candidate(q, 0, generation, callback, arg);
+	}
+
+	// Fast path: a single cell with nothing relocated is already sorted and free of duplicates
+	uint c = cell_index(x, y);
+
+	for(uint32_t i = s->cell_start[c]; i < s->cell_start[c + 1]; ++i) {
+		uint32_t seq = s->entries.data[i];
+		EntityInterface *ent = dynarray_get(&s->ents, seq);
+
+		if(ent->type != ENT_TYPE_ID(Enemy)) {
+			continue;
+		}
+
+		Enemy *e = ENT_CAST(ent, Enemy);
+		void *r = callback(e, arg);
+
+		if(r) {
+			return r;
+		}
+
+		if(!spatialset_still_valid(s, generation, version)) {
+			if(spatialset_resume_query(s, generation)) {
+				CellSpan q = { x, y, x, y };
+				return foreach_enemy_candidate(q, seq + 1, generation, callback, arg);
+			}
+
+			return foreach_enemy_linear(e->next, callback, arg);
+		}
+	}
+
+	return NULL;
+}
+
+static void foreach_target_linear(Enemy *first, SpatialGridTargetCallback callback, void *arg) {
+	for(Enemy *e = first; e; e = e->next) {
+		callback(&e->entity_interface, arg);
+	}
+
+	if(global.boss) {
+		callback(&global.boss->entity_interface, arg);
+	}
+}
+
+void spatialgrid_foreach_target_in_rect(Rect rect, SpatialGridTargetCallback callback, void *arg) {
+	SpatialSet *s = &grid.targets;
+
+	if(!spatialset_usable(s)) {
+		foreach_target_linear(global.enemies.first, callback, arg);
+		return;
+	}
+
+	CellSpan q = cell_span(rect.top_left, rect.bottom_right);
+	uint32_t generation = s->generation;
+	uint32_t min_seq = 0;
+
+restart:;
+	uint32_t version = spatialset_gather(s, q, min_seq);
+
+	for(uint i = 0; i < s->candidates.num_elements; ++i) {
+		uint32_t seq = s->candidates.data[i];
+		EntityInterface *ent = dynarray_get(&s->ents, seq);
+
+		callback(ent, arg);
+
+		if(!spatialset_still_valid(s, generation, version)) {
+			if(spatialset_resume_query(s, generation)) {
+				min_seq = seq + 1;
+				goto restart;
+			}
+
+			if(ent->type == ENT_TYPE_ID(Enemy)) {
+				foreach_target_linear(ENT_CAST(ent, Enemy)->next, callback, arg);
+			}
+
+			return;
+		}
+	}
+}
+
+static void foreach_hazard_linear(Projectile *first, SpatialGridHazardCallback callback, void *arg) {
+	for(Projectile *p = first, *next; p; p = next) {
+		next = p->next;
+		callback(p, arg);
+	}
+}
+
+void spatialgrid_foreach_hazard_in_rect(Rect rect, SpatialGridHazardCallback callback, void *arg) {
+	SpatialSet *s = &grid.hazards;
+
+	if(!spatialset_usable(s)) {
+		foreach_hazard_linear(global.projs.first, callback, arg);
+		return;
+	}
+
+	CellSpan q = cell_span(rect.top_left, rect.bottom_right);
+	uint32_t generation = s->generation;
+	uint32_t min_seq = 0;
+
+restart:;
+	uint32_t version = spatialset_gather(s, q, min_seq);
+
+	for(uint i = 0; i < s->candidates.num_elements; ++i) {
+		uint32_t seq = s->candidates.data[i];
+		Projectile *p = ENT_CAST(dynarray_get(&s->ents, seq), Projectile);
+
+		// Like the linear scan, don't visit projectiles spawned by the callback for the last one
+		Projectile *next = p->next;
+
+		callback(p, arg);
+
+		if(!next) {
+			return;
+		}
+
+		if(!spatialset_still_valid(s, generation, version)) {
+			if(spatialset_resume_query(s, generation)) {
+				min_seq = seq + 1;
+				goto restart;
+			}
+
+			foreach_hazard_linear(next, callback, arg);
+			return;
+		}
+	}
+}
+
+void spatialgrid_hazard_spawned(Projectile *p) {
+	SpatialSet *s = &grid.hazards;
+
+	if(!s->built) {
+		return;
+	}
+
+	// New projectiles are appended to the list, so this keeps sequence numbers in list order.
+	// They are tested by every query until the next rebuild.
+	spatialset_add(s, &p->ent);
+	spatialset_relocate(s, s->ents.num_elements - 1);
+
+	if(s->overflow.num_elements > spatialset_max_overflow(s)) {
+		s->built = false;
+	}
+}
@@ -0,0 +1,75 @@
+/*
+ * This software is licensed under the terms of the MIT License.
+ * See COPYING for further information.
+ * ---
+ * Copyright (c) 2011-2024, Lukas Weber <laochailan@web.de>.
+ * Copyright (c) 2012-2024, Andrei Alexeyev <akari@taisei-project.org>.
+ */
+
+#pragma once
+#include "taisei.h"
+
+#include "enemy.h"
+#include "projectile.h"
+#include "util/geometry.h"
+
+/*
+ * Uniform grid over the viewport used as a broadphase for player shot collision, area damage
+ * and hazard clearing. Two sets of entities are binned into it: targets (enemies and the boss)
+ * and hazards (everything in global.projs).
+ *
+ * The grid is only trusted inside a "window" opened with spatialgrid_begin() and closed with
+ * spatialgrid_end(). Each set is built lazily on the first query. Enemy deaths and spawns,
+ * projectile deaths and boss changes invalidate it; new projectiles are appended in place.
+ *
+ * Entities may be moved by any coroutine task, so the grid compares the binned positions
+ * against the current ones whenever a task could have run since the last query. Entities that
+ * moved are re-binned individually instead of rebuilding the whole set. Queries made by the task
+ * that opened the window skip this check unless a task was resumed in the meantime; everything
+ * else always checks. Outside of a valid window, queries transparently fall back to walking the
+ * entity lists.
+ *
+ * Queries always visit entities in list order, so the results are identical to a linear scan.
+ * This is important for replay determinism.
+ */
+
+// Return non-NULL to stop the iteration; the value is passed through to the caller.
+typedef void *(*SpatialGridEnemyCallback)(Enemy *e, void *arg);
+
+// Called with enemies and the boss
+typedef void (*SpatialGridTargetCallback)(EntityInterface *ent, void *arg);
+
+typedef void (*SpatialGridHazardCallback)(Projectile *p, void *arg);
+
+void spatialgrid_init(void);
+void spatialgrid_shutdown(void);
+
+void spatialgrid_begin(void);
+void spatialgrid_end(void);
+
+// Call when an enemy is spawned or deleted
+void spatialgrid_invalidate(void);
+
+// Call when a projectile is spawned into or deleted from global.projs
+void spatialgrid_hazard_spawned(Projectile *p) attr_nonnull_all;
+void spatialgrid_invalidate_hazards(void);
+
+// Bracket a pass that moves everything in global.projs; hazard queries fall back to a linear
+// scan in between.
+void spatialgrid_begin_hazard_update(void);
+void spatialgrid_end_hazard_update(void);
+
+// Calls the callback for every enemy whose hit circle may contain the point, in list order.
+// The callback is responsible for doing the exact test.
+void *spatialgrid_foreach_enemy_at_point(cmplx point, SpatialGridEnemyCallback callback, void *arg)
+	attr_nonnull(2);
+
+// Calls the callback for every enemy whose hit circle may overlap the rectangle, in list order,
+// followed by the boss if its position may be inside it. The callback does the exact test.
+void spatialgrid_foreach_target_in_rect(Rect rect, SpatialGridTargetCallback callback, void *arg)
+	attr_nonnull(2);
+
+// Calls the callback for every projectile in global.projs whose position may be inside the
+// rectangle, in list order. The callback does the exact test.
+void spatialgrid_foreach_hazard_in_rect(Rect rect, SpatialGridHazardCallback callback, void *arg)
+	attr_nonnull(2);
@@ -9,8 +9,10 @@
 #include "stage.h"
 
 #include "audio/audio.h"
+#include "benchmark.h"
 #include "common_tasks.h"  // IWYU pragma: keep
 #include "config.h"
+#include "coroutine/coroutine.h"
 #include "dynstage.h"
 #include "eventloop/eventloop.h"
 #include "events.h"
@@ -19,12 +21,15 @@
 #include "log.h"
 #include "menu/gameovermenu.h"
 #include "menu/ingamemenu.h"
+#include "menu/mainmenu.h"
 #include "player.h"
 #include "replay/demoplayer.h"
 #include "replay/stage.h"
 #include "replay/state.h"
 #include "replay/struct.h"
+#include "replay/verify.h"
 #include "resource/bgm.h"
+#include "spatialgrid.h"
 #include "stagedraw.h"
 #include "stageinfo.h"
 #include "stageobjects.h"
@@ -40,6 +45,7 @@ typedef struct StageFrameState {
 	Replay *quicksave;
 	bool quicksave_is_automatic;
 	bool quickload_requested;
+	int replay_seek_frame;  // -1 if no seek is pending
 	bool was_skipping;
 	bool paused;
 	uint32_t dynstage_generation;
@@ -53,6 +59,9 @@ typedef struct StageFrameState {
 
 static StageFrameState *_current_stage_state;  // TODO remove this shitty hack
 
+// How far the replay seek keys jump, in frames
+#define REPLAY_SEEK_STEP (FPS * 10)
+
 #define BGM_FADE_LONG (2.0 * FADE_TIME / (double)FPS)
 #define BGM_FADE_SHORT (FADE_TIME / (double)FPS)
 
@@ -435,6 +444,14 @@ static bool stage_input_key_filter(KeyIndex key, bool is_release) {
 	return true;
 }
 
+/*
+ * A quicksave is just the replay of the current attempt, and loading it re-simulates the stage
+ * from the start. Snapshotting the live state instead is not possible here: it is spread across
+ * heap allocations made by tasks, file-scope statics of the stage modules and coroutine stacks
+ * full of absolute pointers, all interleaved with renderer, audio and resource state that must
+ * not be rolled back. A fork()ed copy-on-write snapshot doesn't help either, since the copy has
+ * neither the GPU context nor the audio and worker threads to continue with.
+ */
 attr_nonnull_all
 static Replay *create_quicksave_replay(ReplayStage *rstg_src) {
 	ReplayStage *rstg = memdup(rstg_src, sizeof(*rstg));
@@ -527,7 +544,52 @@ static bool stage_input_handler_gameplay(SDL_Event *event, void *arg) {
 	return false;
 }
 
+static void stage_replay_seek(StageFrameState *fstate, int delta) {
+	ReplayState *rst = &global.replay.input;
+
+	if(global.replay.output.replay || is_quickloading(fstate)) {
+		// Not supported while re-recording, or while a quicksave is being fast-forwarded
+		return;
+	}
+
+	// Presses stack up: relative to a restart that hasn't happened yet, or to where the current
+	// fast-forward will end.
+	int base = fstate->replay_seek_frame;
+
+	if(base < 0) {
+		base = global.frames + rst->play.skip_frames;
+	}
+
+	int target = max(0, base + delta);
+
+	if(target >= global.frames) {
+		// Seeking forward is just fast-forwarding without rendering
+		rst->play.skip_frames = target - global.frames;
+		fstate->replay_seek_frame = -1;
+		audio_sfx_set_enabled(false);
+	} else {
+		// Seeking backward restarts the stage from the start state recorded in the
+		// replay and fast-forwards from there; see stage_end_loop. There are no
+		// mid-stage keyframes, so the cost grows with the target frame.
+		fstate->replay_seek_frame = target;
+	}
+
+	log_info("Seeking replay to frame %i", target);
+}
+
 static bool stage_input_handler_replay(SDL_Event *event, void *arg) {
+	StageFrameState *fstate = NOT_NULL(arg);
+
+	if(event->type == SDL_EVENT_KEY_DOWN && !event->key.repeat) {
+		if(event->key.scancode == config_get_int(CONFIG_KEY_REPLAY_SEEK_BACK)) {
+			stage_replay_seek(fstate, -REPLAY_SEEK_STEP);
+		} else if(event->key.scancode == config_get_int(CONFIG_KEY_REPLAY_SEEK_FWD)) {
+			stage_replay_seek(fstate, REPLAY_SEEK_STEP);
+		}
+
+		return false;
+	}
+
 	stage_input_common(event, arg);
 	return false;
 }
@@ -663,35 +725,64 @@ static void stage_input(StageFrameState *fstate) {
 	player_applymovement(&global.plr);
 }
 
-void stage_clear_hazards_predicate(bool (*predicate)(EntityInterface *ent, void *arg), void *arg, ClearHazardsFlags flags) {
+typedef struct ClearHazardsArgs {
+	bool (*predicate)(EntityInterface *ent, void *arg);
+	void *arg;
+	ClearHazardsFlags flags;
+} ClearHazardsArgs;
+
+static void clear_hazards_bullet(Projectile *p, void *varg) {
+	ClearHazardsArgs *args = varg;
+
+	if(!(args->flags & CLEAR_HAZARDS_FORCE) && !projectile_is_clearable(p)) {
+		return;
+	}
+
+	if(!args->predicate || args->predicate(&p->ent, args->arg)) {
+		clear_projectile(p, args->flags);
+	}
+}
+
+static void clear_hazards_lasers(bool (*predicate)(EntityInterface *ent, void *arg), void *arg, ClearHazardsFlags flags) {
 	bool force = flags & CLEAR_HAZARDS_FORCE;
 
+	for(Laser *l = global.lasers.first, *next; l; l = next) {
+		next = l->next;
+
+		if(!force && !laser_is_clearable(l)) {
+			continue;
+		}
+
+		if(!predicate || predicate(&l->ent, arg)) {
+			clear_laser(l, flags);
+		}
+	}
+}
+
+void stage_clear_hazards_predicate(bool (*predicate)(EntityInterface *ent, void *arg), void *arg, ClearHazardsFlags flags) {
 	if(flags & CLEAR_HAZARDS_BULLETS) {
+		ClearHazardsArgs args = { predicate, arg, flags };
+
 		for(Projectile *p = global.projs.first, *next; p; p = next) {
 			next = p->next;
-
-			if(!force && !projectile_is_clearable(p)) {
-				continue;
-			}
-
-			if(!predicate || predicate(&p->ent, arg)) {
-				clear_projectile(p, flags);
-			}
+			clear_hazards_bullet(p, &args);
 		}
 	}
 
 	if(flags & CLEAR_HAZARDS_LASERS) {
-		for(Laser *l = global.lasers.first, *next; l; l = next) {
-			next = l->next;
+		clear_hazards_lasers(predicate, arg, flags);
+	}
+}
 
-			if(!force && !laser_is_clearable(l)) {
-				continue;
-			}
+// Like stage_clear_hazards_predicate, but the predicate only ever matches bullets inside bbox
+static void stage_clear_hazards_in_rect(Rect bbox, bool (*predicate)(EntityInterface *ent, void *arg), void *arg, ClearHazardsFlags flags) {
+	if(flags & CLEAR_HAZARDS_BULLETS) {
+		ClearHazardsArgs args = { predicate, arg, flags };
+		spatialgrid_foreach_hazard_in_rect(bbox, clear_hazards_bullet, &args);
+	}
 
-			if(!predicate || predicate(&l->ent, arg)) {
-				clear_laser(l, flags);
-			}
-		}
+	if(flags & CLEAR_HAZARDS_LASERS) {
+		clear_hazards_lasers(predicate, arg, flags);
 	}
 }
 
@@ -742,11 +833,13 @@ void stage_clear_hazards_at(cmplx origin, double radius, ClearHazardsFlags flags
 		return;
 	}
 
-	stage_clear_hazards_predicate(proximity_predicate, &area, flags);
+	cmplx r = CMPLX(radius, radius);
+	Rect bbox = { .top_left = origin - r, .bottom_right = origin + r };
+	stage_clear_hazards_in_rect(bbox, proximity_predicate, &area, flags);
 }
 
 void stage_clear_hazards_in_ellipse(Ellipse e, ClearHazardsFlags flags) {
-	stage_clear_hazards_predicate(ellipse_predicate, &e, flags);
+	stage_clear_hazards_in_rect(ellipse_bbox(e), ellipse_predicate, &e, flags);
 }
 
 TASK(clear_dialog) {
@@ -939,7 +1032,12 @@ static void stage_replay_sync(StageFrameState *fstate) {
 			global.is_replay_verification &&
 			!global.replay.output.stage
 		) {
-			exit(1);
+			if(!replay_verify_batch_active()) {
+				exit(1);
+			}
+
+			// abandon this replay, the batch moves on to the next one
+			global.gameover = GAMEOVER_ABORT;
 		}
 
 		if(fstate->quicksave && fstate->quicksave == global.replay.input.replay) {
@@ -949,7 +1047,7 @@ static void stage_replay_sync(StageFrameState *fstate) {
 	}
 }
 
-static LogicFrameAction stage_logic_frame(void *arg) {
+static LogicFrameAction stage_logic_frame_internal(void *arg) {
 	StageFrameState *fstate = arg;
 	StageInfo *stage = fstate->stage;
 
@@ -979,7 +1077,9 @@ static LogicFrameAction stage_logic_frame(void *arg) {
 		// Usually stage_comain will do this
 		events_poll(NULL, 0);
 	} else {
-		cosched_run_tasks(&fstate->sched);
+		BENCHMARK_ZONE(BENCH_ZONE_TASKS, {
+			cosched_run_tasks(&fstate->sched);
+		});
 		update_all_sfx();
 		stage_replay_sync(fstate);
 
@@ -1037,6 +1137,10 @@ static LogicFrameAction stage_logic_frame(void *arg) {
 		return LFRAME_STOP;
 	}
 
+	if(fstate->replay_seek_frame >= 0) {
+		return LFRAME_STOP;
+	}
+
 	if(global.gameover > 0) {
 		return LFRAME_STOP;
 	}
@@ -1061,6 +1165,13 @@ static LogicFrameAction stage_logic_frame(void *arg) {
 	return LFRAME_WAIT;
 }
 
+static LogicFrameAction stage_logic_frame(void *arg) {
+	hrtime_t benchmark_start = benchmark_begin();
+	LogicFrameAction action = stage_logic_frame_internal(arg);
+	benchmark_frame_end(benchmark_start);
+	return action;
+}
+
 static RenderFrameAction stage_render_frame(void *arg) {
 	StageFrameState *fstate = arg;
 	StageInfo *stage = fstate->stage;
@@ -1109,12 +1220,30 @@ TASK(stage_comain, { StageFrameState *fstate; }) {
 
 	for(;;YIELD) {
 		process_input(fstate);
-		process_boss(&global.boss);
-		process_enemies(&global.enemies);
-		process_projectiles(&global.projs, true);
-		process_items();
-		process_lasers();
-		process_projectiles(&global.particles, false);
+
+		// The spatial grid stays open for other tasks between frames, but these move things
+		// around without resuming anything, so it can't be trusted while they run.
+		spatialgrid_end();
+		BENCHMARK_ZONE(BENCH_ZONE_BOSS, {
+			process_boss(&global.boss);
+		});
+		BENCHMARK_ZONE(BENCH_ZONE_ENEMIES, {
+			process_enemies(&global.enemies);
+		});
+		spatialgrid_begin();
+
+		BENCHMARK_ZONE(BENCH_ZONE_PROJECTILES, {
+			process_projectiles(&global.projs, true);
+		});
+		BENCHMARK_ZONE(BENCH_ZONE_ITEMS, {
+			process_items();
+		});
+		BENCHMARK_ZONE(BENCH_ZONE_LASERS, {
+			process_lasers();
+		});
+		BENCHMARK_ZONE(BENCH_ZONE_PROJECTILES, {
+			process_projectiles(&global.particles, false);
+		});
 
 		if(global.dialog) {
 			dialog_update(global.dialog);
@@ -1137,7 +1266,8 @@ TASK(stage_comain, { StageFrameState *fstate; }) {
 }
 
 static void _stage_enter(
-	StageInfo *stage, ResourceGroup *rg, CallChain next, Replay *quickload, bool quicksave_is_automatic
+	StageInfo *stage, ResourceGroup *rg, CallChain next, Replay *quickload, bool quicksave_is_automatic,
+	bool reentering
 ) {
 	assert(stage);
 	assert(stage->procs);
@@ -1178,9 +1308,15 @@ static void _stage_enter(
 	global.stage = stage;
 
 	ent_init();
+	spatialgrid_init();
 	stage_objpools_init();
 	stage_draw_preload(rg);
 	stage_preload(stage, rg);
+
+	if(!reentering) {
+		draw_loading_screen_until_loaded(rg, "Loading");
+	}
+
 	stage_draw_init();
 	lasers_init();
 
@@ -1229,6 +1365,10 @@ static void _stage_enter(
 
 	plrmode_preload(global.plr.mode, rg);
 
+	char pipeline_scope[16];
+	snprintf(pipeline_scope, sizeof(pipeline_scope), "stage_%04x", stage->id);
+	r_pipeline_cache_begin_scope(pipeline_scope);
+
 	res_purge();
 
 	auto fstate = ALLOC(StageFrameState, {
@@ -1236,6 +1376,7 @@ static void _stage_enter(
 		.cc = next,
 		.quicksave = quickload,
 		.quicksave_is_automatic = quicksave_is_automatic,
+		.replay_seek_frame = -1,
 		.desync_check_freq = env_get("TAISEI_REPLAY_DESYNC_CHECK_FREQUENCY", FPS * 5),
 		.dynstage_generation = dynstage_generation,
 		.rg = rg,
@@ -1250,7 +1391,7 @@ static void _stage_enter(
 		audio_sfx_set_enabled(false);
 	}
 
-	if(!is_quickloading(fstate)) {
+	if(!reentering) {
 		demoplayer_suspend();
 	}
 
@@ -1259,7 +1400,7 @@ static void _stage_enter(
 }
 
 void stage_enter(StageInfo *stage, ResourceGroup *rg, CallChain next) {
-	_stage_enter(stage, rg, next, NULL, false);
+	_stage_enter(stage, rg, next, NULL, false, false);
 }
 
 void stage_end_loop(void *ctx) {
@@ -1271,6 +1412,7 @@ void stage_end_loop(void *ctx) {
 	Replay *quicksave = s->quicksave;
 	bool quicksave_is_automatic = s->quicksave_is_automatic;
 	bool is_quickload = s->quickload_requested;
+	int seek_frame = s->replay_seek_frame;
 
 	if(is_quickload) {
 		assume(quicksave != NULL);
@@ -1298,12 +1440,17 @@ void stage_end_loop(void *ctx) {
 		mem_free(quicksave);
 	}
 
+	replay_verify_batch_stage_end();
+
 	s->stage->procs->end();
 	stage_draw_shutdown();
+	r_pipeline_cache_end_scope();
 	cosched_finish(&s->sched);
 	stage_free();
 	player_free(&global.plr);
+	spatialgrid_shutdown();
 	ent_shutdown();
+	coroutines_release_idle_stacks();
 	rng_make_active(&global.rand_visual);
 	stop_all_sfx();
 
@@ -1323,7 +1470,14 @@ void stage_end_loop(void *ctx) {
 	mem_free(s);
 
 	if(is_quickload) {
-		_stage_enter(stginfo, rg, cc, quicksave, quicksave_is_automatic);
+		_stage_enter(stginfo, rg, cc, quicksave, quicksave_is_automatic, true);
+	} else if(seek_frame >= 0) {
+		ReplayState *rst = &global.replay.input;
+		bool demo_mode = rst->play.demo_mode;
+		replay_state_init_play(rst, rst->replay, rst->stage);
+		rst->play.demo_mode = demo_mode;
+		rst->play.skip_frames = seek_frame;
+		_stage_enter(stginfo, rg, cc, NULL, false, true);
 	} else {
 		demoplayer_resume();
 		run_call_chain(&cc, NULL);
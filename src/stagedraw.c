@@ -343,14 +343,17 @@ void stage_draw_init(void) {
 	stagedraw.mfb_group = fbmgr_group_create();
 
 	stagedraw.viewport_pp = res_get_data(RES_POSTPROCESS, "viewport", RESF_OPTIONAL);
-	stagedraw.hud_text.shader = res_shader("text_hud");
+	stagedraw.hud_text.shader = res_shader_by_id(RID_SHPROG_text_hud);
 	stagedraw.hud_text.font = res_font("standard");
-	stagedraw.shaders.fxaa = res_shader("fxaa");
+	stagedraw.shaders.fxaa = res_shader_by_id(RID_SHPROG_fxaa);
 
 	r_shader_standard();
 
+	// Short-lived, heavily overlapping, and spawned in large bursts with mixed states
+	ent_set_layer_unordered(LAYER_PARTICLE_BULLET_CLEAR, true);
+
 	#ifdef DEBUG
-	stagedraw.dummy.tex = res_sprite("star")->tex;
+	stagedraw.dummy.tex = res_sprite_by_id(RID_SPRITE_star)->tex;
 	stagedraw.dummy.w = 1;
 	stagedraw.dummy.h = 1;
 	#endif
@@ -537,8 +540,8 @@ static void draw_spellbg(int t) {
 	}
 
 	r_draw_sprite(&(SpriteParams) {
-		.sprite_ptr = res_sprite("boss_spellcircle0"),
-		.shader_ptr = res_shader("sprite_default"),
+		.sprite_ptr = res_sprite_by_id(RID_SPRITE_boss_spellcircle0),
+		.shader_ptr = res_shader_by_id(RID_SHPROG_sprite_default),
 		.pos = { re(b->pos), im(b->pos) },
 		.rotation.angle = global.frames * 7.0 * DEG2RAD,
 		.rotation.vector = { 0, 0, -1 },
@@ -1693,8 +1696,8 @@ void stage_draw_hud(void) {
 		r_mat_mv_push();
 		r_mat_mv_translate(0, font_get_descent(res_font("standard")), 0);
 
-		Sprite *spr_life = res_sprite("hud/heart");
-		Sprite *spr_bomb = res_sprite("hud/star");
+		Sprite *spr_life = res_sprite_by_id(RID_SPRITE_hud_heart);
+		Sprite *spr_bomb = res_sprite_by_id(RID_SPRITE_hud_star);
 
 		float spacing = 1;
 		float pos_lives = HUD_EFFECTIVE_WIDTH - spr_life->w * (PLR_MAX_LIVES - 0.5) - spacing * (PLR_MAX_LIVES - 1);
@@ -1747,7 +1750,7 @@ void stage_draw_hud(void) {
 		.sprite_ptr = res_sprite(difficulty_sprite_name(global.diff)),
 		.pos = { HUD_EFFECTIVE_WIDTH * 0.5, 400 },
 		.scale.both = 0.6,
-		.shader_ptr = res_shader("sprite_default"),
+		.shader_ptr = res_shader_by_id(RID_SHPROG_sprite_default),
 	});
 
 	// Power/Item/Voltage icons
@@ -1756,41 +1759,41 @@ void stage_draw_hud(void) {
 
 	r_draw_sprite(&(SpriteParams) {
 		.pos = { 2, labels.y.power + 2 },
-		.sprite_ptr = res_sprite("item/power"),
-		.shader_ptr = res_shader("sprite_default"),
+		.sprite_ptr = res_sprite_by_id(RID_SPRITE_item_power),
+		.shader_ptr = res_shader_by_id(RID_SHPROG_sprite_default),
 		.color = RGBA(0, 0, 0, 0.5),
 	});
 
 	r_draw_sprite(&(SpriteParams) {
 		.pos = { 0, labels.y.power },
-		.sprite_ptr = res_sprite("item/power"),
-		.shader_ptr = res_shader("sprite_default"),
+		.sprite_ptr = res_sprite_by_id(RID_SPRITE_item_power),
+		.shader_ptr = res_shader_by_id(RID_SHPROG_sprite_default),
 	});
 
 	r_draw_sprite(&(SpriteParams) {
 		.pos = { 2, labels.y.value + 2 },
-		.sprite_ptr = res_sprite("item/point"),
-		.shader_ptr = res_shader("sprite_default"),
+		.sprite_ptr = res_sprite_by_id(RID_SPRITE_item_point),
+		.shader_ptr = res_shader_by_id(RID_SHPROG_sprite_default),
 		.color = RGBA(0, 0, 0, 0.5),
 	});
 
 	r_draw_sprite(&(SpriteParams) {
 		.pos = { 0, labels.y.value },
-		.sprite_ptr = res_sprite("item/point"),
-		.shader_ptr = res_shader("sprite_default"),
+		.sprite_ptr = res_sprite_by_id(RID_SPRITE_item_point),
+		.shader_ptr = res_shader_by_id(RID_SHPROG_sprite_default),
 	});
 
 	r_draw_sprite(&(SpriteParams) {
 		.pos = { 2, labels.y.voltage + 2 },
-		.sprite_ptr = res_sprite("item/voltage"),
-		.shader_ptr = res_shader("sprite_default"),
+		.sprite_ptr = res_sprite_by_id(RID_SPRITE_item_voltage),
+		.shader_ptr = res_shader_by_id(RID_SHPROG_sprite_default),
 		.color = RGBA(0, 0, 0, 0.5),
 	});
 
 	r_draw_sprite(&(SpriteParams) {
 		.pos = { 0, labels.y.voltage },
-		.sprite_ptr = res_sprite("item/voltage"),
-		.shader_ptr = res_shader("sprite_default"),
+		.sprite_ptr = res_sprite_by_id(RID_SPRITE_item_voltage),
+		.shader_ptr = res_shader_by_id(RID_SHPROG_sprite_default),
 	});
 
 	r_mat_mv_pop();
@@ -1832,8 +1835,8 @@ void stage_draw_hud(void) {
 			red = 0;
 
 		r_draw_sprite(&(SpriteParams) {
-			.sprite_ptr = res_sprite("boss_indicator"),
-			.shader_ptr = res_shader("sprite_default"),
+			.sprite_ptr = res_sprite_by_id(RID_SPRITE_boss_indicator),
+			.shader_ptr = res_shader_by_id(RID_SHPROG_sprite_default),
 			.pos = { VIEWPORT_X+re(global.boss->pos), 590 },
 			.color = RGBA(1 - red, 1 - red, 1 - red, 1 - red),
 		});
@@ -1849,11 +1852,11 @@ void stage_draw_hud(void) {
 		float bg_width = 250;
 		float bg_height = 60;
 
-		Sprite *bg = res_sprite("part/smoke");
+		Sprite *bg = res_sprite_by_id(RID_SPRITE_part_smoke);
 
 		SpriteParams sp = {
 			.sprite_ptr = bg,
-			.shader_ptr = res_shader("sprite_default"),
+			.shader_ptr = res_shader_by_id(RID_SHPROG_sprite_default),
 			.color = RGBA(0.1, 0.1, 0.2, 0.07),
 		};
 
@@ -1878,7 +1881,7 @@ void stage_draw_hud(void) {
 		text_draw("Demo", &(TextParams) {
 			.align = ALIGN_CENTER,
 			.font = "big",
-			.shader_ptr = res_shader("text_demo"),
+			.shader_ptr = res_shader_by_id(RID_SHPROG_text_demo),
 			.shader_params = &(ShaderCustomParams) { global.frames / 60.0f },
 			.pos.as_cmplx = pos,
 		});
@@ -23,20 +23,22 @@ DEFINE_EXTERN_TASK(stage1_boss_nonspell_1) {
 		const int num_projs = difficulty_value(9, 10, 11, 12);
 
 		for(int shot = 0; shot < num_shots; ++shot) {
+			cmplx shot_org = boss->pos;
+			real speed = 3 + shot / 3.0;
+			real boost = shot * 0.7;
+			MoveParams moves[num_projs];
+
 			for(int i = 0; i < num_projs; ++i) {
-				cmplx shot_org = boss->pos;
 				cmplx aim = cdir(i*M_TAU/num_projs + carg(global.plr.pos - shot_org));
-				real speed = 3 + shot / 3.0;
-				real boost = shot * 0.7;
-
-				PROJECTILE(
-					.proto = pp_plainball,
-					.pos = shot_org,
-					.color = RGB(0, 0, 0.5),
-					.move = move_asymptotic_simple(speed * aim, boost),
-				);
+				moves[i] = move_asymptotic_simple(speed * aim, boost);
 			}
 
+			PROJECTILE_BATCH(num_projs, NULL, moves, NULL,
+				.proto = pp_plainball,
+				.pos = shot_org,
+				.color = RGB(0, 0, 0.5),
+			);
+
 			WAIT(2);
 		}
 
@@ -67,18 +69,20 @@ DEFINE_EXTERN_TASK(stage1_boss_nonspell_1) {
 		for(int t = 0, i = 0; t < 150; ++i) {
 			play_sfx("shot1");
 			float dif = rng_angle();
-			for(int shot = 0; shot < 20; ++shot) {
+			real speed = 3.0 + i / 4.0;
+			MoveParams moves[20];
+
+			for(int shot = 0; shot < ARRAY_SIZE(moves); ++shot) {
 				cmplx aim = cdir(M_TAU/8 * shot + dif);
-				real speed = 3.0 + i / 4.0;
-
-				PROJECTILE(
-					.proto = pp_plainball,
-					.pos = boss->pos,
-					.color = RGB(0.04 * i, 0.04 * i, 0.4 + 0.04 * i),
-					.move = move_asymptotic_simple(speed * aim, 2.5),
-				);
+				moves[shot] = move_asymptotic_simple(speed * aim, 2.5);
 			}
 
+			PROJECTILE_BATCH(ARRAY_SIZE(moves), NULL, moves, NULL,
+				.proto = pp_plainball,
+				.pos = boss->pos,
+				.color = RGB(0.04 * i, 0.04 * i, 0.4 + 0.04 * i),
+			);
+
 			t += WAIT(difficulty_value(25, 25, 15, 10));
 		}
 
@@ -10,145 +10,307 @@
 
 #include "list.h"
 #include "log.h"
+#include "profiler.h"
 #include "util/env.h"
 
 #include <SDL3/SDL_atomic.h>
 #include <SDL3/SDL_mutex.h>
 #include <SDL3/SDL_thread.h>
 
+/*
+ * Every worker thread owns a queue of pending tasks. Tasks submitted from a worker go to the back
+ * of its own queue, tasks submitted from other threads are spread across the workers round-robin.
+ * A worker takes tasks from the front of its own queue, and when that runs dry, steals from the
+ * front of the others'. So tasks of equal priority are started in the order they were submitted,
+ * as far as each queue is concerned; in particular, a worker never picks a task over an older one
+ * in the same queue. The queues are short critical sections behind per-worker spinlocks, so
+ * workers mostly don't contend with each other, or with the submitting thread.
+ *
+ * Tasks with a non-default priority (or topmost) go into a single shared list ordered by priority,
+ * like all tasks used to. Those that rank ahead of default-priority tasks are taken before anything
+ * else; the rest only when all queues are empty.
+ *
+ * The semaphore counts queued tasks, plus one extra token per worker at shutdown. A worker that got
+ * a token is guaranteed to eventually find a task, though it may have to look twice if another
+ * worker beat it to the one it was heading for.
+ */
+
 typedef enum TaskManagerState {
 	TMGR_STATE_SHUTDOWN,
 	TMGR_STATE_RUNNING,
 	TMGR_STATE_ABORTED,
 } TaskManagerState;
 
+typedef struct TaskQueue {
+	Task **ring;
+	uint capacity;  // power of 2
+	uint head;      // next task to be taken
+	uint tail;      // next free slot
+	SDL_SpinLock lock;
+} TaskQueue;
+
+typedef struct TaskWorker {
+	TaskManager *mgr;
+	Thread *thread;
+	TaskQueue queue;
+	uint index;
+} TaskWorker;
+
 struct TaskManager {
-	LIST_ANCHOR(Task) queue;
+	LIST_ANCHOR(Task) prio_queue;
+	SDL_SpinLock prio_queue_lock;
+	// Number of tasks in prio_queue; lets workers skip the lock when it's empty
+	SDL_AtomicInt prio_queue_size;
 	SDL_Semaphore *queue_sem;
-	SDL_SpinLock queue_lock;
+	SDL_Mutex *completion_mutex;
+	SDL_Condition *completion_cond;
 	uint numthreads;
 	TaskManagerState state;
 	SDL_AtomicInt numtasks;
-	Thread *threads[];
+	SDL_AtomicInt num_queued;
+	SDL_AtomicInt next_worker;
+	TaskWorker workers[];
 };
 
 struct Task {
 	LIST_INTERFACE(Task);
+	TaskManager *mgr;
 	task_func_t callback;
 	task_free_func_t userdata_free_callback;
 	void *userdata;
-	int prio;
-	SDL_Mutex *mutex;
-	SDL_Condition *cond;
-	TaskStatus status;
 	void *result;
-	uint disowned : 1;
-	uint in_queue : 1;
+	int prio;
+	SDL_AtomicInt status;
+	SDL_AtomicInt num_waiters;
+	// One reference for the owner until it's disowned, one while the task is queued
+	SDL_AtomicInt refs;
+	bool disowned;
+};
+
+enum {
+	TASK_QUEUE_INITIAL_CAPACITY = 64,
+	TASK_POOL_MAX_SIZE = 256,
 };
 
 static TaskManager *g_taskmgr;
+static SDL_TLSID current_worker;
 
-static void taskmgr_free(TaskManager *mgr) {
-	SDL_DestroySemaphore(mgr->queue_sem);
-	mem_free(mgr);
+// Recycled Task structures
+static struct {
+	LIST_ANCHOR(Task) free;
+	uint num_free;
+	SDL_SpinLock lock;
+} task_pool;
+
+static Task *task_alloc(void) {
+	SDL_LockSpinlock(&task_pool.lock);
+	Task *task = alist_pop(&task_pool.free);
+
+	if(task) {
+		--task_pool.num_free;
+	}
+
+	SDL_UnlockSpinlock(&task_pool.lock);
+
+	if(task) {
+		memset(task, 0, sizeof(*task));
+		return task;
+	}
+
+	return ALLOC(Task);
+}
+
+static void task_release(Task *task) {
+	SDL_LockSpinlock(&task_pool.lock);
+
+	if(task_pool.num_free < TASK_POOL_MAX_SIZE) {
+		alist_push(&task_pool.free, task);
+		++task_pool.num_free;
+		task = NULL;
+	}
+
+	SDL_UnlockSpinlock(&task_pool.lock);
+	mem_free(task);
+}
+
+static void task_pool_shutdown(void) {
+	SDL_LockSpinlock(&task_pool.lock);
+
+	for(Task *task; (task = alist_pop(&task_pool.free));) {
+		mem_free(task);
+	}
+
+	task_pool.num_free = 0;
+	SDL_UnlockSpinlock(&task_pool.lock);
 }
 
 static void task_free(Task *task) {
-	assert(!task->in_queue);
 	assert(task->disowned);
 
 	if(task->userdata_free_callback != NULL) {
 		task->userdata_free_callback(task->userdata);
 	}
 
-	if(task->mutex != NULL) {
-		SDL_DestroyMutex(task->mutex);
+	task_release(task);
+}
+
+static void task_unref(Task *task) {
+	if(SDL_AtomicDecRef(&task->refs)) {
+		task_free(task);
 	}
+}
+
+static void task_queue_push(TaskQueue *q, Task *task) {
+	SDL_LockSpinlock(&q->lock);
+
+	if(q->tail - q->head == q->capacity) {
+		uint new_capacity = q->capacity ? q->capacity * 2 : TASK_QUEUE_INITIAL_CAPACITY;
+		Task **new_ring = ALLOC_ARRAY(new_capacity, typeof(*new_ring));
+
+		for(uint i = q->head; i != q->tail; ++i) {
+			new_ring[i & (new_capacity - 1)] = q->ring[i & (q->capacity - 1)];
+		}
 
-	if(task->cond != NULL) {
-		SDL_DestroyCondition(task->cond);
+		mem_free(q->ring);
+		q->ring = new_ring;
+		q->capacity = new_capacity;
 	}
 
-	mem_free(task);
+	q->ring[q->tail++ & (q->capacity - 1)] = task;
+	SDL_UnlockSpinlock(&q->lock);
+}
+
+static Task *task_queue_take(TaskQueue *q) {
+	Task *task = NULL;
+	SDL_LockSpinlock(&q->lock);
+
+	if(q->tail != q->head) {
+		task = q->ring[q->head++ & (q->capacity - 1)];
+	}
+
+	SDL_UnlockSpinlock(&q->lock);
+	return task;
+}
+
+static void taskmgr_free(TaskManager *mgr) {
+	for(uint i = 0; i < mgr->numthreads; ++i) {
+		assert(mgr->workers[i].queue.tail == mgr->workers[i].queue.head);
+		mem_free(mgr->workers[i].queue.ring);
+	}
+
+	SDL_DestroyCondition(mgr->completion_cond);
+	SDL_DestroyMutex(mgr->completion_mutex);
+	SDL_DestroySemaphore(mgr->queue_sem);
+	mem_free(mgr);
+}
+
+static void task_run(Task *task) {
+	assert(SDL_GetAtomicInt(&task->status) == TASK_RUNNING);
+
+	PROFILE_ZONE_BEGIN(zone, "task");
+	task->result = task->callback(task->userdata);
+	PROFILE_ZONE_END(zone);
+
+	SDL_SetAtomicInt(&task->status, TASK_FINISHED);
+
+	if(SDL_GetAtomicInt(&task->num_waiters) > 0) {
+		TaskManager *mgr = task->mgr;
+		SDL_LockMutex(mgr->completion_mutex);
+		SDL_BroadcastCondition(mgr->completion_cond);
+		SDL_UnlockMutex(mgr->completion_mutex);
+	}
 }
 
-static Task *taskmgr_pop_queue(TaskManager *mgr) {
-	if(mgr->queue.first == NULL) {
+static void task_wait_running(Task *task) {
+	TaskManager *mgr = task->mgr;
+	SDL_AtomicIncRef(&task->num_waiters);
+	SDL_LockMutex(mgr->completion_mutex);
+
+	while(SDL_GetAtomicInt(&task->status) == TASK_RUNNING) {
+		SDL_WaitCondition(mgr->completion_cond, mgr->completion_mutex);
+	}
+
+	SDL_UnlockMutex(mgr->completion_mutex);
+	(void)SDL_AtomicDecRef(&task->num_waiters);
+}
+
+// Higher priority tasks are at the head; if urgent_only, only take those that must run before
+// default-priority tasks.
+static Task *taskmgr_pop_prio_queue(TaskManager *mgr, bool urgent_only) {
+	if(SDL_GetAtomicInt(&mgr->prio_queue_size) == 0) {
 		return NULL;
 	}
 
-	SDL_LockSpinlock(&mgr->queue_lock);
-	auto t = alist_pop(&mgr->queue);
-	SDL_UnlockSpinlock(&mgr->queue_lock);
+	SDL_LockSpinlock(&mgr->prio_queue_lock);
+	Task *t = mgr->prio_queue.first;
+
+	if(t && (!urgent_only || t->prio <= 0)) {
+		alist_unlink(&mgr->prio_queue, t);
+		SDL_AddAtomicInt(&mgr->prio_queue_size, -1);
+	} else {
+		t = NULL;
+	}
+
+	SDL_UnlockSpinlock(&mgr->prio_queue_lock);
 	return t;
 }
 
-static void *taskmgr_thread(void *arg) {
-	TaskManager *mgr = arg;
-	attr_unused SDL_ThreadID tid = SDL_GetCurrentThreadID();
+static Task *taskmgr_take_task(TaskManager *mgr, TaskWorker *self) {
+	Task *task;
 
-	TaskManagerState state = mgr->state;
+	if(
+		(task = taskmgr_pop_prio_queue(mgr, true)) ||
+		(task = task_queue_take(&self->queue))
+	) {
+		return task;
+	}
+
+	for(uint i = 1; i < mgr->numthreads; ++i) {
+		TaskWorker *victim = mgr->workers + (self->index + i) % mgr->numthreads;
+
+		if((task = task_queue_take(&victim->queue))) {
+			return task;
+		}
+	}
+
+	return taskmgr_pop_prio_queue(mgr, false);
+}
+
+static void *taskmgr_thread(void *arg) {
+	TaskWorker *self = arg;
+	TaskManager *mgr = self->mgr;
 	SDL_Semaphore *qsem = mgr->queue_sem;
 
-	while(state != TMGR_STATE_ABORTED) {
+	if(!SDL_SetTLS(&current_worker, self, NULL)) {
+		log_sdl_error(LOG_WARN, "SDL_SetTLS");
+	}
+
+	for(;;) {
 		SDL_WaitSemaphore(qsem);
 
-		Task *task = taskmgr_pop_queue(mgr);
-		state = mgr->state;
+		Task *task;
 
-		if(UNLIKELY(task == NULL)) {
-			if(state == TMGR_STATE_SHUTDOWN) {
-				break;
+		while(!(task = taskmgr_take_task(mgr, self))) {
+			if(mgr->state != TMGR_STATE_RUNNING && SDL_GetAtomicInt(&mgr->num_queued) == 0) {
+				return NULL;
 			}
 
-			continue;
+			SDL_CPUPauseInstruction();
 		}
 
-		SDL_LockMutex(task->mutex);
+		(void)SDL_AtomicDecRef(&mgr->num_queued);
 
-		if(state == TMGR_STATE_ABORTED && task->status == TASK_PENDING) {
-			task->status = TASK_CANCELLED;
+		if(mgr->state == TMGR_STATE_ABORTED) {
+			SDL_CompareAndSwapAtomicInt(&task->status, TASK_PENDING, TASK_CANCELLED);
+		} else if(SDL_CompareAndSwapAtomicInt(&task->status, TASK_PENDING, TASK_RUNNING)) {
+			task_run(task);
 		}
 
-		if(task->status == TASK_PENDING) {
-			task->status = TASK_RUNNING;
-
-			SDL_UnlockMutex(task->mutex);
-			task->result = task->callback(task->userdata);
-			SDL_LockMutex(task->mutex);
-
-			assert(task->in_queue);
-			task->in_queue = false;
-			(void)SDL_AtomicDecRef(&mgr->numtasks);
+		// Otherwise the task was cancelled, or task_wait() is running or has run it.
 
-			if(task->disowned) {
-				SDL_UnlockMutex(task->mutex);
-				task_free(task);
-			} else {
-				task->status = TASK_FINISHED;
-				SDL_BroadcastCondition(task->cond);
-				SDL_UnlockMutex(task->mutex);
-			}
-		} else if(
-			task->status == TASK_CANCELLED ||
-			task->status == TASK_RUNNING ||
-			task->status == TASK_FINISHED
-		) {
-			assert(task->in_queue);
-			task->in_queue = false;
-			(void)SDL_AtomicDecRef(&mgr->numtasks);
-			bool task_disowned = task->disowned;
-			SDL_UnlockMutex(task->mutex);
-
-			if(task_disowned) {
-				task_free(task);
-			}
-		} else {
-			UNREACHABLE;
-		}
+		(void)SDL_AtomicDecRef(&mgr->numtasks);
+		task_unref(task);
 	}
-
-	return NULL;
 }
 
 TaskManager *taskmgr_create(uint numthreads, ThreadPriority prio, const char *name) {
@@ -168,29 +330,47 @@ TaskManager *taskmgr_create(uint numthreads, ThreadPriority prio, const char *na
 		numthreads = maxthreads;
 	}
 
-	auto mgr = ALLOC_FLEX(TaskManager, numthreads * sizeof(SDL_Thread*));
+	auto mgr = ALLOC_FLEX(TaskManager, numthreads * sizeof(TaskWorker));
 
 	if(!(mgr->queue_sem = SDL_CreateSemaphore(0))) {
 		log_sdl_error(LOG_ERROR, "SDL_CreateSemaphore");
 		goto fail;
 	}
 
+	if(!(mgr->completion_mutex = SDL_CreateMutex())) {
+		log_sdl_error(LOG_ERROR, "SDL_CreateMutex");
+		goto fail;
+	}
+
+	if(!(mgr->completion_cond = SDL_CreateCondition())) {
+		log_sdl_error(LOG_ERROR, "SDL_CreateCondition");
+		goto fail;
+	}
+
 	mgr->numthreads = numthreads;
 	mgr->state = TMGR_STATE_RUNNING;
 
+	for(uint i = 0; i < numthreads; ++i) {
+		mgr->workers[i].mgr = mgr;
+		mgr->workers[i].index = i;
+	}
+
 	for(uint i = 0; i < numthreads; ++i) {
 		int digits = i ? log10(i) + 1 : 1;
 		static const char *const prefix = "taskmgr";
 		char threadname[sizeof(prefix) + strlen(name) + digits + 2];
 		snprintf(threadname, sizeof(threadname), "%s:%s/%i", prefix, name, i);
 
-		if(!(mgr->threads[i] = thread_create(threadname, taskmgr_thread, mgr, prio))) {
+		if(!(mgr->workers[i].thread = thread_create(threadname, taskmgr_thread, mgr->workers + i, prio))) {
 			mgr->state = TMGR_STATE_ABORTED;
 
 			for(uint j = 0; j < i; ++j) {
 				SDL_SignalSemaphore(mgr->queue_sem);
-				thread_decref(mgr->threads[j]);
-				mgr->threads[j] = NULL;
+			}
+
+			for(uint j = 0; j < i; ++j) {
+				thread_wait(mgr->workers[j].thread);
+				mgr->workers[j].thread = NULL;
 			}
 
 			goto fail;
@@ -220,41 +400,41 @@ Task *taskmgr_submit(TaskManager *mgr, TaskParams params) {
 	assert(params.callback != NULL);
 	assert(mgr->state == TMGR_STATE_RUNNING);
 
-	auto task = ALLOC(Task, {
-		.callback = params.callback,
-		.userdata_free_callback = params.userdata_free_callback,
-		.userdata = params.userdata,
-		.prio = params.prio,
-		.status = TASK_PENDING,
-	});
+	auto task = task_alloc();
+	task->mgr = mgr;
+	task->callback = params.callback;
+	task->userdata_free_callback = params.userdata_free_callback;
+	task->userdata = params.userdata;
+	task->prio = params.prio;
+	SDL_SetAtomicInt(&task->status, TASK_PENDING);
+	SDL_SetAtomicInt(&task->refs, 2);
 
-	if(!(task->mutex = SDL_CreateMutex())) {
-		log_sdl_error(LOG_WARN, "SDL_CreateMutex");
-		goto fail;
-	}
-
-	if(!(task->cond = SDL_CreateCondition())) {
-		log_sdl_error(LOG_WARN, "SDL_CreateCondition");
-		goto fail;
-	}
+	SDL_AtomicIncRef(&mgr->numtasks);
+	SDL_AtomicIncRef(&mgr->num_queued);
 
-	SDL_LockSpinlock(&mgr->queue_lock);
-	if(params.topmost) {
-		alist_insert_at_priority_head(&mgr->queue, task, task->prio, task_prio_func);
+	if(params.prio != 0 || params.topmost) {
+		SDL_LockSpinlock(&mgr->prio_queue_lock);
+		if(params.topmost) {
+			alist_insert_at_priority_head(&mgr->prio_queue, task, task->prio, task_prio_func);
+		} else {
+			alist_insert_at_priority_tail(&mgr->prio_queue, task, task->prio, task_prio_func);
+		}
+		SDL_AddAtomicInt(&mgr->prio_queue_size, 1);
+		SDL_UnlockSpinlock(&mgr->prio_queue_lock);
 	} else {
-		alist_insert_at_priority_tail(&mgr->queue, task, task->prio, task_prio_func);
+		TaskWorker *worker = SDL_GetTLS(&current_worker);
+
+		if(!worker || worker->mgr != mgr) {
+			uint i = (uint)SDL_AddAtomicInt(&mgr->next_worker, 1);
+			worker = mgr->workers + i % mgr->numthreads;
+		}
+
+		task_queue_push(&worker->queue, task);
 	}
-	SDL_UnlockSpinlock(&mgr->queue_lock);
 
-	task->in_queue = true;
-	SDL_AtomicIncRef(&mgr->numtasks);
 	SDL_SignalSemaphore(mgr->queue_sem);
 
 	return task;
-
-fail:
-	task_free(task);
-	return NULL;
 }
 
 uint taskmgr_remaining(TaskManager *mgr) {
@@ -278,7 +458,7 @@ static void taskmgr_finalize_and_wait(TaskManager *mgr, bool do_abort) {
 	}
 
 	for(uint i = 0; i < mgr->numthreads; ++i) {
-		thread_wait(mgr->threads[i]);
+		thread_wait(mgr->workers[i].thread);
 	}
 
 	taskmgr_free(mgr);
@@ -293,106 +473,74 @@ void taskmgr_abort(TaskManager *mgr) {
 }
 
 TaskStatus task_status(Task *task) {
-	TaskStatus result = TASK_INVALID;
-
-	if(task != NULL) {
-		SDL_LockMutex(task->mutex);
-		result = task->status;
-		SDL_UnlockMutex(task->mutex);
+	if(task == NULL) {
+		return TASK_INVALID;
 	}
 
-	return result;
-}
-
-static void *task_offload(Task *task) {
-	assert(task->status == TASK_PENDING);
-	task->status = TASK_RUNNING;
-	SDL_UnlockMutex(task->mutex);
-	void *result = task->callback(task->userdata);
-	SDL_LockMutex(task->mutex);
-	assert(!task->disowned);
-	task->status = TASK_FINISHED;
-	task->result = result;
-	SDL_BroadcastCondition(task->cond);
-	return result;
+	return SDL_GetAtomicInt(&task->status);
 }
 
 bool task_wait(Task *task, void **result) {
-	bool success = false;
-
 	if(task == NULL) {
-		return success;
-	}
-
-	void *_result = NULL;
-
-	SDL_LockMutex(task->mutex);
-
-	if(task->status == TASK_CANCELLED) {
-		success = false;
-	} else if(task->status == TASK_FINISHED) {
-		success = true;
-		_result = task->result;
-	} else if(task->status == TASK_RUNNING) {
-		SDL_WaitCondition(task->cond, task->mutex);
-		_result = task->result;
-		success = (task->status == TASK_FINISHED);
-	} else if(task->status == TASK_PENDING) {
-		// fine, i'll do it myself
-		_result = task_offload(task);
-		success = true;
-	} else {
-		UNREACHABLE;
+		return false;
 	}
 
-	SDL_UnlockMutex(task->mutex);
+	for(;;) {
+		switch(SDL_GetAtomicInt(&task->status)) {
+			case TASK_CANCELLED:
+				return false;
 
-	if(success && result != NULL) {
-		*result = _result;
-	}
+			case TASK_PENDING:
+				// fine, i'll do it myself
+				if(!SDL_CompareAndSwapAtomicInt(&task->status, TASK_PENDING, TASK_RUNNING)) {
+					// lost the race to a worker or task_cancel()
+					continue;
+				}
 
-	return success;
-}
+				assert(!task->disowned);
+				task_run(task);
+				break;
 
-bool task_cancel(Task *task) {
-	bool success = false;
+			case TASK_RUNNING:
+				task_wait_running(task);
+				break;
 
-	if(task == NULL) {
-		return success;
+			case TASK_FINISHED:
+				break;
+
+			default: UNREACHABLE;
+		}
+
+		break;
 	}
 
-	SDL_LockMutex(task->mutex);
+	assert(SDL_GetAtomicInt(&task->status) == TASK_FINISHED);
 
-	if(task->status == TASK_PENDING) {
-		task->status = TASK_CANCELLED;
-		success = true;
+	if(result != NULL) {
+		*result = task->result;
 	}
 
-	SDL_UnlockMutex(task->mutex);
+	return true;
+}
 
-	return success;
+bool task_cancel(Task *task) {
+	if(task == NULL) {
+		return false;
+	}
+
+	return SDL_CompareAndSwapAtomicInt(&task->status, TASK_PENDING, TASK_CANCELLED);
 }
 
 bool task_detach(Task *task) {
-	bool success = false;
-	bool task_in_queue;
-
 	if(task == NULL) {
-		return success;
+		return false;
 	}
 
-	SDL_LockMutex(task->mutex);
 	assert(!task->disowned);
 	task->disowned = true;
-	task_in_queue = task->in_queue;
-	success = true;
-	SDL_UnlockMutex(task->mutex);
+	task_unref(task);
 
-	if(!task_in_queue) {
-		task_free(task);
-	}
-
-	return success;
+	return true;
 }
 
 bool task_finish(Task *task, void **result) {
@@ -418,16 +566,20 @@ void taskmgr_global_shutdown(void) {
 		taskmgr_finish(g_taskmgr);
 		g_taskmgr = NULL;
 	}
+
+	task_pool_shutdown();
 }
 
 Task *taskmgr_global_submit(TaskParams params) {
 	if(g_taskmgr == NULL) {
-		return ALLOC(Task, {
-			.callback = params.callback,
-			.userdata = params.userdata,
-			.userdata_free_callback = params.userdata_free_callback,
-			.result = params.callback(params.userdata),
-		});
+		auto task = task_alloc();
+		task->callback = params.callback;
+		task->userdata = params.userdata;
+		task->userdata_free_callback = params.userdata_free_callback;
+		task->result = params.callback(params.userdata);
+		SDL_SetAtomicInt(&task->status, TASK_FINISHED);
+		SDL_SetAtomicInt(&task->refs, 1);
+		return task;
 	}
 
 	return taskmgr_submit(g_taskmgr, params);
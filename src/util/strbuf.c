@@ -80,6 +80,24 @@ int strbuf_ncat(StringBuffer *strbuf, size_t datasize, const char data[]) {
 	return datasize;
 }
 
+int strbuf_cat_json_string(StringBuffer *strbuf, const char *str) {
+	int r = strbuf_ncat(strbuf, 1, "\"");
+
+	for(const char *p = str; *p; ++p) {
+		uchar c = *p;
+
+		if(c == '"' || c == '\\') {
+			r += strbuf_printf(strbuf, "\\%c", c);
+		} else if(c < 0x20) {
+			r += strbuf_printf(strbuf, "\\u%04x", c);
+		} else {
+			r += strbuf_ncat(strbuf, 1, p);
+		}
+	}
+
+	return r + strbuf_ncat(strbuf, 1, "\"");
+}
+
 void strbuf_clear(StringBuffer *strbuf) {
 	strbuf->pos = strbuf->start;
 
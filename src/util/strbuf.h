@@ -32,6 +32,10 @@ void strbuf_free(StringBuffer *strbuf)
 int strbuf_ncat(StringBuffer *strbuf, size_t datasize, const char data[])
 	attr_nonnull(1, 3);
 
+// Appends str as a quoted and escaped JSON string literal.
+int strbuf_cat_json_string(StringBuffer *strbuf, const char *str)
+	attr_nonnull(1, 2);
+
 INLINE int strbuf_cat(StringBuffer *strbuf, const char *str) {
 	return strbuf_ncat(strbuf, strlen(str), str);
 }
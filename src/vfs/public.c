@@ -106,6 +106,59 @@ VFSInfo vfs_query(const char *path) {
 	return VFSINFO_ERROR;
 }
 
+static char *vfs_syspath_of(const char *path) {
+	char p[strlen(path)+1];
+	path = vfs_path_normalize(path, p);
+	VFSNode *node = vfs_locate(vfs_root, path);
+
+	if(!node) {
+		vfs_set_error("Node '%s' does not exist", path);
+		return NULL;
+	}
+
+	char *syspath = vfs_node_syspath(node);
+	vfs_decref(node);
+	return syspath;
+}
+
+bool vfs_rename(const char *src, const char *dst) {
+	if(UNLIKELY(!vfs_initialized())) {
+		return false;
+	}
+
+	char *src_syspath = vfs_syspath_of(src);
+	char *dst_syspath = src_syspath ? vfs_syspath_of(dst) : NULL;
+	bool result = false;
+
+	if(dst_syspath) {
+		if(!(result = SDL_RenamePath(src_syspath, dst_syspath))) {
+			vfs_set_error_from_sdl();
+		}
+	}
+
+	mem_free(src_syspath);
+	mem_free(dst_syspath);
+	return result;
+}
+
+bool vfs_remove(const char *path) {
+	if(UNLIKELY(!vfs_initialized())) {
+		return false;
+	}
+
+	char *syspath = vfs_syspath_of(path);
+	bool result = false;
+
+	if(syspath) {
+		if(!(result = SDL_RemovePath(syspath))) {
+			vfs_set_error_from_sdl();
+		}
+	}
+
+	mem_free(syspath);
+	return result;
+}
+
 bool vfs_mkdir(const char *path) {
 	if(UNLIKELY(!vfs_initialized())) {
 		return false;
@@ -45,6 +45,12 @@ typedef struct VFSDir VFSDir;
 SDL_IOStream * vfs_open(const char *path, VFSOpenMode mode);
 VFSInfo vfs_query(const char *path);
 
+// Only works within real filesystem mounts; replaces dst if it exists, atomically where supported.
+bool vfs_rename(const char *src, const char *dst) attr_nonnull_all;
+
+// Only works within real filesystem mounts.
+bool vfs_remove(const char *path) attr_nonnull_all;
+
 bool vfs_mkdir(const char *path);
 void vfs_mkdir_required(const char *path);
 bool vfs_mkparents(const char *path);
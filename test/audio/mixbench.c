@@ -0,0 +1,141 @@
+
+#include "taisei.h"
+
+#include "audio/stream/mixops.h"
+#include "audio/stream/player.h"
+#include "audio/stream/stream_pcm.h"
+#include "benchmark.h"
+#include "hirestime.h"
+#include "log.h"
+#include "rwops/rwops_stdiofp.h"
+
+#include <locale.h>
+
+/*
+ * Mixes many concurrent looping SFX-like streams through a StreamPlayer and reports the
+ * time spent per audio callback.
+ *
+ * Usage: mixbench [num_channels] [callback_frames] [num_callbacks]
+ *
+ * Every 4th channel is fading, and every 8th has a different sample rate than the output,
+ * so that the ramp kernel and the conversion path are exercised too.
+ */
+
+#define SAMPLE_RATE 48000
+#define PCM_SECONDS 2
+
+static float *gen_noise(uint num_samples, uint32_t seed) {
+	auto pcm = ALLOC_ARRAY(num_samples, float);
+
+	for(uint i = 0; i < num_samples; ++i) {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+		pcm[i] = (seed / (float)UINT32_MAX - 0.5f) * 0.5f;
+	}
+
+	return pcm;
+}
+
+int main(int argc, char **argv) {
+	setlocale(LC_ALL, "C");
+	time_init();
+	log_init(LOG_ALL);
+	log_add_output(LOG_ALL, SDL_RWFromFP(stderr, false), log_formatter_console);
+
+	int num_channels = argc > 1 ? atoi(argv[1]) : 64;
+	uint callback_frames = argc > 2 ? atoi(argv[2]) : 1024;
+	uint num_callbacks = argc > 3 ? atoi(argv[3]) : 5000;
+
+	if(num_channels < 1 || callback_frames < 1 || num_callbacks < 1) {
+		log_fatal("Usage: %s [num_channels] [callback_frames] [num_callbacks]", argv[0]);
+	}
+
+	AudioStreamSpec out_spec = astream_spec(SDL_AUDIO_F32, 2, SAMPLE_RATE);
+	AudioStreamSpec alt_spec = astream_spec(SDL_AUDIO_F32, 2, 44100);
+
+	StreamPlayer plr;
+
+	if(!splayer_init(&plr, num_channels, &out_spec)) {
+		log_fatal("splayer_init() failed");
+	}
+
+	plr.gain = 1;
+
+	uint pcm_samples = SAMPLE_RATE * PCM_SECONDS * 2;
+	auto pcm = ALLOC_ARRAY(num_channels, float*);
+	auto streams = ALLOC_ARRAY(num_channels, AudioStream);
+
+	for(int i = 0; i < num_channels; ++i) {
+		AudioStreamSpec *spec = (i % 8 == 7) ? &alt_spec : &out_spec;
+		pcm[i] = gen_noise(pcm_samples, 0x9e3779b9u * (i + 1));
+
+		if(!astream_pcm_open(streams + i, spec, pcm_samples * sizeof(float), pcm[i], 0)) {
+			log_fatal("astream_pcm_open() failed");
+		}
+
+		// A fade-in far longer than the benchmark keeps the channel ramping throughout.
+		double fadein = (i % 4 == 3) ? 3600 : 0;
+
+		if(!splayer_play(&plr, i, streams + i, true, 1.0f / num_channels, 0, fadein)) {
+			log_fatal("splayer_play() failed");
+		}
+	}
+
+	size_t bufsize = callback_frames * out_spec.frame_size;
+	float *out = mem_alloc(bufsize);
+	auto times = ALLOC_ARRAY(num_callbacks, uint32_t);
+	hrtime_t total = 0;
+
+	// Warm up
+	splayer_process(&plr, bufsize, out);
+
+	for(uint i = 0; i < num_callbacks; ++i) {
+		memset(out, 0, bufsize);
+		hrtime_t start = time_get();
+		splayer_process(&plr, bufsize, out);
+		times[i] = time_get() - start;
+		total += times[i];
+	}
+
+	benchmark_sort_frame_times(num_callbacks, times);
+
+	double budget_us = callback_frames * 1e6 / SAMPLE_RATE;
+	double mean_us = total * 1e-3 / num_callbacks;
+
+	char report[512];
+	snprintf(report, sizeof(report),
+		"{\"benchmark\":\"mixer\",\"impl\":\"%s\",\"channels\":%i,\"callback_frames\":%u"
+		",\"callbacks\":%u,\"budget_us\":%.3f,\"mean_us\":%.3f,\"p50_us\":%.3f,\"p90_us\":%.3f"
+		",\"p99_us\":%.3f,\"max_us\":%.3f,\"budget_used\":%.5f}\n",
+		mixops_impl_name(),
+		num_channels,
+		callback_frames,
+		num_callbacks,
+		budget_us,
+		mean_us,
+		benchmark_percentile_us(num_callbacks, times, 50),
+		benchmark_percentile_us(num_callbacks, times, 90),
+		benchmark_percentile_us(num_callbacks, times, 99),
+		times[num_callbacks - 1] * 1e-3,
+		mean_us / budget_us
+	);
+	fputs(report, stdout);
+
+	splayer_shutdown(&plr);
+
+	for(int i = 0; i < num_channels; ++i) {
+		astream_close(streams + i);
+		mem_free(pcm[i]);
+	}
+
+	mem_free(pcm);
+	mem_free(streams);
+	mem_free(out);
+	mem_free(times);
+
+	log_shutdown();
+	time_shutdown();
+
+	return 0;
+}
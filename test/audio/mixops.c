@@ -0,0 +1,109 @@
+
+#include "taisei.h"
+
+#include "audio/stream/mixops.h"
+#include "log.h"
+#include "rwops/rwops_stdiofp.h"
+#include "util/miscmath.h"
+
+#include <locale.h>
+
+/*
+ * Checks that every mixing kernel available on this machine produces the same results as the
+ * scalar code. Buffer lengths and offsets are varied, so that the scalar tails and unaligned
+ * accesses are covered too.
+ *
+ * Usage: mixops
+ */
+
+#define MAX_FRAMES 67
+#define MAX_OFFSET 3
+
+static uint32_t rng_state = 0x9e3779b9u;
+
+static float rand_sample(void) {
+	rng_state ^= rng_state << 13;
+	rng_state ^= rng_state >> 17;
+	rng_state ^= rng_state << 5;
+	return (rng_state / (float)UINT32_MAX - 0.5f) * 2.0f;
+}
+
+static bool samples_match(uint num_samples, const float a[num_samples], const float b[num_samples]) {
+	for(uint i = 0; i < num_samples; ++i) {
+		if(fabsf(a[i] - b[i]) > 1e-6f * max(1.0f, fabsf(b[i]))) {
+			log_error("Sample %u: got %.9g, expected %.9g", i, a[i], b[i]);
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static bool check_impl(MixOpsImpl impl) {
+	mixops_select(impl);
+	const char *name = mixops_impl_name();
+	enum { BUFSIZE = (MAX_FRAMES + MAX_OFFSET) * 2 };
+	float src[BUFSIZE], dst[BUFSIZE], expected[BUFSIZE], actual[BUFSIZE];
+
+	for(uint offset = 0; offset <= MAX_OFFSET; ++offset) {
+		for(uint num_frames = 0; num_frames <= MAX_FRAMES; ++num_frames) {
+			for(uint i = 0; i < BUFSIZE; ++i) {
+				src[i] = rand_sample();
+				dst[i] = rand_sample();
+			}
+
+			float gain = rand_sample();
+			float step = rand_sample() / MAX_FRAMES;
+
+			memcpy(expected, dst, sizeof(dst));
+			memcpy(actual, dst, sizeof(dst));
+
+			mixops_select(MIXOPS_SCALAR);
+			mixops_ramp_stereo(expected + offset, num_frames, gain, step);
+			mixops_select(impl);
+			mixops_ramp_stereo(actual + offset, num_frames, gain, step);
+
+			if(!samples_match(BUFSIZE, actual, expected)) {
+				log_error("%s: ramp mismatch (%u frames at offset %u)", name, num_frames, offset);
+				return false;
+			}
+
+			mixops_select(MIXOPS_SCALAR);
+			mixops_mix_stereo(expected + offset, src + offset, num_frames, gain);
+			mixops_select(impl);
+			mixops_mix_stereo(actual + offset, src + offset, num_frames, gain);
+
+			if(!samples_match(BUFSIZE, actual, expected)) {
+				log_error("%s: mix mismatch (%u frames at offset %u)", name, num_frames, offset);
+				return false;
+			}
+		}
+	}
+
+	return true;
+}
+
+int main(int argc, char **argv) {
+	setlocale(LC_ALL, "C");
+	log_init(LOG_ALL);
+	log_add_output(LOG_ALL, SDL_RWFromFP(stderr, false), log_formatter_console);
+
+	int num_failed = 0;
+
+	for(MixOpsImpl impl = MIXOPS_SCALAR + 1; impl < NUM_MIXOPS_IMPLS; ++impl) {
+		if(!mixops_select(impl)) {
+			log_info("Implementation %i not available", impl);
+			continue;
+		}
+
+		if(check_impl(impl)) {
+			log_info("%s: OK", mixops_impl_name());
+		} else {
+			++num_failed;
+		}
+	}
+
+	log_shutdown();
+
+	return num_failed ? 1 : 0;
+}
@@ -0,0 +1,174 @@
+#include "taisei.h"
+
+#include "hashtable.h"
+#include "log.h"
+#include "rwops/rwops_stdiofp.h"
+#include "thread.h"
+#include "util/miscmath.h"
+
+#include <locale.h>
+
+// Instantiated here rather than using ht_str2int_test_t, so that the test can look at the list of
+// retired allocations, which is private to the implementation.
+#define HT_SUFFIX                      str2int_test
+#define HT_KEY_TYPE                    char*
+#define HT_VALUE_TYPE                  int64_t
+#define HT_FUNC_FREE_KEY(key)          mem_free(key)
+#define HT_FUNC_KEYS_EQUAL(key1, key2) (!strcmp(key1, key2))
+#define HT_FUNC_HASH_KEY(key)          htutil_hashfunc_string(key)
+#define HT_FUNC_COPY_KEY(dst, src)     (*(dst) = mem_strdup(src))
+#define HT_KEY_FMT                     "s"
+#define HT_KEY_PRINTABLE(key)          (key)
+#define HT_VALUE_FMT                   PRIi64
+#define HT_VALUE_PRINTABLE(val)        (val)
+#define HT_KEY_CONST
+#define HT_THREAD_SAFE
+#define HT_DECL
+#define HT_IMPL
+#include "hashtable_incproxy.inc.h"
+
+/*
+ * Hammers a thread-safe hashtable with lock-free lookups from several threads while another
+ * thread keeps inserting and removing keys, growing the table along the way.
+ *
+ * Usage: concurrent [num_readers] [num_writes]
+ *
+ * Every key maps to a value derived from its name, so a reader can tell if it got a value that
+ * doesn't belong to the key. Some keys are never removed and must always be found. Run it under
+ * AddressSanitizer to catch readers touching memory that was freed under them.
+ *
+ * Also reports how much retired memory was waiting to be freed at most. This must stay small
+ * even though the readers never stop.
+ */
+
+#define NUM_STABLE_KEYS 64
+#define NUM_CHURN_KEYS 4096
+#define MAX_READERS 64
+
+static struct {
+	ht_str2int_test_t table;
+	SDL_AtomicInt done;
+	char stable_keys[NUM_STABLE_KEYS][16];
+	char churn_keys[NUM_CHURN_KEYS][16];
+} test;
+
+static int64_t key_value(const char *key) {
+	return htutil_hashfunc_string(key) ^ 0x5bd1e995;
+}
+
+static uint count_retired(void) {
+	uint n = 0;
+
+	for(auto r = test.table.sync.retired; r; r = r->next) {
+		++n;
+	}
+
+	return n;
+}
+
+static void *reader(void *arg) {
+	uint32_t seed = (uintptr_t)arg;
+	uint64_t num_found = 0;
+
+	while(!SDL_GetAtomicInt(&test.done)) {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+
+		const char *stable_key = test.stable_keys[seed % NUM_STABLE_KEYS];
+		int64_t value;
+
+		if(!ht_str2int_test_lookup(&test.table, stable_key, &value)) {
+			log_fatal("Key %s went missing", stable_key);
+		}
+
+		if(value != key_value(stable_key)) {
+			log_fatal("Wrong value for key %s", stable_key);
+		}
+
+		const char *churn_key = test.churn_keys[(seed >> 8) % NUM_CHURN_KEYS];
+
+		if(ht_str2int_test_lookup(&test.table, churn_key, &value)) {
+			if(value != key_value(churn_key)) {
+				log_fatal("Wrong value for key %s", churn_key);
+			}
+
+			++num_found;
+		}
+	}
+
+	return (void*)(uintptr_t)num_found;
+}
+
+int main(int argc, char **argv) {
+	setlocale(LC_ALL, "C");
+	log_init(LOG_ALL);
+	log_add_output(LOG_ALL, SDL_RWFromFP(stderr, false), log_formatter_console);
+	thread_init();
+
+	int num_readers = argc > 1 ? atoi(argv[1]) : 4;
+	int num_writes = argc > 2 ? atoi(argv[2]) : 1000000;
+
+	if(num_readers < 1 || num_readers > MAX_READERS || num_writes < 1) {
+		log_fatal("Usage: %s [num_readers (1-%i)] [num_writes]", argv[0], MAX_READERS);
+	}
+
+	ht_str2int_test_create(&test.table);
+
+	for(uint i = 0; i < NUM_STABLE_KEYS; ++i) {
+		snprintf(test.stable_keys[i], sizeof(test.stable_keys[i]), "stable%u", i);
+		ht_str2int_test_set(&test.table, test.stable_keys[i], key_value(test.stable_keys[i]));
+	}
+
+	for(uint i = 0; i < NUM_CHURN_KEYS; ++i) {
+		snprintf(test.churn_keys[i], sizeof(test.churn_keys[i]), "churn%u", i);
+	}
+
+	Thread *readers[MAX_READERS];
+
+	for(int i = 0; i < num_readers; ++i) {
+		readers[i] = thread_create("reader", reader, (void*)(uintptr_t)(0x9e3779b9u * (i + 1)), THREAD_PRIO_NORMAL);
+
+		if(!readers[i]) {
+			log_fatal("thread_create() failed");
+		}
+	}
+
+	uint32_t seed = 0xdeadbeef;
+	uint max_retired = 0;
+
+	for(int i = 0; i < num_writes; ++i) {
+		seed ^= seed << 13;
+		seed ^= seed >> 17;
+		seed ^= seed << 5;
+
+		const char *key = test.churn_keys[seed % NUM_CHURN_KEYS];
+
+		if(seed & (1 << 20)) {
+			ht_str2int_test_set(&test.table, key, key_value(key));
+		} else {
+			ht_str2int_test_unset(&test.table, key);
+		}
+
+		if(i % 4096 == 0) {
+			// Only the writer modifies the list, so this is safe to walk between writes.
+			max_retired = max(max_retired, count_retired());
+		}
+	}
+
+	SDL_SetAtomicInt(&test.done, 1);
+	uint64_t num_found = 0;
+
+	for(int i = 0; i < num_readers; ++i) {
+		num_found += (uintptr_t)thread_wait(readers[i]);
+	}
+
+	log_info("%i writes, %"PRIu64" churning keys found by readers, at most %u retired allocations pending",
+		num_writes, num_found, max_retired);
+
+	ht_str2int_test_destroy(&test.table);
+	thread_shutdown();
+	log_shutdown();
+
+	return 0;
+}